@@ -0,0 +1,471 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+#include "analysis.h"
+#include "eigen3x3.h"
+#include "log.h"
+
+
+using namespace Eigen::internal;
+using Eigen::Matrix3f;
+using Eigen::Vector3f;
+
+typedef packet_traits<float>::type Packet;
+enum { PACKET_SIZE = packet_traits<float>::size };
+
+/* A complex pair whose real part is at most this fraction of its
+ * imaginary part makes a center.
+ */
+#define CENTER_TOLERANCE    1e-3f
+// Samples per eigenvalue batch of vortexRow.
+#define VORTEX_CHUNK        64
+// Newton iterations for a zero in a cell, and the step that ends them.
+#define NEWTON_STEPS        8
+#define NEWTON_TOLERANCE    1e-5f
+/* Zeros within this many cell widths of a cell face are moved onto it,
+ * so that rounding does not lose a zero lying on the face to both cells.
+ */
+#define FACE_TOLERANCE      1e-3f
+
+
+// Critical points found by one worker thread.
+struct PointList {
+    CRITICALPOINT *points;
+    int count;
+    int capacity;
+    bool failed;
+};
+
+struct AnalysisJob {
+    FIELDANALYSIS *analysis;
+    const FIELD *field;
+    PointList *lists;
+};
+
+
+/* Finite differences */
+
+// Stores (a[i] - b[i]) * scale to out[i] for count values.
+static void differenceRow(const float *a, const float *b, float scale, float *out, int count) {
+    const Packet packetScale = pset1<Packet>(scale);
+    int i = 0;
+    for (; i + PACKET_SIZE <= count; i += PACKET_SIZE)
+        pstoreu(out + i, pmul(psub(ploadu<Packet>(a + i), ploadu<Packet>(b + i)), packetScale));
+    for (; i < count; i++)
+        out[i] = (a[i] - b[i]) * scale;
+}
+
+/* Offsets of the neighbours of sample n along an axis of count samples
+ * step apart in memory: both sides inside, the sample itself on a face.
+ * Returns one over their distance, 0 for a single sample axis.
+ */
+static float neighbours(int n, int count, long step, float spacing, long *minus, long *plus) {
+    int low = n > 0 ? n - 1 : n, high = n < count - 1 ? n + 1 : n;
+    *minus = (low - n) * step;
+    *plus = (high - n) * step;
+    return high > low ? 1 / ((high - low) * spacing) : 0;
+}
+
+// Divergence, curl and vorticity of count samples from their Jacobians.
+static void combineRow(FIELDANALYSIS *analysis, long row, int count) {
+    const float *j[9];
+    float *divergence = analysis->divergence.values + row;
+    float *curl[3] = {analysis->curl.x + row, analysis->curl.y + row, analysis->curl.z + row};
+    float *vorticity = analysis->vorticity.values + row;
+    int i = 0, m;
+
+    for (m = 0; m < 9; m++)
+        j[m] = analysis->jacobian[m].values + row;
+    for (; i + PACKET_SIZE <= count; i += PACKET_SIZE) {
+        Packet p[9], x, y, z;
+        for (m = 0; m < 9; m++)
+            p[m] = ploadu<Packet>(j[m] + i);
+        x = psub(p[7], p[5]);
+        y = psub(p[2], p[6]);
+        z = psub(p[3], p[1]);
+        pstoreu(divergence + i, padd(padd(p[0], p[4]), p[8]));
+        pstoreu(curl[0] + i, x);
+        pstoreu(curl[1] + i, y);
+        pstoreu(curl[2] + i, z);
+        // Squared here; NEON has no packet square root.
+        pstoreu(vorticity + i, pmadd(x, x, pmadd(y, y, pmul(z, z))));
+    }
+    for (; i < count; i++) {
+        float x = j[7][i] - j[5][i], y = j[2][i] - j[6][i], z = j[3][i] - j[1][i];
+        divergence[i] = j[0][i] + j[4][i] + j[8][i];
+        curl[0][i] = x;
+        curl[1][i] = y;
+        curl[2][i] = z;
+        vorticity[i] = x * x + y * y + z * z;
+    }
+    for (i = 0; i < count; i++)
+        vorticity[i] = sqrtf(vorticity[i]);
+}
+
+/* Upper triangle of S^2 + W^2 = (J^2 + (J^T)^2) / 2 for the Jacobian j,
+ * on packets or floats.
+ */
+template <typename P>
+static void vortexTensor(const P j[9], P out[9]) {
+    int r, c, k;
+    P square[9];
+    for (r = 0; r < 3; r++) {
+        for (c = 0; c < 3; c++) {
+            P sum = pmul(j[3 * r], j[c]);
+            for (k = 1; k < 3; k++)
+                sum = padd(sum, pmul(j[3 * r + k], j[3 * k + c]));
+            square[3 * r + c] = sum;
+        }
+    }
+    for (r = 0; r < 3; r++)
+        for (c = r; c < 3; c++)
+            out[3 * r + c] = pmul(padd(square[3 * r + c], square[3 * c + r]),
+                                  pset1<P>(0.5f));
+}
+
+// Swirling strength and lambda2 of count samples from their Jacobians.
+static void vortexRow(FIELDANALYSIS *analysis, long row, int count) {
+    float tensor[9][VORTEX_CHUNK], real[3][VORTEX_CHUNK], imaginary[3][VORTEX_CHUNK];
+    float *const tensorRows[9] = {tensor[0], tensor[1], tensor[2], tensor[3], tensor[4],
+                                  tensor[5], tensor[6], tensor[7], tensor[8]};
+    float *const realRows[3] = {real[0], real[1], real[2]};
+    float *const imaginaryRows[3] = {imaginary[0], imaginary[1], imaginary[2]};
+    int start, i, m;
+
+    for (start = 0; start < count; start += VORTEX_CHUNK) {
+        const int n = std::min(count - start, VORTEX_CHUNK);
+        const float *j[9];
+        for (m = 0; m < 9; m++)
+            j[m] = analysis->jacobian[m].values + row + start;
+
+        // The pair comes second with its positive imaginary part.
+        eigen3x3Batch(j, n, realRows, imaginaryRows);
+        memcpy(analysis->swirl.values + row + start, imaginary[1], n * sizeof(float));
+
+        for (i = 0; i + PACKET_SIZE <= n; i += PACKET_SIZE) {
+            Packet p[9], out[9];
+            for (m = 0; m < 9; m++)
+                p[m] = ploadu<Packet>(j[m] + i);
+            vortexTensor(p, out);
+            for (m = 0; m < 9; m++)
+                if (m / 3 <= m % 3)
+                    pstoreu(tensor[m] + i, out[m]);
+        }
+        for (; i < n; i++) {
+            float p[9], out[9];
+            for (m = 0; m < 9; m++)
+                p[m] = j[m][i];
+            vortexTensor(p, out);
+            for (m = 0; m < 9; m++)
+                if (m / 3 <= m % 3)
+                    tensor[m][i] = out[m];
+        }
+        // The lower triangle is not read.
+        eigen3x3SymmetricBatch(tensorRows, n, realRows);
+        memcpy(analysis->lambda2.values + row + start, real[1], n * sizeof(float));
+    }
+}
+
+// Derivatives of the sample planes first to last - 1.
+static void derivativeTask(long first, long last, int worker, void *userData) {
+    AnalysisJob *job = (AnalysisJob *) userData;
+    FIELDANALYSIS *analysis = job->analysis;
+    const FIELD *field = job->field;
+    const float *components[3] = {field->x, field->y, field->z};
+    const int nx = field->nx;
+    const float sx = 1 / field->spacing[0];
+    long k;
+    int j, c;
+
+    for (k = first; k < last; k++) {
+        long zMinus, zPlus;
+        float sz = neighbours(k, field->nz, (long) nx * field->ny, field->spacing[2],
+                              &zMinus, &zPlus);
+        for (j = 0; j < field->ny; j++) {
+            long row = FIELD_INDEX(field, 0, j, k), yMinus, yPlus;
+            float sy = neighbours(j, field->ny, nx, field->spacing[1], &yMinus, &yPlus);
+            for (c = 0; c < 3; c++) {
+                const float *v = components[c] + row;
+                float *dx = analysis->jacobian[3 * c].values + row;
+                float *dy = analysis->jacobian[3 * c + 1].values + row;
+                float *dz = analysis->jacobian[3 * c + 2].values + row;
+                if (nx > 1) {
+                    dx[0] = (v[1] - v[0]) * sx;
+                    differenceRow(v + 2, v, sx / 2, dx + 1, nx - 2);
+                    dx[nx - 1] = (v[nx - 1] - v[nx - 2]) * sx;
+                }
+                else
+                    dx[0] = 0;
+                differenceRow(v + yPlus, v + yMinus, sy, dy, nx);
+                differenceRow(v + zPlus, v + zMinus, sz, dz, nx);
+            }
+            combineRow(analysis, row, nx);
+            vortexRow(analysis, row, nx);
+        }
+    }
+}
+
+
+/* Critical points */
+
+static int classify(const float real[3], const float imaginary[3]) {
+    int positive = 0, negative = 0, m;
+    for (m = 0; m < 3; m++) {
+        if (imaginary[m] != 0 && fabsf(real[m]) <= CENTER_TOLERANCE * fabsf(imaginary[m]))
+            return CRITICAL_CENTER;
+        if (real[m] > 0)
+            positive++;
+        else if (real[m] < 0)
+            negative++;
+    }
+    return positive == 3 ? CRITICAL_SOURCE : negative == 3 ? CRITICAL_SINK : CRITICAL_SADDLE;
+}
+
+static void appendPoint(PointList *list, const CRITICALPOINT &point) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity > 0 ? 2 * list->capacity : 16;
+        CRITICALPOINT *points = (CRITICALPOINT *) realloc(list->points,
+                                                          capacity * sizeof(CRITICALPOINT));
+        if (points == NULL) {
+            list->failed = true;
+            return;
+        }
+        list->points = points;
+        list->capacity = capacity;
+    }
+    list->points[list->count++] = point;
+}
+
+/* Weights of the cell corners for trilinear interpolation at p, in cell
+ * coordinates, and their derivatives along each axis. Corner c has bit 0
+ * set for the upper x side, bit 1 for y and bit 2 for z.
+ */
+static void trilinearWeights(const Vector3f &p, float weights[8], float derivatives[3][8]) {
+    int c, a, b;
+    for (c = 0; c < 8; c++) {
+        weights[c] = 1;
+        for (a = 0; a < 3; a++) {
+            bool upper = (c >> a) & 1;
+            weights[c] *= upper ? p[a] : 1 - p[a];
+            derivatives[a][c] = upper ? 1 : -1;
+            for (b = 0; b < 3; b++)
+                if (b != a)
+                    derivatives[a][c] *= (c >> b) & 1 ? p[b] : 1 - p[b];
+        }
+    }
+}
+
+/* Looks for a zero of the trilinear interpolant of the cell with lowest
+ * corner (i, j, k), whose corner field indices are in corners, by Newton
+ * iteration from the cell center, and classifies it by the Jacobian
+ * interpolated there.
+ */
+static void analyzeCell(const AnalysisJob *job, int i, int j, int k, const long corners[8],
+                        PointList *list) {
+    const FIELDANALYSIS *analysis = job->analysis;
+    const FIELD *field = job->field;
+    const float *components[3] = {field->x, field->y, field->z};
+    const int index[3] = {i, j, k}, counts[3] = {field->nx, field->ny, field->nz};
+    float weights[8], derivatives[3][8], jacobian[9];
+    Vector3f p(0.5f, 0.5f, 0.5f);
+    CRITICALPOINT point;
+    int step, corner, m, a;
+
+    for (step = 0; step < NEWTON_STEPS; step++) {
+        Matrix3f slope = Matrix3f::Zero();
+        Vector3f value = Vector3f::Zero(), delta;
+        trilinearWeights(p, weights, derivatives);
+        for (m = 0; m < 3; m++) {
+            for (corner = 0; corner < 8; corner++) {
+                float v = components[m][corners[corner]];
+                value[m] += weights[corner] * v;
+                for (a = 0; a < 3; a++)
+                    slope(m, a) += derivatives[a][corner] * v;
+            }
+        }
+        Eigen::FullPivLU<Matrix3f> lu(slope);
+        if (!lu.isInvertible())
+            return;
+        delta = -lu.solve(value);
+        p += delta;
+        // Zeros far outside belong to other cells, if any.
+        if (!(p.minCoeff() > -0.5f && p.maxCoeff() < 1.5f))
+            return;
+        if (delta.cwiseAbs().maxCoeff() < NEWTON_TOLERANCE)
+            break;
+    }
+    if (step == NEWTON_STEPS)
+        return;
+    for (a = 0; a < 3; a++) {
+        float u = p[a];
+        if (fabsf(u) < FACE_TOLERANCE)
+            u = 0;
+        else if (fabsf(u - 1) < FACE_TOLERANCE)
+            u = 1;
+        // Half open, so that a zero on a shared face is found once.
+        if (!(u >= 0 && (u < 1 || (u == 1 && index[a] == counts[a] - 2))))
+            return;
+        point.position[a] = field->origin[a] + (index[a] + u) * field->spacing[a];
+    }
+
+    trilinearWeights(p, weights, derivatives);
+    for (m = 0; m < 9; m++) {
+        jacobian[m] = 0;
+        for (corner = 0; corner < 8; corner++)
+            jacobian[m] += weights[corner] * analysis->jacobian[m].values[corners[corner]];
+    }
+    eigen3x3(jacobian, point.real, point.imaginary);
+    point.type = classify(point.real, point.imaginary);
+    point.cell = corners[0];
+    appendPoint(list, point);
+}
+
+// Tests the cell planes first to last - 1 for zeros.
+static void criticalPointTask(long first, long last, int worker, void *userData) {
+    const AnalysisJob *job = (const AnalysisJob *) userData;
+    const FIELD *field = job->field;
+    const float *components[3] = {field->x, field->y, field->z};
+    const long dy = field->nx, dz = (long) field->nx * field->ny;
+    PointList *list = &job->lists[worker];
+    long k;
+    int i, j, c, corner;
+
+    for (k = first; k < last; k++) {
+        for (j = 0; j + 1 < field->ny; j++) {
+            for (i = 0; i + 1 < field->nx; i++) {
+                long n = FIELD_INDEX(field, i, j, k);
+                const long corners[8] = {n, n + 1, n + dy, n + dy + 1,
+                                         n + dz, n + dz + 1, n + dz + dy, n + dz + dy + 1};
+                bool straddles = true;
+                // Every component must change sign, or touch zero, in the cell.
+                for (c = 0; c < 3 && straddles; c++) {
+                    const float *v = components[c];
+                    float lo = v[n], hi = v[n];
+                    for (corner = 1; corner < 8; corner++) {
+                        lo = std::min(lo, v[corners[corner]]);
+                        hi = std::max(hi, v[corners[corner]]);
+                    }
+                    straddles = lo <= 0 && hi >= 0;
+                }
+                if (straddles)
+                    analyzeCell(job, i, j, k, corners, list);
+            }
+        }
+    }
+}
+
+static bool compareCells(const CRITICALPOINT &a, const CRITICALPOINT &b) {
+    return a.cell < b.cell;
+}
+
+
+int fieldAnalysisInit(FIELDANALYSIS *analysis, const FIELD *field) {
+    const int nx = field->nx, ny = field->ny, nz = field->nz;
+    int ok, m;
+
+    memset(analysis, 0, sizeof(FIELDANALYSIS));
+    ok = scalarFieldInit(&analysis->divergence, nx, ny, nz, field->origin, field->spacing) &&
+         scalarFieldInit(&analysis->vorticity, nx, ny, nz, field->origin, field->spacing) &&
+         scalarFieldInit(&analysis->swirl, nx, ny, nz, field->origin, field->spacing) &&
+         scalarFieldInit(&analysis->lambda2, nx, ny, nz, field->origin, field->spacing) &&
+         fieldInit(&analysis->curl, nx, ny, nz, field->origin, field->spacing);
+    for (m = 0; m < 9 && ok; m++)
+        ok = scalarFieldInit(&analysis->jacobian[m], nx, ny, nz, field->origin, field->spacing);
+    if (!ok) {
+        LOGE(FIELD, "cannot allocate the field analysis");
+        fieldAnalysisDeinit(analysis);
+    }
+    return ok;
+}
+
+void fieldAnalysisDeinit(FIELDANALYSIS *analysis) {
+    int m;
+    for (m = 0; m < 9; m++)
+        scalarFieldDeinit(&analysis->jacobian[m]);
+    scalarFieldDeinit(&analysis->divergence);
+    scalarFieldDeinit(&analysis->vorticity);
+    scalarFieldDeinit(&analysis->swirl);
+    scalarFieldDeinit(&analysis->lambda2);
+    fieldDeinit(&analysis->curl);
+    free(analysis->criticalPoints);
+    memset(analysis, 0, sizeof(FIELDANALYSIS));
+}
+
+
+int fieldAnalysisUpdate(FIELDANALYSIS *analysis, const FIELD *field, THREADPOOL *pool) {
+    int workers = threadPoolSize(pool), count = 0, result = 1, w;
+    AnalysisJob job;
+
+    analysis->criticalPointCount = 0;
+    if (analysis->divergence.nx != field->nx || analysis->divergence.ny != field->ny ||
+        analysis->divergence.nz != field->nz)
+        return 0;
+    job.analysis = analysis;
+    job.field = field;
+    job.lists = (PointList *) calloc(workers, sizeof(PointList));
+    if (job.lists == NULL)
+        return 0;
+
+    // Each chunk of planes is a z slab; the cells need the derivatives of
+    // the planes on both sides, so they wait for all slabs.
+    threadPoolRun(pool, field->nz, 0, derivativeTask, &job);
+    if (field->nx > 1 && field->ny > 1 && field->nz > 1)
+        threadPoolRun(pool, field->nz - 1, 0, criticalPointTask, &job);
+
+    for (w = 0; w < workers; w++) {
+        count += job.lists[w].count;
+        if (job.lists[w].failed)
+            result = 0;
+    }
+    if (result && count > 0) {
+        CRITICALPOINT *points = (CRITICALPOINT *) realloc(analysis->criticalPoints,
+                                                          count * sizeof(CRITICALPOINT));
+        if (points != NULL) {
+            analysis->criticalPoints = points;
+            for (w = 0; w < workers; w++) {
+                memcpy(points + analysis->criticalPointCount, job.lists[w].points,
+                       job.lists[w].count * sizeof(CRITICALPOINT));
+                analysis->criticalPointCount += job.lists[w].count;
+            }
+            std::sort(points, points + count, compareCells);
+        }
+        else
+            result = 0;
+    }
+    for (w = 0; w < workers; w++)
+        free(job.lists[w].points);
+    free(job.lists);
+    if (!result)
+        LOGE(FIELD, "fieldAnalysisUpdate: out of memory");
+    return result;
+}
+
+
+const char *criticalPointTypeName(int type) {
+    static const char *names[] = {"source", "sink", "saddle", "center"};
+    return type >= 0 && type <= CRITICAL_CENTER ? names[type] : "unknown";
+}
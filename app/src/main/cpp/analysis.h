@@ -0,0 +1,101 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef ANALYSIS_H_INCLUDED
+#define ANALYSIS_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "field.h"
+#include "threadpool.h"
+
+
+// CRITICALPOINT types, from the eigenvalues of the Jacobian there.
+#define CRITICAL_SOURCE     0   // All real parts positive.
+#define CRITICAL_SINK       1   // All real parts negative.
+#define CRITICAL_SADDLE     2   // Real parts of both signs.
+#define CRITICAL_CENTER     3   // A complex pair with a vanishing real part.
+
+
+/* A zero of the trilinear interpolant of a lattice cell, typed by the
+ * finite difference Jacobian interpolated to it.
+ */
+typedef struct {
+    float position[3];
+    int type;
+    // Eigenvalues of the Jacobian, real and imaginary parts.
+    float real[3];
+    float imaginary[3];
+    // Field index of the lowest corner of the cell.
+    long cell;
+} CRITICALPOINT;
+
+/* Quantities derived from a FIELD by finite differences: central
+ * differences inside the lattice and one sided ones on its faces. All
+ * grids share the lattice of the field.
+ */
+typedef struct {
+    // d v_r / d x_c at each sample in jacobian[3 * r + c].
+    SCALARFIELD jacobian[9];
+    SCALARFIELD divergence;
+    FIELD curl;
+    // Length of the curl.
+    SCALARFIELD vorticity;
+    /* Vortex indicators: the swirling strength, the imaginary part of the
+     * complex eigenvalues of the Jacobian or 0 when they are all real, and
+     * lambda2, the middle eigenvalue of S^2 + W^2 for the symmetric and
+     * antisymmetric parts S and W of the Jacobian, negative in vortices.
+     */
+    SCALARFIELD swirl;
+    SCALARFIELD lambda2;
+    // Sorted by cell.
+    CRITICALPOINT *criticalPoints;
+    int criticalPointCount;
+} FIELDANALYSIS;
+
+
+/* Allocates the grids for the lattice of field. Returns non-zero on
+ * success and 0 on failure.
+ */
+extern int fieldAnalysisInit(FIELDANALYSIS *analysis, const FIELD *field);
+
+extern void fieldAnalysisDeinit(FIELDANALYSIS *analysis);
+
+/* Recomputes everything for field, which must have the lattice given to
+ * fieldAnalysisInit, splitting the work into z slabs between the threads
+ * of pool, which may be NULL. Returns non-zero on success and 0 on
+ * failure.
+ */
+extern int fieldAnalysisUpdate(FIELDANALYSIS *analysis, const FIELD *field,
+                               THREADPOOL *pool);
+
+extern const char *criticalPointTypeName(int type);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !ANALYSIS_H_INCLUDED
@@ -20,10 +20,11 @@
 #include <jni.h>
 #include <sys/time.h>
 #include <time.h>
-#include <android/log.h>
 #include <stdint.h>
 #include "importgl.h"
 #include "app.h"
+#include "log.h"
+#include "profile.h"
 
 int gAppAlive = 1;
 
@@ -45,6 +46,7 @@ _getTime(void) {
 /* Call to initialize the graphics state */
 void
 Java_com_tbse_vectorfields3_DemoRenderer_nativeInit(JNIEnv *env) {
+    logStartAsync();
     importGLInit();
     appInit();
     gAppAlive = 1;
@@ -54,7 +56,7 @@ void
 Java_com_tbse_vectorfields3_DemoRenderer_nativeResize(JNIEnv *env, jobject thiz, jint w, jint h) {
     sWindowWidth = w;
     sWindowHeight = h;
-    __android_log_print(ANDROID_LOG_INFO, "vf", "resize w=%d h=%d", w, h);
+    LOGI(APP, "resize w=%d h=%d", w, h);
 }
 
 /* Call to finalize the graphics state */
@@ -62,6 +64,7 @@ void
 Java_com_tbse_vectorfields3_DemoRenderer_nativeDone(JNIEnv *env) {
     appDeinit();
     importGLDeinit();
+    logStopAsync();
 }
 
 /* This is called to indicate to the render loop that it should
@@ -121,16 +124,55 @@ Java_com_tbse_vectorfields3_DemoRenderer_nativeRender(JNIEnv *env) {
         }
     }
 
-    //__android_log_print(ANDROID_LOG_INFO, "VF3", "curTime=%ld", curTime);
+    LOGV(APP, "curTime=%ld", curTime);
 
     appRender(curTime, sWindowWidth, sWindowHeight);
 }
 
-JNIEXPORT void JNICALL
-Java_com_tbse_vectorfields3_DemoGLSurfaceView_nativeTouchEvent(JNIEnv *env, jclass type,
-                                                               jfloat x, jfloat y) {
+/* Returns the stage timings as PROFILE_JNI_FIELDS longs per stage, in
+ * PROFILE_STAGE_* order: count, total, min, max, p50, p95 and p99, all
+ * times in nanoseconds. Clears the timings afterwards when reset is set.
+ */
+#define PROFILE_JNI_FIELDS  7
+
+JNIEXPORT jlongArray JNICALL
+Java_com_tbse_vectorfields3_DemoRenderer_nativeGetProfile(JNIEnv *env, jclass type,
+                                                          jboolean reset) {
+    PROFILESNAPSHOT snapshot;
+    jlong values[PROFILE_STAGE_COUNT * PROFILE_JNI_FIELDS];
+    jlongArray result;
+    int stage;
+
+    profileSnapshot(&snapshot);
+    if (reset)
+        profileReset();
+    for (stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+        const PROFILESTAGE *s = &snapshot.stages[stage];
+        jlong *out = &values[stage * PROFILE_JNI_FIELDS];
+        out[0] = (jlong) s->count;
+        out[1] = (jlong) s->total;
+        out[2] = (jlong) s->minimum;
+        out[3] = (jlong) s->maximum;
+        out[4] = (jlong) profilePercentile(s, 50);
+        out[5] = (jlong) profilePercentile(s, 95);
+        out[6] = (jlong) profilePercentile(s, 99);
+    }
 
-    // TODO
-    __android_log_print(ANDROID_LOG_INFO, "vf", "curTime=%ld, x=%fd, y=%fd", _getTime(), x, y);
+    result = (*env)->NewLongArray(env, PROFILE_STAGE_COUNT * PROFILE_JNI_FIELDS);
+    if (result != NULL)
+        (*env)->SetLongArrayRegion(env, result, 0, PROFILE_STAGE_COUNT * PROFILE_JNI_FIELDS,
+                                   values);
+    return result;
+}
 
+/* Called on the UI thread; the camera picks the drag up on the next
+ * rendered frame. action is a MotionEvent action, whose DOWN, UP and MOVE
+ * values match CAMERA_TOUCH_*.
+ */
+JNIEXPORT void JNICALL
+Java_com_tbse_vectorfields3_DemoGLSurfaceView_nativeTouchEvent(JNIEnv *env, jclass type,
+                                                               jint action, jfloat x,
+                                                               jfloat y) {
+    LOGV(APP, "touch action=%d, x=%f, y=%f", action, x, y);
+    appTouch(action, x, y);
 }
\ No newline at end of file
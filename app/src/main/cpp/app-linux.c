@@ -0,0 +1,648 @@
+/* San Angeles Observation OpenGL ES version example
+ * Copyright 2004-2005 Jetro Lauha
+ * All rights reserved.
+ * Web: http://iki.fi/jetro/
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ *
+ * $Id: app-linux.c,v 1.4 2005/02/08 18:42:48 tonic Exp $
+ * $Revision: 1.4 $
+ *
+ * Parts of this source file is based on test/example code from
+ * GLESonGL implementation by David Blythe. Here is copy of the
+ * license notice from that source:
+ *
+ * Copyright (C) 2003  David Blythe   All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * DAVID BLYTHE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef HAVE_X11
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#endif // HAVE_X11
+
+#include "importgl.h"
+#include "softgl.h"
+
+#include "app.h"
+#include "log.h"
+#include "profile.h"
+
+
+/* Without an X display the demo can only be run in benchmark mode:
+ *
+ *   sanangeles-linux --benchmark [--frames=N] [--tick=MS] [--size=WxH]
+ *                    [--ppm=FILE] [--profile=FILE|-] [--target-ms=MS]
+ *                    [--sparse=TOLERANCE]
+ *                    [--color=divergence|vorticity|swirl|lambda2]
+ *                    [--isosurface=[QUANTITY:]VALUE] [--lic=AXIS[:POSITION]]
+ *                    [--particles=N[:TRAIL]] [--keyframes=N[:INTERVAL]]
+ *                    [--field=FILE]
+ *
+ * Benchmark mode renders N frames offscreen with the software backend
+ * (see softgl.h) on a fixed timestep: the synthetic tick advances by MS,
+ * 16 unless given, on every frame, whatever the frames cost, so runs are
+ * repeatable and still animate the field, the keyframes and the camera.
+ * A run stops early at the end of the demo track. It prints the CPU time
+ * of appInit, the p50/p95/p99 CPU time of appRender and the peak
+ * resident set size.
+ * --profile writes the per-stage timings of profile.h as JSON.
+ * Benchmarks draw at full glyph density unless --target-ms gives a frame
+ * time for the density controller to hold. --sparse draws from a sparse
+ * octree copy of the field (see octree.h) instead of the dense grid.
+ * --color colors the glyphs by a quantity from analysis.h. --isosurface
+ * draws the surface where the magnitude, or a --color quantity, equals
+ * VALUE. --lic draws a line integral convolution slice perpendicular to
+ * the x, y or z AXIS at POSITION, 0 unless given. --particles advects N
+ * particles with trails of TRAIL positions, 8 unless given, or points for
+ * a TRAIL of 1. --keyframes plays the field back from N keyframes
+ * INTERVAL ticks apart, 1000 unless given, streamed from a background
+ * loader. --field shows a field file written by fieldfile-tool, or the
+ * vectors of a .vtk or .vti file, instead of the demo expression.
+ */
+#define BENCHMARK_DEFAULT_FRAMES    500
+#define BENCHMARK_DEFAULT_WIDTH     320
+#define BENCHMARK_DEFAULT_HEIGHT    240
+#define BENCHMARK_DEFAULT_STEP      16
+// appRender takes the first tick it sees as the start of the demo, and a
+// tick of 0 as not started yet.
+#define BENCHMARK_START_TICK        1
+
+
+int gAppAlive = 1;
+
+static int sWindowWidth = WINDOW_DEFAULT_WIDTH;
+static int sWindowHeight = WINDOW_DEFAULT_HEIGHT;
+
+#ifdef HAVE_X11
+static const char sAppName[] =
+    "San Angeles Observation OpenGL ES version example (Linux)";
+static Display *sDisplay;
+static Window sWindow;
+static EGLDisplay sEglDisplay = EGL_NO_DISPLAY;
+static EGLConfig sEglConfig;
+static EGLContext sEglContext = EGL_NO_CONTEXT;
+static EGLSurface sEglSurface = EGL_NO_SURFACE;
+#endif // HAVE_X11
+
+
+static void checkGLErrors()
+{
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+        fprintf(stderr, "GL Error: 0x%04x\n", (int)error);
+}
+
+
+#ifdef HAVE_X11
+static void checkEGLErrors()
+{
+    EGLint error = eglGetError();
+    // GLESonGL seems to be returning 0 when there is no errors?
+    if (error && error != EGL_SUCCESS)
+        fprintf(stderr, "EGL Error: 0x%04x\n", (int)error);
+}
+
+
+// Initializes and opens both X11 display and OpenGL ES.
+static int initGraphics()
+{
+    static const EGLint configAttribs[] =
+    {
+#if (WINDOW_BPP == 16)
+        EGL_RED_SIZE,       5,
+        EGL_GREEN_SIZE,     5,
+        EGL_BLUE_SIZE,      5,
+#elif (WINDOW_BPP == 32)
+        EGL_RED_SIZE,       8,
+        EGL_GREEN_SIZE,     8,
+        EGL_BLUE_SIZE,      8,
+#else
+#error WINDOW_BPP must be 16 or 32
+#endif
+        EGL_DEPTH_SIZE,     16,
+        EGL_ALPHA_SIZE,     EGL_DONT_CARE,
+        EGL_STENCIL_SIZE,   EGL_DONT_CARE,
+        EGL_SURFACE_TYPE,   EGL_WINDOW_BIT,
+        EGL_NONE
+    };
+    EGLBoolean success;
+    EGLint numConfigs;
+    EGLint majorVersion;
+    EGLint minorVersion;
+
+    int importGLResult;
+    importGLResult = importGLInit();
+    if (!importGLResult)
+        return 0;
+
+    sDisplay = XOpenDisplay(NULL);
+    if (sDisplay == NULL)
+        return 0;
+
+    sEglDisplay = eglGetDisplay(sDisplay);
+    success = eglInitialize(sEglDisplay, &majorVersion, &minorVersion);
+    if (success != EGL_FALSE)
+        success = eglGetConfigs(sEglDisplay, NULL, 0, &numConfigs);
+    if (success != EGL_FALSE)
+        success = eglChooseConfig(sEglDisplay, configAttribs,
+                                  &sEglConfig, 1, &numConfigs);
+    if (success != EGL_FALSE)
+    {
+        sEglContext = eglCreateContext(sEglDisplay, sEglConfig, NULL, NULL);
+        if (sEglContext == EGL_NO_CONTEXT)
+            success = EGL_FALSE;
+    }
+    if (success != EGL_FALSE)
+    {
+        XSetWindowAttributes swa;
+        XVisualInfo *vi, tmp;
+        XSizeHints sh;
+        int n;
+        EGLint vid;
+
+        eglGetConfigAttrib(sEglDisplay, sEglConfig,
+                           EGL_NATIVE_VISUAL_ID, &vid);
+        tmp.visualid = vid;
+        vi = XGetVisualInfo(sDisplay, VisualIDMask, &tmp, &n);
+        swa.colormap = XCreateColormap(sDisplay,
+                                       RootWindow(sDisplay, vi->screen),
+                                       vi->visual, AllocNone);
+        sh.flags = PMinSize | PMaxSize;
+        sh.min_width = sh.max_width = sWindowWidth;
+        sh.min_height = sh.max_height = sWindowHeight;
+        swa.border_pixel = 0;
+        swa.event_mask = ExposureMask | StructureNotifyMask |
+                         KeyPressMask | ButtonPressMask | ButtonReleaseMask |
+                         Button1MotionMask;
+        sWindow = XCreateWindow(sDisplay, RootWindow(sDisplay, vi->screen),
+                                0, 0, sWindowWidth, sWindowHeight,
+                                0, vi->depth, InputOutput, vi->visual,
+                                CWBorderPixel | CWColormap | CWEventMask,
+                                &swa);
+        XMapWindow(sDisplay, sWindow);
+        XSetStandardProperties(sDisplay, sWindow, sAppName, sAppName,
+                               None, (void *)0, 0, &sh);
+    }
+    if (success != EGL_FALSE)
+    {
+        sEglSurface = eglCreateWindowSurface(sEglDisplay, sEglConfig,
+                                             (NativeWindowType)sWindow, NULL);
+        if (sEglSurface == EGL_NO_SURFACE)
+            success = EGL_FALSE;
+    }
+    if (success != EGL_FALSE)
+        success = eglMakeCurrent(sEglDisplay, sEglSurface,
+                                 sEglSurface, sEglContext);
+
+    if (success == EGL_FALSE)
+        checkEGLErrors();
+
+    return success != EGL_FALSE;
+}
+
+
+static void deinitGraphics()
+{
+    eglMakeCurrent(sEglDisplay, NULL, NULL, NULL);
+    eglDestroyContext(sEglDisplay, sEglContext);
+    eglDestroySurface(sEglDisplay, sEglSurface);
+    eglTerminate(sEglDisplay);
+    XCloseDisplay(sDisplay);
+    importGLDeinit();
+}
+
+
+static int runWindowed()
+{
+    if (!initGraphics())
+    {
+        fprintf(stderr, "Graphics initialization failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    appInit();
+
+    while (gAppAlive)
+    {
+        struct timeval timeNow;
+
+        while (XPending(sDisplay))
+        {
+            XEvent ev;
+            XNextEvent(sDisplay, &ev);
+            switch (ev.type)
+            {
+            case KeyPress:
+                {
+                    KeySym keysym = XLookupKeysym(&ev.xkey, 0);
+                    if (keysym == XK_Return || keysym == XK_Escape)
+                        gAppAlive = 0;
+                }
+                break;
+            // Dragging with the left button orbits the camera.
+            case ButtonPress:
+                if (ev.xbutton.button == Button1)
+                    appTouch(CAMERA_TOUCH_DOWN, ev.xbutton.x, ev.xbutton.y);
+                break;
+            case MotionNotify:
+                appTouch(CAMERA_TOUCH_MOVE, ev.xmotion.x, ev.xmotion.y);
+                break;
+            case ButtonRelease:
+                if (ev.xbutton.button == Button1)
+                    appTouch(CAMERA_TOUCH_UP, ev.xbutton.x, ev.xbutton.y);
+                break;
+            }
+        }
+
+        if (gAppAlive)
+        {
+            gettimeofday(&timeNow, NULL);
+            appRender(timeNow.tv_sec * 1000 + timeNow.tv_usec / 1000,
+                      sWindowWidth, sWindowHeight);
+            checkGLErrors();
+            eglSwapBuffers(sEglDisplay, sEglSurface);
+            checkEGLErrors();
+        }
+    }
+
+    appDeinit();
+    deinitGraphics();
+
+    return EXIT_SUCCESS;
+}
+#endif // HAVE_X11
+
+
+// Returns the elapsed time of the given clock in milliseconds.
+static double clockMillis(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+
+// Nearest rank percentile of sorted values.
+static double percentile(const double *sorted, long count, int p)
+{
+    long rank = (long)((p * count + 99) / 100);
+    if (rank < 1)
+        rank = 1;
+    return sorted[rank - 1];
+}
+
+
+/* Writes the stage timings as JSON to path, or to stdout when path is "-".
+ */
+static void writeProfile(const char *path)
+{
+    PROFILESNAPSHOT *snapshot;
+    FILE *file;
+
+    snapshot = (PROFILESNAPSHOT *)malloc(sizeof(PROFILESNAPSHOT));
+    if (snapshot == NULL)
+        return;
+    profileSnapshot(snapshot);
+    file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (file == NULL || !profileWriteJSON(snapshot, file))
+        fprintf(stderr, "Cannot write %s\n", path);
+    if (file != NULL && file != stdout)
+        fclose(file);
+    free(snapshot);
+}
+
+
+static int runBenchmark(long frames, long step, const char *ppmPath,
+                        const char *profilePath)
+{
+    double *frameTimes;
+    double initCpu, initWall, total = 0;
+    struct rusage usage;
+    ARENASTATS sceneArena, frameArena;
+    CULLSTATS glyphCull, streamlineCull;
+    long rendered;
+
+    frameTimes = (double *)malloc(frames * sizeof(double));
+    if (frameTimes == NULL)
+        return EXIT_FAILURE;
+
+    if (!importGLInitBackend(IMPORTGL_BACKEND_SOFTWARE) ||
+        !softglResize(sWindowWidth, sWindowHeight))
+    {
+        fprintf(stderr, "Graphics initialization failed.\n");
+        free(frameTimes);
+        return EXIT_FAILURE;
+    }
+
+    initWall = clockMillis(CLOCK_MONOTONIC);
+    initCpu = clockMillis(CLOCK_THREAD_CPUTIME_ID);
+    appInit();
+    initCpu = clockMillis(CLOCK_THREAD_CPUTIME_ID) - initCpu;
+    initWall = clockMillis(CLOCK_MONOTONIC) - initWall;
+    checkGLErrors();
+
+    for (rendered = 0; rendered < frames && gAppAlive; rendered++)
+    {
+        double start = clockMillis(CLOCK_THREAD_CPUTIME_ID);
+        appRender(BENCHMARK_START_TICK + rendered * step, sWindowWidth, sWindowHeight);
+        frameTimes[rendered] = clockMillis(CLOCK_THREAD_CPUTIME_ID) - start;
+        total += frameTimes[rendered];
+    }
+    checkGLErrors();
+
+    if (ppmPath != NULL && !softglWritePPM(ppmPath))
+        fprintf(stderr, "Cannot write %s\n", ppmPath);
+
+    appGetArenaStats(&sceneArena, &frameArena);
+    appGetCullStats(&glyphCull, &streamlineCull);
+    appDeinit();
+    importGLDeinit();
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("frames:         %ld at %dx%d, tick step %ld ms\n",
+           rendered, sWindowWidth, sWindowHeight, step);
+    printf("appInit:        %.3f ms cpu, %.3f ms wall\n", initCpu, initWall);
+    if (rendered > 0)
+    {
+        qsort(frameTimes, rendered, sizeof(double), compareDoubles);
+        printf("appRender cpu:  p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, "
+               "mean %.3f ms, max %.3f ms\n",
+               percentile(frameTimes, rendered, 50),
+               percentile(frameTimes, rendered, 95),
+               percentile(frameTimes, rendered, 99),
+               total / rendered, frameTimes[rendered - 1]);
+    }
+    printf("scene arena:    %lu allocations, %lu KB used, %lu KB reserved in %lu blocks\n",
+           sceneArena.allocations, (unsigned long)sceneArena.used / 1024,
+           (unsigned long)sceneArena.capacity / 1024, sceneArena.blockAllocations);
+    printf("frame arena:    peak %lu KB, %lu resets\n",
+           (unsigned long)frameArena.peak / 1024, frameArena.resets);
+    printf("glyph culling:  %ld clusters drawn, %ld culled, %ld draw calls, %ld nodes tested\n",
+           glyphCull.clustersDrawn, glyphCull.clustersCulled, glyphCull.drawCalls,
+           glyphCull.nodesTested);
+    printf("line culling:   %ld segments drawn, %ld culled, %ld draw calls, %ld nodes tested\n",
+           streamlineCull.clustersDrawn, streamlineCull.clustersCulled,
+           streamlineCull.drawCalls, streamlineCull.nodesTested);
+    printf("glyph density:  %.3f\n", appGetDensity());
+    printf("peak rss:       %ld KB\n", usage.ru_maxrss);
+    if (profilePath != NULL)
+        writeProfile(profilePath);
+
+    free(frameTimes);
+    return EXIT_SUCCESS;
+}
+
+
+static void printUsage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--benchmark [--frames=N] [--tick=MS] "
+            "[--size=WxH] [--ppm=FILE] [--profile=FILE|-] [--target-ms=MS] "
+            "[--sparse=TOLERANCE] [--color=divergence|vorticity|swirl|lambda2] "
+            "[--isosurface=[QUANTITY:]VALUE] [--lic=AXIS[:POSITION]] "
+            "[--particles=N[:TRAIL]] [--keyframes=N[:INTERVAL]] "
+            "[--field=FILE]]\n", name);
+}
+
+
+/* Parses the [QUANTITY:]VALUE of --isosurface, QUANTITY being magnitude,
+ * the default, or one of the --color quantities. Returns 0 when invalid.
+ */
+static int parseIsosurface(const char *option)
+{
+    // In APP_COLOR_ order.
+    static const char *const names[] = {
+        "magnitude", "divergence", "vorticity", "swirl", "lambda2"
+    };
+    const char *colon = strchr(option, ':');
+    int quantity = APP_COLOR_MAGNITUDE, count = sizeof(names) / sizeof(names[0]);
+    char *end;
+    float value;
+
+    if (colon != NULL)
+    {
+        for (quantity = 0; quantity < count; quantity++)
+            if (strlen(names[quantity]) == (size_t)(colon - option) &&
+                strncmp(option, names[quantity], colon - option) == 0)
+                break;
+        if (quantity == count)
+            return 0;
+        option = colon + 1;
+    }
+    value = strtof(option, &end);
+    if (end == option || *end != '\0')
+        return 0;
+    appSetIsosurface(quantity, value);
+    return 1;
+}
+
+
+/* Parses the AXIS[:POSITION] of --lic, AXIS being x, y or z. Returns 0
+ * when invalid.
+ */
+static int parseLic(const char *option)
+{
+    const char *axes = "xyz", *axis;
+    char *end;
+    float position = 0;
+
+    if (option[0] == '\0' || (axis = strchr(axes, option[0])) == NULL)
+        return 0;
+    if (option[1] == ':')
+    {
+        position = strtof(option + 2, &end);
+        if (end == option + 2 || *end != '\0')
+            return 0;
+    }
+    else if (option[1] != '\0')
+        return 0;
+    appSetLicSlice((int)(axis - axes), position);
+    return 1;
+}
+
+
+/* Parses the N[:TRAIL] of --particles. Returns 0 when invalid.
+ */
+static int parseParticles(const char *option)
+{
+    char *end;
+    long count = strtol(option, &end, 10), trail = 8;
+
+    if (end == option || count <= 0)
+        return 0;
+    if (*end == ':')
+    {
+        option = end + 1;
+        trail = strtol(option, &end, 10);
+        if (end == option || trail <= 0)
+            return 0;
+    }
+    if (*end != '\0')
+        return 0;
+    appSetParticles((int)count, (int)trail);
+    return 1;
+}
+
+
+/* Parses the N[:INTERVAL] of --keyframes. Returns 0 when invalid.
+ */
+static int parseKeyframes(const char *option)
+{
+    char *end;
+    long count = strtol(option, &end, 10), interval = 1000;
+
+    if (end == option || count <= 0)
+        return 0;
+    if (*end == ':')
+    {
+        option = end + 1;
+        interval = strtol(option, &end, 10);
+        if (end == option || interval <= 0)
+            return 0;
+    }
+    if (*end != '\0')
+        return 0;
+    appSetKeyframes((int)count, interval);
+    return 1;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int benchmark, result, i;
+    int width = 0, height = 0;
+#ifdef HAVE_X11
+    const char *display = getenv("DISPLAY");
+#endif
+    long frames = BENCHMARK_DEFAULT_FRAMES, step = BENCHMARK_DEFAULT_STEP;
+    const char *ppmPath = NULL, *profilePath = NULL;
+    float targetMs = -1;
+
+#ifdef HAVE_X11
+    benchmark = display == NULL || display[0] == '\0';
+#else
+    benchmark = 1;
+#endif
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--benchmark") == 0)
+            benchmark = 1;
+        else if (strncmp(argv[i], "--frames=", 9) == 0)
+            frames = atol(argv[i] + 9);
+        else if (strncmp(argv[i], "--tick=", 7) == 0)
+            step = atol(argv[i] + 7);
+        else if (strncmp(argv[i], "--size=", 7) == 0 &&
+                 sscanf(argv[i] + 7, "%dx%d", &width, &height) == 2 &&
+                 width > 0 && height > 0)
+            continue;
+        else if (strncmp(argv[i], "--ppm=", 6) == 0)
+            ppmPath = argv[i] + 6;
+        else if (strncmp(argv[i], "--profile=", 10) == 0)
+            profilePath = argv[i] + 10;
+        else if (strncmp(argv[i], "--target-ms=", 12) == 0)
+            targetMs = (float)atof(argv[i] + 12);
+        else if (strncmp(argv[i], "--sparse=", 9) == 0)
+            appSetSparseField((float)atof(argv[i] + 9));
+        else if (strcmp(argv[i], "--color=divergence") == 0)
+            appSetGlyphColoring(APP_COLOR_DIVERGENCE);
+        else if (strcmp(argv[i], "--color=vorticity") == 0)
+            appSetGlyphColoring(APP_COLOR_VORTICITY);
+        else if (strcmp(argv[i], "--color=swirl") == 0)
+            appSetGlyphColoring(APP_COLOR_SWIRL);
+        else if (strcmp(argv[i], "--color=lambda2") == 0)
+            appSetGlyphColoring(APP_COLOR_LAMBDA2);
+        else if (strncmp(argv[i], "--isosurface=", 13) == 0 &&
+                 parseIsosurface(argv[i] + 13))
+            continue;
+        else if (strncmp(argv[i], "--lic=", 6) == 0 && parseLic(argv[i] + 6))
+            continue;
+        else if (strncmp(argv[i], "--particles=", 12) == 0 &&
+                 parseParticles(argv[i] + 12))
+            continue;
+        else if (strncmp(argv[i], "--keyframes=", 12) == 0 &&
+                 parseKeyframes(argv[i] + 12))
+            continue;
+        else if (strncmp(argv[i], "--field=", 8) == 0 && argv[i][8] != '\0')
+            appSetFieldFile(argv[i] + 8);
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (frames <= 0 || step < 0)
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (width > 0)
+    {
+        sWindowWidth = width;
+        sWindowHeight = height;
+    }
+    else if (benchmark)
+    {
+        sWindowWidth = BENCHMARK_DEFAULT_WIDTH;
+        sWindowHeight = BENCHMARK_DEFAULT_HEIGHT;
+    }
+
+    if (targetMs >= 0)
+        appSetFrameTarget(targetMs);
+    else if (benchmark)
+        appSetFrameTarget(0);
+
+    logStartAsync();
+#ifdef HAVE_X11
+    if (!benchmark)
+        result = runWindowed();
+    else
+#endif
+        result = runBenchmark(frames, step, ppmPath, profilePath);
+    logStopAsync();
+
+    return result;
+}
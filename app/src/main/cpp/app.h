@@ -31,6 +31,11 @@ extern "C" {
 #endif
 
 
+#include "arena.h"
+#include "bvh.h"
+#include "camera.h"
+
+
 #define WINDOW_DEFAULT_WIDTH    640
 #define WINDOW_DEFAULT_HEIGHT   480
 
@@ -42,6 +47,88 @@ extern void appInit();
 extern void appDeinit();
 extern void appRender(long tick, int width, int height);
 
+/* Sets the frame time in milliseconds that the glyph density is adjusted
+ * to hold, LOD_DEFAULT_TARGET_MS unless set; 0 keeps full density. Call
+ * before appInit.
+ */
+extern void appSetFrameTarget(float milliseconds);
+
+/* Current glyph density, 1 at full density.
+ */
+extern float appGetDensity();
+
+/* Samples the field into a sparse octree, collapsing regions that stay
+ * within tolerance of one vector, and builds the glyphs and streamlines
+ * from it instead of the dense grid. A negative tolerance, the default,
+ * keeps the dense grid. Call before appInit.
+ */
+extern void appSetSparseField(float tolerance);
+
+// Quantities for appSetGlyphColoring.
+#define APP_COLOR_MAGNITUDE     0
+#define APP_COLOR_DIVERGENCE    1
+#define APP_COLOR_VORTICITY     2
+#define APP_COLOR_SWIRL         3
+#define APP_COLOR_LAMBDA2       4
+
+/* Colors the glyphs by one of the APP_COLOR_ quantities, by magnitude
+ * unless set. Derived quantities need the dense grid. Call before
+ * appInit.
+ */
+extern void appSetGlyphColoring(int quantity);
+
+/* Draws the surface where one of the APP_COLOR_ quantities equals
+ * isovalue, extracted from every field frame with isosurface.h. Needs the
+ * dense grid. Call before appInit.
+ */
+extern void appSetIsosurface(int quantity, float isovalue);
+
+/* Draws a line integral convolution texture of the field, computed for
+ * every field frame with lic.h, on the plane perpendicular to axis (0 for
+ * x, 1 for y, 2 for z) at the given coordinate along it. Needs the dense
+ * grid. Call before appInit.
+ */
+extern void appSetLicSlice(int axis, float position);
+
+/* Plays the field back from a sequence of count keyframes, interval ticks
+ * apart and looping, streamed by fieldsequence.h and interpolated for
+ * every frame, instead of evaluating it for every frame. The keyframes
+ * are sampled from the demo expression. Needs the dense grid. Call before
+ * appInit.
+ */
+extern void appSetKeyframes(int count, long interval);
+
+/* Advects count particles through the field on every frame with
+ * particles.h, drawn as points for a trailLength of 1 and as trails of
+ * their last trailLength positions otherwise. Needs the dense grid. Call
+ * before appInit.
+ */
+extern void appSetParticles(int count, int trailLength);
+
+/* Shows the field stored at path, written by fieldfile-tool, instead of
+ * the animated demo expression. Files in grid order are mapped and used
+ * in place; others are read into memory. Paths ending in .vtk or .vti
+ * are imported from VTK with vtkimport.h. The sparse grid and keyframes
+ * are not available with a field file. The path must stay valid until
+ * appDeinit. Call before appInit.
+ */
+extern void appSetFieldFile(const char *path);
+
+/* Feeds a touch or mouse drag event in window pixels. action is one of
+ * CAMERA_TOUCH_DOWN, CAMERA_TOUCH_MOVE and CAMERA_TOUCH_UP. Can be called
+ * from another thread than appRender.
+ */
+extern void appTouch(int action, float x, float y);
+
+/* Allocation counters of the arena of the scene being drawn and of the
+ * per-frame arena, for benchmarking.
+ */
+extern void appGetArenaStats(ARENASTATS *scene, ARENASTATS *frame);
+
+/* Culling counts of the glyphs and the streamlines in the last frame.
+ */
+extern void appGetCullStats(CULLSTATS *glyphs, CULLSTATS *streamlines);
+
 /* Value is non-zero when application is alive, and 0 when it is closing.
  * Defined by the application framework.
  */
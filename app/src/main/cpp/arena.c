@@ -0,0 +1,163 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "log.h"
+
+
+/* One heap block. The header takes a whole cache line so that the data
+ * after it stays aligned; blocks are chained newest first.
+ */
+struct ARENABLOCK {
+    ARENABLOCK *previous;
+    size_t size;
+    size_t offset;
+    void *memory;
+};
+
+#define ARENA_HEADER_SIZE \
+        ((sizeof(ARENABLOCK) + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1))
+
+
+static size_t alignSize(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+static ARENABLOCK *newBlock(ARENA *arena, size_t size) {
+    ARENABLOCK *block;
+    // Over-allocate by one alignment unit so the header can be aligned.
+    void *memory = malloc(ARENA_HEADER_SIZE + size + ARENA_ALIGNMENT);
+    if (memory == NULL)
+        return NULL;
+    block = (ARENABLOCK *) (((size_t) memory + ARENA_ALIGNMENT - 1) &
+                            ~(size_t) (ARENA_ALIGNMENT - 1));
+    block->previous = arena->blocks;
+    block->size = size;
+    block->offset = 0;
+    block->memory = memory;
+    arena->blocks = block;
+    arena->stats.capacity += size;
+    arena->stats.blockAllocations++;
+    return block;
+}
+
+static void freeBlocks(ARENA *arena) {
+    while (arena->blocks != NULL) {
+        ARENABLOCK *previous = arena->blocks->previous;
+        free(arena->blocks->memory);
+        arena->blocks = previous;
+    }
+    arena->stats.capacity = 0;
+}
+
+
+void arenaInit(ARENA *arena, size_t blockSize) {
+    memset(arena, 0, sizeof(ARENA));
+    arena->blockSize = alignSize(blockSize > 0 ? blockSize : ARENA_ALIGNMENT);
+}
+
+
+void arenaDeinit(ARENA *arena) {
+    freeBlocks(arena);
+    memset(arena, 0, sizeof(ARENA));
+}
+
+
+void *arenaAlloc(ARENA *arena, size_t size) {
+    ARENABLOCK *block = arena->blocks;
+    void *result;
+
+    size = alignSize(size > 0 ? size : 1);
+    if (block == NULL || block->offset + size > block->size) {
+        size_t blockSize = arena->blockSize;
+        while (blockSize < size)
+            blockSize *= 2;
+        block = newBlock(arena, blockSize);
+        if (block == NULL) {
+            LOGE(APP, "arena out of memory for %lu bytes", (unsigned long) size);
+            return NULL;
+        }
+    }
+    result = (char *) block + ARENA_HEADER_SIZE + block->offset;
+    block->offset += size;
+    arena->stats.allocations++;
+    arena->stats.used += size;
+    if (arena->stats.used > arena->stats.peak)
+        arena->stats.peak = arena->stats.used;
+    return result;
+}
+
+
+void *arenaCalloc(ARENA *arena, size_t size) {
+    void *result = arenaAlloc(arena, size);
+    if (result != NULL)
+        memset(result, 0, size);
+    return result;
+}
+
+
+void arenaReset(ARENA *arena) {
+    if (arena->blocks != NULL && arena->blocks->previous != NULL) {
+        // Replace the chain with one block that holds the peak.
+        size_t size = arena->blockSize;
+        while (size < arena->stats.peak)
+            size *= 2;
+        freeBlocks(arena);
+        arena->blockSize = size;
+        newBlock(arena, size);
+    }
+    else if (arena->blocks != NULL)
+        arena->blocks->offset = 0;
+    arena->stats.allocations = 0;
+    arena->stats.used = 0;
+    arena->stats.resets++;
+}
+
+
+ARENAMARK arenaMark(const ARENA *arena) {
+    ARENAMARK mark;
+    mark.block = arena->blocks;
+    mark.offset = arena->blocks != NULL ? arena->blocks->offset : 0;
+    mark.allocations = arena->stats.allocations;
+    mark.used = arena->stats.used;
+    return mark;
+}
+
+
+void arenaRelease(ARENA *arena, ARENAMARK mark) {
+    // Blocks chained on after the mark was taken are freed.
+    while (arena->blocks != NULL && arena->blocks != mark.block) {
+        ARENABLOCK *previous = arena->blocks->previous;
+        arena->stats.capacity -= arena->blocks->size;
+        free(arena->blocks->memory);
+        arena->blocks = previous;
+    }
+    if (arena->blocks != NULL)
+        arena->blocks->offset = mark.offset;
+    arena->stats.allocations = mark.allocations;
+    arena->stats.used = mark.used;
+}
+
+
+void arenaGetStats(const ARENA *arena, ARENASTATS *stats) {
+    *stats = arena->stats;
+}
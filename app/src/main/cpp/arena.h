@@ -0,0 +1,112 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stddef.h>
+
+
+// Alignment of every arena allocation: one cache line.
+#define ARENA_ALIGNMENT     64
+
+
+/* Allocation counters of an arena, for benchmarking.
+ */
+typedef struct {
+    // Allocations and bytes handed out since the last reset.
+    unsigned long allocations;
+    size_t used;
+    // Most bytes in use at once since the arena was created.
+    size_t peak;
+    // Bytes reserved from the heap, and the heap allocations made for it.
+    size_t capacity;
+    unsigned long blockAllocations;
+    unsigned long resets;
+} ARENASTATS;
+
+typedef struct ARENABLOCK ARENABLOCK;
+
+/* Bump allocator. Allocations are carved in order from large blocks and
+ * are never freed one by one; arenaReset releases all of them at once.
+ * When the first block runs out, further blocks are chained on, and the
+ * next reset merges them into one block big enough for the whole peak, so
+ * after the first round everything sits in one contiguous block. An arena
+ * must only be used by one thread at a time.
+ */
+typedef struct {
+    ARENABLOCK *blocks;
+    size_t blockSize;
+    ARENASTATS stats;
+} ARENA;
+
+/* Position in an arena, for releasing what was allocated after it.
+ */
+typedef struct {
+    ARENABLOCK *block;
+    size_t offset;
+    unsigned long allocations;
+    size_t used;
+} ARENAMARK;
+
+
+/* Sets up an empty arena whose first block will hold blockSize bytes.
+ * No memory is reserved before the first allocation.
+ */
+extern void arenaInit(ARENA *arena, size_t blockSize);
+
+/* Frees all blocks. The arena can be used again after arenaInit.
+ */
+extern void arenaDeinit(ARENA *arena);
+
+/* Returns size bytes aligned to ARENA_ALIGNMENT, or NULL when the heap is
+ * exhausted. A size of 0 returns a valid unique pointer.
+ */
+extern void *arenaAlloc(ARENA *arena, size_t size);
+
+/* As arenaAlloc, but zero filled.
+ */
+extern void *arenaCalloc(ARENA *arena, size_t size);
+
+/* Releases every allocation, keeping the memory for reuse.
+ */
+extern void arenaReset(ARENA *arena);
+
+extern ARENAMARK arenaMark(const ARENA *arena);
+
+/* Releases the allocations made since mark was taken.
+ */
+extern void arenaRelease(ARENA *arena, ARENAMARK mark);
+
+extern void arenaGetStats(const ARENA *arena, ARENASTATS *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !ARENA_H_INCLUDED
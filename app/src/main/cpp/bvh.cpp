@@ -0,0 +1,280 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "bvh.h"
+#include "log.h"
+
+
+using Eigen::AlignedBox3f;
+using Eigen::Vector3f;
+using Eigen::Vector4f;
+using Eigen::Matrix4f;
+
+
+/* Leaf nodes have the index of their leaf box, interior nodes -1. The
+ * left child of an interior node follows it and the right child starts at
+ * the skip of the left one; skip is the first node after the subtree.
+ */
+struct BVHNODE {
+    AlignedBox3f box;
+    int leaf;
+    int skip;
+};
+
+
+static AlignedBox3f toAlignedBox(const BVHBOX *box) {
+    return AlignedBox3f(Vector3f(box->min[0], box->min[1], box->min[2]),
+                        Vector3f(box->max[0], box->max[1], box->max[2]));
+}
+
+static float surfaceArea(const AlignedBox3f &box) {
+    Vector3f size;
+    if (box.isEmpty())
+        return 0;
+    size = box.sizes();
+    return 2 * (size.x() * size.y() + size.y() * size.z() + size.z() * size.x());
+}
+
+// Orders leaf indices by the center of their box along one axis.
+struct CenterLess {
+    const Vector3f *centers;
+    int axis;
+
+    bool operator()(int a, int b) const {
+        return centers[a][axis] < centers[b][axis];
+    }
+};
+
+/* Builds the subtree over order[first, first + count) by splitting at the
+ * median center along the longest axis of the centers, and returns the
+ * summed surface area of its nodes.
+ */
+static float buildNode(BVH *bvh, const BVHBOX *leaves, const Vector3f *centers,
+                       int *order, int first, int count) {
+    int index = bvh->nodeCount++, left, axis;
+    AlignedBox3f centerBounds;
+    CenterLess less;
+    float cost;
+
+    if (count == 1) {
+        BVHNODE *node = &bvh->nodes[index];
+        node->leaf = order[first];
+        node->box = toAlignedBox(&leaves[node->leaf]);
+        node->skip = bvh->nodeCount;
+        return surfaceArea(node->box);
+    }
+
+    centerBounds.setEmpty();
+    for (left = first; left < first + count; left++)
+        centerBounds.extend(centers[order[left]]);
+    centerBounds.sizes().maxCoeff(&axis);
+    less.centers = centers;
+    less.axis = axis;
+    std::nth_element(order + first, order + first + count / 2, order + first + count, less);
+
+    left = bvh->nodeCount;
+    cost = buildNode(bvh, leaves, centers, order, first, count / 2);
+    cost += buildNode(bvh, leaves, centers, order, first + count / 2, count - count / 2);
+    bvh->nodes[index].leaf = -1;
+    bvh->nodes[index].box = bvh->nodes[left].box.merged(
+            bvh->nodes[bvh->nodes[left].skip].box);
+    bvh->nodes[index].skip = bvh->nodeCount;
+    return cost + surfaceArea(bvh->nodes[index].box);
+}
+
+static int rebuild(BVH *bvh, const BVHBOX *leaves, int leafCount) {
+    int nodes = 2 * leafCount - 1, n;
+    Vector3f *centers;
+    int *order;
+
+    // The old nodes are rebuilt from scratch, so they need not be kept.
+    if (nodes > bvh->nodeCapacity) {
+        free(bvh->nodes);
+        bvh->nodeCapacity = 0;
+        bvh->nodes = (BVHNODE *) malloc(nodes * sizeof(BVHNODE));
+        if (bvh->nodes == NULL)
+            return 0;
+        bvh->nodeCapacity = nodes;
+    }
+    centers = (Vector3f *) malloc(leafCount * sizeof(Vector3f));
+    order = (int *) malloc(leafCount * sizeof(int));
+    if (centers == NULL || order == NULL) {
+        free(centers);
+        free(order);
+        return 0;
+    }
+    // Empty leaves are parked at the origin; they are never visible.
+    for (n = 0; n < leafCount; n++) {
+        AlignedBox3f box = toAlignedBox(&leaves[n]);
+        if (box.isEmpty())
+            centers[n].setZero();
+        else
+            centers[n] = box.center();
+        order[n] = n;
+    }
+    bvh->nodeCount = 0;
+    bvh->leafCount = leafCount;
+    bvh->buildCost = buildNode(bvh, leaves, centers, order, 0, leafCount);
+    bvh->rebuilds++;
+    free(centers);
+    free(order);
+    return 1;
+}
+
+// Refits the boxes bottom up and returns the summed surface area.
+static float refit(BVH *bvh, const BVHBOX *leaves) {
+    float cost = 0;
+    int n;
+    for (n = bvh->nodeCount - 1; n >= 0; n--) {
+        BVHNODE *node = &bvh->nodes[n];
+        if (node->leaf >= 0)
+            node->box = toAlignedBox(&leaves[node->leaf]);
+        else
+            node->box = bvh->nodes[n + 1].box.merged(bvh->nodes[bvh->nodes[n + 1].skip].box);
+        cost += surfaceArea(node->box);
+    }
+    bvh->refits++;
+    return cost;
+}
+
+
+void bvhBoxSetEmpty(BVHBOX *box) {
+    box->min[0] = box->min[1] = box->min[2] = FLT_MAX;
+    box->max[0] = box->max[1] = box->max[2] = -FLT_MAX;
+}
+
+void bvhBoxExtend(BVHBOX *box, const float *points, long count) {
+    long p;
+    int a;
+    for (p = 0; p < count; p++) {
+        for (a = 0; a < 3; a++) {
+            box->min[a] = std::min(box->min[a], points[p * 3 + a]);
+            box->max[a] = std::max(box->max[a], points[p * 3 + a]);
+        }
+    }
+}
+
+
+void frustumFromMatrices(FRUSTUM *frustum, const float projection[16],
+                         const float modelview[16]) {
+    Matrix4f clip = Eigen::Map<const Matrix4f>(projection) *
+                    Eigen::Map<const Matrix4f>(modelview);
+    int p;
+
+    // Gribb and Hartmann: each plane is the w row plus or minus another.
+    for (p = 0; p < 6; p++) {
+        Vector4f plane = clip.row(3).transpose();
+        if (p % 2 == 0)
+            plane += clip.row(p / 2).transpose();
+        else
+            plane -= clip.row(p / 2).transpose();
+        plane /= plane.head<3>().norm();
+        Eigen::Map<Vector4f>(frustum->planes[p]) = plane;
+    }
+}
+
+
+int bvhUpdate(BVH *bvh, const BVHBOX *leaves, int leafCount) {
+    if (leafCount <= 0) {
+        bvh->nodeCount = bvh->leafCount = 0;
+        return 1;
+    }
+    if (leafCount == bvh->leafCount && bvh->nodeCount > 0 &&
+        refit(bvh, leaves) <= BVH_REBUILD_FACTOR * bvh->buildCost)
+        return 1;
+    if (!rebuild(bvh, leaves, leafCount)) {
+        LOGE(RENDER, "cannot build a hierarchy of %d leaves", leafCount);
+        bvh->nodeCount = bvh->leafCount = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void bvhDeinit(BVH *bvh) {
+    free(bvh->nodes);
+    memset(bvh, 0, sizeof(BVH));
+}
+
+
+#define BOX_OUTSIDE     0
+#define BOX_INTERSECTS  1
+#define BOX_INSIDE      2
+
+/* Classifies box against the frustum by the corners furthest along and
+ * against each plane normal.
+ */
+static int classifyBox(const FRUSTUM *frustum, const AlignedBox3f &box) {
+    int result = BOX_INSIDE, p;
+    if (box.isEmpty())
+        return BOX_OUTSIDE;
+    for (p = 0; p < 6; p++) {
+        const float *plane = frustum->planes[p];
+        Vector3f normal(plane[0], plane[1], plane[2]);
+        Vector3f positive = (normal.array() >= 0).select(box.max(), box.min());
+        Vector3f negative = (normal.array() >= 0).select(box.min(), box.max());
+        if (normal.dot(positive) + plane[3] < 0)
+            return BOX_OUTSIDE;
+        if (normal.dot(negative) + plane[3] < 0)
+            result = BOX_INTERSECTS;
+    }
+    return result;
+}
+
+int bvhCull(const BVH *bvh, const FRUSTUM *frustum, unsigned char *visible,
+            CULLSTATS *stats) {
+    int visibleCount = 0, tested = 0, n = 0, m;
+
+    memset(visible, 0, bvh->leafCount);
+    while (n < bvh->nodeCount) {
+        const BVHNODE *node = &bvh->nodes[n];
+        int classification = classifyBox(frustum, node->box);
+        tested++;
+        if (classification == BOX_OUTSIDE) {
+            n = node->skip;
+            continue;
+        }
+        if (classification == BOX_INSIDE) {
+            // Everything below is visible without further tests.
+            for (m = n; m < node->skip; m++) {
+                if (bvh->nodes[m].leaf >= 0 && !bvh->nodes[m].box.isEmpty()) {
+                    visible[bvh->nodes[m].leaf] = 1;
+                    visibleCount++;
+                }
+            }
+            n = node->skip;
+            continue;
+        }
+        if (node->leaf >= 0) {
+            visible[node->leaf] = 1;
+            visibleCount++;
+        }
+        n++;
+    }
+    if (stats != NULL)
+        stats->nodesTested += tested;
+    return visibleCount;
+}
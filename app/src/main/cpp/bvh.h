@@ -0,0 +1,115 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef BVH_H_INCLUDED
+#define BVH_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Axis aligned bounding box. Empty when min exceeds max on an axis, which
+ * bvhBoxSetEmpty arranges.
+ */
+typedef struct {
+    float min[3];
+    float max[3];
+} BVHBOX;
+
+/* View frustum as the planes left, right, bottom, top, near and far. A
+ * point p is inside plane n when planes[n] . (p, 1) >= 0.
+ */
+typedef struct {
+    float planes[6][4];
+} FRUSTUM;
+
+/* Culling counters of one draw, accumulated by the draw functions that
+ * take a FRUSTUM. Clusters without geometry are not counted.
+ */
+typedef struct {
+    long nodesTested;
+    long clustersDrawn;
+    long clustersCulled;
+    long drawCalls;
+} CULLSTATS;
+
+typedef struct BVHNODE BVHNODE;
+
+/* Bounding volume hierarchy over leaf boxes, one leaf per drawable
+ * cluster. Nodes are stored depth first with each node followed by its
+ * left subtree, so that culling walks them in order without a stack.
+ *
+ * When the leaves move but keep their number, bvhUpdate only refits the
+ * boxes of the existing tree. The tree is rebuilt when the number of
+ * leaves changes or when refitting has loosened it by more than
+ * BVH_REBUILD_FACTOR, measured by the summed surface area of its nodes.
+ */
+typedef struct {
+    BVHNODE *nodes;
+    int nodeCount;
+    int nodeCapacity;
+    int leafCount;
+    // Summed node surface area right after the last rebuild.
+    float buildCost;
+    // Number of rebuilds and refits done by bvhUpdate.
+    unsigned long rebuilds;
+    unsigned long refits;
+} BVH;
+
+#define BVH_REBUILD_FACTOR  1.5f
+
+
+extern void bvhBoxSetEmpty(BVHBOX *box);
+
+/* Grows box to contain count xyz points.
+ */
+extern void bvhBoxExtend(BVHBOX *box, const float *points, long count);
+
+/* Extracts the frustum of the given column major GL matrices, with
+ * normalized planes so that plane distances are in world units.
+ */
+extern void frustumFromMatrices(FRUSTUM *frustum, const float projection[16],
+                                const float modelview[16]);
+
+/* Fits the hierarchy to leafCount leaf boxes, refitting or rebuilding it
+ * as described for BVH. bvh must be zero filled or hold an earlier
+ * hierarchy. Returns non-zero on success and 0 on failure, in which case
+ * the hierarchy is empty.
+ */
+extern int bvhUpdate(BVH *bvh, const BVHBOX *leaves, int leafCount);
+
+extern void bvhDeinit(BVH *bvh);
+
+/* Sets visible[n] to 1 for leaf n if its box may intersect the frustum and
+ * to 0 otherwise, and returns the number of visible leaves. Empty leaves
+ * are never visible. Adds the nodes tested to stats, which may be NULL.
+ */
+extern int bvhCull(const BVH *bvh, const FRUSTUM *frustum, unsigned char *visible,
+                   CULLSTATS *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !BVH_H_INCLUDED
@@ -0,0 +1,150 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <string.h>
+#include <math.h>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "camera.h"
+
+
+using Eigen::AngleAxisf;
+using Eigen::Map;
+using Eigen::Matrix3f;
+using Eigen::Matrix4f;
+using Eigen::Quaternionf;
+using Eigen::Vector3f;
+
+
+// Guards the touch state and the shared eye of every camera. Never
+// destroyed, since touches may arrive while the renderer shuts down.
+static pthread_mutex_t sMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+// Rebuilds the cached matrices from the orbit state.
+static void rebuildView(CAMERA *camera) {
+    Map<Quaternionf> orientation(camera->orientation);
+    Map<Vector3f> eye(camera->eye);
+    Map<Matrix4f> modelview(camera->modelview);
+    Matrix3f rotation;
+    int a;
+
+    orientation.normalize();
+    // The camera looks down its -z axis, so the eye is on its +z axis.
+    eye = Map<const Vector3f>(camera->target) +
+          orientation * Vector3f(0, 0, camera->distance);
+    rotation = orientation.conjugate().toRotationMatrix();
+    modelview.setIdentity();
+    modelview.topLeftCorner<3, 3>() = rotation;
+    modelview.topRightCorner<3, 1>() = -(rotation * eye);
+    for (a = 0; a < 16; a++)
+        camera->fixedModelview[a] = (GLfixed) (camera->modelview[a] * 65536);
+    camera->version++;
+
+    pthread_mutex_lock(&sMutex);
+    memcpy(camera->sharedEye, camera->eye, sizeof(camera->eye));
+    pthread_mutex_unlock(&sMutex);
+}
+
+
+void cameraInit(CAMERA *camera, const float eye[3], const float target[3],
+                const float up[3]) {
+    Vector3f z = Map<const Vector3f>(eye) - Map<const Vector3f>(target);
+    Vector3f x, y;
+    Matrix3f frame;
+
+    pthread_mutex_lock(&sMutex);
+    memset(camera, 0, sizeof(CAMERA));
+    pthread_mutex_unlock(&sMutex);
+    memcpy(camera->target, target, sizeof(camera->target));
+    memcpy(camera->up, up, sizeof(camera->up));
+    camera->distance = z.norm();
+
+    // Same frame as gluLookAt: x to the right, y up and z toward the eye.
+    z.normalize();
+    x = Map<const Vector3f>(up).cross(z).normalized();
+    y = z.cross(x);
+    frame << x, y, z;
+    Map<Quaternionf>(camera->orientation) = Quaternionf(frame);
+    rebuildView(camera);
+}
+
+void cameraDeinit(CAMERA *camera) {
+    pthread_mutex_lock(&sMutex);
+    camera->pendingDrag[0] = camera->pendingDrag[1] = 0;
+    camera->touching = 0;
+    pthread_mutex_unlock(&sMutex);
+}
+
+void cameraTouch(CAMERA *camera, int action, float x, float y) {
+    pthread_mutex_lock(&sMutex);
+    if (action == CAMERA_TOUCH_DOWN) {
+        camera->touching = 1;
+    }
+    else if (action == CAMERA_TOUCH_MOVE && camera->touching) {
+        camera->pendingDrag[0] += x - camera->lastTouch[0];
+        camera->pendingDrag[1] += y - camera->lastTouch[1];
+    }
+    else if (action == CAMERA_TOUCH_UP)
+        camera->touching = 0;
+    camera->lastTouch[0] = x;
+    camera->lastTouch[1] = y;
+    pthread_mutex_unlock(&sMutex);
+}
+
+int cameraUpdate(CAMERA *camera) {
+    Map<Quaternionf> orientation(camera->orientation);
+    Vector3f up = Map<const Vector3f>(camera->up).normalized();
+    float drag[2], elevation, pitch;
+
+    pthread_mutex_lock(&sMutex);
+    drag[0] = camera->pendingDrag[0];
+    drag[1] = camera->pendingDrag[1];
+    camera->pendingDrag[0] = camera->pendingDrag[1] = 0;
+    pthread_mutex_unlock(&sMutex);
+    if (drag[0] == 0 && drag[1] == 0)
+        return 0;
+
+    /* Dragging right turns the scene right, so the eye turns left about
+     * the world up axis; dragging down tilts the eye up over the target.
+     * The camera x axis stays level, so a pitch of p about it lowers the
+     * elevation of the eye by exactly p, which is clamped to keep the eye
+     * off the poles.
+     */
+    elevation = asinf(fmaxf(-1, fminf(1, (orientation * Vector3f::UnitZ()).dot(up))));
+    pitch = -drag[1] * CAMERA_RADIANS_PER_PIXEL;
+    pitch = elevation - fmaxf(-CAMERA_MAX_ELEVATION,
+                              fminf(CAMERA_MAX_ELEVATION, elevation - pitch));
+    orientation = AngleAxisf(-drag[0] * CAMERA_RADIANS_PER_PIXEL, up) *
+                  orientation * AngleAxisf(pitch, Vector3f::UnitX());
+    rebuildView(camera);
+    return 1;
+}
+
+void cameraApply(const CAMERA *camera) {
+    glMultMatrixx(camera->fixedModelview);
+}
+
+void cameraGetEye(CAMERA *camera, float eye[3]) {
+    pthread_mutex_lock(&sMutex);
+    memcpy(eye, camera->sharedEye, sizeof(camera->sharedEye));
+    pthread_mutex_unlock(&sMutex);
+}
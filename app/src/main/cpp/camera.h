@@ -0,0 +1,117 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef CAMERA_H_INCLUDED
+#define CAMERA_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <pthread.h>
+
+#include "importgl.h"
+
+
+// Actions for cameraTouch, the values of the Android MotionEvent actions.
+#define CAMERA_TOUCH_DOWN   0
+#define CAMERA_TOUCH_UP     1
+#define CAMERA_TOUCH_MOVE   2
+
+// Orbit angle per pixel dragged.
+#define CAMERA_RADIANS_PER_PIXEL    0.01f
+/* Largest angle of the eye above or below the target, about 85 degrees,
+ * so that the orbit stops short of the poles instead of flipping over.
+ */
+#define CAMERA_MAX_ELEVATION        1.48f
+
+
+/* Camera orbiting a target point. Dragging horizontally turns it around
+ * the world up axis and dragging vertically around its own x axis.
+ *
+ * Touches may come from another thread than the one rendering: they only
+ * add to the pending drag under a mutex, and cameraUpdate applies it on
+ * the render thread. The mutex is shared by all cameras and never
+ * destroyed, so a touch that races cameraDeinit or a later cameraInit
+ * stays safe. The modelview matrix, in float for culling and in fixed
+ * point for GL, is rebuilt only when the orbit changed.
+ */
+typedef struct {
+    // Rotation from camera to world coordinates as x, y, z, w.
+    float orientation[4];
+    float target[3];
+    float distance;
+    float up[3];
+
+    // Guarded by the mutex: the drag not yet applied and the last touch.
+    float pendingDrag[2];
+    float lastTouch[2];
+    int touching;
+    // Guarded by the mutex: eye position of the current view, for threads
+    // other than the render thread.
+    float sharedEye[3];
+
+    // Cache of the current view, owned by the render thread.
+    float eye[3];
+    GLfloat modelview[16];
+    GLfixed fixedModelview[16];
+    // Incremented whenever the view changes.
+    unsigned long version;
+} CAMERA;
+
+
+/* Places the camera at eye looking at target, with up pointing up on the
+ * screen.
+ */
+extern void cameraInit(CAMERA *camera, const float eye[3], const float target[3],
+                       const float up[3]);
+
+/* Drops the pending drag. Touches may still arrive afterwards, which is
+ * safe; cameraInit discards them.
+ */
+extern void cameraDeinit(CAMERA *camera);
+
+/* Feeds one touch event in screen pixels. Can be called from any thread.
+ */
+extern void cameraTouch(CAMERA *camera, int action, float x, float y);
+
+/* Applies the pending drag and rebuilds the cached matrices if the view
+ * changed. Returns non-zero when it did.
+ */
+extern int cameraUpdate(CAMERA *camera);
+
+/* Multiplies the current GL matrix by the cached view matrix.
+ */
+extern void cameraApply(const CAMERA *camera);
+
+/* Copies the eye position of the latest view. Can be called from any
+ * thread.
+ */
+extern void cameraGetEye(CAMERA *camera, float eye[3]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !CAMERA_H_INCLUDED
@@ -22,38 +22,43 @@
  * $Revision: 1.10 $
  */
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
-#include <assert.h>
 
 #include "importgl.h"
+#include "field.h"
+#include "analysis.h"
+#include "glyph.h"
+#include "streamline.h"
+#include "threadpool.h"
+#include "fieldworker.h"
+#include "fieldsequence.h"
+#include "fieldfile.h"
+#include "vtkimport.h"
+#include "octree.h"
+#include "isosurface.h"
+#include "lic.h"
+#include "particles.h"
+#include "arena.h"
+#include "bvh.h"
+#include "camera.h"
+#include "lod.h"
 
 #include "app.h"
 #include "shapes.h"
 #include "cams.h"
 
-#include <android/log.h>
+#include "log.h"
+#include "profile.h"
 
 // Total run length is 20 * camera track base unit length (see cams.h).
 #define RUN_LENGTH  (20 * CAMTRACK_LEN)
 #undef PI
 #define PI 3.1415926535897932f
-#define NUMBOXES 1
 #define ONE_OVER_RADICAL_2 0.070710678118f
 //#define RANDOM_UINT_MAX 65535
 
 
-static unsigned long sRandomSeed = 0;
-
-//static void seedRandom(unsigned long seed) {
-//    sRandomSeed = seed;
-//}
-
-static unsigned long randomUInt() {
-    sRandomSeed = sRandomSeed * 0x343fd + 0x269ec3;
-    return sRandomSeed >> 16;
-}
-
-
 // Capped conversion from float to fixed.
 //static long floatToFixed(float value) {
 //    if (value < -32768) value = -32768;
@@ -64,273 +69,439 @@ static unsigned long randomUInt() {
 #define FIXED(value) floatToFixed(value)
 
 
-// Definition of one GL object in this demo.
-typedef struct {
-    /* Vertex array and color array are enabled for all objects, so their
-     * pointers must always be valid and non-NULL. Normal array is not
-     * used by the ground plane, so when its pointer is NULL then normal
-     * array usage is disabled.
-     *
-     * Vertex array is supposed to use GL_FIXED datatype and stride 0
-     * (i.e. tightly packed array). Color array is supposed to have 4
-     * components per color with GL_UNSIGNED_BYTE datatype and stride 0.
-     * Normal array is supposed to use GL_FIXED datatype and stride 0.
-     */
-    GLfixed *vertexArray;
-    GLubyte *colorArray;
-    GLfixed *normalArray;
-    GLint vertexComponents;
-    GLsizei count;
-} GLOBJECT;
-
-
 static long sStartTick = 0;
 static long sTick = 0;
+// profileNow() at the start of the last rendered frame.
+static long long sLastFrameStart = 0;
 
-static GLOBJECT *sBoxes[NUMBOXES];
+/* State of the demo field at one tick, recomputed by the field worker
+ * while the render thread draws an earlier one.
+ */
+typedef struct {
+    FIELD field;
+    // Sparse copy of the field, used instead of it when
+    // sSparseTolerance >= 0.
+    OCTREEFIELD octree;
+    // Derived quantities, allocated when the glyphs are colored by one or
+    // the isosurface is of one.
+    FIELDANALYSIS analysis;
+    // Sample magnitudes, allocated for an isosurface of the magnitude.
+    SCALARFIELD magnitude;
+    // Holds the glyph and streamline arrays; reset whenever the field is
+    // recomputed.
+    ARENA scene;
+    // Glyph density and screen scale the glyphs were built for.
+    float density;
+    float screenScale;
+    GLYPHSET glyphs;
+    STREAMLINESET streamlines;
+    ISOSURFACE isosurface;
+    // Allocated when a LIC slice is drawn.
+    LICSLICE lic;
+} FIELDFRAME;
+
+// First block size of the arenas; they grow to fit on the first frames.
+#define SCENE_ARENA_BLOCK   (1024 * 1024)
+#define FRAME_ARENA_BLOCK   (64 * 1024)
+
+// Texels along each side of the LIC slice.
+#define LIC_SLICE_SIZE  512
+
+// Keyframes of a played back sequence held in memory at once.
+#define KEYFRAME_RING   4
+
+#define SEEDS_X 8
+#define SEEDS_Y 8
+#define SEEDS_Z 4
+#define SEED_COUNT (SEEDS_X * SEEDS_Y * SEEDS_Z)
+
+static THREADPOOL *sThreadPool = NULL;
+static FIELDWORKER *sFieldWorker = NULL;
+static FIELDFRAME sFrames[FIELDWORKER_SLOTS];
+// The frame being drawn.
+static FIELDFRAME *sFrame = &sFrames[0];
+static FIELDEXPR *sExpression = NULL;
+// Keyframes the field is played back from instead of evaluated on every
+// frame, when sKeyframeCount > 0.
+static FIELDSEQUENCE *sSequence = NULL;
+static int sKeyframeCount = 0;
+static long sKeyframeInterval = 1000;
+// Field file shown instead of the expression, when sFieldPath is set.
+// sFileField is the mapped field itself for files in grid order and a
+// copy reordered from the file otherwise; every frame shares its arrays.
+static const char *sFieldPath = NULL;
+static FIELDFILE sFieldFile;
+static FIELD sFileField;
+/* What does not depend on the view is built from a file field once, into
+ * this frame: the analysis, the magnitudes, the streamlines, the
+ * isosurface and the LIC slice. The worker then only rebuilds the glyphs,
+ * whose detail follows the eye and the density.
+ */
+static FIELDFRAME sFileFrame;
+static GLYPHPARAMS sGlyphParams;
+static STREAMLINEPARAMS sStreamlineParams;
+static float sSparseTolerance = -1;
+static int sGlyphColoring = APP_COLOR_MAGNITUDE;
+// Quantity of the isosurface, -1 for none.
+static int sIsosurfaceQuantity = -1;
+static float sIsovalue = 0;
+static ISOSURFACEPARAMS sIsosurfaceParams;
+// Axis the LIC slice is perpendicular to, -1 for none.
+static int sLicAxis = -1;
+static float sLicPosition = 0;
+static LICPARAMS sLicParams;
+// Particles advected through the frame being drawn; none when the count
+// is 0.
+static int sParticleCount = 0;
+static int sParticleTrail = 8;
+static PARTICLESYSTEM sParticles;
+static float sSeeds[SEED_COUNT * 3];
+// Temporaries of the render thread, reset at the start of every frame.
+static ARENA sFrameArena;
+
+// Initial camera placement, orbiting the field center with z up.
+static const float sEye[3] = {5, -5, 5};
+static const float sTarget[3] = {0, 0, 0};
+static const float sUp[3] = {0, 0, 1};
+// Orbit camera driven by touch; glyphs near its eye get more detailed cones.
+static CAMERA sCamera;
+// Matrix set by gluPerspective, for culling.
+static GLfloat sProjection[16];
+#define FIELD_OF_VIEW   45
+
+/* Glyph density control. The render thread updates the controller and
+ * publishes the density and the screen scale of the last frame, which
+ * the field worker reads with atomic loads; a rebuild is asked for when
+ * either moved by more than LOD_REBUILD_CHANGE since the last one. Until
+ * the rebuilt glyphs are drawn the controller is not fed.
+ */
+#define LOD_REBUILD_CHANGE  0.05f
+static float sFrameTargetMs = LOD_DEFAULT_TARGET_MS;
+static LODCONTROLLER sLod;
+static float sDensity = 1;
+static float sScreenScale = 0;
+static int sLodWaiting = 0;
+// Culling counts of the last frame.
+static CULLSTATS sGlyphCull;
+static CULLSTATS sStreamlineCull;
+
+
+// Whether the frames need a FIELDANALYSIS.
+static int needsAnalysis() {
+    return sGlyphColoring != APP_COLOR_MAGNITUDE ||
+           sIsosurfaceQuantity > APP_COLOR_MAGNITUDE;
+}
 
 
-typedef struct {
-    float x, y, z;
-} VECTOR3;
+// The scalar of frame for one of the APP_COLOR_ quantities.
+static const SCALARFIELD *frameQuantity(FIELDFRAME *frame, int quantity) {
+    switch (quantity) {
+        case APP_COLOR_MAGNITUDE:
+            return &frame->magnitude;
+        case APP_COLOR_DIVERGENCE:
+            return &frame->analysis.divergence;
+        case APP_COLOR_VORTICITY:
+            return &frame->analysis.vorticity;
+        case APP_COLOR_SWIRL:
+            return &frame->analysis.swirl;
+        default:
+            return &frame->analysis.lambda2;
+    }
+}
 
 
-static void vector3Sub(VECTOR3 *dest, VECTOR3 *v1, VECTOR3 *v2) {
-    dest->x = v1->x - v2->x;
-    dest->y = v1->y - v2->y;
-    dest->z = v1->z - v2->z;
+// The frame holding the view independent products of frame.
+static FIELDFRAME *productFrame(FIELDFRAME *frame) {
+    return sFileField.x != NULL ? &sFileFrame : frame;
 }
 
 
-static void assignVertex(int pi, int m, GLOBJECT *result, long p[][3]) {
-    int i;
-    GLubyte color;
-    GLubyte c;
-    for (i = 0; i < 3; i++) {
-        __android_log_print(ANDROID_LOG_DEBUG, "vf", "vertex[%d] = %d", m * 3 + i,
-                            (int) p[pi - 1][i]);
-        result->vertexArray[m * 3 + i] = (GLfixed) p[pi - 1][i];
-
-        int j;
-        color = (GLubyte) ((randomUInt() & 0x5f) + 81);
-        for (j = 0; j < 4; j++) {
-            c = (GLubyte) (j == 3 ? 0 : color);
-            result->colorArray[(m * 3 + i) * 4 + j] = c;
-            __android_log_print(ANDROID_LOG_DEBUG, "vf",
-                                "color[%d] = %d", (m * 3 + i) * 4 + j, c);
+/* Builds the analysis, the magnitudes, the streamlines, the isosurface
+ * and the LIC slice of the field of frame, into its scene arena. Makes no
+ * GL calls.
+ */
+static int buildFieldProducts(FIELDFRAME *frame, THREADPOOL *pool) {
+    int sparse = sSparseTolerance >= 0;
+    if (needsAnalysis() && !sparse) {
+        if (!fieldAnalysisUpdate(&frame->analysis, &frame->field, pool))
+            return 0;
+        LOGD(FIELD, "%d critical points", frame->analysis.criticalPointCount);
+    }
+    if (sIsosurfaceQuantity == APP_COLOR_MAGNITUDE && !sparse)
+        fieldMagnitude(&frame->field, &frame->magnitude);
+    if (!(sparse ? streamlineSetTraceOctree(&frame->streamlines, &frame->octree, sSeeds,
+                                            SEED_COUNT, &sStreamlineParams, pool,
+                                            &frame->scene) :
+                   streamlineSetTrace(&frame->streamlines, &frame->field, sSeeds, SEED_COUNT,
+                                      &sStreamlineParams, pool, &frame->scene))) {
+        LOGE(FIELD, "cannot trace the streamlines");
+        return 0;
+    }
+    if (sIsosurfaceQuantity >= 0 && !sparse &&
+        !isosurfaceBuild(&frame->isosurface, frameQuantity(frame, sIsosurfaceQuantity),
+                         &sIsosurfaceParams, pool, &frame->scene)) {
+        LOGE(MESH, "cannot build the isosurface");
+        return 0;
+    }
+    if (sLicAxis >= 0 && !sparse) {
+        LICPLANE plane;
+        licPlaneAxis(&plane, &frame->field, sLicAxis, sLicPosition);
+        if (!licSliceCompute(&frame->lic, &frame->field, &plane, &sLicParams, pool)) {
+            LOGE(FIELD, "cannot compute the LIC slice");
+            return 0;
         }
     }
+    return 1;
 }
 
-static void freeGLObject(GLOBJECT *object) {
-    if (object == NULL)
-        return;
-    free(object->normalArray);
-    free(object->colorArray);
-    free(object->vertexArray);
-    free(object);
-}
 
-static GLOBJECT *newGLObject(long vertices, int vertexComponents,
-                             int useNormalArray) {
-    GLOBJECT *result;
-    result = (GLOBJECT *) malloc(sizeof(GLOBJECT));
-    if (result == NULL)
-        return NULL;
-    result->count = (GLsizei) vertices;
-    result->vertexComponents = vertexComponents;
-    result->vertexArray = (GLfixed *) malloc(vertices * vertexComponents * sizeof(GLfixed));
-    result->colorArray = (GLubyte *) malloc(vertices * 4 * sizeof(GLubyte));
-    if (useNormalArray) {
-        result->normalArray = (GLfixed *) malloc(vertices * 3 * sizeof(GLfixed));
+/* Samples the demo field at tick and rebuilds the arrow glyphs and the
+ * buildFieldProducts for it. A file field is not sampled and only gets
+ * new glyphs, its products are in sFileFrame.
+ */
+static int buildFrame(FIELDFRAME *frame, long tick, THREADPOOL *pool) {
+    GLYPHPARAMS glyphParams = sGlyphParams;
+    int sparse = sSparseTolerance >= 0;
+
+    if (sSequence != NULL) {
+        if (!fieldSequenceSample(sSequence, (float) tick / sKeyframeInterval, &frame->field))
+            return 0;
     }
-    else
-        result->normalArray = NULL;
-    if (result->vertexArray == NULL ||
-        result->colorArray == NULL ||
-        (useNormalArray && result->normalArray == NULL)) {
-        freeGLObject(result);
-        return NULL;
+    else if (sparse) {
+        if (!octreeFieldEvaluateExpression(&frame->octree, sExpression, tick * 0.001f,
+                                           sSparseTolerance))
+            return 0;
     }
-    return result;
+    else if (sFileField.x == NULL)
+        fieldEvaluateExpression(&frame->field, sExpression, tick * 0.001f);
+
+    // Replaces the glyphs and lines in the arena; their hierarchies are kept.
+    arenaReset(&frame->scene);
+    if (productFrame(frame) == frame && !buildFieldProducts(frame, pool))
+        return 0;
+    if (sGlyphColoring != APP_COLOR_MAGNITUDE && !sparse)
+        glyphParams.colorField = frameQuantity(productFrame(frame), sGlyphColoring);
+    cameraGetEye(&sCamera, glyphParams.eye);
+    __atomic_load(&sDensity, &glyphParams.density, __ATOMIC_RELAXED);
+    __atomic_load(&sScreenScale, &glyphParams.screenScale, __ATOMIC_RELAXED);
+    frame->density = glyphParams.density;
+    frame->screenScale = glyphParams.screenScale;
+    if (!(sparse ? glyphSetBuildOctree(&frame->glyphs, &frame->octree, &glyphParams,
+                                       &frame->scene) :
+                   glyphSetBuild(&frame->glyphs, &frame->field, &glyphParams, &frame->scene))) {
+        LOGE(MESH, "cannot build the glyphs");
+        return 0;
+    }
+    return 1;
 }
 
-static void drawGLObject(GLOBJECT *object) {
-    if (object == NULL) {
-        __android_log_print(ANDROID_LOG_ERROR, "vf", "drawGLObject object was null");
-        return;
-    }
-    assert(object != NULL);
 
-    glVertexPointer(object->vertexComponents, GL_FIXED,
-                    0, object->vertexArray);
-    glColorPointer(4, GL_UNSIGNED_BYTE, 0, object->colorArray);
+/* buildFrame as a FIELDWORKERUPDATE, timed as one field update. Called on
+ * the field worker thread, on frames whose buffer objects the render
+ * thread has deleted, so no GL calls are made.
+ */
+static int updateFrame(void *slot, long tick, void *userData) {
+    long long start = profileNow();
+    int result = buildFrame((FIELDFRAME *) slot, tick, (THREADPOOL *) userData);
+    profileRecordSince(PROFILE_STAGE_FIELD_UPDATE, start);
+    return result;
+}
 
-//     Already done in initialization:
-//    glEnableClientState(GL_VERTEX_ARRAY);
-//    glEnableClientState(GL_COLOR_ARRAY);
 
-    if (object->normalArray) {
-        glNormalPointer(GL_FIXED, 0, object->normalArray);
-        glEnableClientState(GL_NORMAL_ARRAY);
-    }
-    else
-        glDisableClientState(GL_NORMAL_ARRAY);
-    glDrawArrays(GL_TRIANGLES, 0, object->count);
+/* Loads a keyframe of the played back sequence on its loader thread. The
+ * demo has no recorded sequence, so the keyframes are sampled from the
+ * expression, which stands in for reading them from storage.
+ */
+static int loadKeyframe(FIELD *field, int keyframe, void *userData) {
+    (void) userData;
+    fieldEvaluateExpression(field, sExpression, keyframe * sKeyframeInterval * 0.001f);
+    return 1;
 }
 
-static void assignNormal(int pi, GLOBJECT *result) {
-    int i;
-    __android_log_print(ANDROID_LOG_DEBUG, "vf", "assign normal to triangle %d", pi/3+1);
-    VECTOR3 r1, r2, r3, v1, v2, n;
-
-    r1.x = result->vertexArray[pi * 3];
-    r1.y = result->vertexArray[pi * 3 + 1];
-    r1.z = result->vertexArray[pi * 3 + 2];
-
-    r2.x = result->vertexArray[pi * 3 + 3];
-    r2.y = result->vertexArray[pi * 3 + 4];
-    r2.z = result->vertexArray[pi * 3 + 5];
-
-    r3.x = result->vertexArray[pi * 3 + 6];
-    r3.y = result->vertexArray[pi * 3 + 7];
-    r3.z = result->vertexArray[pi * 3 + 8];
-
-//    __android_log_print(ANDROID_LOG_DEBUG, "vf", "r1 = (%2.2f, %2.2f, %2.2f)",
-//                        r1.x, r1.y, r1.z);
-//    __android_log_print(ANDROID_LOG_DEBUG, "vf", "r2 = (%2.2f, %2.2f, %2.2f)",
-//                        r2.x, r2.y, r2.z);
-//    __android_log_print(ANDROID_LOG_DEBUG, "vf", "r3 = (%2.2f, %2.2f, %2.2f)",
-//                        r3.x, r3.y, r3.z);
-
-    vector3Sub(&v1, &r2, &r1);
-    vector3Sub(&v2, &r3, &r2);
-
-//    __android_log_print(ANDROID_LOG_DEBUG, "vf", "v1 = (%2.2f, %2.2f, %2.2f)",
-//                        v1.x, v1.y, v1.z);
-//    __android_log_print(ANDROID_LOG_DEBUG, "vf", "v2 = (%2.2f, %2.2f, %2.2f)",
-//                        v2.x, v2.y, v2.z);
-//
-//    __android_log_print(ANDROID_LOG_DEBUG, "vf", "n.x = %2.2f * %2.2f - %2.2f * %2.2f",
-//                        v1.y, v2.z, v1.z, v2.y);
-//    __android_log_print(ANDROID_LOG_DEBUG, "vf", "n.y = %2.2f * %2.2f - %2.2f * %2.2f",
-//                        v1.z, v2.x, v1.x, v2.z);
-//    __android_log_print(ANDROID_LOG_DEBUG, "vf", "n.z = %2.2f * %2.2f - %2.2f * %2.2f",
-//                        v1.x, v2.y, v1.y, v2.x);
-
-    n.x = v1.y * v2.z - v1.z * v2.y;
-    n.y = v1.z * v2.x - v1.x * v2.z;
-    n.z = v1.x * v2.y - v1.y * v2.x;
-
-    float mag = (float) sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
-    if (mag) {
-        n.x /= mag;
-        n.y /= mag;
-        n.z /= mag;
+
+/* Allocates the arrays that buildFieldProducts fills for the field of
+ * frame. Returns 0 on failure.
+ */
+static int allocateFieldProducts(FIELDFRAME *frame) {
+    const FIELD *field = &frame->field;
+    if ((needsAnalysis() && !fieldAnalysisInit(&frame->analysis, field)) ||
+        (sIsosurfaceQuantity == APP_COLOR_MAGNITUDE &&
+         !scalarFieldInit(&frame->magnitude, field->nx, field->ny, field->nz, field->origin,
+                          field->spacing)) ||
+        // The same noise in every frame, so that only the flow moves.
+        (sLicAxis >= 0 && !licSliceInit(&frame->lic, LIC_SLICE_SIZE, LIC_SLICE_SIZE, 1))) {
+        LOGE(FIELD, "cannot allocate the field");
+        return 0;
     }
+    return 1;
+}
 
-    float nvector[3] = {n.x, n.y, n.z};
 
-    for (i = 0; i < 3; i++) {
-        result->normalArray[pi * 3 + i] = (GLfixed) nvector[i];
+/* Maps the field file and, unless its samples are in grid order already,
+ * copies them into sFileField. VTK files are imported into sFileField
+ * instead. Returns 0 on failure.
+ */
+static int openFieldFile() {
+    const FIELD *mapped = &sFieldFile.field;
+    const char *extension = strrchr(sFieldPath, '.');
+    if (extension != NULL && (strcmp(extension, ".vtk") == 0 || strcmp(extension, ".vti") == 0))
+        return vtkImportField(&sFileField, sFieldPath, NULL, sThreadPool);
+    if (!fieldFileOpen(&sFieldFile, sFieldPath))
+        return 0;
+    if (mapped->x != NULL) {
+        sFileField = *mapped;
+        return 1;
     }
-    __android_log_print(ANDROID_LOG_DEBUG, "vf", "normal for triangle %d = (%2.2f, %2.2f, %2.2f)",
-                        pi / 3 + 1, nvector[0], nvector[1], nvector[2]);
+    if (!fieldInit(&sFileField, mapped->nx, mapped->ny, mapped->nz, mapped->origin,
+                   mapped->spacing) ||
+        !fieldFileLoad(&sFieldFile, &sFileField)) {
+        fieldDeinit(&sFileField);
+        return 0;
+    }
+    return 1;
 }
 
-static GLOBJECT *createBox(long x, long y, long z, long w, long l, long h) {
-    const long triangleCount = 12;
-    const long vertices = triangleCount * 3;
-    GLOBJECT *result;
-
-    long p[8][3] = {{x,     y,     z},
-                    {x + w, y,     z},
-                    {x + w, y + l, z},
-                    {x,     y + l, z},
-                    {x,     y,     z + h},
-                    {x + w, y,     z + h},
-                    {x + w, y + l, z + h},
-                    {x,     y + l, z + h}};
-
-    result = newGLObject(vertices, 3, 1);
-
-    assignVertex(1, 0, result, p);
-    assignVertex(2, 1, result, p);
-    assignVertex(6, 2, result, p);
-    assignNormal(0, result);
-
-    assignVertex(6, 3, result, p);
-    assignVertex(5, 4, result, p);
-    assignVertex(1, 5, result, p);
-    assignNormal(3, result);
-
-    assignVertex(2, 6, result, p);
-    assignVertex(3, 7, result, p);
-    assignVertex(7, 8, result, p);
-    assignNormal(6, result);
-
-    assignVertex(7, 9, result, p);
-    assignVertex(6, 10, result, p);
-    assignVertex(2, 11, result, p);
-    assignNormal(9, result);
-
-    assignVertex(3, 12, result, p);
-    assignVertex(4, 13, result, p);
-    assignVertex(8, 14, result, p);
-    assignNormal(12, result);
-
-//    assignVertex(8, 15, result, p);
-//    assignVertex(7, 16, result, p);
-//    assignVertex(3, 17, result, p);
-//    assignNormal(15, result);
-
-    assignVertex(4, 18, result, p);
-    assignVertex(1, 19, result, p);
-    assignVertex(5, 20, result, p);
-    assignNormal(18, result);
-
-    assignVertex(5, 21, result, p);
-    assignVertex(8, 22, result, p);
-    assignVertex(4, 23, result, p);
-    assignNormal(21, result);
-
-    assignVertex(5, 24, result, p);
-    assignVertex(6, 25, result, p);
-    assignVertex(7, 26, result, p);
-    assignNormal(24, result);
-
-//    assignVertex(7, 27, result, p);
-//    assignVertex(8, 28, result, p);
-//    assignVertex(5, 29, result, p);
-//    assignNormal(27, result);
-
-    assignVertex(2, 30, result, p);
-    assignVertex(1, 31, result, p);
-    assignVertex(4, 32, result, p);
-    assignNormal(30, result);
-
-    assignVertex(4, 33, result, p);
-    assignVertex(3, 34, result, p);
-    assignVertex(2, 35, result, p);
-    assignNormal(33, result);
 
-    return result;
+/* Sets up the demo field, computes its first frame and starts the field
+ * worker that keeps it up to date.
+ */
+static void createField() {
+    static const float demoOrigin[3] = {-2, -2, -2};
+    static const float demoSpacing[3] = {0.25f, 0.25f, 0.25f};
+    const float *origin = demoOrigin, *spacing = demoSpacing;
+    void *slots[FIELDWORKER_SLOTS];
+    char error[128];
+    float *seed = sSeeds;
+    float extent[3];
+    int nx = 17, ny = 17, nz = 17;
+    int i, j, k;
+
+    memset(sFrames, 0, sizeof(sFrames));
+    sFrame = &sFrames[0];
+    if (sFieldPath != NULL) {
+        if (!openFieldFile()) {
+            LOGE(FIELD, "cannot load %s", sFieldPath);
+            return;
+        }
+        if (sSparseTolerance >= 0 || sKeyframeCount > 0)
+            LOGW(FIELD, "the sparse grid and keyframes are not used with a field file");
+        sSparseTolerance = -1;
+        sKeyframeCount = 0;
+        nx = sFileField.nx;
+        ny = sFileField.ny;
+        nz = sFileField.nz;
+        origin = sFileField.origin;
+        spacing = sFileField.spacing;
+    }
+    memset(&sFileFrame, 0, sizeof(sFileFrame));
+    if (sFileField.x != NULL) {
+        sFileFrame.field = sFileField;
+        arenaInit(&sFileFrame.scene, SCENE_ARENA_BLOCK);
+        if (!allocateFieldProducts(&sFileFrame))
+            return;
+    }
+    for (i = 0; i < FIELDWORKER_SLOTS; i++) {
+        arenaInit(&sFrames[i].scene, SCENE_ARENA_BLOCK);
+        if (sFileField.x != NULL)
+            sFrames[i].field = sFileField;
+        else if (!fieldInit(&sFrames[i].field, nx, ny, nz, origin, spacing)) {
+            LOGE(FIELD, "cannot allocate the field");
+            return;
+        }
+        if (!octreeFieldInit(&sFrames[i].octree, nx, ny, nz, origin, spacing)) {
+            LOGE(FIELD, "cannot allocate the field");
+            return;
+        }
+        if (productFrame(&sFrames[i]) == &sFrames[i] && !allocateFieldProducts(&sFrames[i]))
+            return;
+        slots[i] = &sFrames[i];
+    }
+    sExpression = fieldCompileExpression("-y", "x", "0.5 * sin(2 * z + t)",
+                                         error, sizeof(error));
+    if (sExpression == NULL) {
+        LOGE(FIELD, "%s", error);
+        return;
+    }
+    if (sKeyframeCount > 0 && sSparseTolerance < 0) {
+        sSequence = fieldSequenceCreate(nx, ny, nz, origin, spacing, sKeyframeCount,
+                                        KEYFRAME_RING, loadKeyframe, NULL);
+        if (sSequence == NULL || !fieldSequenceWait(sSequence, 0)) {
+            LOGE(FIELD, "cannot load the first keyframes");
+            return;
+        }
+    }
 
-}
+    glyphParamsDefault(&sGlyphParams, &sFrame->field);
+    streamlineParamsDefault(&sStreamlineParams, &sFrame->field);
+    isosurfaceParamsDefault(&sIsosurfaceParams, &productFrame(sFrame)->magnitude);
+    sIsosurfaceParams.isovalue = sIsovalue;
+    licParamsDefault(&sLicParams);
+    // Seeds fill the grid box less a sixteenth of it on each side.
+    extent[0] = (nx - 1) * spacing[0];
+    extent[1] = (ny - 1) * spacing[1];
+    extent[2] = (nz - 1) * spacing[2];
+    for (k = 0; k < SEEDS_Z; k++) {
+        for (j = 0; j < SEEDS_Y; j++) {
+            for (i = 0; i < SEEDS_X; i++) {
+                *seed++ = origin[0] + extent[0] * (0.0625f + 0.875f * (i + 0.5f) / SEEDS_X);
+                *seed++ = origin[1] + extent[1] * (0.0625f + 0.875f * (j + 0.5f) / SEEDS_Y);
+                *seed++ = origin[2] + extent[2] * (0.0625f + 0.875f * (k + 0.5f) / SEEDS_Z);
+            }
+        }
+    }
 
+    if (sFileField.x != NULL) {
+        if (!buildFieldProducts(&sFileFrame, sThreadPool))
+            return;
+        streamlineSetCreateBuffers(&sFileFrame.streamlines);
+        isosurfaceCreateBuffers(&sFileFrame.isosurface);
+        licSliceCreateTexture(&sFileFrame.lic);
+    }
+    if (!updateFrame(sFrame, 0, sThreadPool))
+        return;
+    glyphSetCreateBuffers(&sFrame->glyphs);
+    streamlineSetCreateBuffers(&sFrame->streamlines);
+    isosurfaceCreateBuffers(&sFrame->isosurface);
+    licSliceCreateTexture(&sFrame->lic);
+
+    // Sized from the first frame, whose magnitudes are known by now.
+    if (sParticleCount > 0 && sSparseTolerance < 0) {
+        PARTICLEPARAMS particleParams;
+        particleParamsDefault(&particleParams, &sFrame->field);
+        particleParams.trailLength = sParticleTrail;
+        if (!particleSystemInit(&sParticles, sParticleCount, sSeeds, SEED_COUNT,
+                                &particleParams))
+            LOGE(FIELD, "cannot allocate the particles");
+    }
 
-static void drawBox(int i) {
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ZERO, GL_SRC_COLOR);
-    glDisable(GL_LIGHTING);
+    sFieldWorker = fieldWorkerCreate(slots, updateFrame, sThreadPool, 0);
+    if (sFieldWorker == NULL)
+        LOGW(FIELD, "no field worker, the field stays at its first frame");
+}
 
-    drawGLObject(sBoxes[i]);
 
-    glEnable(GL_LIGHTING);
-    glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
+/* Moves to the newest frame computed by the field worker, if any. The
+ * buffer and texture objects of the frame going back to the worker are
+ * deleted first. A file field does not change with the tick, so the
+ * worker is only asked for new glyphs when the view or the density
+ * changes.
+ */
+static void swapFieldFrame(long tick) {
+    if (sFieldWorker == NULL)
+        return;
+    if (sFileField.x == NULL)
+        fieldWorkerRequest(sFieldWorker, tick);
+    if (!fieldWorkerPending(sFieldWorker))
+        return;
+    glyphSetDeleteBuffers(&sFrame->glyphs);
+    streamlineSetDeleteBuffers(&sFrame->streamlines);
+    isosurfaceDeleteBuffers(&sFrame->isosurface);
+    licSliceDeleteTexture(&sFrame->lic);
+    sFrame = (FIELDFRAME *) fieldWorkerSwap(sFieldWorker);
+    glyphSetCreateBuffers(&sFrame->glyphs);
+    streamlineSetCreateBuffers(&sFrame->streamlines);
+    isosurfaceCreateBuffers(&sFrame->isosurface);
+    licSliceCreateTexture(&sFrame->lic);
 }
 
 
@@ -351,20 +522,134 @@ void appInit() {
 
 //    seedRandom(15);
 
-    int i;
-    for (i = 0; i < NUMBOXES; i++) {
-        sBoxes[i] = createBox(i, i, i, 2, 2, 2);
-        assert(sBoxes[i] != NULL);
-    }
+    arenaInit(&sFrameArena, FRAME_ARENA_BLOCK);
+    cameraInit(&sCamera, sEye, sTarget, sUp);
+    lodControllerInit(&sLod, sFrameTargetMs);
+    sDensity = sLod.density;
+    sScreenScale = 0;
+    sLodWaiting = 0;
+    sThreadPool = threadPoolCreate(0);
+    if (sThreadPool == NULL)
+        LOGW(APP, "no thread pool, tracing on one thread only");
+
+    createField();
 }
 
 
 // Called from the app framework.
 void appDeinit() {
-    int a;
-    for (a = 0; a < NUMBOXES; a++) {
-        freeGLObject(sBoxes[a]);
+    int i;
+    // Stop the worker before freeing the frames it writes to.
+    fieldWorkerDestroy(sFieldWorker);
+    sFieldWorker = NULL;
+    fieldSequenceDestroy(sSequence);
+    sSequence = NULL;
+    streamlineSetDeinit(&sFileFrame.streamlines);
+    isosurfaceDeinit(&sFileFrame.isosurface);
+    licSliceDeinit(&sFileFrame.lic);
+    arenaDeinit(&sFileFrame.scene);
+    fieldAnalysisDeinit(&sFileFrame.analysis);
+    scalarFieldDeinit(&sFileFrame.magnitude);
+    memset(&sFileFrame, 0, sizeof(sFileFrame));
+    for (i = 0; i < FIELDWORKER_SLOTS; i++) {
+        streamlineSetDeinit(&sFrames[i].streamlines);
+        glyphSetDeinit(&sFrames[i].glyphs);
+        isosurfaceDeinit(&sFrames[i].isosurface);
+        licSliceDeinit(&sFrames[i].lic);
+        arenaDeinit(&sFrames[i].scene);
+        // Frames share the arrays of a file field, freed below.
+        if (sFileField.x != NULL)
+            memset(&sFrames[i].field, 0, sizeof(FIELD));
+        fieldDeinit(&sFrames[i].field);
+        octreeFieldDeinit(&sFrames[i].octree);
+        fieldAnalysisDeinit(&sFrames[i].analysis);
+        scalarFieldDeinit(&sFrames[i].magnitude);
     }
+    particleSystemDeinit(&sParticles);
+    if (sFileField.x != sFieldFile.field.x)
+        fieldDeinit(&sFileField);
+    memset(&sFileField, 0, sizeof(FIELD));
+    fieldFileClose(&sFieldFile);
+    arenaDeinit(&sFrameArena);
+    fieldFreeExpression(sExpression);
+    sExpression = NULL;
+    threadPoolDestroy(sThreadPool);
+    sThreadPool = NULL;
+    cameraDeinit(&sCamera);
+}
+
+
+/* Publishes a new density or screen scale for the glyphs, when either
+ * changed enough to be worth a rebuild. Returns non-zero when it did.
+ */
+static int updateGlyphDensity(float density, float screenScale) {
+    float oldDensity, oldScale;
+    __atomic_load(&sDensity, &oldDensity, __ATOMIC_RELAXED);
+    __atomic_load(&sScreenScale, &oldScale, __ATOMIC_RELAXED);
+    if (fabsf(density - oldDensity) <= LOD_REBUILD_CHANGE * oldDensity &&
+        fabsf(screenScale - oldScale) <= LOD_REBUILD_CHANGE * oldScale)
+        return 0;
+    __atomic_store(&sDensity, &density, __ATOMIC_RELAXED);
+    __atomic_store(&sScreenScale, &screenScale, __ATOMIC_RELAXED);
+    if (sFieldWorker != NULL)
+        fieldWorkerInvalidate(sFieldWorker);
+    LOGD(RENDER, "glyph density %.3f at %.1f pixels per unit", density, screenScale);
+    return 1;
+}
+
+
+void appSetFrameTarget(float milliseconds) {
+    sFrameTargetMs = milliseconds;
+}
+
+
+float appGetDensity() {
+    return sLod.density;
+}
+
+
+void appSetSparseField(float tolerance) {
+    sSparseTolerance = tolerance;
+}
+
+
+void appSetGlyphColoring(int quantity) {
+    sGlyphColoring = quantity;
+}
+
+
+void appSetIsosurface(int quantity, float isovalue) {
+    sIsosurfaceQuantity = quantity;
+    sIsovalue = isovalue;
+}
+
+
+void appSetLicSlice(int axis, float position) {
+    sLicAxis = axis;
+    sLicPosition = position;
+}
+
+
+void appSetKeyframes(int count, long interval) {
+    sKeyframeCount = count;
+    sKeyframeInterval = interval;
+}
+
+
+void appSetFieldFile(const char *path) {
+    sFieldPath = path;
+}
+
+
+void appSetParticles(int count, int trailLength) {
+    sParticleCount = count;
+    sParticleTrail = trailLength;
+}
+
+
+// Called from the app framework, possibly on another thread than appRender.
+void appTouch(int action, float x, float y) {
+    cameraTouch(&sCamera, action, x, y);
 }
 
 
@@ -377,6 +662,15 @@ static void gluPerspective(GLfloat fovy, GLfloat aspect,
     xmin = ymin * aspect;
     xmax = ymax * aspect;
 
+    memset(sProjection, 0, sizeof(sProjection));
+    sProjection[0] = 2 * zNear / (xmax - xmin);
+    sProjection[5] = 2 * zNear / (ymax - ymin);
+    sProjection[8] = (xmax + xmin) / (xmax - xmin);
+    sProjection[9] = (ymax + ymin) / (ymax - ymin);
+    sProjection[10] = -(zFar + zNear) / (zFar - zNear);
+    sProjection[11] = -1;
+    sProjection[14] = -2 * zFar * zNear / (zFar - zNear);
+
     glFrustumx((GLfixed) (xmin * 65536), (GLfixed) (xmax * 65536),
                (GLfixed) (ymin * 65536), (GLfixed) (ymax * 65536),
                (GLfixed) (zNear * 65536), (GLfixed) (zFar * 65536));
@@ -393,7 +687,7 @@ static void prepareFrame(int width, int height) {
 
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(45, (float) width / height, 0.5f, 150);
+    gluPerspective(FIELD_OF_VIEW, (float) width / height, 0.5f, 150);
 
     glMatrixMode(GL_MODELVIEW);
 
@@ -423,96 +717,6 @@ static void configureLightAndMaterial() {
 }
 
 
-/* Following gluLookAt implementation is adapted from the
- * Mesa 3D Graphics library. http://www.mesa3d.org
- */
-static void gluLookAt(GLfloat eyex, GLfloat eyey, GLfloat eyez,
-                      GLfloat centerx, GLfloat centery, GLfloat centerz,
-                      GLfloat upx, GLfloat upy, GLfloat upz) {
-    GLfloat m[16];
-    GLfloat x[3], y[3], z[3];
-    GLfloat mag;
-
-    /* Make rotation matrix */
-
-    /* Z vector */
-    z[0] = eyex - centerx;
-    z[1] = eyey - centery;
-    z[2] = eyez - centerz;
-    mag = (float) sqrt(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
-    if (mag) {            /* mpichler, 19950515 */
-        z[0] /= mag;
-        z[1] /= mag;
-        z[2] /= mag;
-    }
-
-    /* Y vector */
-    y[0] = upx;
-    y[1] = upy;
-    y[2] = upz;
-
-    /* X vector = Y cross Z */
-    x[0] = y[1] * z[2] - y[2] * z[1];
-    x[1] = -y[0] * z[2] + y[2] * z[0];
-    x[2] = y[0] * z[1] - y[1] * z[0];
-
-    /* Recompute Y = Z cross X */
-    y[0] = z[1] * x[2] - z[2] * x[1];
-    y[1] = -z[0] * x[2] + z[2] * x[0];
-    y[2] = z[0] * x[1] - z[1] * x[0];
-
-    /* mpichler, 19950515 */
-    /* cross product gives area of parallelogram, which is < 1.0 for
-     * non-perpendicular unit-length vectors; so normalize x, y here
-     */
-
-    mag = (float) sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
-    if (mag) {
-        x[0] /= mag;
-        x[1] /= mag;
-        x[2] /= mag;
-    }
-
-    mag = (float) sqrt(y[0] * y[0] + y[1] * y[1] + y[2] * y[2]);
-    if (mag) {
-        y[0] /= mag;
-        y[1] /= mag;
-        y[2] /= mag;
-    }
-
-#define M(row, col)  m[col*4+row]
-    M(0, 0) = x[0];
-    M(0, 1) = x[1];
-    M(0, 2) = x[2];
-    M(0, 3) = 0.0;
-    M(1, 0) = y[0];
-    M(1, 1) = y[1];
-    M(1, 2) = y[2];
-    M(1, 3) = 0.0;
-    M(2, 0) = z[0];
-    M(2, 1) = z[1];
-    M(2, 2) = z[2];
-    M(2, 3) = 0.0;
-    M(3, 0) = 0.0;
-    M(3, 1) = 0.0;
-    M(3, 2) = 0.0;
-    M(3, 3) = 1.0;
-#undef M
-    {
-        int a;
-        GLfixed fixedM[16];
-        for (a = 0; a < 16; ++a)
-            fixedM[a] = (GLfixed) (m[a] * 65536);
-        glMultMatrixx(fixedM);
-    }
-
-    /* Translate Eye to Origin */
-    glTranslatex((GLfixed) (-eyex * 65536),
-                 (GLfixed) (-eyey * 65536),
-                 (GLfixed) (-eyez * 65536));
-}
-
-
 static void paintGL() {
 
     GLfloat object[] = {
@@ -542,6 +746,9 @@ static void paintGL() {
  * are the image dimensions to be rendered.
  */
 void appRender(long tick, int width, int height) {
+    long long frameStart, stageStart, interval = 0;
+    FRUSTUM frustum;
+
     if (sStartTick == 0)
         sStartTick = tick;
     if (!gAppAlive)
@@ -556,22 +763,77 @@ void appRender(long tick, int width, int height) {
         return;
     }
 
+    arenaReset(&sFrameArena);
+
+    frameStart = profileNow();
+    if (sLastFrameStart != 0) {
+        interval = frameStart - sLastFrameStart;
+        profileRecord(PROFILE_STAGE_FRAME_INTERVAL, interval);
+    }
+    sLastFrameStart = frameStart;
+
+    // Pick up the newest field state; the worker computes the next one.
+    swapFieldFrame(sTick);
+    particleSystemStep(&sParticles, &sFrame->field);
+
     // Prepare OpenGL ES for rendering of the frame.
+    stageStart = profileNow();
     prepareFrame(width, height);
 
-    // Update the camera position and set the lookat.
-    gluLookAt(5, -5, 5, 0, 0, 0, 0, 0, 1);
+    // Apply the touch input, if any, and set the cached view matrix. The
+    // glyphs of a file field are only rebuilt for a new view.
+    if (cameraUpdate(&sCamera) && sFileField.x != NULL && sFieldWorker != NULL)
+        fieldWorkerInvalidate(sFieldWorker);
+    cameraApply(&sCamera);
+    profileRecordSince(PROFILE_STAGE_PREPARE_FRAME, stageStart);
 
     // Configure environment.
+    stageStart = profileNow();
     configureLightAndMaterial();
+    profileRecordSince(PROFILE_STAGE_LIGHTING, stageStart);
 
+    stageStart = profileNow();
     paintGL();
 
-    // Create the box.
-    int i;
-    for (i = 0; i < NUMBOXES; i++) {
-        __android_log_print(ANDROID_LOG_DEBUG, "vf", "drawing box");
-        drawBox(i);
+    // Draw the parts of the field inside the view.
+    frustumFromMatrices(&frustum, sProjection, sCamera.modelview);
+    memset(&sGlyphCull, 0, sizeof(CULLSTATS));
+    memset(&sStreamlineCull, 0, sizeof(CULLSTATS));
+    drawGlyphSet(&sFrame->glyphs, &frustum, &sFrameArena, &sGlyphCull);
+    drawStreamlineSet(&productFrame(sFrame)->streamlines, &frustum, &sFrameArena,
+                      &sStreamlineCull);
+    drawIsosurface(&productFrame(sFrame)->isosurface);
+    drawLicSlice(&productFrame(sFrame)->lic);
+    drawParticleSystem(&sParticles);
+    LOGV(RENDER, "glyph clusters: %ld drawn, %ld culled; streamline segments: %ld drawn, "
+         "%ld culled", sGlyphCull.clustersDrawn, sGlyphCull.clustersCulled,
+         sStreamlineCull.clustersDrawn, sStreamlineCull.clustersCulled);
+    profileRecordSince(PROFILE_STAGE_DRAW, stageStart);
+
+    profileRecordSince(PROFILE_STAGE_FRAME, frameStart);
+
+    // Steer the glyph density toward the frame time target, once the
+    // glyphs of the last change are in.
+    if (sFrame->density == sDensity && sFrame->screenScale == sScreenScale) {
+        if (sLodWaiting) {
+            lodControllerRestart(&sLod);
+            sLodWaiting = 0;
+        }
+        else
+            lodControllerUpdate(&sLod, interval * 1e-6f, (profileNow() - frameStart) * 1e-6f);
+        sLodWaiting = updateGlyphDensity(sLod.density,
+                                         height / 2 / tanf(FIELD_OF_VIEW * PI / 360));
     }
+}
+
+
+void appGetCullStats(CULLSTATS *glyphs, CULLSTATS *streamlines) {
+    *glyphs = sGlyphCull;
+    *streamlines = sStreamlineCull;
+}
+
 
+void appGetArenaStats(ARENASTATS *scene, ARENASTATS *frame) {
+    arenaGetStats(&sFrame->scene, scene);
+    arenaGetStats(&sFrameArena, frame);
 }
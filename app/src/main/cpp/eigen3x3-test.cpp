@@ -0,0 +1,274 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+/* Checks the closed forms of eigen3x3.h against the iterative solvers of
+ * Eigen, run in double, within the tolerances eigen3x3.h states: every
+ * error within 1e-2 of the matrix norm, and the mean error of random
+ * matrices within 1e-4 of it. Prints the worst errors and exits with a
+ * failure status when a bound is broken.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <complex>
+
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+#include <Eigen/Geometry>
+
+#include "eigen3x3.h"
+
+
+using Eigen::Matrix3d;
+using Eigen::Matrix3f;
+using Eigen::Vector3d;
+
+typedef std::complex<double> Complex;
+
+#define MAX_ERROR   1e-2
+#define MEAN_ERROR  1e-4
+
+#define RANDOM_COUNT    20000
+// Not a multiple of the packet size, so the batches have a scalar tail.
+#define BATCH_COUNT     4099
+
+// Error of one set of cases relative to the matrix norms.
+typedef struct {
+    const char *name;
+    double max;
+    double total;
+    long count;
+} ERRORSTATS;
+
+
+static unsigned sRandom = 2463534242u;
+
+// Uniform in [-1, 1].
+static double randomUnit() {
+    sRandom ^= sRandom << 13;
+    sRandom ^= sRandom >> 17;
+    sRandom ^= sRandom << 5;
+    return sRandom / 2147483647.5 - 1;
+}
+
+static Matrix3d randomRotation() {
+    Eigen::Quaterniond q(randomUnit(), randomUnit(), randomUnit(), randomUnit());
+    q.normalize();
+    return q.toRotationMatrix();
+}
+
+static Matrix3f randomMatrix(bool symmetric) {
+    double scale = pow(10.0, 2 * randomUnit());
+    Matrix3d m;
+    int r, c;
+    for (r = 0; r < 3; r++)
+        for (c = 0; c < 3; c++)
+            m(r, c) = scale * randomUnit();
+    if (symmetric)
+        return ((m + m.transpose()) / 2).cast<float>();
+    return m.cast<float>();
+}
+
+
+/* Largest distance between matching values, the match being the
+ * permutation that minimizes it.
+ */
+static double matchError(const Complex found[3], const Complex expected[3]) {
+    static const int permutations[6][3] = {
+        {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+    };
+    double best = HUGE_VAL;
+    int p, i;
+    for (p = 0; p < 6; p++) {
+        double worst = 0;
+        for (i = 0; i < 3; i++)
+            worst = std::max(worst, std::abs(found[i] - expected[permutations[p][i]]));
+        best = std::min(best, worst);
+    }
+    return best;
+}
+
+static void addError(ERRORSTATS *stats, const Matrix3f &m, const Complex found[3],
+                     const Complex expected[3]) {
+    double norm = std::max((double) m.norm(), 1e-30);
+    double error = matchError(found, expected) / norm;
+    stats->max = std::max(stats->max, error);
+    stats->total += error;
+    stats->count++;
+}
+
+static void referenceGeneral(const Matrix3f &m, Complex values[3]) {
+    Eigen::EigenSolver<Matrix3d> solver(m.cast<double>(), false);
+    int i;
+    for (i = 0; i < 3; i++)
+        values[i] = solver.eigenvalues()(i);
+}
+
+static void referenceSymmetric(const Matrix3f &m, Complex values[3]) {
+    Eigen::SelfAdjointEigenSolver<Matrix3d> solver(m.cast<double>(), Eigen::EigenvaluesOnly);
+    int i;
+    for (i = 0; i < 3; i++)
+        values[i] = solver.eigenvalues()(i);
+}
+
+// Row major copy, as eigen3x3.h takes matrices.
+static void rowMajor(const Matrix3f &m, float out[9]) {
+    int r, c;
+    for (r = 0; r < 3; r++)
+        for (c = 0; c < 3; c++)
+            out[3 * r + c] = m(r, c);
+}
+
+static void checkGeneral(ERRORSTATS *stats, const Matrix3f &m) {
+    float a[9], real[3], imaginary[3];
+    Complex found[3], expected[3];
+    int i;
+    rowMajor(m, a);
+    eigen3x3(a, real, imaginary);
+    for (i = 0; i < 3; i++)
+        found[i] = Complex(real[i], imaginary[i]);
+    referenceGeneral(m, expected);
+    addError(stats, m, found, expected);
+}
+
+static void checkSymmetric(ERRORSTATS *stats, const Matrix3f &m) {
+    float a[9], values[3];
+    Complex found[3], expected[3];
+    int i;
+    rowMajor(m, a);
+    eigen3x3Symmetric(a, values);
+    for (i = 0; i < 3; i++)
+        found[i] = values[i];
+    referenceSymmetric(m, expected);
+    addError(stats, m, found, expected);
+    // Out of order counts as a failure.
+    if (values[0] > values[1] || values[1] > values[2])
+        stats->max = HUGE_VAL;
+}
+
+
+/* Matrices with a triple or nearly repeated root: a multiple of the
+ * identity, a rotated Jordan block, and rotated diagonals whose values
+ * are delta apart.
+ */
+static Matrix3f repeatedRoots(int kind, double delta) {
+    double value = 4 * randomUnit();
+    Matrix3d q = randomRotation(), d = Matrix3d::Identity() * value;
+    if (kind == 0)
+        return d.cast<float>();
+    if (kind == 1) {
+        d(0, 1) = 1;
+        d(1, 2) = 1;
+    }
+    else {
+        d(1, 1) += delta;
+        d(2, 2) += 2 * delta;
+    }
+    return (q * d * q.transpose()).cast<float>();
+}
+
+static void checkBatch(ERRORSTATS *general, ERRORSTATS *symmetric) {
+    static float storage[2][9][BATCH_COUNT];
+    static float results[6][BATCH_COUNT];
+    static Matrix3f matrices[2][BATCH_COUNT];
+    const float *m[2][9];
+    float *real[3] = {results[0], results[1], results[2]};
+    float *imaginary[3] = {results[3], results[4], results[5]};
+    long n;
+    int s, e, i;
+
+    for (s = 0; s < 2; s++) {
+        for (n = 0; n < BATCH_COUNT; n++) {
+            float a[9];
+            matrices[s][n] = randomMatrix(s == 1);
+            rowMajor(matrices[s][n], a);
+            for (e = 0; e < 9; e++)
+                storage[s][e][n] = a[e];
+        }
+        for (e = 0; e < 9; e++)
+            m[s][e] = storage[s][e];
+    }
+
+    eigen3x3Batch(m[0], BATCH_COUNT, real, imaginary);
+    for (n = 0; n < BATCH_COUNT; n++) {
+        Complex found[3], expected[3];
+        for (i = 0; i < 3; i++)
+            found[i] = Complex(real[i][n], imaginary[i][n]);
+        referenceGeneral(matrices[0][n], expected);
+        addError(general, matrices[0][n], found, expected);
+    }
+    eigen3x3SymmetricBatch(m[1], BATCH_COUNT, real);
+    for (n = 0; n < BATCH_COUNT; n++) {
+        Complex found[3], expected[3];
+        for (i = 0; i < 3; i++)
+            found[i] = real[i][n];
+        referenceSymmetric(matrices[1][n], expected);
+        addError(symmetric, matrices[1][n], found, expected);
+    }
+}
+
+
+// Prints the stats and returns whether they are within the bounds.
+static bool report(const ERRORSTATS *stats, bool random) {
+    double mean = stats->total / stats->count;
+    bool ok = stats->max <= MAX_ERROR && (!random || mean <= MEAN_ERROR);
+    printf("%-28s %6ld matrices, max %.2e, mean %.2e %s\n", stats->name, stats->count,
+           stats->max, mean, ok ? "" : "FAILED");
+    return ok;
+}
+
+int main() {
+    static const double deltas[] = {1e-2, 1e-3, 1e-4, 1e-5, 1e-6};
+    ERRORSTATS general = {"general random", 0, 0, 0};
+    ERRORSTATS symmetric = {"symmetric random", 0, 0, 0};
+    ERRORSTATS generalRepeated = {"general repeated roots", 0, 0, 0};
+    ERRORSTATS symmetricRepeated = {"symmetric repeated roots", 0, 0, 0};
+    ERRORSTATS generalBatch = {"general batch", 0, 0, 0};
+    ERRORSTATS symmetricBatch = {"symmetric batch", 0, 0, 0};
+    bool ok = true;
+    int n, kind;
+    size_t d;
+
+    for (n = 0; n < RANDOM_COUNT; n++) {
+        checkGeneral(&general, randomMatrix(false));
+        checkSymmetric(&symmetric, randomMatrix(true));
+    }
+    for (n = 0; n < 200; n++) {
+        for (kind = 0; kind < 3; kind++) {
+            for (d = 0; d < sizeof(deltas) / sizeof(deltas[0]); d++) {
+                Matrix3f m = repeatedRoots(kind, deltas[d]);
+                checkGeneral(&generalRepeated, m);
+                // The Jordan block is not symmetric.
+                if (kind != 1)
+                    checkSymmetric(&symmetricRepeated, m);
+            }
+        }
+    }
+    checkBatch(&generalBatch, &symmetricBatch);
+
+    ok = report(&general, true) && ok;
+    ok = report(&symmetric, true) && ok;
+    ok = report(&generalRepeated, false) && ok;
+    ok = report(&symmetricRepeated, false) && ok;
+    ok = report(&generalBatch, true) && ok;
+    ok = report(&symmetricBatch, true) && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
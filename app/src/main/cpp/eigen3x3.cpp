@@ -0,0 +1,217 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <math.h>
+
+#include <Eigen/Core>
+
+#include "eigen3x3.h"
+
+
+using namespace Eigen::internal;
+
+typedef packet_traits<float>::type Packet;
+enum { PACKET_SIZE = packet_traits<float>::size };
+
+#define EIGEN3X3_SQRT3_2    0.8660254037844386f
+#define EIGEN3X3_TWO_PI_3   2.0943951023931955f
+
+
+/* Polynomial coefficients, on packets or plain floats: the generic Eigen
+ * packet functions take floats too, which the single matrix functions and
+ * the batch tails use.
+ */
+
+/* Depressed form t^3 + p t + q of the characteristic polynomial of a,
+ * whose roots are the eigenvalues less shift, and its discriminant
+ * (q / 2)^2 + (p / 3)^3, positive when there is a complex pair.
+ */
+template <typename P>
+static void generalCoefficients(const P a[9], P *shift, P *p, P *q, P *discriminant) {
+    const P third = pset1<P>(1.0f / 3);
+    P trace = padd(padd(a[0], a[4]), a[8]);
+    // Sum of the principal 2x2 minors.
+    P minors = psub(padd(padd(pmul(a[0], a[4]), pmul(a[0], a[8])), pmul(a[4], a[8])),
+                    padd(padd(pmul(a[1], a[3]), pmul(a[2], a[6])), pmul(a[5], a[7])));
+    P determinant = padd(psub(pmul(a[0], psub(pmul(a[4], a[8]), pmul(a[5], a[7]))),
+                              pmul(a[1], psub(pmul(a[3], a[8]), pmul(a[5], a[6])))),
+                         pmul(a[2], psub(pmul(a[3], a[7]), pmul(a[4], a[6]))));
+    P halfQ, thirdP;
+
+    *shift = pmul(trace, third);
+    *p = psub(minors, pmul(trace, *shift));
+    // -2 trace^3 / 27 + trace minors / 3 - determinant.
+    *q = psub(pmul(*shift, psub(minors, pmul(pset1<P>(2), pmul(*shift, *shift)))), determinant);
+    halfQ = pmul(*q, pset1<P>(0.5f));
+    thirdP = pmul(*p, third);
+    *discriminant = padd(pmul(halfQ, halfQ), pmul(thirdP, pmul(thirdP, thirdP)));
+}
+
+/* For a symmetric a: the mean of the eigenvalues, six times their
+ * variance and the determinant of a - mean I.
+ */
+template <typename P>
+static void symmetricCoefficients(const P a[9], P *mean, P *spread, P *determinant) {
+    P d0, d1, d2, offDiagonal;
+    *mean = pmul(padd(padd(a[0], a[4]), a[8]), pset1<P>(1.0f / 3));
+    d0 = psub(a[0], *mean);
+    d1 = psub(a[4], *mean);
+    d2 = psub(a[8], *mean);
+    offDiagonal = padd(padd(pmul(a[1], a[1]), pmul(a[2], a[2])), pmul(a[5], a[5]));
+    *spread = padd(padd(padd(pmul(d0, d0), pmul(d1, d1)), pmul(d2, d2)),
+                   padd(offDiagonal, offDiagonal));
+    *determinant = padd(psub(pmul(d0, psub(pmul(d1, d2), pmul(a[5], a[5]))),
+                             pmul(a[1], psub(pmul(a[1], d2), pmul(a[5], a[2])))),
+                        pmul(a[2], psub(pmul(a[1], a[5]), pmul(d1, a[2]))));
+}
+
+
+/* Roots. There are no packet versions of acos and cbrt, so these run per
+ * matrix.
+ */
+
+static void generalRoots(float shift, float p, float q, float discriminant,
+                         float *real, float *imaginary) {
+    float r, angle;
+    if (discriminant > 0) {
+        // Cardano, with the larger cube root taken directly and the other
+        // from their product -p / 3 to avoid cancellation.
+        float s = sqrtf(discriminant);
+        float u = -copysignf(cbrtf(fabsf(q) / 2 + s), q);
+        float v = u != 0 ? -p / (3 * u) : 0;
+        real[0] = shift + u + v;
+        real[1] = real[2] = shift - (u + v) / 2;
+        imaginary[0] = 0;
+        imaginary[1] = EIGEN3X3_SQRT3_2 * fabsf(u - v);
+        imaginary[2] = -imaginary[1];
+        return;
+    }
+    imaginary[0] = imaginary[1] = imaginary[2] = 0;
+    if (p >= 0) {
+        // A triple root.
+        real[0] = real[1] = real[2] = shift;
+        return;
+    }
+    r = sqrtf(-p / 3);
+    angle = -q / (2 * r * r * r);
+    angle = acosf(angle < -1 ? -1 : angle > 1 ? 1 : angle) / 3;
+    real[0] = shift + 2 * r * cosf(angle + EIGEN3X3_TWO_PI_3);
+    real[1] = shift + 2 * r * cosf(angle - EIGEN3X3_TWO_PI_3);
+    real[2] = shift + 2 * r * cosf(angle);
+}
+
+static void symmetricRoots(float mean, float spread, float determinant, float *values) {
+    float p = sqrtf(spread / 6), r, angle;
+    if (p == 0) {
+        values[0] = values[1] = values[2] = mean;
+        return;
+    }
+    r = determinant / (2 * p * p * p);
+    angle = acosf(r < -1 ? -1 : r > 1 ? 1 : r) / 3;
+    values[2] = mean + 2 * p * cosf(angle);
+    values[0] = mean + 2 * p * cosf(angle + EIGEN3X3_TWO_PI_3);
+    values[1] = 3 * mean - values[0] - values[2];
+    // Rounding can put it just outside the others for nearly equal roots.
+    values[1] = values[1] < values[0] ? values[0] : values[1] > values[2] ? values[2] : values[1];
+}
+
+
+void eigen3x3(const float m[9], float real[3], float imaginary[3]) {
+    float shift, p, q, discriminant;
+    generalCoefficients(m, &shift, &p, &q, &discriminant);
+    generalRoots(shift, p, q, discriminant, real, imaginary);
+}
+
+void eigen3x3Symmetric(const float m[9], float values[3]) {
+    // Mirror the upper triangle.
+    const float a[9] = {m[0], m[1], m[2], m[1], m[4], m[5], m[2], m[5], m[8]};
+    float mean, spread, determinant;
+    symmetricCoefficients(a, &mean, &spread, &determinant);
+    symmetricRoots(mean, spread, determinant, values);
+}
+
+
+void eigen3x3Batch(const float *const m[9], long count,
+                   float *const real[3], float *const imaginary[3]) {
+    EIGEN_ALIGN16 float shift[PACKET_SIZE], p[PACKET_SIZE], q[PACKET_SIZE];
+    EIGEN_ALIGN16 float discriminant[PACKET_SIZE];
+    float lanesReal[3], lanesImaginary[3];
+    long n = 0;
+    int i, k;
+
+    for (; n + PACKET_SIZE <= count; n += PACKET_SIZE) {
+        Packet a[9], packetShift, packetP, packetQ, packetDiscriminant;
+        for (k = 0; k < 9; k++)
+            a[k] = ploadu<Packet>(m[k] + n);
+        generalCoefficients(a, &packetShift, &packetP, &packetQ, &packetDiscriminant);
+        pstore(shift, packetShift);
+        pstore(p, packetP);
+        pstore(q, packetQ);
+        pstore(discriminant, packetDiscriminant);
+        for (i = 0; i < PACKET_SIZE; i++) {
+            generalRoots(shift[i], p[i], q[i], discriminant[i], lanesReal, lanesImaginary);
+            for (k = 0; k < 3; k++) {
+                real[k][n + i] = lanesReal[k];
+                imaginary[k][n + i] = lanesImaginary[k];
+            }
+        }
+    }
+    for (; n < count; n++) {
+        float a[9];
+        for (k = 0; k < 9; k++)
+            a[k] = m[k][n];
+        eigen3x3(a, lanesReal, lanesImaginary);
+        for (k = 0; k < 3; k++) {
+            real[k][n] = lanesReal[k];
+            imaginary[k][n] = lanesImaginary[k];
+        }
+    }
+}
+
+void eigen3x3SymmetricBatch(const float *const m[9], long count, float *const values[3]) {
+    // Upper triangle, mirrored.
+    static const int mirror[9] = {0, 1, 2, 1, 4, 5, 2, 5, 8};
+    EIGEN_ALIGN16 float mean[PACKET_SIZE], spread[PACKET_SIZE], determinant[PACKET_SIZE];
+    float lanes[3];
+    long n = 0;
+    int i, k;
+
+    for (; n + PACKET_SIZE <= count; n += PACKET_SIZE) {
+        Packet a[9], packetMean, packetSpread, packetDeterminant;
+        for (k = 0; k < 9; k++)
+            a[k] = ploadu<Packet>(m[mirror[k]] + n);
+        symmetricCoefficients(a, &packetMean, &packetSpread, &packetDeterminant);
+        pstore(mean, packetMean);
+        pstore(spread, packetSpread);
+        pstore(determinant, packetDeterminant);
+        for (i = 0; i < PACKET_SIZE; i++) {
+            symmetricRoots(mean[i], spread[i], determinant[i], lanes);
+            for (k = 0; k < 3; k++)
+                values[k][n + i] = lanes[k];
+        }
+    }
+    for (; n < count; n++) {
+        float a[9];
+        for (k = 0; k < 9; k++)
+            a[k] = m[mirror[k]][n];
+        eigen3x3Symmetric(a, lanes);
+        for (k = 0; k < 3; k++)
+            values[k][n] = lanes[k];
+    }
+}
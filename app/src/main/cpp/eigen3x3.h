@@ -0,0 +1,72 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef EIGEN3X3_H_INCLUDED
+#define EIGEN3X3_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Closed form eigenvalues of 3x3 matrices, for per sample use where the
+ * iterative solvers of Eigen cost too much. Matrices are row major, m[3 *
+ * r + c]. They are found as the roots of the characteristic cubic:
+ * Cardano's formula when there is one real root and a complex pair, the
+ * trigonometric form when all three are real.
+ *
+ * In float the results are typically within 1e-4 of the matrix norm of
+ * the values of the iterative solvers. Nearly repeated roots lose more,
+ * about 2e-3 and at most 1e-2 of the norm for a triple root, as with any
+ * closed form. eigen3x3-test checks both bounds.
+ */
+
+
+/* Eigenvalues of a general matrix. When there is a complex pair, the real
+ * root comes first, then the pair with the positive imaginary part first;
+ * otherwise the values are in ascending order with zero imaginary parts.
+ */
+extern void eigen3x3(const float m[9], float real[3], float imaginary[3]);
+
+/* Eigenvalues of a symmetric matrix in ascending order. Only the upper
+ * triangle is read.
+ */
+extern void eigen3x3Symmetric(const float m[9], float values[3]);
+
+/* eigen3x3 for count matrices stored as nine component arrays, matrix n
+ * being m[0][n] .. m[8][n]. The characteristic polynomials are computed
+ * on SIMD packets four matrices at a time.
+ */
+extern void eigen3x3Batch(const float *const m[9], long count,
+                          float *const real[3], float *const imaginary[3]);
+
+/* eigen3x3Symmetric for count matrices stored as nine component arrays.
+ */
+extern void eigen3x3SymmetricBatch(const float *const m[9], long count,
+                                   float *const values[3]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !EIGEN3X3_H_INCLUDED
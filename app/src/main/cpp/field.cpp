@@ -0,0 +1,791 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+#include "field.h"
+#include "log.h"
+
+
+using namespace Eigen::internal;
+
+/* Native float packet: Packet4f with SSE or NEON, a plain float when
+ * Eigen is built without vectorization.
+ */
+typedef packet_traits<float>::type Packet;
+enum { PACKET_SIZE = packet_traits<float>::size };
+
+
+#define FIELDEXPR_MAX_OPS       128
+#define FIELDEXPR_MAX_STACK     16
+
+enum {
+    OP_CONST,
+    OP_X,
+    OP_Y,
+    OP_Z,
+    OP_T,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_NEG,
+    OP_POWI,    // Integer power of the top of stack, exponent in value.
+    OP_SIN,
+    OP_COS,
+    OP_EXP,
+    OP_LOG,
+    OP_SQRT,
+    OP_ABS
+};
+
+typedef struct {
+    int op;
+    float value;
+} FIELDOP;
+
+// Postfix program of one component expression.
+typedef struct {
+    FIELDOP ops[FIELDEXPR_MAX_OPS];
+    int opCount;
+    int depth;
+    int maxDepth;
+} FIELDPROGRAM;
+
+struct FIELDEXPR {
+    FIELDPROGRAM components[3];
+};
+
+
+/* Expression compiler */
+
+typedef struct {
+    const char *source;
+    const char *p;
+    FIELDPROGRAM *program;
+    char *error;
+    int errorSize;
+    int failed;
+} FIELDPARSER;
+
+static void parseError(FIELDPARSER *parser, const char *message) {
+    if (parser->failed)
+        return;
+    parser->failed = 1;
+    if (parser->error && parser->errorSize > 0)
+        snprintf(parser->error, parser->errorSize, "%s at offset %d in \"%s\"",
+                 message, (int) (parser->p - parser->source), parser->source);
+}
+
+static int isBinaryOp(int op) {
+    return op >= OP_ADD && op <= OP_POW;
+}
+
+static float evaluateScalar(int op, float a, float b, float value) {
+    switch (op) {
+        case OP_ADD:
+            return a + b;
+        case OP_SUB:
+            return a - b;
+        case OP_MUL:
+            return a * b;
+        case OP_DIV:
+            return a / b;
+        case OP_POW:
+            return powf(a, b);
+        case OP_NEG:
+            return -a;
+        case OP_POWI:
+            return powf(a, value);
+        case OP_SIN:
+            return sinf(a);
+        case OP_COS:
+            return cosf(a);
+        case OP_EXP:
+            return expf(a);
+        case OP_LOG:
+            return logf(a);
+        case OP_SQRT:
+            return sqrtf(a);
+        default:
+            return fabsf(a);
+    }
+}
+
+/* Appends an operation, folding it into a constant when all of its
+ * operands are constants.
+ */
+static void emit(FIELDPARSER *parser, int op, float value) {
+    FIELDPROGRAM *program = parser->program;
+    FIELDOP *ops = program->ops;
+    int n = program->opCount;
+
+    if (parser->failed)
+        return;
+    if (op > OP_T) {
+        int operands = isBinaryOp(op) ? 2 : 1;
+        if (n >= operands && ops[n - 1].op == OP_CONST &&
+            (operands == 1 || ops[n - 2].op == OP_CONST)) {
+            float a = ops[n - operands].value;
+            float b = ops[n - 1].value;
+            ops[n - operands].value = evaluateScalar(op, a, b, value);
+            program->opCount -= operands - 1;
+            program->depth -= operands - 1;
+            return;
+        }
+    }
+    if (n == FIELDEXPR_MAX_OPS) {
+        parseError(parser, "expression too long");
+        return;
+    }
+    ops[n].op = op;
+    ops[n].value = value;
+    program->opCount++;
+    if (op <= OP_T)
+        program->depth++;
+    else if (isBinaryOp(op))
+        program->depth--;
+    if (program->depth > program->maxDepth)
+        program->maxDepth = program->depth;
+    if (program->maxDepth > FIELDEXPR_MAX_STACK)
+        parseError(parser, "expression nested too deeply");
+}
+
+static void skipSpace(FIELDPARSER *parser) {
+    while (isspace((unsigned char) *parser->p))
+        parser->p++;
+}
+
+static int accept(FIELDPARSER *parser, char c) {
+    skipSpace(parser);
+    if (*parser->p != c)
+        return 0;
+    parser->p++;
+    return 1;
+}
+
+static void parseSum(FIELDPARSER *parser);
+static void parseUnary(FIELDPARSER *parser);
+
+static const struct {
+    const char *name;
+    int op;
+} sFunctions[] = {
+        {"sin",  OP_SIN},
+        {"cos",  OP_COS},
+        {"exp",  OP_EXP},
+        {"log",  OP_LOG},
+        {"sqrt", OP_SQRT},
+        {"abs",  OP_ABS},
+};
+
+static void parseIdentifier(FIELDPARSER *parser) {
+    const char *start = parser->p;
+    size_t length;
+    unsigned int f;
+
+    while (isalnum((unsigned char) *parser->p) || *parser->p == '_')
+        parser->p++;
+    length = parser->p - start;
+
+    if (length == 1 && (*start == 'x' || *start == 'y' || *start == 'z' || *start == 't')) {
+        static const int variables[] = {OP_X, OP_Y, OP_Z};
+        emit(parser, *start == 't' ? OP_T : variables[*start - 'x'], 0);
+        return;
+    }
+    if (length == 2 && strncmp(start, "pi", 2) == 0) {
+        emit(parser, OP_CONST, 3.14159265358979f);
+        return;
+    }
+    if (length == 1 && *start == 'e') {
+        emit(parser, OP_CONST, 2.71828182845905f);
+        return;
+    }
+    for (f = 0; f < sizeof(sFunctions) / sizeof(sFunctions[0]); f++) {
+        if (strlen(sFunctions[f].name) == length &&
+            strncmp(start, sFunctions[f].name, length) == 0) {
+            if (!accept(parser, '(')) {
+                parseError(parser, "expected '('");
+                return;
+            }
+            parseSum(parser);
+            if (!accept(parser, ')')) {
+                parseError(parser, "expected ')'");
+                return;
+            }
+            emit(parser, sFunctions[f].op, 0);
+            return;
+        }
+    }
+    parser->p = start;
+    parseError(parser, "unknown identifier");
+}
+
+static void parsePrimary(FIELDPARSER *parser) {
+    skipSpace(parser);
+    if (isdigit((unsigned char) *parser->p) || *parser->p == '.') {
+        char *end;
+        float value = strtof(parser->p, &end);
+        if (end == parser->p) {
+            parseError(parser, "bad number");
+            return;
+        }
+        parser->p = end;
+        emit(parser, OP_CONST, value);
+    }
+    else if (isalpha((unsigned char) *parser->p))
+        parseIdentifier(parser);
+    else if (accept(parser, '(')) {
+        parseSum(parser);
+        if (!accept(parser, ')'))
+            parseError(parser, "expected ')'");
+    }
+    else
+        parseError(parser, "expected a value");
+}
+
+// power := primary ('^' unary)?, right associative.
+static void parsePower(FIELDPARSER *parser) {
+    FIELDPROGRAM *program = parser->program;
+    parsePrimary(parser);
+    if (!accept(parser, '^'))
+        return;
+    parseUnary(parser);
+    if (parser->failed)
+        return;
+    // Small integer exponents become repeated multiplication.
+    if (program->ops[program->opCount - 1].op == OP_CONST) {
+        float exponent = program->ops[program->opCount - 1].value;
+        if (exponent == floorf(exponent) && exponent >= 0 && exponent <= 16) {
+            program->opCount--;
+            program->depth--;
+            emit(parser, OP_POWI, exponent);
+            return;
+        }
+    }
+    emit(parser, OP_POW, 0);
+}
+
+static void parseUnary(FIELDPARSER *parser) {
+    if (accept(parser, '-')) {
+        parseUnary(parser);
+        emit(parser, OP_NEG, 0);
+    }
+    else if (accept(parser, '+'))
+        parseUnary(parser);
+    else
+        parsePower(parser);
+}
+
+static void parseProduct(FIELDPARSER *parser) {
+    parseUnary(parser);
+    while (!parser->failed) {
+        if (accept(parser, '*')) {
+            parseUnary(parser);
+            emit(parser, OP_MUL, 0);
+        }
+        else if (accept(parser, '/')) {
+            parseUnary(parser);
+            emit(parser, OP_DIV, 0);
+        }
+        else
+            break;
+    }
+}
+
+static void parseSum(FIELDPARSER *parser) {
+    parseProduct(parser);
+    while (!parser->failed) {
+        if (accept(parser, '+')) {
+            parseProduct(parser);
+            emit(parser, OP_ADD, 0);
+        }
+        else if (accept(parser, '-')) {
+            parseProduct(parser);
+            emit(parser, OP_SUB, 0);
+        }
+        else
+            break;
+    }
+}
+
+static int compileProgram(FIELDPROGRAM *program, const char *source,
+                          char *error, int errorSize) {
+    FIELDPARSER parser;
+    memset(program, 0, sizeof(FIELDPROGRAM));
+    parser.source = parser.p = source;
+    parser.program = program;
+    parser.error = error;
+    parser.errorSize = errorSize;
+    parser.failed = 0;
+
+    parseSum(&parser);
+    skipSpace(&parser);
+    if (*parser.p != '\0')
+        parseError(&parser, "unexpected character");
+    return !parser.failed;
+}
+
+
+/* Packet evaluation
+ *
+ * Programs run one operation at a time over a whole grid row, so the
+ * interpreter dispatch is paid once per row and operation rather than
+ * once per packet. Each stack slot holds a row of packets.
+ */
+
+/* Applies a math function to each lane separately, for functions without
+ * a packet implementation on the target.
+ */
+static void lanewise(int op, Packet *a, const Packet *b, float value, int packets) {
+    EIGEN_ALIGN16 float lanesA[PACKET_SIZE];
+    EIGEN_ALIGN16 float lanesB[PACKET_SIZE];
+    int n, i;
+    for (n = 0; n < packets; n++) {
+        pstore(lanesA, a[n]);
+        if (b)
+            pstore(lanesB, b[n]);
+        for (i = 0; i < PACKET_SIZE; i++)
+            lanesA[i] = evaluateScalar(op, lanesA[i], b ? lanesB[i] : 0, value);
+        a[n] = pload<Packet>(lanesA);
+    }
+}
+
+// Picks the Eigen packet function when the target has one.
+#define PACKET_FUNCTION(name, function, op) \
+    template <bool Vectorized> struct name { \
+        static void run(Packet *a, int packets) { \
+            lanewise(op, a, NULL, 0, packets); \
+        } \
+    }; \
+    template <> struct name<true> { \
+        static void run(Packet *a, int packets) { \
+            int n; \
+            for (n = 0; n < packets; n++) \
+                a[n] = function(a[n]); \
+        } \
+    };
+
+PACKET_FUNCTION(PacketSin, psin, OP_SIN)
+PACKET_FUNCTION(PacketCos, pcos, OP_COS)
+PACKET_FUNCTION(PacketExp, pexp, OP_EXP)
+PACKET_FUNCTION(PacketLog, plog, OP_LOG)
+PACKET_FUNCTION(PacketSqrt, psqrt, OP_SQRT)
+
+#undef PACKET_FUNCTION
+
+static Packet powi(Packet base, int exponent) {
+    Packet result = pset1<Packet>(1.0f);
+    while (exponent > 0) {
+        if (exponent & 1)
+            result = pmul(result, base);
+        base = pmul(base, base);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+/* Runs the program over one row of packets. The stack holds
+ * FIELDEXPR_MAX_STACK rows; the result is left in the first one.
+ */
+static void evaluateRow(const FIELDPROGRAM *program, Packet *stack, int packets,
+                        const Packet *px, const Packet &py, const Packet &pz,
+                        const Packet &pt) {
+    Packet *top = stack - packets;
+    int i, n;
+
+    for (i = 0; i < program->opCount; i++) {
+        const FIELDOP *op = &program->ops[i];
+        Packet *a, *b;
+        if (op->op <= OP_T)
+            top += packets;
+        else if (isBinaryOp(op->op))
+            top -= packets;
+        a = top;
+        b = top + packets;
+
+        switch (op->op) {
+            case OP_CONST: {
+                const Packet value = pset1<Packet>(op->value);
+                for (n = 0; n < packets; n++)
+                    a[n] = value;
+                break;
+            }
+            case OP_X:
+                memcpy(a, px, packets * sizeof(Packet));
+                break;
+            case OP_Y:
+            case OP_Z:
+            case OP_T: {
+                const Packet value = op->op == OP_Y ? py : (op->op == OP_Z ? pz : pt);
+                for (n = 0; n < packets; n++)
+                    a[n] = value;
+                break;
+            }
+            case OP_ADD:
+                for (n = 0; n < packets; n++)
+                    a[n] = padd(a[n], b[n]);
+                break;
+            case OP_SUB:
+                for (n = 0; n < packets; n++)
+                    a[n] = psub(a[n], b[n]);
+                break;
+            case OP_MUL:
+                for (n = 0; n < packets; n++)
+                    a[n] = pmul(a[n], b[n]);
+                break;
+            case OP_DIV:
+                for (n = 0; n < packets; n++)
+                    a[n] = pdiv(a[n], b[n]);
+                break;
+            case OP_POW:
+                lanewise(OP_POW, a, b, 0, packets);
+                break;
+            case OP_NEG:
+                for (n = 0; n < packets; n++)
+                    a[n] = pnegate(a[n]);
+                break;
+            case OP_POWI:
+                for (n = 0; n < packets; n++)
+                    a[n] = powi(a[n], (int) op->value);
+                break;
+            case OP_SIN:
+                PacketSin<packet_traits<float>::HasSin>::run(a, packets);
+                break;
+            case OP_COS:
+                PacketCos<packet_traits<float>::HasCos>::run(a, packets);
+                break;
+            case OP_EXP:
+                PacketExp<packet_traits<float>::HasExp>::run(a, packets);
+                break;
+            case OP_LOG:
+                PacketLog<packet_traits<float>::HasLog>::run(a, packets);
+                break;
+            case OP_SQRT:
+                PacketSqrt<packet_traits<float>::HasSqrt>::run(a, packets);
+                break;
+            default:
+                for (n = 0; n < packets; n++)
+                    a[n] = pabs(a[n]);
+                break;
+        }
+    }
+}
+
+
+/* Field storage */
+
+static float *allocateComponent(long count) {
+    long padded = (count + FIELD_PACKET_SIZE - 1) & ~(long) (FIELD_PACKET_SIZE - 1);
+    float *array = (float *) aligned_malloc(padded * sizeof(float));
+    if (array != NULL)
+        memset(array, 0, padded * sizeof(float));
+    return array;
+}
+
+int fieldSpacingValid(const float spacing[3]) {
+    int a;
+    for (a = 0; a < 3; a++) {
+        if (!(spacing[a] > 0) || !isfinite(spacing[a]))
+            return 0;
+    }
+    return 1;
+}
+
+int fieldInit(FIELD *field, int nx, int ny, int nz,
+              const float origin[3], const float spacing[3]) {
+    int a;
+    memset(field, 0, sizeof(FIELD));
+    if (nx <= 0 || ny <= 0 || nz <= 0)
+        return 0;
+    field->nx = nx;
+    field->ny = ny;
+    field->nz = nz;
+    field->count = (long) nx * ny * nz;
+    for (a = 0; a < 3; a++) {
+        field->origin[a] = origin[a];
+        field->spacing[a] = spacing[a];
+    }
+    field->x = allocateComponent(field->count);
+    field->y = allocateComponent(field->count);
+    field->z = allocateComponent(field->count);
+    if (field->x == NULL || field->y == NULL || field->z == NULL) {
+        fieldDeinit(field);
+        return 0;
+    }
+    return 1;
+}
+
+void fieldDeinit(FIELD *field) {
+    aligned_free(field->x);
+    aligned_free(field->y);
+    aligned_free(field->z);
+    memset(field, 0, sizeof(FIELD));
+}
+
+
+int scalarFieldInit(SCALARFIELD *field, int nx, int ny, int nz,
+                    const float origin[3], const float spacing[3]) {
+    int a;
+    memset(field, 0, sizeof(SCALARFIELD));
+    if (nx <= 0 || ny <= 0 || nz <= 0)
+        return 0;
+    field->nx = nx;
+    field->ny = ny;
+    field->nz = nz;
+    field->count = (long) nx * ny * nz;
+    for (a = 0; a < 3; a++) {
+        field->origin[a] = origin[a];
+        field->spacing[a] = spacing[a];
+    }
+    field->values = allocateComponent(field->count);
+    if (field->values == NULL) {
+        scalarFieldDeinit(field);
+        return 0;
+    }
+    return 1;
+}
+
+void scalarFieldDeinit(SCALARFIELD *field) {
+    aligned_free(field->values);
+    memset(field, 0, sizeof(SCALARFIELD));
+}
+
+void scalarFieldRange(const SCALARFIELD *field, float *minimum, float *maximum) {
+    long n = 0, packets = field->count - field->count % PACKET_SIZE;
+    float lo = HUGE_VALF, hi = -HUGE_VALF;
+
+    if (packets > 0) {
+        Packet packetLo = pset1<Packet>(HUGE_VALF);
+        Packet packetHi = pset1<Packet>(-HUGE_VALF);
+        for (; n < packets; n += PACKET_SIZE) {
+            Packet value = pload<Packet>(field->values + n);
+            packetLo = pmin(packetLo, value);
+            packetHi = pmax(packetHi, value);
+        }
+        lo = predux_min(packetLo);
+        hi = predux_max(packetHi);
+    }
+    for (; n < field->count; n++) {
+        if (field->values[n] < lo)
+            lo = field->values[n];
+        if (field->values[n] > hi)
+            hi = field->values[n];
+    }
+    *minimum = field->count > 0 ? lo : 0;
+    *maximum = field->count > 0 ? hi : 0;
+}
+
+
+FIELDEXPR *fieldCompileExpression(const char *x, const char *y, const char *z,
+                                  char *error, int errorSize) {
+    const char *sources[3] = {x, y, z};
+    FIELDEXPR *expression;
+    int c;
+
+    expression = (FIELDEXPR *) malloc(sizeof(FIELDEXPR));
+    if (expression == NULL) {
+        if (error && errorSize > 0)
+            snprintf(error, errorSize, "out of memory");
+        return NULL;
+    }
+    for (c = 0; c < 3; c++) {
+        if (!compileProgram(&expression->components[c], sources[c], error, errorSize)) {
+            LOGW(FIELD, "cannot compile field component %d: \"%s\"", c, sources[c]);
+            free(expression);
+            return NULL;
+        }
+    }
+    return expression;
+}
+
+void fieldFreeExpression(FIELDEXPR *expression) {
+    free(expression);
+}
+
+
+void fieldEvaluateExpression(FIELD *field, const FIELDEXPR *expression, float t) {
+    const Packet pt = pset1<Packet>(t);
+    const int packets = (field->nx + PACKET_SIZE - 1) / PACKET_SIZE;
+    Packet *px, *stack;
+    int i, j, k, c;
+
+    px = (Packet *) aligned_malloc((1 + FIELDEXPR_MAX_STACK) * packets * sizeof(Packet));
+    if (px == NULL) {
+        LOGE(FIELD, "fieldEvaluateExpression: out of memory");
+        return;
+    }
+    stack = px + packets;
+    for (i = 0; i < packets; i++)
+        px[i] = padd(pset1<Packet>(field->origin[0] + i * PACKET_SIZE * field->spacing[0]),
+                     pmul(plset<float>(0), pset1<Packet>(field->spacing[0])));
+
+    for (k = 0; k < field->nz; k++) {
+        const Packet pz = pset1<Packet>(field->origin[2] + k * field->spacing[2]);
+        for (j = 0; j < field->ny; j++) {
+            const Packet py = pset1<Packet>(field->origin[1] + j * field->spacing[1]);
+            long row = FIELD_INDEX(field, 0, j, k);
+            float *out[3] = {field->x + row, field->y + row, field->z + row};
+
+            for (c = 0; c < 3; c++) {
+                evaluateRow(&expression->components[c], stack, packets, px, py, pz, pt);
+                for (i = 0; i + PACKET_SIZE <= field->nx; i += PACKET_SIZE)
+                    pstoreu(out[c] + i, stack[i / PACKET_SIZE]);
+                if (i < field->nx) {
+                    // Row tail: keep only the valid lanes of the last packet.
+                    EIGEN_ALIGN16 float lanes[PACKET_SIZE];
+                    pstore(lanes, stack[i / PACKET_SIZE]);
+                    memcpy(out[c] + i, lanes, (field->nx - i) * sizeof(float));
+                }
+            }
+        }
+    }
+    aligned_free(px);
+}
+
+
+void fieldEvaluateCallback(FIELD *field, FIELDCALLBACK callback, void *userData, float t) {
+    float *positions;
+    float *px, *py, *pz;
+    int i, j, k;
+
+    positions = (float *) aligned_malloc(3 * field->nx * sizeof(float));
+    if (positions == NULL) {
+        LOGE(FIELD, "fieldEvaluateCallback: out of memory");
+        return;
+    }
+    px = positions;
+    py = positions + field->nx;
+    pz = positions + 2 * field->nx;
+    for (i = 0; i < field->nx; i++)
+        px[i] = field->origin[0] + i * field->spacing[0];
+
+    for (k = 0; k < field->nz; k++) {
+        float z = field->origin[2] + k * field->spacing[2];
+        for (i = 0; i < field->nx; i++)
+            pz[i] = z;
+        for (j = 0; j < field->ny; j++) {
+            float y = field->origin[1] + j * field->spacing[1];
+            long row = FIELD_INDEX(field, 0, j, k);
+            for (i = 0; i < field->nx; i++)
+                py[i] = y;
+            callback(px, py, pz, t, field->x + row, field->y + row, field->z + row,
+                     field->nx, userData);
+        }
+    }
+    aligned_free(positions);
+}
+
+
+void fieldMagnitudeRange(const FIELD *field, float *minimum, float *maximum) {
+    long n = 0, packets = field->count - field->count % PACKET_SIZE;
+    float lo = HUGE_VALF, hi = 0;
+
+    if (packets > 0) {
+        Packet packetLo = pset1<Packet>(HUGE_VALF);
+        Packet packetHi = pset1<Packet>(0);
+        for (; n < packets; n += PACKET_SIZE) {
+            Packet x = pload<Packet>(field->x + n);
+            Packet y = pload<Packet>(field->y + n);
+            Packet z = pload<Packet>(field->z + n);
+            Packet squared = pmadd(x, x, pmadd(y, y, pmul(z, z)));
+            packetLo = pmin(packetLo, squared);
+            packetHi = pmax(packetHi, squared);
+        }
+        lo = predux_min(packetLo);
+        hi = predux_max(packetHi);
+    }
+    for (; n < field->count; n++) {
+        float squared = field->x[n] * field->x[n] + field->y[n] * field->y[n] +
+                        field->z[n] * field->z[n];
+        if (squared < lo)
+            lo = squared;
+        if (squared > hi)
+            hi = squared;
+    }
+    *minimum = field->count > 0 ? sqrtf(lo) : 0;
+    *maximum = sqrtf(hi);
+}
+
+void fieldMagnitude(const FIELD *field, SCALARFIELD *magnitude) {
+    // The arrays are padded to whole packets.
+    int packets = (int) ((field->count + PACKET_SIZE - 1) / PACKET_SIZE), n;
+    Packet *out = (Packet *) magnitude->values;
+    for (n = 0; n < packets; n++) {
+        Packet x = pload<Packet>(field->x + n * PACKET_SIZE);
+        Packet y = pload<Packet>(field->y + n * PACKET_SIZE);
+        Packet z = pload<Packet>(field->z + n * PACKET_SIZE);
+        out[n] = pmadd(x, x, pmadd(y, y, pmul(z, z)));
+    }
+    PacketSqrt<packet_traits<float>::HasSqrt>::run(out, packets);
+}
+
+
+void fieldMagnitudeColor(float t, unsigned char color[4]) {
+    color[0] = (unsigned char) (40 + t * 215);
+    color[1] = (unsigned char) (90 - t * 20);
+    color[2] = (unsigned char) (255 - t * 215);
+    color[3] = 255;
+}
+
+
+int fieldInterpolate(const FIELD *field, const float position[3], float vector[3]) {
+    float u = (position[0] - field->origin[0]) / field->spacing[0];
+    float v = (position[1] - field->origin[1]) / field->spacing[1];
+    float w = (position[2] - field->origin[2]) / field->spacing[2];
+    int i, j, k;
+    long n, dx, dy, dz;
+
+    // Also rejects NaN.
+    if (!(u >= 0 && u <= field->nx - 1 && v >= 0 && v <= field->ny - 1 &&
+          w >= 0 && w <= field->nz - 1))
+        return 0;
+    // The last sample plane belongs to the cell below it.
+    i = (int) u;
+    j = (int) v;
+    k = (int) w;
+    dx = i < field->nx - 1 ? 1 : 0;
+    dy = j < field->ny - 1 ? field->nx : 0;
+    dz = k < field->nz - 1 ? (long) field->nx * field->ny : 0;
+    u -= i;
+    v -= j;
+    w -= k;
+    n = FIELD_INDEX(field, i, j, k);
+
+#define LERP(a, b, t) ((a) + ((b) - (a)) * (t))
+#define TRILINEAR(c) \
+        LERP(LERP(LERP(c[0], c[dx], u), LERP(c[dy], c[dy + dx], u), v), \
+             LERP(LERP(c[dz], c[dz + dx], u), LERP(c[dz + dy], c[dz + dy + dx], u), v), w)
+    {
+        const float *x = field->x + n, *y = field->y + n, *z = field->z + n;
+        vector[0] = TRILINEAR(x);
+        vector[1] = TRILINEAR(y);
+        vector[2] = TRILINEAR(z);
+    }
+#undef TRILINEAR
+#undef LERP
+    return 1;
+}
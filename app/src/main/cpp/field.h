@@ -0,0 +1,161 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef FIELD_H_INCLUDED
+#define FIELD_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Alignment of the component arrays in bytes. Array lengths are padded to
+ * a multiple of FIELD_PACKET_SIZE so that whole packets can be loaded.
+ */
+#define FIELD_ALIGNMENT     16
+#define FIELD_PACKET_SIZE   4
+
+// Linear index of grid sample (i, j, k); i varies fastest.
+#define FIELD_INDEX(field, i, j, k) \
+        (((long) (k) * (field)->ny + (j)) * (field)->nx + (i))
+
+
+/* A 3D vector field sampled on a regular grid. Sample (i, j, k) lies at
+ * origin + (i, j, k) * spacing. The vector components are stored as
+ * structure of arrays: x[n], y[n] and z[n] hold the components of sample
+ * n = FIELD_INDEX(field, i, j, k).
+ */
+typedef struct {
+    int nx;
+    int ny;
+    int nz;
+    float origin[3];
+    float spacing[3];
+    float *x;
+    float *y;
+    float *z;
+    // Number of samples, nx * ny * nz.
+    long count;
+} FIELD;
+
+/* A scalar field on the same kind of lattice, such as a quantity derived
+ * from a FIELD. values[n] is the value of sample n.
+ */
+typedef struct {
+    int nx;
+    int ny;
+    int nz;
+    float origin[3];
+    float spacing[3];
+    float *values;
+    long count;
+} SCALARFIELD;
+
+/* Compiled form of an analytic field given as three expressions, one per
+ * component. Expressions use the sample position x, y, z and the time t,
+ * the constants pi and e, the operators + - * / ^ and the functions sin,
+ * cos, exp, log, sqrt and abs, for example "-y", "x", "0.1 * sin(t + z)".
+ */
+typedef struct FIELDEXPR FIELDEXPR;
+
+/* Evaluates the field at count positions given as separate coordinate
+ * arrays and stores the components to vx, vy and vz. Called once per grid
+ * row, so count is the row length nx.
+ */
+typedef void (*FIELDCALLBACK)(const float *px, const float *py, const float *pz,
+                              float t, float *vx, float *vy, float *vz,
+                              long count, void *userData);
+
+
+/* Returns non-zero when all three grid spacings are finite and positive,
+ * as the interpolation and the derivatives divide by them. Grids read
+ * from files are checked with this.
+ */
+extern int fieldSpacingValid(const float spacing[3]);
+
+/* Allocates the component arrays of an nx * ny * nz grid, zero filled.
+ * Returns non-zero on success and 0 on failure.
+ */
+extern int fieldInit(FIELD *field, int nx, int ny, int nz,
+                     const float origin[3], const float spacing[3]);
+
+/* Frees the component arrays.
+ */
+extern void fieldDeinit(FIELD *field);
+
+/* Allocates the values of an nx * ny * nz scalar grid, zero filled,
+ * padded like the FIELD component arrays. Returns non-zero on success and
+ * 0 on failure.
+ */
+extern int scalarFieldInit(SCALARFIELD *field, int nx, int ny, int nz,
+                           const float origin[3], const float spacing[3]);
+
+extern void scalarFieldDeinit(SCALARFIELD *field);
+
+/* Finds the smallest and largest value.
+ */
+extern void scalarFieldRange(const SCALARFIELD *field, float *minimum, float *maximum);
+
+/* Compiles the component expressions. On a syntax error NULL is returned
+ * and a description is written to error, which may be NULL.
+ */
+extern FIELDEXPR *fieldCompileExpression(const char *x, const char *y, const char *z,
+                                         char *error, int errorSize);
+
+extern void fieldFreeExpression(FIELDEXPR *expression);
+
+/* Samples the expression at every grid point at time t, evaluating
+ * FIELD_PACKET_SIZE points at a time with SIMD packets.
+ */
+extern void fieldEvaluateExpression(FIELD *field, const FIELDEXPR *expression, float t);
+
+/* Samples the callback at every grid point at time t.
+ */
+extern void fieldEvaluateCallback(FIELD *field, FIELDCALLBACK callback,
+                                  void *userData, float t);
+
+/* Finds the smallest and largest vector length of the samples.
+ */
+extern void fieldMagnitudeRange(const FIELD *field, float *minimum, float *maximum);
+
+/* Stores the vector length of every sample to magnitude, which must have
+ * the lattice of field.
+ */
+extern void fieldMagnitude(const FIELD *field, SCALARFIELD *magnitude);
+
+/* Maps a magnitude fraction t in [0, 1] from blue to red, as opaque RGBA.
+ * The glyphs, streamlines, particles and LIC slices share this ramp.
+ */
+extern void fieldMagnitudeColor(float t, unsigned char color[4]);
+
+/* Trilinearly interpolates the field at a position in field coordinates.
+ * Returns 0, leaving vector unchanged, when the position is outside the
+ * grid, otherwise non-zero.
+ */
+extern int fieldInterpolate(const FIELD *field, const float position[3], float vector[3]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !FIELD_H_INCLUDED
@@ -0,0 +1,250 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+/* Creates, converts and checks field files.
+ *
+ *   fieldfile-tool info FILE
+ *   fieldfile-tool check FILE
+ *   fieldfile-tool generate FILE N [--layout=L] [--brick=B] [--expr=X,Y,Z]
+ *   fieldfile-tool convert IN OUT [--layout=L] [--brick=B]
+ *   fieldfile-tool import IN OUT [--array=NAME] [--layout=L] [--brick=B]
+ *
+ * Generated fields are N samples per side over the demo cube, [-2, 2] on
+ * each axis. L is linear, the default, bricked or morton. import reads a
+ * legacy or XML VTK image file with vtkimport.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "fieldfile.h"
+#include "vtkimport.h"
+
+
+#define DEFAULT_BRICK_SIZE  8
+
+static const char *sLayoutNames[] = {"linear", "bricked", "morton"};
+
+
+static double nowMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+
+static void printUsage(const char *name)
+{
+    fprintf(stderr, "Usage: %s info FILE\n"
+            "       %s check FILE\n"
+            "       %s generate FILE N [--layout=linear|bricked|morton] [--brick=B] "
+            "[--expr=X,Y,Z]\n"
+            "       %s convert IN OUT [--layout=linear|bricked|morton] [--brick=B]\n"
+            "       %s import IN OUT [--array=NAME] [--layout=linear|bricked|morton] "
+            "[--brick=B]\n",
+            name, name, name, name, name);
+}
+
+
+/* Parses the options shared by generate and convert. Returns 0 when one
+ * is invalid.
+ */
+static int parseOptions(int argc, char *argv[], int *layout, int *brickSize,
+                        char expressions[3][256], const char **arrayName)
+{
+    int i, l;
+    for (i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--layout=", 9) == 0) {
+            for (l = 0; l < 3 && strcmp(argv[i] + 9, sLayoutNames[l]) != 0; l++)
+                ;
+            if (l == 3)
+                return 0;
+            *layout = l;
+        }
+        else if (strncmp(argv[i], "--brick=", 8) == 0)
+            *brickSize = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--expr=", 7) == 0 && expressions != NULL &&
+                 sscanf(argv[i] + 7, "%255[^,],%255[^,],%255[^,]",
+                        expressions[0], expressions[1], expressions[2]) == 3)
+            continue;
+        else if (strncmp(argv[i], "--array=", 8) == 0 && arrayName != NULL)
+            *arrayName = argv[i] + 8;
+        else
+            return 0;
+    }
+    return 1;
+}
+
+
+static int info(const char *path)
+{
+    FIELDFILE file;
+    const FIELDFILEHEADER *header = &file.header;
+    double start = nowMs();
+
+    if (!fieldFileOpen(&file, path))
+        return EXIT_FAILURE;
+    printf("opened in:      %.3f ms\n", nowMs() - start);
+    printf("version:        %u\n", header->version);
+    printf("grid:           %d x %d x %d\n", header->dims[0], header->dims[1],
+           header->dims[2]);
+    printf("origin:         %g %g %g\n", header->origin[0], header->origin[1],
+           header->origin[2]);
+    printf("spacing:        %g %g %g\n", header->spacing[0], header->spacing[1],
+           header->spacing[2]);
+    printf("layout:         %s", sLayoutNames[header->layout]);
+    if (header->layout != FIELDFILE_LINEAR)
+        printf(", %u^3 bricks", header->brickSize);
+    printf("\nsamples:        %llu per component\n",
+           (unsigned long long) header->sampleCount);
+    printf("file size:      %llu bytes\n", (unsigned long long) file.mappingSize);
+    fieldFileClose(&file);
+    return EXIT_SUCCESS;
+}
+
+
+static int check(const char *path)
+{
+    FIELDFILE file;
+    FIELD field;
+    float minimum, maximum;
+    double start;
+
+    if (!fieldFileOpen(&file, path))
+        return EXIT_FAILURE;
+    start = nowMs();
+    if (!fieldFileValidate(&file)) {
+        fieldFileClose(&file);
+        return EXIT_FAILURE;
+    }
+    printf("validated in:   %.1f ms\n", nowMs() - start);
+    // Unlike the checksum, the range needs the samples in grid order.
+    field = file.field;
+    if (field.x == NULL) {
+        if (!fieldInit(&field, field.nx, field.ny, field.nz, field.origin, field.spacing) ||
+            !fieldFileLoad(&file, &field)) {
+            fprintf(stderr, "Cannot load %s\n", path);
+            fieldDeinit(&field);
+            fieldFileClose(&file);
+            return EXIT_FAILURE;
+        }
+    }
+    fieldMagnitudeRange(&field, &minimum, &maximum);
+    printf("magnitude:      %g to %g\n", minimum, maximum);
+    if (field.x != file.field.x)
+        fieldDeinit(&field);
+    fieldFileClose(&file);
+    printf("%s is valid\n", path);
+    return EXIT_SUCCESS;
+}
+
+
+static int generate(const char *path, int size, int layout, int brickSize,
+                    char expressions[3][256])
+{
+    float origin[3] = {-2, -2, -2}, spacing[3];
+    FIELDEXPR *expression;
+    FIELD field;
+    char error[128];
+    int ok, a;
+
+    for (a = 0; a < 3; a++)
+        spacing[a] = 4.0f / (size - 1);
+    expression = fieldCompileExpression(expressions[0], expressions[1], expressions[2],
+                                        error, sizeof(error));
+    if (expression == NULL) {
+        fprintf(stderr, "%s\n", error);
+        return EXIT_FAILURE;
+    }
+    if (!fieldInit(&field, size, size, size, origin, spacing)) {
+        fprintf(stderr, "Cannot allocate a %d^3 field\n", size);
+        fieldFreeExpression(expression);
+        return EXIT_FAILURE;
+    }
+    fieldEvaluateExpression(&field, expression, 0);
+    ok = fieldFileWrite(path, &field, layout, brickSize);
+    fieldDeinit(&field);
+    fieldFreeExpression(expression);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static int convert(const char *inPath, const char *outPath, int layout, int brickSize)
+{
+    FIELDFILE file;
+    FIELD field;
+    int ok;
+
+    if (!fieldFileOpen(&file, inPath))
+        return EXIT_FAILURE;
+    ok = fieldInit(&field, file.field.nx, file.field.ny, file.field.nz,
+                   file.field.origin, file.field.spacing) &&
+         fieldFileLoad(&file, &field) &&
+         fieldFileWrite(outPath, &field, layout, brickSize);
+    fieldDeinit(&field);
+    fieldFileClose(&file);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static int import(const char *inPath, const char *outPath, const char *arrayName,
+                  int layout, int brickSize)
+{
+    THREADPOOL *pool = threadPoolCreate(0);
+    FIELD field;
+    double start = nowMs();
+    int ok;
+
+    ok = vtkImportField(&field, inPath, arrayName, pool);
+    threadPoolDestroy(pool);
+    if (!ok)
+        return EXIT_FAILURE;
+    printf("imported in:    %.1f ms\n", nowMs() - start);
+    ok = fieldFileWrite(outPath, &field, layout, brickSize);
+    fieldDeinit(&field);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+int main(int argc, char *argv[])
+{
+    char expressions[3][256] = {"-y", "x", "0.5 * sin(2 * z)"};
+    const char *arrayName = NULL;
+    int layout = FIELDFILE_LINEAR, brickSize = DEFAULT_BRICK_SIZE;
+
+    if (argc == 3 && strcmp(argv[1], "info") == 0)
+        return info(argv[2]);
+    if (argc == 3 && strcmp(argv[1], "check") == 0)
+        return check(argv[2]);
+    if (argc >= 4 && strcmp(argv[1], "generate") == 0 && atoi(argv[3]) >= 2 &&
+        parseOptions(argc - 4, argv + 4, &layout, &brickSize, expressions, NULL))
+        return generate(argv[2], atoi(argv[3]), layout, brickSize, expressions);
+    if (argc >= 4 && strcmp(argv[1], "convert") == 0 &&
+        parseOptions(argc - 4, argv + 4, &layout, &brickSize, NULL, NULL))
+        return convert(argv[2], argv[3], layout, brickSize);
+    if (argc >= 4 && strcmp(argv[1], "import") == 0 &&
+        parseOptions(argc - 4, argv + 4, &layout, &brickSize, NULL, &arrayName))
+        return import(argv[2], argv[3], arrayName, layout, brickSize);
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,395 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fieldfile.h"
+#include "log.h"
+
+
+// The header is written as is, so its layout must not depend on the ABI.
+typedef char FieldFileHeaderSize[sizeof(FIELDFILEHEADER) == 128 ? 1 : -1];
+
+#define FNV32_OFFSET    2166136261u
+#define FNV32_PRIME     16777619u
+#define FNV64_OFFSET    14695981039346656037ull
+#define FNV64_PRIME     1099511628211ull
+
+
+static int littleEndian() {
+    const uint32_t one = 1;
+    return *(const unsigned char *) &one == 1;
+}
+
+static uint32_t headerChecksum(const FIELDFILEHEADER *header) {
+    FIELDFILEHEADER copy = *header;
+    const unsigned char *bytes = (const unsigned char *) &copy;
+    uint32_t hash = FNV32_OFFSET;
+    size_t n;
+    copy.checksum = 0;
+    for (n = 0; n < sizeof(copy); n++)
+        hash = (hash ^ bytes[n]) * FNV32_PRIME;
+    return hash;
+}
+
+// Adds count samples to a 64-bit FNV-1a hash, one 32-bit word at a time.
+static uint64_t payloadHash(uint64_t hash, const float *samples, size_t count) {
+    const uint32_t *words = (const uint32_t *) samples;
+    size_t n;
+    for (n = 0; n < count; n++)
+        hash = (hash ^ words[n]) * FNV64_PRIME;
+    return hash;
+}
+
+static uint32_t nextPowerOfTwo(uint32_t value) {
+    uint32_t power = 1;
+    while (power < value)
+        power <<= 1;
+    return power;
+}
+
+// Bricks along each axis, padded to powers of two for FIELDFILE_MORTON.
+static void brickGrid(const FIELDFILEHEADER *header, uint32_t bricks[3]) {
+    int a;
+    for (a = 0; a < 3; a++) {
+        bricks[a] = ((uint32_t) header->dims[a] + header->brickSize - 1) / header->brickSize;
+        if (header->layout == FIELDFILE_MORTON)
+            bricks[a] = nextPowerOfTwo(bricks[a]);
+    }
+}
+
+// Samples in each component array, or 0 when the header is not usable.
+static uint64_t expectedSampleCount(const FIELDFILEHEADER *header) {
+    uint64_t count;
+    if (header->dims[0] <= 0 || header->dims[1] <= 0 || header->dims[2] <= 0)
+        return 0;
+    if (header->layout == FIELDFILE_LINEAR) {
+        count = (uint64_t) header->dims[0] * header->dims[1] * header->dims[2];
+    }
+    else if (header->layout == FIELDFILE_BRICKED || header->layout == FIELDFILE_MORTON) {
+        uint32_t bricks[3];
+        if (header->brickSize == 0 || header->brickSize > 1024)
+            return 0;
+        brickGrid(header, bricks);
+        count = (uint64_t) bricks[0] * bricks[1] * bricks[2] *
+                header->brickSize * header->brickSize * header->brickSize;
+    }
+    else
+        return 0;
+    return (count + FIELD_PACKET_SIZE - 1) & ~(uint64_t) (FIELD_PACKET_SIZE - 1);
+}
+
+/* Interleaves the bits of the brick coordinates, x lowest, leaving out
+ * an axis once its coordinates have no bits left, so that brick grids
+ * that are not cubes have no gaps.
+ */
+static uint64_t mortonIndex(const uint32_t bricks[3], uint32_t bi, uint32_t bj, uint32_t bk) {
+    uint64_t index = 0;
+    int shift = 0, bit;
+    for (bit = 0; (1u << bit) < bricks[0] || (1u << bit) < bricks[1] ||
+                  (1u << bit) < bricks[2]; bit++) {
+        if ((1u << bit) < bricks[0])
+            index |= (uint64_t) ((bi >> bit) & 1) << shift++;
+        if ((1u << bit) < bricks[1])
+            index |= (uint64_t) ((bj >> bit) & 1) << shift++;
+        if ((1u << bit) < bricks[2])
+            index |= (uint64_t) ((bk >> bit) & 1) << shift++;
+    }
+    return index;
+}
+
+
+long fieldFileIndex(const FIELDFILEHEADER *header, int i, int j, int k) {
+    uint32_t size = header->brickSize, bricks[3], bi, bj, bk;
+    uint64_t brick;
+    long inside;
+
+    if (header->layout == FIELDFILE_LINEAR)
+        return ((long) k * header->dims[1] + j) * header->dims[0] + i;
+    brickGrid(header, bricks);
+    bi = i / size;
+    bj = j / size;
+    bk = k / size;
+    inside = ((long) (k - bk * size) * size + (j - bj * size)) * size + (i - bi * size);
+    if (header->layout == FIELDFILE_MORTON)
+        brick = mortonIndex(bricks, bi, bj, bk);
+    else
+        brick = ((uint64_t) bk * bricks[1] + bj) * bricks[0] + bi;
+    return (long) (brick * size * size * size) + inside;
+}
+
+
+// Logs what is wrong with the header of a file of fileSize bytes.
+static int checkHeader(const FIELDFILEHEADER *header, uint64_t fileSize, const char *path) {
+    uint64_t bytes;
+    int c;
+
+    if (memcmp(header->magic, FIELDFILE_MAGIC, 4) != 0) {
+        LOGE(FIELD, "%s is not a field file", path);
+        return 0;
+    }
+    if (header->version != FIELDFILE_VERSION || header->headerSize != sizeof(FIELDFILEHEADER)) {
+        LOGE(FIELD, "%s has unsupported version %u", path, header->version);
+        return 0;
+    }
+    if (header->checksum != headerChecksum(header)) {
+        LOGE(FIELD, "%s has a corrupt header", path);
+        return 0;
+    }
+    if (header->componentType != FIELDFILE_FLOAT32 || header->componentCount != 3) {
+        LOGE(FIELD, "%s has %u components of unsupported type %u", path,
+             header->componentCount, header->componentType);
+        return 0;
+    }
+    if (header->sampleCount == 0 || header->sampleCount != expectedSampleCount(header)) {
+        LOGE(FIELD, "%s has a bad grid or layout", path);
+        return 0;
+    }
+    if (!fieldSpacingValid(header->spacing)) {
+        LOGE(FIELD, "%s has bad spacing %g %g %g", path, header->spacing[0],
+             header->spacing[1], header->spacing[2]);
+        return 0;
+    }
+    bytes = header->sampleCount * sizeof(float);
+    for (c = 0; c < 3; c++) {
+        if (header->offsets[c] % FIELDFILE_ALIGNMENT != 0 ||
+            header->offsets[c] < sizeof(FIELDFILEHEADER) ||
+            header->offsets[c] > fileSize || fileSize - header->offsets[c] < bytes) {
+            LOGE(FIELD, "%s is truncated or has misaligned arrays", path);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+int fieldFileOpen(FIELDFILE *file, const char *path) {
+    struct stat status;
+    void *mapping;
+    int fd, c;
+
+    memset(file, 0, sizeof(FIELDFILE));
+    if (!littleEndian()) {
+        LOGE(FIELD, "field files are little-endian only");
+        return 0;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOGE(FIELD, "cannot open %s: %s", path, strerror(errno));
+        return 0;
+    }
+    if (fstat(fd, &status) != 0 || (size_t) status.st_size < sizeof(FIELDFILEHEADER)) {
+        LOGE(FIELD, "%s is not a field file", path);
+        close(fd);
+        return 0;
+    }
+    // Private and writable: the FIELD arrays are not const, and anything
+    // written to them is copied on write instead of reaching the file.
+    mapping = mmap(NULL, (size_t) status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGE(FIELD, "cannot map %s: %s", path, strerror(errno));
+        return 0;
+    }
+    file->mapping = mapping;
+    file->mappingSize = (size_t) status.st_size;
+    memcpy(&file->header, mapping, sizeof(FIELDFILEHEADER));
+    if (!checkHeader(&file->header, (uint64_t) status.st_size, path)) {
+        fieldFileClose(file);
+        return 0;
+    }
+
+    for (c = 0; c < 3; c++) {
+        file->components[c] = (const float *) ((const char *) mapping + file->header.offsets[c]);
+        file->field.origin[c] = file->header.origin[c];
+        file->field.spacing[c] = file->header.spacing[c];
+    }
+    file->field.nx = file->header.dims[0];
+    file->field.ny = file->header.dims[1];
+    file->field.nz = file->header.dims[2];
+    file->field.count = (long) file->field.nx * file->field.ny * file->field.nz;
+    if (file->header.layout == FIELDFILE_LINEAR) {
+        file->field.x = (float *) file->components[0];
+        file->field.y = (float *) file->components[1];
+        file->field.z = (float *) file->components[2];
+    }
+    LOGI(FIELD, "mapped %s, %d x %d x %d", path, file->field.nx, file->field.ny,
+         file->field.nz);
+    return 1;
+}
+
+void fieldFileClose(FIELDFILE *file) {
+    if (file->mapping != NULL)
+        munmap(file->mapping, file->mappingSize);
+    memset(file, 0, sizeof(FIELDFILE));
+}
+
+
+int fieldFileLoad(const FIELDFILE *file, FIELD *field) {
+    float *targets[3] = {field->x, field->y, field->z};
+    int i, j, k, c;
+
+    if (field->nx != file->field.nx || field->ny != file->field.ny ||
+        field->nz != file->field.nz)
+        return 0;
+    for (c = 0; c < 3; c++) {
+        const float *source = file->components[c];
+        if (file->header.layout == FIELDFILE_LINEAR) {
+            memcpy(targets[c], source, field->count * sizeof(float));
+            continue;
+        }
+        for (k = 0; k < field->nz; k++)
+            for (j = 0; j < field->ny; j++) {
+                float *row = targets[c] + FIELD_INDEX(field, 0, j, k);
+                for (i = 0; i < field->nx; i++)
+                    row[i] = source[fieldFileIndex(&file->header, i, j, k)];
+            }
+    }
+    return 1;
+}
+
+
+int fieldFileValidate(const FIELDFILE *file) {
+    uint64_t hash = FNV64_OFFSET;
+    long n, count = (long) file->header.sampleCount;
+    int c;
+
+    for (c = 0; c < 3; c++) {
+        const float *samples = file->components[c];
+        hash = payloadHash(hash, samples, count);
+        for (n = 0; n < count; n++) {
+            if (!isfinite(samples[n])) {
+                LOGE(FIELD, "sample %ld of component %d is not finite", n, c);
+                return 0;
+            }
+        }
+    }
+    if (hash != file->header.payloadChecksum) {
+        LOGE(FIELD, "the samples do not match their checksum");
+        return 0;
+    }
+    return 1;
+}
+
+
+// Writes count zero bytes.
+static int writeZeros(FILE *stream, uint64_t count) {
+    static const char zeros[256] = {0};
+    while (count > 0) {
+        size_t chunk = count < sizeof(zeros) ? (size_t) count : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, stream) != chunk)
+            return 0;
+        count -= chunk;
+    }
+    return 1;
+}
+
+int fieldFileWrite(const char *path, const FIELD *field, int layout, int brickSize) {
+    const float *sources[3] = {field->x, field->y, field->z};
+    FIELDFILEHEADER header;
+    uint64_t bytes, offset, hash = FNV64_OFFSET;
+    float *buffer = NULL;
+    FILE *stream;
+    int ok = 1, i, j, k, c;
+
+    if (!littleEndian()) {
+        LOGE(FIELD, "field files are little-endian only");
+        return 0;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FIELDFILE_MAGIC, 4);
+    header.version = FIELDFILE_VERSION;
+    header.headerSize = sizeof(header);
+    header.dims[0] = field->nx;
+    header.dims[1] = field->ny;
+    header.dims[2] = field->nz;
+    for (c = 0; c < 3; c++) {
+        header.origin[c] = field->origin[c];
+        header.spacing[c] = field->spacing[c];
+    }
+    header.componentType = FIELDFILE_FLOAT32;
+    header.componentCount = 3;
+    header.layout = (uint32_t) layout;
+    header.brickSize = layout == FIELDFILE_LINEAR ? 0 : (uint32_t) brickSize;
+    header.sampleCount = expectedSampleCount(&header);
+    if (header.sampleCount == 0) {
+        LOGE(FIELD, "cannot write a field with layout %d and brick size %d", layout, brickSize);
+        return 0;
+    }
+    bytes = header.sampleCount * sizeof(float);
+    offset = FIELDFILE_ALIGNMENT;
+    for (c = 0; c < 3; c++) {
+        header.offsets[c] = offset;
+        offset += (bytes + FIELDFILE_ALIGNMENT - 1) & ~(uint64_t) (FIELDFILE_ALIGNMENT - 1);
+    }
+
+    if (layout != FIELDFILE_LINEAR) {
+        buffer = (float *) malloc((size_t) bytes);
+        if (buffer == NULL) {
+            LOGE(FIELD, "cannot allocate %llu bytes to reorder the field",
+                 (unsigned long long) bytes);
+            return 0;
+        }
+    }
+    stream = fopen(path, "wb");
+    if (stream == NULL) {
+        LOGE(FIELD, "cannot create %s: %s", path, strerror(errno));
+        free(buffer);
+        return 0;
+    }
+    // The header goes last, once the samples are hashed.
+    ok = writeZeros(stream, header.offsets[0]);
+    for (c = 0; c < 3 && ok; c++) {
+        // FIELD arrays are padded with zeros to sampleCount already.
+        const float *samples = sources[c];
+        if (buffer != NULL) {
+            memset(buffer, 0, (size_t) bytes);
+            for (k = 0; k < field->nz; k++)
+                for (j = 0; j < field->ny; j++) {
+                    const float *row = samples + FIELD_INDEX(field, 0, j, k);
+                    for (i = 0; i < field->nx; i++)
+                        buffer[fieldFileIndex(&header, i, j, k)] = row[i];
+                }
+            samples = buffer;
+        }
+        hash = payloadHash(hash, samples, (size_t) header.sampleCount);
+        ok = fwrite(samples, sizeof(float), (size_t) header.sampleCount, stream) ==
+             header.sampleCount;
+        if (ok && c < 2)
+            ok = writeZeros(stream, header.offsets[c + 1] - header.offsets[c] - bytes);
+    }
+    header.payloadChecksum = hash;
+    header.checksum = headerChecksum(&header);
+    ok = ok && fseek(stream, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, stream) == 1;
+    if (fclose(stream) != 0)
+        ok = 0;
+    free(buffer);
+    if (!ok)
+        LOGE(FIELD, "cannot write %s", path);
+    return ok;
+}
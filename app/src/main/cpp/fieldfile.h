@@ -0,0 +1,148 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef FIELDFILE_H_INCLUDED
+#define FIELDFILE_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+#include <Eigen/Core>
+
+extern "C" {
+#endif
+
+
+#include "field.h"
+
+
+/* Field files hold one FIELD: a FIELDFILEHEADER followed by the x, y and
+ * z component arrays, each starting on a FIELDFILE_ALIGNMENT boundary so
+ * that a memory mapping of the file can be used as the arrays in place.
+ * All values are little-endian.
+ */
+#define FIELDFILE_MAGIC         "VFLD"
+#define FIELDFILE_VERSION       1
+#define FIELDFILE_ALIGNMENT     4096
+
+// Component types. Version 1 only writes and reads 32-bit floats.
+#define FIELDFILE_FLOAT32       1
+
+/* Sample orders of the component arrays:
+ * - FIELDFILE_LINEAR is FIELD_INDEX order, x fastest, and maps straight
+ *   onto a FIELD.
+ * - FIELDFILE_BRICKED splits the grid into cubes of brickSize samples per
+ *   axis, the last ones padded with zeros, stored x fastest with the
+ *   samples in each brick x fastest, so neighbours share pages.
+ * - FIELDFILE_MORTON stores the bricks in Morton order, interleaving the
+ *   bits of the brick coordinates. The brick grid is padded to a power of
+ *   two along each axis.
+ */
+#define FIELDFILE_LINEAR        0
+#define FIELDFILE_BRICKED       1
+#define FIELDFILE_MORTON        2
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;
+    // FNV-1a of the header with this member 0.
+    uint32_t checksum;
+    int32_t dims[3];
+    float origin[3];
+    float spacing[3];
+    uint32_t componentType;
+    uint32_t componentCount;
+    uint32_t layout;
+    uint32_t brickSize;
+    uint32_t reserved0;
+    // Samples in each component array, padded to FIELD_PACKET_SIZE.
+    uint64_t sampleCount;
+    // Byte offsets of the component arrays from the start of the file.
+    uint64_t offsets[3];
+    // 64-bit FNV-1a of the three arrays, checked by fieldFileValidate only.
+    uint64_t payloadChecksum;
+    uint32_t reserved[4];
+} FIELDFILEHEADER;
+
+/* An open field file. When the file is FIELDFILE_LINEAR the arrays of
+ * field point into a private mapping of it: nothing is read until touched
+ * and writes stay in memory. Otherwise field only holds the grid, with
+ * NULL arrays, and the samples are read with fieldFileLoad.
+ */
+typedef struct {
+    FIELDFILEHEADER header;
+    FIELD field;
+    const float *components[3];
+    void *mapping;
+    size_t mappingSize;
+} FIELDFILE;
+
+
+/* Maps path and checks its header and size. Opening does not read the
+ * samples, whatever the size of the file. Returns non-zero on success and
+ * 0, with the reason logged, on failure.
+ */
+extern int fieldFileOpen(FIELDFILE *file, const char *path);
+
+/* Unmaps the file. The arrays of file->field go with it.
+ */
+extern void fieldFileClose(FIELDFILE *file);
+
+/* Index into the component arrays of the sample at grid point (i, j, k).
+ */
+extern long fieldFileIndex(const FIELDFILEHEADER *header, int i, int j, int k);
+
+/* Copies the samples into field, whose arrays must be allocated on the
+ * file grid, reordering them from the file layout. Returns 0 when the
+ * grids differ.
+ */
+extern int fieldFileLoad(const FIELDFILE *file, FIELD *field);
+
+/* Writes field to path in the given layout; brickSize is ignored for
+ * FIELDFILE_LINEAR. Returns non-zero on success and 0 on failure.
+ */
+extern int fieldFileWrite(const char *path, const FIELD *field, int layout, int brickSize);
+
+/* Reads every sample of an open file, checking the payload checksum and
+ * that all samples are finite. Returns non-zero when the file is valid
+ * and 0, with the reason logged, when it is not.
+ */
+extern int fieldFileValidate(const FIELDFILE *file);
+
+
+#ifdef __cplusplus
+}
+
+/* The component arrays of an open file as Eigen arrays over the mapping,
+ * in the file layout. No samples are copied.
+ */
+typedef Eigen::Map<const Eigen::ArrayXf, Eigen::Aligned> FieldFileComponent;
+
+inline FieldFileComponent fieldFileComponent(const FIELDFILE *file, int component) {
+    return FieldFileComponent(file->components[component],
+                              (Eigen::DenseIndex) file->header.sampleCount);
+}
+#endif
+
+
+#endif // !FIELDFILE_H_INCLUDED
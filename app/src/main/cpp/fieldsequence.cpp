@@ -0,0 +1,304 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <Eigen/Core>
+
+#include "fieldsequence.h"
+#include "log.h"
+
+
+using namespace Eigen::internal;
+
+/* Native float packet: Packet4f with SSE or NEON, a plain float when
+ * Eigen is built without vectorization.
+ */
+typedef packet_traits<float>::type Packet;
+enum { PACKET_SIZE = packet_traits<float>::size };
+
+
+// States of a ring slot.
+enum {
+    SLOT_EMPTY,
+    SLOT_LOADING,
+    SLOT_READY,
+    SLOT_FAILED
+};
+
+typedef struct {
+    FIELD field;
+    int keyframe;
+    int state;
+    // Samples interpolating from the slot right now; it is not reused
+    // until they are done.
+    int readers;
+} Slot;
+
+struct FIELDSEQUENCE {
+    Slot *slots;
+    int ringSize;
+    int keyframeCount;
+    FIELDSEQUENCELOAD load;
+    void *userData;
+    pthread_t thread;
+    // Guards everything below and the slot states. Signalled whenever a
+    // slot or the playback position changes.
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    // Keyframe at or before the playback position; the loader keeps the
+    // keyframes from it on loaded.
+    int base;
+    int stop;
+};
+
+
+// Keyframes the loader keeps loaded from base on.
+static int windowSize(const FIELDSEQUENCE *sequence) {
+    return sequence->ringSize < sequence->keyframeCount ?
+           sequence->ringSize : sequence->keyframeCount;
+}
+
+static int inWindow(const FIELDSEQUENCE *sequence, int keyframe) {
+    int distance = (keyframe - sequence->base + sequence->keyframeCount) %
+                   sequence->keyframeCount;
+    return distance < windowSize(sequence);
+}
+
+// The slot holding or loading keyframe, or NULL.
+static Slot *findSlot(FIELDSEQUENCE *sequence, int keyframe) {
+    int s;
+    for (s = 0; s < sequence->ringSize; s++) {
+        Slot *slot = &sequence->slots[s];
+        if (slot->state != SLOT_EMPTY && slot->keyframe == keyframe)
+            return slot;
+    }
+    return NULL;
+}
+
+/* A slot that can take a new keyframe: an empty one, else one whose
+ * keyframe fell behind the window and that nobody reads. NULL if none.
+ */
+static Slot *freeSlot(FIELDSEQUENCE *sequence) {
+    Slot *stale = NULL;
+    int s;
+    for (s = 0; s < sequence->ringSize; s++) {
+        Slot *slot = &sequence->slots[s];
+        if (slot->state == SLOT_EMPTY)
+            return slot;
+        if (stale == NULL && slot->state != SLOT_LOADING && slot->readers == 0 &&
+            !inWindow(sequence, slot->keyframe))
+            stale = slot;
+    }
+    return stale;
+}
+
+/* Loads the first keyframe of the window that is missing, nearest the
+ * playback position first. When every keyframe of the window is resident,
+ * or there is no slot to put the missing one in, it blocks on changed
+ * until the playback position moves or a slot is released.
+ */
+static void *loaderThread(void *arg) {
+    FIELDSEQUENCE *sequence = (FIELDSEQUENCE *) arg;
+    pthread_mutex_lock(&sequence->mutex);
+    while (!sequence->stop) {
+        Slot *slot = NULL;
+        int keyframe = 0, d, loaded;
+        for (d = 0; d < windowSize(sequence) && slot == NULL; d++) {
+            keyframe = (sequence->base + d) % sequence->keyframeCount;
+            if (findSlot(sequence, keyframe) == NULL)
+                slot = freeSlot(sequence);
+        }
+        if (slot == NULL) {
+            pthread_cond_wait(&sequence->changed, &sequence->mutex);
+            continue;
+        }
+        slot->keyframe = keyframe;
+        slot->state = SLOT_LOADING;
+        pthread_mutex_unlock(&sequence->mutex);
+
+        loaded = sequence->load(&slot->field, keyframe, sequence->userData);
+        if (!loaded)
+            LOGE(FIELD, "cannot load keyframe %d", keyframe);
+
+        pthread_mutex_lock(&sequence->mutex);
+        slot->state = loaded ? SLOT_READY : SLOT_FAILED;
+        pthread_cond_broadcast(&sequence->changed);
+    }
+    pthread_mutex_unlock(&sequence->mutex);
+    return NULL;
+}
+
+/* Splits position into the keyframe before it and the fraction of the way
+ * to the next one, and moves the loader there. Called with the mutex held.
+ */
+static int seek(FIELDSEQUENCE *sequence, float position, float *fraction) {
+    float wrapped = fmodf(position, (float) sequence->keyframeCount);
+    int keyframe;
+    if (wrapped < 0)
+        wrapped += sequence->keyframeCount;
+    keyframe = (int) wrapped;
+    if (keyframe >= sequence->keyframeCount)
+        keyframe = sequence->keyframeCount - 1;
+    *fraction = wrapped - keyframe;
+    if (keyframe != sequence->base) {
+        sequence->base = keyframe;
+        pthread_cond_broadcast(&sequence->changed);
+    }
+    return keyframe;
+}
+
+
+FIELDSEQUENCE *fieldSequenceCreate(int nx, int ny, int nz, const float origin[3],
+                                   const float spacing[3], int keyframeCount,
+                                   int ringSize, FIELDSEQUENCELOAD load, void *userData) {
+    FIELDSEQUENCE *sequence;
+    int s;
+
+    if (keyframeCount < 1 || ringSize < 2)
+        return NULL;
+    sequence = (FIELDSEQUENCE *) calloc(1, sizeof(FIELDSEQUENCE));
+    if (sequence == NULL)
+        return NULL;
+    sequence->slots = (Slot *) calloc(ringSize, sizeof(Slot));
+    sequence->ringSize = ringSize;
+    sequence->keyframeCount = keyframeCount;
+    sequence->load = load;
+    sequence->userData = userData;
+    for (s = 0; sequence->slots != NULL && s < ringSize; s++) {
+        if (!fieldInit(&sequence->slots[s].field, nx, ny, nz, origin, spacing)) {
+            LOGE(FIELD, "cannot allocate %d keyframes of %dx%dx%d", ringSize, nx, ny, nz);
+            break;
+        }
+    }
+    if (s < ringSize) {
+        while (sequence->slots != NULL && s-- > 0)
+            fieldDeinit(&sequence->slots[s].field);
+        free(sequence->slots);
+        free(sequence);
+        return NULL;
+    }
+    pthread_mutex_init(&sequence->mutex, NULL);
+    pthread_cond_init(&sequence->changed, NULL);
+    if (pthread_create(&sequence->thread, NULL, loaderThread, sequence) != 0) {
+        LOGE(FIELD, "cannot start the keyframe loader");
+        sequence->stop = 1;
+        fieldSequenceDestroy(sequence);
+        return NULL;
+    }
+    return sequence;
+}
+
+
+void fieldSequenceDestroy(FIELDSEQUENCE *sequence) {
+    int s;
+    if (sequence == NULL)
+        return;
+    if (!sequence->stop) {
+        pthread_mutex_lock(&sequence->mutex);
+        sequence->stop = 1;
+        pthread_cond_broadcast(&sequence->changed);
+        pthread_mutex_unlock(&sequence->mutex);
+        pthread_join(sequence->thread, NULL);
+    }
+    pthread_cond_destroy(&sequence->changed);
+    pthread_mutex_destroy(&sequence->mutex);
+    for (s = 0; s < sequence->ringSize; s++)
+        fieldDeinit(&sequence->slots[s].field);
+    free(sequence->slots);
+    free(sequence);
+}
+
+
+// Writes from + (to - from) * fraction to field.
+static void blendFields(const FIELD *from, const FIELD *to, float fraction, FIELD *field) {
+    const Packet t = pset1<Packet>(fraction);
+    const float *a[3] = {from->x, from->y, from->z};
+    const float *b[3] = {to->x, to->y, to->z};
+    float *out[3] = {field->x, field->y, field->z};
+    long n;
+    int c;
+    // The arrays are aligned and padded to whole packets.
+    for (c = 0; c < 3; c++) {
+        for (n = 0; n < field->count; n += PACKET_SIZE) {
+            Packet p = pload<Packet>(a[c] + n);
+            pstore(out[c] + n, pmadd(psub(pload<Packet>(b[c] + n), p), t, p));
+        }
+    }
+}
+
+
+int fieldSequenceSample(FIELDSEQUENCE *sequence, float position, FIELD *field) {
+    Slot *from, *to;
+    float fraction;
+    int keyframe;
+
+    pthread_mutex_lock(&sequence->mutex);
+    keyframe = seek(sequence, position, &fraction);
+    from = findSlot(sequence, keyframe);
+    to = findSlot(sequence, (keyframe + 1) % sequence->keyframeCount);
+    if (from == NULL || to == NULL || from->state != SLOT_READY || to->state != SLOT_READY) {
+        pthread_mutex_unlock(&sequence->mutex);
+        return 0;
+    }
+    from->readers++;
+    to->readers++;
+    pthread_mutex_unlock(&sequence->mutex);
+
+    blendFields(&from->field, &to->field, fraction, field);
+
+    // Only a slot that nobody reads and that fell behind the window is of
+    // use to the loader, so other releases leave it asleep.
+    pthread_mutex_lock(&sequence->mutex);
+    from->readers--;
+    to->readers--;
+    if ((from->readers == 0 && !inWindow(sequence, from->keyframe)) ||
+        (to->readers == 0 && !inWindow(sequence, to->keyframe)))
+        pthread_cond_broadcast(&sequence->changed);
+    pthread_mutex_unlock(&sequence->mutex);
+    return 1;
+}
+
+
+int fieldSequenceWait(FIELDSEQUENCE *sequence, float position) {
+    float fraction;
+    int keyframe, result = 0;
+
+    pthread_mutex_lock(&sequence->mutex);
+    keyframe = seek(sequence, position, &fraction);
+    for (;;) {
+        Slot *from = findSlot(sequence, keyframe);
+        Slot *to = findSlot(sequence, (keyframe + 1) % sequence->keyframeCount);
+        if ((from != NULL && from->state == SLOT_FAILED) ||
+            (to != NULL && to->state == SLOT_FAILED))
+            break;
+        if (from != NULL && to != NULL && from->state == SLOT_READY &&
+            to->state == SLOT_READY) {
+            result = 1;
+            break;
+        }
+        pthread_cond_wait(&sequence->changed, &sequence->mutex);
+    }
+    pthread_mutex_unlock(&sequence->mutex);
+    return result;
+}
@@ -0,0 +1,83 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef FIELDSEQUENCE_H_INCLUDED
+#define FIELDSEQUENCE_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "field.h"
+
+
+/* Reads keyframe index of a sequence into field, whose arrays are already
+ * allocated on the sequence grid. Runs on the loader thread. Returns
+ * non-zero on success.
+ */
+typedef int (*FIELDSEQUENCELOAD)(FIELD *field, int keyframe, void *userData);
+
+/* A time-varying field given as keyframes on one grid, played back by
+ * interpolating linearly between consecutive ones. Only a ring of
+ * ringSize keyframes is resident: a loader thread keeps the ones at and
+ * after the playback position loaded, reusing the slots of keyframes that
+ * fell behind it. A sequence can so be far longer than fits in memory
+ * while it holds ringSize grids, and playback never waits for the loader.
+ */
+typedef struct FIELDSEQUENCE FIELDSEQUENCE;
+
+
+/* Creates a sequence of keyframeCount keyframes on the given grid and
+ * starts its loader at keyframe 0. ringSize must be at least 2. Returns
+ * NULL on failure.
+ */
+extern FIELDSEQUENCE *fieldSequenceCreate(int nx, int ny, int nz, const float origin[3],
+                                          const float spacing[3], int keyframeCount,
+                                          int ringSize, FIELDSEQUENCELOAD load,
+                                          void *userData);
+
+/* Stops and joins the loader and frees the ring. NULL is accepted.
+ */
+extern void fieldSequenceDestroy(FIELDSEQUENCE *sequence);
+
+/* Interpolates the sequence at position, in keyframes, into field, which
+ * must be on the sequence grid: 2.25 lies a quarter of the way from
+ * keyframe 2 to 3. Positions wrap around, the last keyframe blending into
+ * the first. Also moves the loader on to the keyframes after position.
+ * Returns 0, leaving field unchanged, when either keyframe is not loaded
+ * yet.
+ */
+extern int fieldSequenceSample(FIELDSEQUENCE *sequence, float position, FIELD *field);
+
+/* Moves the loader to position and waits until both keyframes around it
+ * are loaded, for the first frame of a playback. Returns 0 when loading
+ * either failed.
+ */
+extern int fieldSequenceWait(FIELDSEQUENCE *sequence, float position);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !FIELDSEQUENCE_H_INCLUDED
@@ -0,0 +1,162 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "fieldworker.h"
+#include "log.h"
+
+
+// Set in ready when its slot has not been taken by the render thread yet.
+#define FIELDWORKER_FRESH   4
+#define FIELDWORKER_INDEX   3
+
+
+struct FIELDWORKER {
+    void *slots[FIELDWORKER_SLOTS];
+    FIELDWORKERUPDATE update;
+    void *userData;
+    pthread_t thread;
+    // Held to wait on and signal wake, which follows changes to requested,
+    // invalid and stop.
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    // Slot drawn by the render thread; only it reads and writes front.
+    int front;
+    // Slot filled by the worker; only it reads and writes back.
+    int back;
+    // Slot in between, plus FIELDWORKER_FRESH when it holds a new state.
+    // Changed only by atomic exchange.
+    int ready;
+    long requested;
+    // Set to compute the requested tick again even if it was computed.
+    int invalid;
+    int stop;
+};
+
+
+// Called after changing requested, invalid or stop. Taking the lock orders
+// the signal after the worker's check of them, so no change goes unseen.
+static void wakeWorker(FIELDWORKER *worker) {
+    pthread_mutex_lock(&worker->lock);
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+
+static void *workerThread(void *arg) {
+    FIELDWORKER *worker = (FIELDWORKER *) arg;
+    long computed = __atomic_load_n(&worker->requested, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        long tick;
+        pthread_mutex_lock(&worker->lock);
+        while (!__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE) &&
+               __atomic_load_n(&worker->requested, __ATOMIC_ACQUIRE) == computed &&
+               !__atomic_load_n(&worker->invalid, __ATOMIC_ACQUIRE))
+            pthread_cond_wait(&worker->wake, &worker->lock);
+        pthread_mutex_unlock(&worker->lock);
+        if (__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE))
+            break;
+        tick = __atomic_load_n(&worker->requested, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&worker->invalid, 0, __ATOMIC_RELEASE);
+        computed = tick;
+        if (!worker->update(worker->slots[worker->back], tick, worker->userData)) {
+            LOGW(FIELD, "field update for tick %ld failed", tick);
+            continue;
+        }
+        // Publish the back slot and take whatever was ready in exchange:
+        // either a stale state nobody drew, or the render thread's old
+        // front slot.
+        worker->back = __atomic_exchange_n(&worker->ready, worker->back | FIELDWORKER_FRESH,
+                                           __ATOMIC_ACQ_REL) & FIELDWORKER_INDEX;
+    }
+    return NULL;
+}
+
+
+FIELDWORKER *fieldWorkerCreate(void *slots[FIELDWORKER_SLOTS],
+                               FIELDWORKERUPDATE update, void *userData, long tick) {
+    FIELDWORKER *worker = (FIELDWORKER *) calloc(1, sizeof(FIELDWORKER));
+    int i;
+
+    if (worker == NULL)
+        return NULL;
+    for (i = 0; i < FIELDWORKER_SLOTS; i++)
+        worker->slots[i] = slots[i];
+    worker->update = update;
+    worker->userData = userData;
+    worker->front = 0;
+    worker->ready = 1;
+    worker->back = 2;
+    worker->requested = tick;
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->wake, NULL);
+    if (pthread_create(&worker->thread, NULL, workerThread, worker) != 0) {
+        LOGE(FIELD, "cannot start the field worker");
+        pthread_cond_destroy(&worker->wake);
+        pthread_mutex_destroy(&worker->lock);
+        free(worker);
+        return NULL;
+    }
+    return worker;
+}
+
+
+void fieldWorkerDestroy(FIELDWORKER *worker) {
+    if (worker == NULL)
+        return;
+    __atomic_store_n(&worker->stop, 1, __ATOMIC_RELEASE);
+    wakeWorker(worker);
+    pthread_join(worker->thread, NULL);
+    pthread_cond_destroy(&worker->wake);
+    pthread_mutex_destroy(&worker->lock);
+    free(worker);
+}
+
+
+void fieldWorkerRequest(FIELDWORKER *worker, long tick) {
+    if (__atomic_exchange_n(&worker->requested, tick, __ATOMIC_ACQ_REL) != tick)
+        wakeWorker(worker);
+}
+
+
+void fieldWorkerInvalidate(FIELDWORKER *worker) {
+    __atomic_store_n(&worker->invalid, 1, __ATOMIC_RELEASE);
+    wakeWorker(worker);
+}
+
+
+void *fieldWorkerFront(const FIELDWORKER *worker) {
+    return worker->slots[worker->front];
+}
+
+
+int fieldWorkerPending(const FIELDWORKER *worker) {
+    return (__atomic_load_n(&worker->ready, __ATOMIC_ACQUIRE) & FIELDWORKER_FRESH) != 0;
+}
+
+
+void *fieldWorkerSwap(FIELDWORKER *worker) {
+    if (fieldWorkerPending(worker))
+        worker->front = __atomic_exchange_n(&worker->ready, worker->front,
+                                            __ATOMIC_ACQ_REL) & FIELDWORKER_INDEX;
+    return worker->slots[worker->front];
+}
@@ -0,0 +1,93 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef FIELDWORKER_H_INCLUDED
+#define FIELDWORKER_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Number of state slots: one being drawn, one being computed and the
+ * newest complete one waiting in between.
+ */
+#define FIELDWORKER_SLOTS   3
+
+
+/* Computes the state for tick into slot, which holds the state of some
+ * earlier tick. Runs on the worker thread, so it must not call GL.
+ * Returns non-zero when slot holds a complete new state.
+ */
+typedef int (*FIELDWORKERUPDATE)(void *slot, long tick, void *userData);
+
+/* Thread that recomputes time dependent field state, such as the samples
+ * and the geometry built from them, away from the render thread. States
+ * are triple buffered: the render thread draws its front slot while the
+ * worker fills its back slot, and finished states are exchanged through
+ * a third, ready slot. Neither thread ever waits for the other.
+ */
+typedef struct FIELDWORKER FIELDWORKER;
+
+
+/* Starts the worker on the given slots. slots[0] must already hold the
+ * state of tick; it is the first front slot. Returns NULL on failure.
+ */
+extern FIELDWORKER *fieldWorkerCreate(void *slots[FIELDWORKER_SLOTS],
+                                      FIELDWORKERUPDATE update, void *userData, long tick);
+
+/* Stops and joins the worker. The slots are left to the caller. NULL is
+ * accepted.
+ */
+extern void fieldWorkerDestroy(FIELDWORKER *worker);
+
+/* Asks for the state of tick. The worker computes the latest tick asked
+ * for whenever it is idle; ticks asked for while it is busy are skipped.
+ */
+extern void fieldWorkerRequest(FIELDWORKER *worker, long tick);
+
+/* Asks for the requested tick to be computed again, for when something
+ * besides the tick that the update depends on has changed.
+ */
+extern void fieldWorkerInvalidate(FIELDWORKER *worker);
+
+/* The slot the render thread may use until the next fieldWorkerSwap.
+ */
+extern void *fieldWorkerFront(const FIELDWORKER *worker);
+
+/* Non-zero when a state newer than the front slot is complete. Render
+ * thread only; once set it stays set until fieldWorkerSwap.
+ */
+extern int fieldWorkerPending(const FIELDWORKER *worker);
+
+/* Makes the newest complete state the front slot and returns it, handing
+ * the old front slot back to the worker for reuse. Render thread only.
+ * Without a pending state the front slot is returned unchanged.
+ */
+extern void *fieldWorkerSwap(FIELDWORKER *worker);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !FIELDWORKER_H_INCLUDED
@@ -0,0 +1,401 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "globject.h"
+#include "log.h"
+
+
+const GLVERTEXFORMAT gFixedVertexFormat = {GL_FIXED, GL_FIXED, {0, 0, 0}, 1};
+
+
+/* Returns the client array with the given GLOBJECT_*_ARRAY bit index and
+ * stores its layout, or returns NULL when the object does not have it.
+ */
+static GLvoid *getArray(const GLOBJECT *object, int array, long *elementSize,
+                        long *elements, GLenum *target) {
+    *target = GL_ARRAY_BUFFER;
+    *elements = object->count;
+    switch (array) {
+        case 0:
+            *elementSize = object->vertexComponents * sizeOfGLType(object->format.vertexType);
+            return object->vertexArray;
+        case 1:
+            *elementSize = 4 * sizeof(GLubyte);
+            return object->colorArray;
+        case 2:
+            *elementSize = 3 * sizeOfGLType(object->format.normalType);
+            return object->normalArray;
+        default:
+            *target = GL_ELEMENT_ARRAY_BUFFER;
+            *elementSize = sizeof(GLushort);
+            *elements = object->indexCount;
+            return object->indexArray;
+    }
+}
+
+
+// Largest magnitude of a stored quantized coordinate, 0 when not quantized.
+static int quantizedRange(GLenum type) {
+    switch (type) {
+        case GL_SHORT:
+            return 32767;
+        case GL_BYTE:
+            return 127;
+        default:
+            return 0;
+    }
+}
+
+static int isVertexType(GLenum type) {
+    return type == GL_FIXED || type == GL_FLOAT || type == GL_SHORT || type == GL_BYTE;
+}
+
+static int clampInt(float value, int low, int high) {
+    return value < low ? low : value > high ? high : (int) value;
+}
+
+
+int sizeOfGLType(GLenum type) {
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+int fitGLVertexFormat(GLVERTEXFORMAT *format, GLenum vertexType, GLenum normalType,
+                      const GLfloat min[3], const GLfloat max[3]) {
+    int range = quantizedRange(vertexType), a;
+    float halfExtent = 0;
+
+    if (!isVertexType(vertexType) || !isVertexType(normalType))
+        return 0;
+    memset(format, 0, sizeof(GLVERTEXFORMAT));
+    format->vertexType = vertexType;
+    format->normalType = normalType;
+    format->scale = 1;
+    if (range == 0)
+        return 1;
+    if (min == NULL || max == NULL)
+        return 0;
+
+    // Center the box on an origin that is exact in GL_FIXED.
+    for (a = 0; a < 3; a++) {
+        float origin = floorf((min[a] + max[a]) / 2 * 65536 + 0.5f) / 65536;
+        format->origin[a] = origin;
+        if (max[a] - origin > halfExtent)
+            halfExtent = max[a] - origin;
+        if (origin - min[a] > halfExtent)
+            halfExtent = origin - min[a];
+    }
+    // Smallest power of two step that covers the box, no finer than one
+    // GL_FIXED unit so that glScalex gets it exactly.
+    format->scale = 1.0f / 65536;
+    while (format->scale * range < halfExtent && format->scale < 1e30f)
+        format->scale *= 2;
+    return 1;
+}
+
+void convertGLVertices(const GLVERTEXFORMAT *format, const GLfloat *positions,
+                       long count, GLvoid *destination) {
+    int range = quantizedRange(format->vertexType);
+    float inverseScale = 1 / format->scale;
+    long v;
+    int a;
+
+    switch (format->vertexType) {
+        case GL_FLOAT:
+            memcpy(destination, positions, count * 3 * sizeof(GLfloat));
+            break;
+        case GL_FIXED:
+            for (v = 0; v < count * 3; v++)
+                ((GLfixed *) destination)[v] = (GLfixed) (positions[v] * 65536);
+            break;
+        case GL_SHORT:
+            for (v = 0; v < count; v++) {
+                for (a = 0; a < 3; a++) {
+                    float q = floorf((positions[v * 3 + a] - format->origin[a]) *
+                                     inverseScale + 0.5f);
+                    ((GLshort *) destination)[v * 3 + a] = (GLshort) clampInt(q, -range, range);
+                }
+            }
+            break;
+        case GL_BYTE:
+            for (v = 0; v < count; v++) {
+                for (a = 0; a < 3; a++) {
+                    float q = floorf((positions[v * 3 + a] - format->origin[a]) *
+                                     inverseScale + 0.5f);
+                    ((GLbyte *) destination)[v * 3 + a] = (GLbyte) clampInt(q, -range, range);
+                }
+            }
+            break;
+    }
+}
+
+/* Integer normals decode as (2c + 1) / (2^b - 1), so encode the inverse
+ * of that rounded to nearest.
+ */
+void convertGLNormals(const GLVERTEXFORMAT *format, const GLfloat *normals,
+                      long count, GLvoid *destination) {
+    long n;
+
+    switch (format->normalType) {
+        case GL_FLOAT:
+            memcpy(destination, normals, count * 3 * sizeof(GLfloat));
+            break;
+        case GL_FIXED:
+            for (n = 0; n < count * 3; n++)
+                ((GLfixed *) destination)[n] = (GLfixed) (normals[n] * 65536);
+            break;
+        case GL_SHORT:
+            for (n = 0; n < count * 3; n++)
+                ((GLshort *) destination)[n] = (GLshort) clampInt(
+                        floorf((normals[n] * 65535 - 1) / 2 + 0.5f), -32768, 32767);
+            break;
+        case GL_BYTE:
+            for (n = 0; n < count * 3; n++)
+                ((GLbyte *) destination)[n] = (GLbyte) clampInt(
+                        floorf((normals[n] * 255 - 1) / 2 + 0.5f), -128, 127);
+            break;
+    }
+}
+
+
+static size_t alignSize(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+/* Lays out an object and its arrays one after the other in block, each
+ * part starting on a cache line, and returns the size of the layout. With
+ * a NULL block only the size is computed.
+ */
+static size_t layoutGLObject(unsigned char *block, const GLVERTEXFORMAT *format,
+                             long vertices, int vertexComponents,
+                             int useNormalArray, long indices) {
+    size_t objectBytes = alignSize(sizeof(GLOBJECT));
+    size_t vertexBytes = alignSize(vertices * vertexComponents *
+                                   sizeOfGLType(format->vertexType));
+    size_t colorBytes = alignSize(vertices * 4 * sizeof(GLubyte));
+    size_t normalBytes = useNormalArray ?
+                         alignSize(vertices * 3 * sizeOfGLType(format->normalType)) : 0;
+    size_t indexBytes = alignSize(indices * sizeof(GLushort));
+    GLOBJECT *object = (GLOBJECT *) block;
+
+    if (block != NULL) {
+        memset(object, 0, sizeof(GLOBJECT));
+        object->count = (GLsizei) vertices;
+        object->indexCount = (GLsizei) indices;
+        object->vertexComponents = vertexComponents;
+        object->format = *format;
+        block += objectBytes;
+        object->vertexArray = block;
+        block += vertexBytes;
+        object->colorArray = (GLubyte *) block;
+        block += colorBytes;
+        object->normalArray = useNormalArray ? block : NULL;
+        block += normalBytes;
+        object->indexArray = indices > 0 ? (GLushort *) block : NULL;
+    }
+    return objectBytes + vertexBytes + colorBytes + normalBytes + indexBytes;
+}
+
+
+void freeGLObject(GLOBJECT *object) {
+    if (object == NULL)
+        return;
+    deleteGLObjectBuffers(object);
+    free(object->storage);
+}
+
+GLOBJECT *newGLObject(const GLVERTEXFORMAT *format, long vertices,
+                      int vertexComponents, int useNormalArray, long indices) {
+    size_t size = layoutGLObject(NULL, format, vertices, vertexComponents, useNormalArray,
+                                 indices);
+    unsigned char *storage = (unsigned char *) malloc(size + ARENA_ALIGNMENT - 1);
+    GLOBJECT *result;
+    if (storage == NULL)
+        return NULL;
+    result = (GLOBJECT *) (((size_t) storage + ARENA_ALIGNMENT - 1) &
+                           ~(size_t) (ARENA_ALIGNMENT - 1));
+    layoutGLObject((unsigned char *) result, format, vertices, vertexComponents,
+                   useNormalArray, indices);
+    result->storage = storage;
+    return result;
+}
+
+GLOBJECT *newGLObjectInArena(ARENA *arena, const GLVERTEXFORMAT *format,
+                             long vertices, int vertexComponents,
+                             int useNormalArray, long indices) {
+    size_t size = layoutGLObject(NULL, format, vertices, vertexComponents, useNormalArray,
+                                 indices);
+    unsigned char *block = (unsigned char *) arenaAlloc(arena, size);
+    if (block == NULL)
+        return NULL;
+    layoutGLObject(block, format, vertices, vertexComponents, useNormalArray, indices);
+    return (GLOBJECT *) block;
+}
+
+int createGLObjectBuffers(GLOBJECT *object) {
+    GLuint buffers[GLOBJECT_ARRAY_COUNT];
+    int a;
+
+    deleteGLObjectBuffers(object);
+    glGenBuffers(GLOBJECT_ARRAY_COUNT, buffers);
+    for (a = 0; a < GLOBJECT_ARRAY_COUNT; a++) {
+        long elementSize, elements;
+        GLenum target;
+        GLvoid *array = getArray(object, a, &elementSize, &elements, &target);
+        if (array == NULL || elements == 0) {
+            glDeleteBuffers(1, &buffers[a]);
+            continue;
+        }
+        glBindBuffer(target, buffers[a]);
+        glBufferData(target, elementSize * elements, array, GL_STATIC_DRAW);
+        object->buffers[a] = buffers[a];
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    if (glGetError() != GL_NO_ERROR) {
+        LOGE(RENDER, "createGLObjectBuffers failed, drawing from client memory");
+        deleteGLObjectBuffers(object);
+        return 0;
+    }
+    return 1;
+}
+
+void deleteGLObjectBuffers(GLOBJECT *object) {
+    int a;
+    for (a = 0; a < GLOBJECT_ARRAY_COUNT; a++) {
+        if (object->buffers[a] != 0)
+            glDeleteBuffers(1, &object->buffers[a]);
+        object->buffers[a] = 0;
+    }
+}
+
+/* Issues the draw calls for ranges of an object whose vertex and color
+ * arrays are already set, with its origin and scale applied for quantized
+ * vertices. indexBase is the address of the first index, in client memory
+ * or in the bound element buffer. NULL ranges draws the whole object.
+ */
+static void drawGLObjectElements(const GLOBJECT *object, size_t indexBase,
+                                 const GLOBJECTRANGE *ranges, int rangeCount) {
+    const GLVERTEXFORMAT *format = &object->format;
+    int quantized = quantizedRange(format->vertexType) != 0;
+    GLOBJECTRANGE whole;
+    int r;
+
+    if (ranges == NULL) {
+        whole.first = 0;
+        whole.last = object->indexArray ? object->indexCount : object->count;
+        ranges = &whole;
+        rangeCount = 1;
+    }
+    if (quantized) {
+        GLfixed scale = (GLfixed) (format->scale * 65536);
+        glPushMatrix();
+        glTranslatex((GLfixed) (format->origin[0] * 65536),
+                     (GLfixed) (format->origin[1] * 65536),
+                     (GLfixed) (format->origin[2] * 65536));
+        glScalex(scale, scale, scale);
+    }
+    for (r = 0; r < rangeCount; r++) {
+        GLsizei count = (GLsizei) (ranges[r].last - ranges[r].first);
+        if (count <= 0)
+            continue;
+        if (object->indexArray)
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT,
+                           (const GLvoid *) (indexBase + ranges[r].first * sizeof(GLushort)));
+        else
+            glDrawArrays(GL_TRIANGLES, (GLint) ranges[r].first, count);
+    }
+    if (quantized)
+        glPopMatrix();
+}
+
+// Draws ranges of an object whose arrays are in buffer objects.
+static void drawGLObjectBuffers(GLOBJECT *object, const GLOBJECTRANGE *ranges,
+                                int rangeCount) {
+    glBindBuffer(GL_ARRAY_BUFFER, object->buffers[0]);
+    glVertexPointer(object->vertexComponents, object->format.vertexType, 0,
+                    (const GLvoid *) 0);
+    glBindBuffer(GL_ARRAY_BUFFER, object->buffers[1]);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid *) 0);
+
+    if (object->buffers[2] != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, object->buffers[2]);
+        glNormalPointer(object->format.normalType, 0, (const GLvoid *) 0);
+        glEnableClientState(GL_NORMAL_ARRAY);
+    }
+    else
+        glDisableClientState(GL_NORMAL_ARRAY);
+
+    if (object->buffers[3] != 0)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, object->buffers[3]);
+    drawGLObjectElements(object, 0, ranges, rangeCount);
+    if (object->buffers[3] != 0)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // Client array users such as paintGL expect no buffer to be bound.
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawGLObjectRanges(GLOBJECT *object, const GLOBJECTRANGE *ranges, int rangeCount) {
+    if (object == NULL) {
+        LOGE(RENDER, "drawGLObject object was null");
+        return;
+    }
+    assert(object != NULL);
+
+    if (object->buffers[0] != 0) {
+        drawGLObjectBuffers(object, ranges, rangeCount);
+        return;
+    }
+
+    glVertexPointer(object->vertexComponents, object->format.vertexType,
+                    0, object->vertexArray);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, object->colorArray);
+
+//     Already done in initialization:
+//    glEnableClientState(GL_VERTEX_ARRAY);
+//    glEnableClientState(GL_COLOR_ARRAY);
+
+    if (object->normalArray) {
+        glNormalPointer(object->format.normalType, 0, object->normalArray);
+        glEnableClientState(GL_NORMAL_ARRAY);
+    }
+    else
+        glDisableClientState(GL_NORMAL_ARRAY);
+
+    drawGLObjectElements(object, (size_t) object->indexArray, ranges, rangeCount);
+}
+
+void drawGLObject(GLOBJECT *object) {
+    drawGLObjectRanges(object, NULL, 0);
+}
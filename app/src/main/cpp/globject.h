@@ -0,0 +1,194 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef GLOBJECT_H_INCLUDED
+#define GLOBJECT_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "importgl.h"
+#include "arena.h"
+
+
+// Arrays of a GL object, as a bit mask for markGLObjectDirty.
+#define GLOBJECT_VERTEX_ARRAY   0x1
+#define GLOBJECT_COLOR_ARRAY    0x2
+#define GLOBJECT_NORMAL_ARRAY   0x4
+#define GLOBJECT_INDEX_ARRAY    0x8
+
+#define GLOBJECT_ARRAY_COUNT    4
+
+/* Indices are GL_UNSIGNED_SHORT, so one mesh can address at most this
+ * many vertices.
+ */
+#define GLOBJECT_MAX_VERTICES   65536
+
+
+/* Storage types of the vertex and normal arrays of a GL object. Vertex
+ * and normal types are each GL_FIXED, GL_FLOAT, GL_SHORT or GL_BYTE.
+ *
+ * GL_SHORT and GL_BYTE vertices are quantized: a stored coordinate c
+ * stands for origin + c * scale, and drawGLObject applies origin and
+ * scale on the modelview matrix. Both are exact GL_FIXED values and scale
+ * is a power of two, so the quantization is the only rounding. GL_SHORT
+ * and GL_BYTE normals are the normalized GL forms, where the full signed
+ * range maps to [-1, 1]. With quantized vertices GL_NORMALIZE (or
+ * GL_RESCALE_NORMAL) must be enabled for lighting to stay correct.
+ */
+typedef struct {
+    GLenum vertexType;
+    GLenum normalType;
+    GLfloat origin[3];
+    GLfloat scale;
+} GLVERTEXFORMAT;
+
+// GL_FIXED vertices and normals, the format of the San Angeles objects.
+extern const GLVERTEXFORMAT gFixedVertexFormat;
+
+
+/* Range of array elements, indices or vertices, to draw. Empty when
+ * first >= last.
+ */
+typedef struct {
+    long first;
+    long last;
+} GLOBJECTRANGE;
+
+
+// Definition of one GL object in this demo.
+typedef struct {
+    /* Vertex array and color array are enabled for all objects, so their
+     * pointers must always be valid and non-NULL. Normal array is not
+     * used by the ground plane, so when its pointer is NULL then normal
+     * array usage is disabled.
+     *
+     * Vertex and normal arrays use the types of format and stride 0
+     * (i.e. tightly packed arrays). Color array is supposed to have 4
+     * components per color with GL_UNSIGNED_BYTE datatype and stride 0.
+     *
+     * Index array is optional. When it is non-NULL the object is drawn
+     * with glDrawElements using indexCount GL_UNSIGNED_SHORT indices into
+     * the count vertices, otherwise the vertices are drawn in order with
+     * glDrawArrays.
+     *
+     * After createGLObjectBuffers the arrays also live in GL buffer objects
+     * and are drawn from there, so a static object costs no uploads after
+     * the first. Objects rebuilt from a changing field are given new
+     * buffer objects with each rebuild.
+     */
+    GLvoid *vertexArray;
+    GLubyte *colorArray;
+    GLvoid *normalArray;
+    GLushort *indexArray;
+    GLVERTEXFORMAT format;
+    GLint vertexComponents;
+    GLsizei count;
+    GLsizei indexCount;
+    // Buffer names in GLOBJECT_*_ARRAY bit order, 0 when not created.
+    GLuint buffers[GLOBJECT_ARRAY_COUNT];
+    // Heap block holding the object and its arrays, freed by
+    // freeGLObject. NULL when the memory belongs to an arena or to the
+    // caller.
+    void *storage;
+} GLOBJECT;
+
+
+/* Returns the size in bytes of one component of the given type.
+ */
+extern int sizeOfGLType(GLenum type);
+
+/* Sets up format for the given vertex and normal types. For quantized
+ * vertex types origin and scale are fitted to the bounding box min, max
+ * of the positions that will be stored; min and max are ignored
+ * otherwise and may be NULL. Returns non-zero on success and 0 for an
+ * unsupported type.
+ */
+extern int fitGLVertexFormat(GLVERTEXFORMAT *format, GLenum vertexType, GLenum normalType,
+                             const GLfloat min[3], const GLfloat max[3]);
+
+/* Converts count xyz positions to the vertex type of format, writing them
+ * tightly packed to destination. Positions outside the box the format
+ * was fitted to are clamped.
+ */
+extern void convertGLVertices(const GLVERTEXFORMAT *format, const GLfloat *positions,
+                              long count, GLvoid *destination);
+
+/* Converts count unit xyz normals to the normal type of format, writing
+ * them tightly packed to destination.
+ */
+extern void convertGLNormals(const GLVERTEXFORMAT *format, const GLfloat *normals,
+                             long count, GLvoid *destination);
+
+/* Allocates an object with room for the given number of vertices and,
+ * when indices is non-zero, an index array of that length, storing
+ * vertices and normals in the given format. The object and its arrays
+ * share one heap block, each starting on a cache line. Returns NULL if
+ * the allocation fails.
+ */
+extern GLOBJECT *newGLObject(const GLVERTEXFORMAT *format, long vertices,
+                             int vertexComponents, int useNormalArray, long indices);
+
+/* As newGLObject, but the block comes from arena. freeGLObject then only
+ * deletes the buffer objects; the memory goes away with the arena, so
+ * all objects of a scene built in one arena sit in one block.
+ */
+extern GLOBJECT *newGLObjectInArena(ARENA *arena, const GLVERTEXFORMAT *format,
+                                    long vertices, int vertexComponents,
+                                    int useNormalArray, long indices);
+
+/* Frees the object and all of its arrays and buffer objects, or only the
+ * buffer objects of an object in an arena. NULL is accepted.
+ */
+extern void freeGLObject(GLOBJECT *object);
+
+/* Creates buffer objects for the arrays of the object and uploads their
+ * contents. Needs a current GL context. Returns non-zero on success and 0
+ * on failure, in which case the object keeps drawing from client memory.
+ */
+extern int createGLObjectBuffers(GLOBJECT *object);
+
+/* Deletes the buffer objects of the object, which then draws from client
+ * memory again. Needs a current GL context.
+ */
+extern void deleteGLObjectBuffers(GLOBJECT *object);
+
+/* Binds the arrays of the object and draws it as triangles, indexed when
+ * the object has an index array.
+ */
+extern void drawGLObject(GLOBJECT *object);
+
+/* As drawGLObject, but draws only rangeCount ranges of indices, or of
+ * vertices for an object without an index array. NULL ranges draws the
+ * whole object.
+ */
+extern void drawGLObjectRanges(GLOBJECT *object, const GLOBJECTRANGE *ranges,
+                               int rangeCount);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !GLOBJECT_H_INCLUDED
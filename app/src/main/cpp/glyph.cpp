@@ -0,0 +1,678 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+#include "glyph.h"
+#include "log.h"
+#include "profile.h"
+
+
+using Eigen::Matrix3f;
+using Eigen::Matrix3Xf;
+using Eigen::Vector3f;
+
+#define GLYPH_MAX_LEVELS    6
+#define GLYPH_TWO_PI        6.2831853071795865f
+// Upper limit of GLYPHPARAMS clusterSize.
+#define GLYPH_MAX_CLUSTER_SIZE  8
+#define GLYPH_MAX_CLUSTER_SAMPLES \
+        (GLYPH_MAX_CLUSTER_SIZE * GLYPH_MAX_CLUSTER_SIZE * GLYPH_MAX_CLUSTER_SIZE)
+
+// Alignment of the arrays inside the GLYPHSET storage block.
+#define GLYPH_ARRAY_ALIGNMENT   64
+
+
+/* Arrow mesh along +z in a local frame. The x and y position components
+ * are radial offsets in field units, z is the position along the arrow as
+ * a fraction of its length. Each face has its own vertices so that the
+ * flat shaded provoking vertex always carries the face normal.
+ */
+struct ArrowTemplate {
+    Matrix3Xf positions;
+    Matrix3Xf normals;
+    Eigen::Matrix<GLushort, Eigen::Dynamic, 1> indices;
+    int vertexCount;
+    int indexCount;
+};
+
+
+static void addTemplateVertex(ArrowTemplate *arrow, float x, float y, float z,
+                              float nx, float ny, float nz) {
+    arrow->positions.col(arrow->vertexCount) << x, y, z;
+    arrow->normals.col(arrow->vertexCount) << nx, ny, nz;
+    arrow->vertexCount++;
+}
+
+static void addTemplateTriangle(ArrowTemplate *arrow, int a, int b, int c) {
+    arrow->indices[arrow->indexCount++] = (GLushort) a;
+    arrow->indices[arrow->indexCount++] = (GLushort) b;
+    arrow->indices[arrow->indexCount++] = (GLushort) c;
+}
+
+/* Ring of sides vertices at axial position z, with a fan of triangles
+ * facing -z closing it.
+ */
+static void addTemplateCap(ArrowTemplate *arrow, int sides, float radius, float z) {
+    int first = arrow->vertexCount, i;
+    for (i = 0; i < sides; i++) {
+        float angle = GLYPH_TWO_PI * i / sides;
+        addTemplateVertex(arrow, radius * cosf(angle), radius * sinf(angle), z, 0, 0, -1);
+    }
+    for (i = 1; i + 1 < sides; i++)
+        addTemplateTriangle(arrow, first, first + i + 1, first + i);
+}
+
+// Vertices of an arrow template.
+static int arrowVertices(int shaftSides, int coneSides) {
+    return 5 * shaftSides + 4 * coneSides;
+}
+
+static void buildArrowTemplate(ArrowTemplate *arrow, const GLYPHPARAMS *params,
+                               int shaftSides, int coneSides) {
+    float shaftRadius = params->shaftRadius * params->lengthScale;
+    float headRadius = params->headRadius * params->lengthScale;
+    float headStart = 1 - params->headLength;
+    // Cone normals are exact for an arrow of length lengthScale.
+    float slopeRadial = params->headLength * params->lengthScale;
+    float slopeAxial = headRadius;
+    float slopeLength = sqrtf(slopeRadial * slopeRadial + slopeAxial * slopeAxial);
+    int vertices = arrowVertices(shaftSides, coneSides);
+    int indices = 3 * (3 * shaftSides - 2) + 3 * (2 * coneSides - 2);
+    int i;
+
+    arrow->positions.resize(3, vertices);
+    arrow->normals.resize(3, vertices);
+    arrow->indices.resize(indices);
+    arrow->vertexCount = arrow->indexCount = 0;
+
+    for (i = 0; i < shaftSides; i++) {
+        float a0 = GLYPH_TWO_PI * i / shaftSides;
+        float a1 = GLYPH_TWO_PI * (i + 1) / shaftSides;
+        float am = (a0 + a1) / 2;
+        float x0 = shaftRadius * cosf(a0), y0 = shaftRadius * sinf(a0);
+        float x1 = shaftRadius * cosf(a1), y1 = shaftRadius * sinf(a1);
+        int first = arrow->vertexCount;
+        addTemplateVertex(arrow, x0, y0, 0, cosf(am), sinf(am), 0);
+        addTemplateVertex(arrow, x1, y1, 0, cosf(am), sinf(am), 0);
+        addTemplateVertex(arrow, x1, y1, headStart, cosf(am), sinf(am), 0);
+        addTemplateVertex(arrow, x0, y0, headStart, cosf(am), sinf(am), 0);
+        addTemplateTriangle(arrow, first, first + 1, first + 2);
+        addTemplateTriangle(arrow, first, first + 2, first + 3);
+    }
+    addTemplateCap(arrow, shaftSides, shaftRadius, 0);
+
+    for (i = 0; i < coneSides; i++) {
+        float a0 = GLYPH_TWO_PI * i / coneSides;
+        float a1 = GLYPH_TWO_PI * (i + 1) / coneSides;
+        float am = (a0 + a1) / 2;
+        float nx = cosf(am) * slopeRadial / slopeLength;
+        float ny = sinf(am) * slopeRadial / slopeLength;
+        float nz = slopeAxial / slopeLength;
+        int first = arrow->vertexCount;
+        addTemplateVertex(arrow, headRadius * cosf(a0), headRadius * sinf(a0), headStart,
+                          nx, ny, nz);
+        addTemplateVertex(arrow, headRadius * cosf(a1), headRadius * sinf(a1), headStart,
+                          nx, ny, nz);
+        addTemplateVertex(arrow, 0, 0, 1, nx, ny, nz);
+        addTemplateTriangle(arrow, first, first + 1, first + 2);
+    }
+    addTemplateCap(arrow, coneSides, headRadius, headStart);
+}
+
+
+static int coneSidesForLevel(const GLYPHPARAMS *params, int level) {
+    int sides = params->coneSides >> level;
+    return sides < params->minConeSides ? params->minConeSides : sides;
+}
+
+static int levelCount(const GLYPHPARAMS *params) {
+    int levels = 1;
+    while (levels < GLYPH_MAX_LEVELS &&
+           coneSidesForLevel(params, levels) < coneSidesForLevel(params, levels - 1))
+        levels++;
+    return levels;
+}
+
+// Cone level of detail of an arrow of the given length at position.
+static int selectLevel(const GLYPHPARAMS *params, const float *position, float length,
+                       int levels) {
+    float dx = position[0] - params->eye[0];
+    float dy = position[1] - params->eye[1];
+    float dz = position[2] - params->eye[2];
+    float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+    float ratio = length / (distance > 1e-6f ? distance : 1e-6f);
+    int level = 0;
+    if (ratio <= 0)
+        return levels - 1;
+    // Smallest level whose 2^level times the ratio reaches detailSize.
+    // log2f is missing from the android-9 libm.
+    while (level < levels - 1 && ratio < params->detailSize) {
+        ratio *= 2;
+        level++;
+    }
+    return level;
+}
+
+static size_t alignSize(size_t size) {
+    return (size + GLYPH_ARRAY_ALIGNMENT - 1) & ~(size_t) (GLYPH_ARRAY_ALIGNMENT - 1);
+}
+
+/* The functions up to buildGlyphs take either a dense FIELD or an
+ * OCTREEFIELD, which share the lattice members.
+ */
+
+template <class Field>
+static void samplePosition(const Field *field, long n, float *position) {
+    long i = n % field->nx, j = n / field->nx % field->ny, k = n / field->nx / field->ny;
+    position[0] = field->origin[0] + i * field->spacing[0];
+    position[1] = field->origin[1] + j * field->spacing[1];
+    position[2] = field->origin[2] + k * field->spacing[2];
+}
+
+
+/* The used samples, every stride:th along each axis, split into bricks of
+ * size samples per axis. Bricks are numbered x fastest.
+ */
+struct BrickGrid {
+    int stride;
+    int size;
+    int bricks[3];
+    int count;
+};
+
+template <class Field>
+static void initBrickGrid(BrickGrid *grid, const Field *field, const GLYPHPARAMS *params) {
+    int samples[3] = {field->nx, field->ny, field->nz}, a;
+    grid->stride = params->stride;
+    grid->size = params->clusterSize;
+    grid->count = 1;
+    for (a = 0; a < 3; a++) {
+        int used = (samples[a] + grid->stride - 1) / grid->stride;
+        grid->bricks[a] = (used + grid->size - 1) / grid->size;
+        grid->count *= grid->bricks[a];
+    }
+}
+
+// First field sample of brick along each axis.
+static void brickOrigin(const BrickGrid *grid, int brick, int first[3]) {
+    int step = grid->stride * grid->size;
+    first[0] = brick % grid->bricks[0] * step;
+    first[1] = brick / grid->bricks[0] % grid->bricks[1] * step;
+    first[2] = brick / grid->bricks[0] / grid->bricks[1] * step;
+}
+
+/* Subsampling of the used samples in brick for the screen space density
+ * of params: a power of two, at most the brick size.
+ */
+template <class Field>
+static int brickSubsampling(const BrickGrid *grid, const Field *field,
+                            const GLYPHPARAMS *params, int brick) {
+    float spacing = fminf(field->spacing[0], fminf(field->spacing[1], field->spacing[2]));
+    float distance = 0, pixels, wanted;
+    int first[3], a, subsampling = 1;
+
+    if (params->screenScale <= 0 || params->minSpacing <= 0 || params->density <= 0)
+        return 1;
+    // Distance from the eye to the nearest point of the brick.
+    brickOrigin(grid, brick, first);
+    for (a = 0; a < 3; a++) {
+        float low = field->origin[a] + first[a] * field->spacing[a];
+        float high = low + (grid->size - 1) * grid->stride * field->spacing[a];
+        float d = params->eye[a] < low ? low - params->eye[a] :
+                  params->eye[a] > high ? params->eye[a] - high : 0;
+        distance += d * d;
+    }
+    distance = sqrtf(distance);
+    if (distance < spacing)
+        return 1;
+
+    pixels = grid->stride * spacing * params->screenScale / distance;
+    wanted = params->minSpacing / params->density;
+    while (subsampling < grid->size && pixels * subsampling < wanted)
+        subsampling *= 2;
+    return subsampling;
+}
+
+/* Stores the field indices of every subsampling:th used sample of brick
+ * and returns their count.
+ */
+template <class Field>
+static int brickSamples(const BrickGrid *grid, const Field *field, int brick,
+                        int subsampling, long *samples) {
+    int size = grid->stride * grid->size, step = grid->stride * subsampling, count = 0;
+    int first[3], i, j, k;
+    brickOrigin(grid, brick, first);
+    for (k = first[2]; k < first[2] + size && k < field->nz; k += step)
+        for (j = first[1]; j < first[1] + size && j < field->ny; j += step)
+            for (i = first[0]; i < first[0] + size && i < field->nx; i += step)
+                samples[count++] = FIELD_INDEX(field, i, j, k);
+    return count;
+}
+
+/* Stores the positions and vectors of count samples, given by index, as
+ * x, y, z triples.
+ */
+static void gatherSamples(const FIELD *field, const long *samples, int count,
+                          float *positions, float *vectors) {
+    int s;
+    for (s = 0; s < count; s++) {
+        long n = samples[s];
+        samplePosition(field, n, positions + 3 * s);
+        vectors[3 * s] = field->x[n];
+        vectors[3 * s + 1] = field->y[n];
+        vectors[3 * s + 2] = field->z[n];
+    }
+}
+
+static void gatherSamples(const OCTREEFIELD *tree, const long *samples, int count,
+                          float *positions, float *vectors) {
+    int s;
+    for (s = 0; s < count; s++)
+        samplePosition(tree, samples[s], positions + 3 * s);
+    octreeFieldInterpolateBatch(tree, positions, count, vectors, NULL);
+}
+
+static void magnitudeRange(const FIELD *field, float *minimum, float *maximum) {
+    fieldMagnitudeRange(field, minimum, maximum);
+}
+
+static void magnitudeRange(const OCTREEFIELD *tree, float *minimum, float *maximum) {
+    *minimum = tree->minMagnitude;
+    *maximum = tree->maxMagnitude;
+}
+
+/* Level of detail of the arrow of a sample, or -1 when the sample is too
+ * short to get one.
+ */
+static int arrowLevel(const GLYPHPARAMS *params, const float *position, const float *vector,
+                      float maxMagnitude, float cutoff, int levelTotal) {
+    float magnitude = sqrtf(vector[0] * vector[0] + vector[1] * vector[1] +
+                            vector[2] * vector[2]);
+    if (magnitude < cutoff || magnitude <= 0)
+        return -1;
+    return selectLevel(params, position, params->lengthScale * magnitude / maxMagnitude,
+                       levelTotal);
+}
+
+
+void glyphParamsDefault(GLYPHPARAMS *params, const FIELD *field) {
+    float spacing = field->spacing[0];
+    if (field->spacing[1] < spacing)
+        spacing = field->spacing[1];
+    if (field->spacing[2] < spacing)
+        spacing = field->spacing[2];
+
+    memset(params, 0, sizeof(GLYPHPARAMS));
+    params->lengthScale = 0.9f * spacing;
+    params->shaftRadius = 0.04f;
+    params->headRadius = 0.12f;
+    params->headLength = 0.3f;
+    params->minMagnitude = 0.01f;
+    params->stride = 1;
+    params->shaftSides = 4;
+    params->coneSides = 8;
+    params->minConeSides = 3;
+    // Full detail up to 20 full length arrows away from the eye.
+    params->detailSize = 0.05f;
+    // 6 byte positions and 3 byte normals instead of 12 and 12.
+    params->vertexType = GL_SHORT;
+    params->normalType = GL_BYTE;
+    params->clusterSize = 4;
+    params->minSpacing = 8;
+    params->density = 1;
+}
+
+
+template <class Field>
+static int buildGlyphs(GLYPHSET *set, const Field *field, const GLYPHPARAMS *params,
+                       ARENA *arena) {
+    ArrowTemplate templates[GLYPH_MAX_LEVELS];
+    Matrix3Xf positions, normals;
+    BrickGrid bricks;
+    long samples[GLYPH_MAX_CLUSTER_SAMPLES];
+    float samplePositions[3 * GLYPH_MAX_CLUSTER_SAMPLES];
+    float sampleVectors[3 * GLYPH_MAX_CLUSTER_SAMPLES];
+    long *brickVertices;
+    float minMagnitude, maxMagnitude, cutoff, minColor = 0, colorRange = 0;
+    long vertices = 0, indices = 0, chunkVertices = 0, glyph = 0;
+    long vertexBase = 0, indexBase = 0;
+    size_t chunkBytes, clusterBytes, boxBytes, vertexBytes, normalBytes, indexBytes, colorBytes;
+    size_t size;
+    int levelTotal, level, chunkCount = 1, vertexSize, normalSize, b, s, i;
+    ProfileScope profile(PROFILE_STAGE_MESH_BUILD);
+    GLVERTEXFORMAT format;
+    GLfloat boundsMin[3], boundsMax[3];
+    unsigned char *vertexArray, *normalArray;
+    GLubyte *colorArray;
+    GLushort *indexArray;
+    unsigned char *storage;
+    GLOBJECT *chunk;
+    BVH bvh;
+
+    // Keep the hierarchy so that it can be refit.
+    bvh = set->bvh;
+    Eigen::internal::aligned_free(set->storage);
+    memset(set, 0, sizeof(GLYPHSET));
+    set->bvh = bvh;
+    if (params->shaftSides < 3 || params->shaftSides > GLYPH_MAX_SIDES ||
+        params->coneSides < 3 || params->coneSides > GLYPH_MAX_SIDES ||
+        params->minConeSides < 3 || params->stride < 1 ||
+        params->clusterSize < 1 || params->clusterSize > GLYPH_MAX_CLUSTER_SIZE)
+        return 0;
+    // A brick never straddles two chunks, so a full one must fit in one.
+    if ((long) params->clusterSize * params->clusterSize * params->clusterSize *
+        arrowVertices(params->shaftSides, params->coneSides) > GLOBJECT_MAX_VERTICES) {
+        LOGE(MESH, "glyph bricks of %d^3 arrows of %d and %d sides too large for %d vertices",
+             params->clusterSize, params->shaftSides, params->coneSides,
+             GLOBJECT_MAX_VERTICES);
+        return 0;
+    }
+    if (params->colorField != NULL) {
+        const SCALARFIELD *colors = params->colorField;
+        float maxColor;
+        if (colors->nx != field->nx || colors->ny != field->ny || colors->nz != field->nz)
+            return 0;
+        scalarFieldRange(colors, &minColor, &maxColor);
+        colorRange = maxColor - minColor;
+    }
+
+    // Arrows reach at most lengthScale beyond the samples.
+    for (i = 0; i < 3; i++) {
+        int count = i == 0 ? field->nx : i == 1 ? field->ny : field->nz;
+        boundsMin[i] = field->origin[i] - params->lengthScale;
+        boundsMax[i] = field->origin[i] + (count - 1) * field->spacing[i] +
+                       params->lengthScale;
+    }
+    if (!fitGLVertexFormat(&format, params->vertexType, params->normalType,
+                           boundsMin, boundsMax))
+        return 0;
+    vertexSize = 3 * sizeOfGLType(format.vertexType);
+    normalSize = 3 * sizeOfGLType(format.normalType);
+
+    levelTotal = levelCount(params);
+    for (level = 0; level < levelTotal; level++)
+        buildArrowTemplate(&templates[level], params, params->shaftSides,
+                           coneSidesForLevel(params, level));
+    positions.resize(3, templates[0].vertexCount);
+    normals.resize(3, templates[0].vertexCount);
+
+    magnitudeRange(field, &minMagnitude, &maxMagnitude);
+    if (maxMagnitude <= 0)
+        return bvhUpdate(&set->bvh, NULL, 0);
+    cutoff = params->minMagnitude * maxMagnitude;
+    initBrickGrid(&bricks, field, params);
+
+    /* First pass: pick the level of every arrow and count the vertices,
+     * indices and chunks, so that everything fits in one allocation. A
+     * brick never straddles two chunks. The second pass gathers the same
+     * samples again and picks the same levels.
+     */
+    brickVertices = (long *) malloc(bricks.count * sizeof(long));
+    if (brickVertices == NULL)
+        return 0;
+    for (b = 0; b < bricks.count; b++) {
+        int sampleCount = brickSamples(&bricks, field, b,
+                                       brickSubsampling(&bricks, field, params, b), samples);
+        gatherSamples(field, samples, sampleCount, samplePositions, sampleVectors);
+        brickVertices[b] = 0;
+        for (s = 0; s < sampleCount; s++) {
+            int level = arrowLevel(params, samplePositions + 3 * s, sampleVectors + 3 * s,
+                                   maxMagnitude, cutoff, levelTotal);
+            const ArrowTemplate *arrow;
+            if (level < 0)
+                continue;
+            arrow = &templates[level];
+            brickVertices[b] += arrow->vertexCount;
+            indices += arrow->indexCount;
+            set->glyphCount++;
+        }
+        if (chunkVertices + brickVertices[b] > GLOBJECT_MAX_VERTICES) {
+            chunkCount++;
+            chunkVertices = 0;
+        }
+        chunkVertices += brickVertices[b];
+        vertices += brickVertices[b];
+    }
+    if (set->glyphCount == 0) {
+        free(brickVertices);
+        return bvhUpdate(&set->bvh, NULL, 0);
+    }
+
+    chunkBytes = alignSize(chunkCount * sizeof(GLOBJECT));
+    clusterBytes = alignSize(bricks.count * sizeof(GLYPHCLUSTER));
+    boxBytes = alignSize(bricks.count * sizeof(BVHBOX));
+    vertexBytes = alignSize(vertices * vertexSize);
+    normalBytes = alignSize(vertices * normalSize);
+    indexBytes = alignSize(indices * sizeof(GLushort));
+    colorBytes = alignSize(vertices * 4 * sizeof(GLubyte));
+    size = chunkBytes + clusterBytes + boxBytes + vertexBytes + normalBytes + indexBytes +
+           colorBytes;
+    if (arena != NULL)
+        storage = (unsigned char *) arenaAlloc(arena, size);
+    else
+        storage = (unsigned char *) Eigen::internal::aligned_malloc(size);
+    if (storage == NULL) {
+        free(brickVertices);
+        set->glyphCount = 0;
+        return 0;
+    }
+    set->storage = arena != NULL ? NULL : storage;
+    set->chunks = (GLOBJECT *) storage;
+    set->clusters = (GLYPHCLUSTER *) (storage + chunkBytes);
+    set->clusterBoxes = (BVHBOX *) (storage + chunkBytes + clusterBytes);
+    vertexArray = storage + chunkBytes + clusterBytes + boxBytes;
+    normalArray = vertexArray + vertexBytes;
+    indexArray = (GLushort *) (normalArray + normalBytes);
+    colorArray = (GLubyte *) indexArray + indexBytes;
+    memset(set->chunks, 0, chunkCount * sizeof(GLOBJECT));
+    set->clusterCount = bricks.count;
+    set->vertexCount = vertices;
+    set->indexCount = indices;
+
+    // Second pass: place a copy of the template of each arrow.
+    set->chunkCount = 1;
+    chunk = &set->chunks[0];
+    chunk->vertexArray = vertexArray;
+    chunk->normalArray = normalArray;
+    chunk->colorArray = colorArray;
+    chunk->indexArray = indexArray;
+    chunk->format = format;
+    chunk->vertexComponents = 3;
+    for (b = 0; b < bricks.count; b++) {
+        int sampleCount = brickSamples(&bricks, field, b,
+                                       brickSubsampling(&bricks, field, params, b), samples);
+        GLYPHCLUSTER *cluster = &set->clusters[b];
+        BVHBOX *box = &set->clusterBoxes[b];
+
+        gatherSamples(field, samples, sampleCount, samplePositions, sampleVectors);
+
+        if (chunk->count + brickVertices[b] > GLOBJECT_MAX_VERTICES) {
+            vertexBase += chunk->count;
+            indexBase += chunk->indexCount;
+            chunk = &set->chunks[set->chunkCount++];
+            chunk->vertexArray = vertexArray + vertexBase * vertexSize;
+            chunk->normalArray = normalArray + vertexBase * normalSize;
+            chunk->colorArray = colorArray + vertexBase * 4;
+            chunk->indexArray = indexArray + indexBase;
+            chunk->format = format;
+            chunk->vertexComponents = 3;
+        }
+        cluster->chunk = set->chunkCount - 1;
+        cluster->firstIndex = chunk->indexCount;
+        bvhBoxSetEmpty(box);
+
+        for (s = 0; s < sampleCount; s++) {
+            int level = arrowLevel(params, samplePositions + 3 * s, sampleVectors + 3 * s,
+                                   maxMagnitude, cutoff, levelTotal);
+            const ArrowTemplate *arrow;
+            Vector3f position, direction, u, w;
+            Matrix3f frame;
+            GLubyte color[4];
+            float magnitude, sign, a, c;
+            long v;
+
+            if (level < 0)
+                continue;
+            arrow = &templates[level];
+
+            position = Vector3f::Map(samplePositions + 3 * s);
+            direction = Vector3f::Map(sampleVectors + 3 * s);
+            magnitude = direction.norm();
+            direction /= magnitude;
+
+            // Orthonormal frame around the direction, branchless except
+            // for the sign (Duff et al. 2017).
+            sign = direction.z() >= 0 ? 1.0f : -1.0f;
+            a = -1 / (sign + direction.z());
+            c = direction.x() * direction.y() * a;
+            u << 1 + sign * direction.x() * direction.x() * a, sign * c,
+                 -sign * direction.x();
+            w << c, sign + direction.y() * direction.y() * a, -direction.y();
+
+            frame << u, w, direction;
+            normals.leftCols(arrow->vertexCount).noalias() = frame * arrow->normals;
+            frame.col(2) *= params->lengthScale * magnitude / maxMagnitude;
+            positions.leftCols(arrow->vertexCount).noalias() = frame * arrow->positions;
+            positions.leftCols(arrow->vertexCount).colwise() += position;
+            bvhBoxExtend(box, positions.data(), arrow->vertexCount);
+
+            if (params->colorField == NULL)
+                fieldMagnitudeColor(magnitude / maxMagnitude, color);
+            else
+                fieldMagnitudeColor(colorRange > 0 ? (params->colorField->values[samples[s]] -
+                                                      minColor) / colorRange : 0.5f, color);
+            {
+                GLubyte *vertexColor = chunk->colorArray + chunk->count * 4;
+                GLushort *index = chunk->indexArray + chunk->indexCount;
+                convertGLVertices(&format, positions.data(), arrow->vertexCount,
+                                  (GLubyte *) chunk->vertexArray +
+                                  chunk->count * vertexSize);
+                convertGLNormals(&format, normals.data(), arrow->vertexCount,
+                                 (GLubyte *) chunk->normalArray +
+                                 chunk->count * normalSize);
+                for (v = 0; v < arrow->vertexCount; v++)
+                    memcpy(vertexColor + v * 4, color, 4);
+                for (v = 0; v < arrow->indexCount; v++)
+                    index[v] = (GLushort) (chunk->count + arrow->indices[v]);
+            }
+            chunk->count += arrow->vertexCount;
+            chunk->indexCount += arrow->indexCount;
+            glyph++;
+        }
+        cluster->indexCount = chunk->indexCount - cluster->firstIndex;
+    }
+    free(brickVertices);
+
+    if (!bvhUpdate(&set->bvh, set->clusterBoxes, set->clusterCount))
+        return 0;
+    LOGD(MESH, "glyphs: %ld arrows, %ld vertices, %ld indices in %d chunks, %d levels, "
+         "%d clusters", glyph, set->vertexCount, set->indexCount, set->chunkCount,
+         levelTotal, set->clusterCount);
+    return 1;
+}
+
+
+int glyphSetBuild(GLYPHSET *set, const FIELD *field, const GLYPHPARAMS *params,
+                  ARENA *arena) {
+    return buildGlyphs(set, field, params, arena);
+}
+
+
+int glyphSetBuildOctree(GLYPHSET *set, const OCTREEFIELD *tree, const GLYPHPARAMS *params,
+                        ARENA *arena) {
+    return buildGlyphs(set, tree, params, arena);
+}
+
+
+void glyphSetDeinit(GLYPHSET *set) {
+    glyphSetDeleteBuffers(set);
+    bvhDeinit(&set->bvh);
+    Eigen::internal::aligned_free(set->storage);
+    memset(set, 0, sizeof(GLYPHSET));
+}
+
+
+void glyphSetCreateBuffers(GLYPHSET *set) {
+    int c;
+    for (c = 0; c < set->chunkCount; c++)
+        createGLObjectBuffers(&set->chunks[c]);
+}
+
+
+void glyphSetDeleteBuffers(GLYPHSET *set) {
+    int c;
+    for (c = 0; c < set->chunkCount; c++)
+        deleteGLObjectBuffers(&set->chunks[c]);
+}
+
+
+void drawGlyphSet(GLYPHSET *set, const FRUSTUM *frustum, ARENA *scratch,
+                  CULLSTATS *stats) {
+    unsigned char *visible = NULL;
+    GLOBJECTRANGE *ranges = NULL;
+    int b, c, rangeCount;
+
+    if (frustum != NULL && set->clusterCount > 0) {
+        visible = (unsigned char *) arenaAlloc(scratch, set->clusterCount);
+        ranges = (GLOBJECTRANGE *) arenaAlloc(scratch,
+                                              set->clusterCount * sizeof(GLOBJECTRANGE));
+    }
+    if (visible == NULL || ranges == NULL) {
+        for (c = 0; c < set->chunkCount; c++)
+            drawGLObject(&set->chunks[c]);
+        if (stats != NULL)
+            stats->drawCalls += set->chunkCount;
+        return;
+    }
+
+    bvhCull(&set->bvh, frustum, visible, stats);
+    // Clusters are in chunk order; merge neighbouring visible ones.
+    b = 0;
+    for (c = 0; c < set->chunkCount; c++) {
+        rangeCount = 0;
+        for (; b < set->clusterCount && set->clusters[b].chunk == c; b++) {
+            const GLYPHCLUSTER *cluster = &set->clusters[b];
+            if (cluster->indexCount == 0)
+                continue;
+            if (!visible[b]) {
+                if (stats != NULL)
+                    stats->clustersCulled++;
+                continue;
+            }
+            if (stats != NULL)
+                stats->clustersDrawn++;
+            if (rangeCount > 0 && ranges[rangeCount - 1].last == cluster->firstIndex)
+                ranges[rangeCount - 1].last += cluster->indexCount;
+            else {
+                ranges[rangeCount].first = cluster->firstIndex;
+                ranges[rangeCount].last = cluster->firstIndex + cluster->indexCount;
+                rangeCount++;
+            }
+        }
+        if (rangeCount > 0)
+            drawGLObjectRanges(&set->chunks[c], ranges, rangeCount);
+        if (stats != NULL)
+            stats->drawCalls += rangeCount;
+    }
+}
@@ -0,0 +1,179 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef GLYPH_H_INCLUDED
+#define GLYPH_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "globject.h"
+#include "field.h"
+#include "octree.h"
+#include "arena.h"
+#include "bvh.h"
+
+
+// Upper limit of GLYPHPARAMS coneSides and shaftSides.
+#define GLYPH_MAX_SIDES     32
+
+
+/* Shape and level of detail of arrow glyphs. Lengths are in field
+ * coordinates.
+ */
+typedef struct {
+    // Length of the arrow of the largest vector in the field.
+    float lengthScale;
+    // Radii of the shaft and the cone base, and the cone length, as
+    // fractions of lengthScale.
+    float shaftRadius;
+    float headRadius;
+    float headLength;
+    // Samples shorter than this fraction of the largest vector get no glyph.
+    float minMagnitude;
+    // Use every stride:th sample along each axis.
+    int stride;
+    // Sides of the shaft prism and, at full detail, of the cone.
+    int shaftSides;
+    int coneSides;
+    int minConeSides;
+    /* Level of detail. Arrows whose length over their distance to eye is
+     * at least detailSize get coneSides; the cone sides halve, down to
+     * minConeSides, each time that ratio halves. So distant arrows and
+     * short arrows in dense regions get cheaper cones.
+     */
+    float eye[3];
+    float detailSize;
+    /* Storage of the arrow vertices and normals, see GLVERTEXFORMAT.
+     * Quantized vertices are fitted to the bounds of the field.
+     */
+    GLenum vertexType;
+    GLenum normalType;
+    /* Samples along each axis of the bricks that are culled as one. A
+     * brick of full detail arrows must fit in GLOBJECT_MAX_VERTICES, so
+     * the cube of clusterSize times 5 * shaftSides + 4 * coneSides may not
+     * exceed it.
+     */
+    int clusterSize;
+    /* Screen space density. Within each brick only every 2^n:th sample
+     * gets an arrow, with n the smallest that keeps the arrows nearest to
+     * eye at least minSpacing / density pixels apart, up to one arrow per
+     * brick. screenScale is the pixels per unit length at unit distance,
+     * 0 to draw every sample.
+     */
+    float screenScale;
+    float minSpacing;
+    float density;
+    /* Scalar on the lattice of the field that colors the arrows over its
+     * range, such as the divergence of a FIELDANALYSIS. NULL colors them
+     * by magnitude.
+     */
+    const SCALARFIELD *colorField;
+} GLYPHPARAMS;
+
+/* Arrows of one brick of samples: a range of indices in one chunk.
+ */
+typedef struct {
+    int chunk;
+    long firstIndex;
+    long indexCount;
+} GLYPHCLUSTER;
+
+/* Arrows for the samples of a field. All arrows are written in one pass to
+ * one allocation, split into indexed GL objects of at most
+ * GLOBJECT_MAX_VERTICES vertices each. The arrows share one material and
+ * are stored transformed, with per-vertex colors, so each chunk is a
+ * batch that draws in one call under the GL state appInit sets once.
+ *
+ * The arrows are written brick by brick, so the arrows of a brick are
+ * one index range of a chunk. Every brick is a cluster, empty or not, and
+ * the bounding hierarchy over the cluster boxes is kept across rebuilds,
+ * so an animated field only refits it.
+ */
+typedef struct {
+    GLOBJECT *chunks;
+    int chunkCount;
+    long glyphCount;
+    long vertexCount;
+    long indexCount;
+    GLYPHCLUSTER *clusters;
+    BVHBOX *clusterBoxes;
+    int clusterCount;
+    BVH bvh;
+    // The single heap block holding the chunks and all of their arrays,
+    // NULL when they were allocated from an arena.
+    void *storage;
+} GLYPHSET;
+
+
+/* Fills in parameters that fit the grid spacing of the field.
+ */
+extern void glyphParamsDefault(GLYPHPARAMS *params, const FIELD *field);
+
+/* Builds arrows for the field samples, oriented along and scaled by the
+ * sample vectors and colored by magnitude or params colorField. The
+ * chunks and their arrays come from arena, or from the heap when arena is
+ * NULL. Replaces the arrows of set, which must be zero filled or hold
+ * earlier arrows whose buffer objects were deleted. Makes no GL calls.
+ * Returns non-zero on success and 0 on failure.
+ */
+extern int glyphSetBuild(GLYPHSET *set, const FIELD *field, const GLYPHPARAMS *params,
+                         ARENA *arena);
+
+/* glyphSetBuild for a sparse field. The samples of each cluster are read
+ * with one batched query.
+ */
+extern int glyphSetBuildOctree(GLYPHSET *set, const OCTREEFIELD *tree,
+                               const GLYPHPARAMS *params, ARENA *arena);
+
+/* Deletes the buffer objects and frees the arrows unless they are in an
+ * arena, and frees the hierarchy.
+ */
+extern void glyphSetDeinit(GLYPHSET *set);
+
+/* Moves the arrows into GL buffer objects. Needs a current GL context.
+ */
+extern void glyphSetCreateBuffers(GLYPHSET *set);
+
+/* Deletes the buffer objects, after which the arrows are drawn from client
+ * memory and glyphSetDeinit makes no GL calls. Needs a current GL context.
+ */
+extern void glyphSetDeleteBuffers(GLYPHSET *set);
+
+/* Draws the clusters that may be inside frustum, or all of them when
+ * frustum is NULL. Neighbouring visible clusters of a chunk are merged
+ * into one index range, so a chunk takes one draw call unless culling
+ * splits it, and only the client arrays are switched around it. The
+ * per-frame scratch comes from scratch. Adds the counts of this draw to
+ * stats, which may be NULL.
+ */
+extern void drawGlyphSet(GLYPHSET *set, const FRUSTUM *frustum, ARENA *scratch,
+                         CULLSTATS *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !GLYPH_H_INCLUDED
@@ -43,8 +43,21 @@ static HMODULE sGLESDLL = NULL;
 
 #ifdef LINUX
 #include <stdlib.h>
+#include <string.h>
 #include <dlfcn.h>
 static void *sGLESSO = NULL;
+#ifdef IMPORTGL_SOFTWARE
+#include "softgl.h"
+#endif // IMPORTGL_SOFTWARE
+
+static void *getProcAddress(const char *name)
+{
+#ifdef IMPORTGL_SOFTWARE
+    if (sGLESSO == NULL)
+        return softglGetProcAddress(name);
+#endif // IMPORTGL_SOFTWARE
+    return dlsym(sGLESSO, name);
+}
 #endif // LINUX
 
 #endif /* DISABLE_IMPORTGL */
@@ -62,14 +75,32 @@ static void *sGLESSO = NULL;
  * with preprocessor macros (see importgl.h).
  */
 int importGLInit()
+{
+    int backend = IMPORTGL_BACKEND_NATIVE;
+#if defined(LINUX) && !defined(DISABLE_IMPORTGL)
+    const char *name = getenv("IMPORTGL_BACKEND");
+    if (name != NULL && strcmp(name, "software") == 0)
+        backend = IMPORTGL_BACKEND_SOFTWARE;
+#endif
+    return importGLInitBackend(backend);
+}
+
+
+int importGLInitBackend(int backend)
 {
     int result = 1;
 
+#if defined(DISABLE_IMPORTGL) || !defined(IMPORTGL_SOFTWARE)
+    if (backend != IMPORTGL_BACKEND_NATIVE)
+        return 0;   // Software backend is not built in.
+#endif
+
 #ifndef DISABLE_IMPORTGL
 
 #undef IMPORT_FUNC
 
 #ifdef WIN32
+    (void) backend;
     sGLESDLL = LoadLibrary(_T("libGLES_CM.dll"));
     if (sGLESDLL == NULL)
         sGLESDLL = LoadLibrary(_T("libGLES_CL.dll"));
@@ -88,18 +119,27 @@ int importGLInit()
 #endif // WIN32
 
 #ifdef LINUX
+#ifdef IMPORTGL_SOFTWARE
+    if (backend == IMPORTGL_BACKEND_SOFTWARE)
+        sGLESSO = NULL;     // Functions come from softglGetProcAddress.
+    else
+#else
+    (void) backend;
+#endif // IMPORTGL_SOFTWARE
+    {
 #ifdef ANDROID_NDK
-    sGLESSO = dlopen("libGLESv1_CM.so", RTLD_NOW);
+        sGLESSO = dlopen("libGLESv1_CM.so", RTLD_NOW);
 #else /* !ANDROID_NDK */
-    sGLESSO = dlopen("libGLES_CM.so", RTLD_NOW);
-    if (sGLESSO == NULL)
-        sGLESSO = dlopen("libGLES_CL.so", RTLD_NOW);
+        sGLESSO = dlopen("libGLES_CM.so", RTLD_NOW);
+        if (sGLESSO == NULL)
+            sGLESSO = dlopen("libGLES_CL.so", RTLD_NOW);
 #endif /* !ANDROID_NDK */
-    if (sGLESSO == NULL)
-        return 0;   // Cannot find OpenGL ES Common or Common Lite SO.
+        if (sGLESSO == NULL)
+            return 0;   // Cannot find OpenGL ES Common or Common Lite SO.
+    }
 
 #define IMPORT_FUNC(funcName) do { \
-        void *procAddress = (void *)dlsym(sGLESSO, #funcName); \
+        void *procAddress = getProcAddress(#funcName); \
         if (procAddress == NULL) result = 0; \
         *((void **)&FNPTR(funcName)) = procAddress; } while (0)
 #endif // LINUX
@@ -120,17 +160,27 @@ int importGLInit()
     IMPORT_FUNC(eglTerminate);
 #endif /* !ANDROID_NDK */
 
+    IMPORT_FUNC(glBindBuffer);
+    IMPORT_FUNC(glBindTexture);
     IMPORT_FUNC(glBlendFunc);
+    IMPORT_FUNC(glBufferData);
+    IMPORT_FUNC(glBufferSubData);
     IMPORT_FUNC(glClear);
     IMPORT_FUNC(glClearColorx);
     IMPORT_FUNC(glColor4x);
     IMPORT_FUNC(glColorPointer);
+    IMPORT_FUNC(glDeleteBuffers);
+    IMPORT_FUNC(glDeleteTextures);
     IMPORT_FUNC(glDisable);
     IMPORT_FUNC(glDisableClientState);
     IMPORT_FUNC(glDrawArrays);
+    IMPORT_FUNC(glDrawElements);
     IMPORT_FUNC(glEnable);
     IMPORT_FUNC(glEnableClientState);
+    IMPORT_FUNC(glFlush);
     IMPORT_FUNC(glFrustumx);
+    IMPORT_FUNC(glGenBuffers);
+    IMPORT_FUNC(glGenTextures);
     IMPORT_FUNC(glGetError);
     IMPORT_FUNC(glLightxv);
     IMPORT_FUNC(glLoadIdentity);
@@ -144,6 +194,10 @@ int importGLInit()
     IMPORT_FUNC(glRotatex);
     IMPORT_FUNC(glScalex);
     IMPORT_FUNC(glShadeModel);
+    IMPORT_FUNC(glTexCoordPointer);
+    IMPORT_FUNC(glTexImage2D);
+    IMPORT_FUNC(glTexParameterx);
+    IMPORT_FUNC(glTexSubImage2D);
     IMPORT_FUNC(glTranslatex);
     IMPORT_FUNC(glVertexPointer);
     IMPORT_FUNC(glViewport);
@@ -162,7 +216,12 @@ void importGLDeinit()
 #endif
 
 #ifdef LINUX
-    dlclose(sGLESSO);
+    if (sGLESSO != NULL)
+        dlclose(sGLESSO);
+    sGLESSO = NULL;
+#ifdef IMPORTGL_SOFTWARE
+    softglDeinit();
+#endif // IMPORTGL_SOFTWARE
 #endif
 #endif /* DISABLE_IMPORTGL */
 }
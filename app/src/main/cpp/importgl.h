@@ -36,12 +36,25 @@ extern "C" {
 #include <GLES/egl.h>
 #endif /* !ANDROID_NDK */
 
+/* Backends importGLInitBackend can fetch the egl & gl functions from.
+ * The software backend is the CPU rasterizer of softgl.c, which is only
+ * available in builds with IMPORTGL_SOFTWARE defined.
+ */
+#define IMPORTGL_BACKEND_NATIVE     0
+#define IMPORTGL_BACKEND_SOFTWARE   1
+
 /* Dynamically fetches pointers to the egl & gl functions.
  * Should be called once on application initialization.
+ * The backend is native unless the IMPORTGL_BACKEND environment variable
+ * is set to "software".
  * Returns non-zero on success and 0 on failure.
  */
 extern int importGLInit();
 
+/* As importGLInit, but with an explicitly selected backend.
+ */
+extern int importGLInitBackend(int backend);
+
 /* Frees the handle to egl & gl functions library.
  */
 extern void importGLDeinit();
@@ -77,17 +90,27 @@ FNDEF(EGLBoolean, eglSwapBuffers, (EGLDisplay dpy, EGLSurface draw));
 FNDEF(EGLBoolean, eglTerminate, (EGLDisplay dpy));
 #endif /* !ANDROID_NDK */
 
+FNDEF(void, glBindBuffer, (GLenum target, GLuint buffer));
+FNDEF(void, glBindTexture, (GLenum target, GLuint texture));
 FNDEF(void, glBlendFunc, (GLenum sfactor, GLenum dfactor));
+FNDEF(void, glBufferData, (GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage));
+FNDEF(void, glBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data));
 FNDEF(void, glClear, (GLbitfield mask));
 FNDEF(void, glClearColorx, (GLclampx red, GLclampx green, GLclampx blue, GLclampx alpha));
 FNDEF(void, glColor4x, (GLfixed red, GLfixed green, GLfixed blue, GLfixed alpha));
 FNDEF(void, glColorPointer, (GLint size, GLenum type, GLsizei stride, const GLvoid *pointer));
+FNDEF(void, glDeleteBuffers, (GLsizei n, const GLuint *buffers));
+FNDEF(void, glDeleteTextures, (GLsizei n, const GLuint *textures));
 FNDEF(void, glDisable, (GLenum cap));
 FNDEF(void, glDisableClientState, (GLenum array));
 FNDEF(void, glDrawArrays, (GLenum mode, GLint first, GLsizei count));
+FNDEF(void, glDrawElements, (GLenum mode, GLsizei count, GLenum type, const GLvoid *indices));
 FNDEF(void, glEnable, (GLenum cap));
 FNDEF(void, glEnableClientState, (GLenum array));
+FNDEF(void, glFlush, (void));
 FNDEF(void, glFrustumx, (GLfixed left, GLfixed right, GLfixed bottom, GLfixed top, GLfixed zNear, GLfixed zFar));
+FNDEF(void, glGenBuffers, (GLsizei n, GLuint *buffers));
+FNDEF(void, glGenTextures, (GLsizei n, GLuint *textures));
 FNDEF(GLenum, glGetError, (void));
 FNDEF(void, glLightxv, (GLenum light, GLenum pname, const GLfixed *params));
 FNDEF(void, glLoadIdentity, (void));
@@ -101,6 +124,10 @@ FNDEF(void, glPushMatrix, (void));
 FNDEF(void, glRotatex, (GLfixed angle, GLfixed x, GLfixed y, GLfixed z));
 FNDEF(void, glScalex, (GLfixed x, GLfixed y, GLfixed z));
 FNDEF(void, glShadeModel, (GLenum mode));
+FNDEF(void, glTexCoordPointer, (GLint size, GLenum type, GLsizei stride, const GLvoid *pointer));
+FNDEF(void, glTexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels));
+FNDEF(void, glTexParameterx, (GLenum target, GLenum pname, GLfixed param));
+FNDEF(void, glTexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels));
 FNDEF(void, glTranslatex, (GLfixed x, GLfixed y, GLfixed z));
 FNDEF(void, glVertexPointer, (GLint size, GLenum type, GLsizei stride, const GLvoid *pointer));
 FNDEF(void, glViewport, (GLint x, GLint y, GLsizei width, GLsizei height));
@@ -129,17 +156,27 @@ FNDEF(void, glViewport, (GLint x, GLint y, GLsizei width, GLsizei height));
 #define eglTerminate            FNPTR(eglTerminate)
 #endif /* !ANDROID_NDK */
 
+#define glBindBuffer            FNPTR(glBindBuffer)
+#define glBindTexture           FNPTR(glBindTexture)
 #define glBlendFunc             FNPTR(glBlendFunc)
+#define glBufferData            FNPTR(glBufferData)
+#define glBufferSubData         FNPTR(glBufferSubData)
 #define glClear                 FNPTR(glClear)
 #define glClearColorx           FNPTR(glClearColorx)
 #define glColor4x               FNPTR(glColor4x)
 #define glColorPointer          FNPTR(glColorPointer)
+#define glDeleteBuffers         FNPTR(glDeleteBuffers)
+#define glDeleteTextures        FNPTR(glDeleteTextures)
 #define glDisable               FNPTR(glDisable)
 #define glDisableClientState    FNPTR(glDisableClientState)
 #define glDrawArrays            FNPTR(glDrawArrays)
+#define glDrawElements          FNPTR(glDrawElements)
 #define glEnable                FNPTR(glEnable)
 #define glEnableClientState     FNPTR(glEnableClientState)
+#define glFlush                 FNPTR(glFlush)
 #define glFrustumx              FNPTR(glFrustumx)
+#define glGenBuffers            FNPTR(glGenBuffers)
+#define glGenTextures           FNPTR(glGenTextures)
 #define glGetError              FNPTR(glGetError)
 #define glLightxv               FNPTR(glLightxv)
 #define glLoadIdentity          FNPTR(glLoadIdentity)
@@ -153,6 +190,10 @@ FNDEF(void, glViewport, (GLint x, GLint y, GLsizei width, GLsizei height));
 #define glRotatex               FNPTR(glRotatex)
 #define glScalex                FNPTR(glScalex)
 #define glShadeModel            FNPTR(glShadeModel)
+#define glTexCoordPointer       FNPTR(glTexCoordPointer)
+#define glTexImage2D            FNPTR(glTexImage2D)
+#define glTexParameterx         FNPTR(glTexParameterx)
+#define glTexSubImage2D         FNPTR(glTexSubImage2D)
 #define glTranslatex            FNPTR(glTranslatex)
 #define glVertexPointer         FNPTR(glVertexPointer)
 #define glViewport              FNPTR(glViewport)
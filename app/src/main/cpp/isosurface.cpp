@@ -0,0 +1,756 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+#include "isosurface.h"
+#include "log.h"
+#include "profile.h"
+
+
+// Alignment of the arrays inside the ISOSURFACE storage block.
+#define ISOSURFACE_ARRAY_ALIGNMENT  64
+
+
+/* Cube corner c sits at offset (c & 1, (c >> 1) & 1, c >> 2) from the
+ * cell origin, and its bit in the case index is set when its value is
+ * below the isovalue. Edges 0-3 run along x, 4-7 along y and 8-11 along
+ * z. Each row lists the triangles of a case as edge triples, ended by -1,
+ * wound counterclockwise seen from the side below the isovalue. On a face
+ * with two diagonal corners below, the surface cuts those corners off
+ * separately, so the two cells sharing the face agree. The polygons are
+ * fanned from a vertex that has no diagonal lying in a cube face, where
+ * it would touch the triangles of the neighbouring cell.
+ */
+static const signed char sTriangleTable[256][16] = {
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 5, 9, 4, 9, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 10, 0, 10, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 1, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 5, 9, 1, 9, 8, 1, 8, 10, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 1, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 11, 0, 11, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 9, 1, 9, 8, 1, 8, 4, -1, -1, -1, -1, -1, -1, -1},
+    {4, 10, 11, 4, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 10, 0, 10, 11, 0, 11, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 4, 10, 0, 10, 11, 0, 11, 9, -1, -1, -1, -1, -1, -1, -1},
+    {8, 10, 11, 8, 11, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 6, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 2, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 6, 4, 2, 4, 5, 2, 5, 9, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 10, 2, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 6, 0, 6, 10, 0, 10, 1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 1, 4, 10, 2, 6, 8, -1, -1, -1, -1, -1, -1, -1},
+    {1, 5, 9, 1, 9, 2, 1, 2, 6, 1, 6, 10, -1, -1, -1, -1},
+    {1, 11, 5, 2, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 6, 0, 6, 4, 1, 11, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 11, 0, 11, 9, 2, 6, 8, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 9, 1, 9, 2, 1, 2, 6, 1, 6, 4, -1, -1, -1, -1},
+    {2, 6, 8, 4, 10, 11, 4, 11, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 6, 0, 6, 10, 0, 10, 11, 0, 11, 5, -1, -1, -1, -1},
+    {0, 4, 10, 0, 10, 11, 0, 11, 9, 2, 6, 8, -1, -1, -1, -1},
+    {2, 6, 10, 2, 10, 11, 2, 11, 9, -1, -1, -1, -1, -1, -1, -1},
+    {2, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 2, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 7, 0, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 8, 4, 2, 4, 5, 2, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 10, 2, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 10, 0, 10, 1, 2, 9, 7, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 7, 0, 7, 2, 1, 4, 10, -1, -1, -1, -1, -1, -1, -1},
+    {1, 5, 7, 1, 7, 2, 1, 2, 8, 1, 8, 10, -1, -1, -1, -1},
+    {1, 11, 5, 2, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 1, 11, 5, 2, 9, 7, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 11, 0, 11, 7, 0, 7, 2, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 7, 1, 7, 2, 1, 2, 8, 1, 8, 4, -1, -1, -1, -1},
+    {2, 9, 7, 4, 10, 11, 4, 11, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 10, 0, 10, 11, 0, 11, 5, 2, 9, 7, -1, -1, -1, -1},
+    {0, 4, 10, 0, 10, 11, 0, 11, 7, 0, 7, 2, -1, -1, -1, -1},
+    {2, 8, 10, 2, 10, 11, 2, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+    {6, 8, 9, 6, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 7, 0, 7, 6, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 7, 0, 7, 6, 0, 6, 8, -1, -1, -1, -1, -1, -1, -1},
+    {4, 5, 7, 4, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 10, 6, 8, 9, 6, 9, 7, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 7, 0, 7, 6, 0, 6, 10, 0, 10, 1, -1, -1, -1, -1},
+    {0, 5, 7, 0, 7, 6, 0, 6, 8, 1, 4, 10, -1, -1, -1, -1},
+    {1, 5, 7, 1, 7, 6, 1, 6, 10, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 5, 6, 8, 9, 6, 9, 7, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 7, 0, 7, 6, 0, 6, 4, 1, 11, 5, -1, -1, -1, -1},
+    {0, 1, 11, 0, 11, 7, 0, 7, 6, 0, 6, 8, -1, -1, -1, -1},
+    {1, 11, 7, 1, 7, 6, 1, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+    {4, 10, 11, 4, 11, 5, 6, 8, 9, 6, 9, 7, -1, -1, -1, -1},
+    {0, 9, 7, 0, 7, 6, 0, 6, 10, 0, 10, 11, 0, 11, 5, -1},
+    {0, 4, 10, 0, 10, 11, 0, 11, 7, 0, 7, 6, 0, 6, 8, -1},
+    {6, 10, 11, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 10, 6, 4, 5, 9, 4, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 6, 1, 6, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 6, 0, 6, 3, 0, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 1, 4, 6, 1, 6, 3, -1, -1, -1, -1, -1, -1, -1},
+    {1, 5, 9, 1, 9, 8, 1, 8, 6, 1, 6, 3, -1, -1, -1, -1},
+    {1, 11, 5, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 1, 11, 5, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 11, 0, 11, 9, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 9, 1, 9, 8, 1, 8, 4, 3, 10, 6, -1, -1, -1, -1},
+    {3, 11, 5, 3, 5, 4, 3, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 6, 0, 6, 3, 0, 3, 11, 0, 11, 5, -1, -1, -1, -1},
+    {0, 4, 6, 0, 6, 3, 0, 3, 11, 0, 11, 9, -1, -1, -1, -1},
+    {3, 11, 9, 3, 9, 8, 3, 8, 6, -1, -1, -1, -1, -1, -1, -1},
+    {2, 3, 10, 2, 10, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 3, 0, 3, 10, 0, 10, 4, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 2, 3, 10, 2, 10, 8, -1, -1, -1, -1, -1, -1, -1},
+    {2, 3, 10, 2, 10, 4, 2, 4, 5, 2, 5, 9, -1, -1, -1, -1},
+    {1, 4, 8, 1, 8, 2, 1, 2, 3, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 3, 0, 3, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 1, 4, 8, 1, 8, 2, 1, 2, 3, -1, -1, -1, -1},
+    {1, 5, 9, 1, 9, 2, 1, 2, 3, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 5, 2, 3, 10, 2, 10, 8, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 3, 0, 3, 10, 0, 10, 4, 1, 11, 5, -1, -1, -1, -1},
+    {0, 1, 11, 0, 11, 9, 2, 3, 10, 2, 10, 8, -1, -1, -1, -1},
+    {9, 2, 3, 9, 3, 10, 9, 10, 4, 9, 4, 1, 9, 1, 11, -1},
+    {2, 3, 11, 2, 11, 5, 2, 5, 4, 2, 4, 8, -1, -1, -1, -1},
+    {0, 2, 3, 0, 3, 11, 0, 11, 5, -1, -1, -1, -1, -1, -1, -1},
+    {4, 8, 2, 4, 2, 3, 4, 3, 11, 4, 11, 9, 4, 9, 0, -1},
+    {2, 3, 11, 2, 11, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 9, 7, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 2, 9, 7, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 7, 0, 7, 2, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+    {2, 8, 4, 2, 4, 5, 2, 5, 7, 3, 10, 6, -1, -1, -1, -1},
+    {1, 4, 6, 1, 6, 3, 2, 9, 7, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 6, 0, 6, 3, 0, 3, 1, 2, 9, 7, -1, -1, -1, -1},
+    {0, 5, 7, 0, 7, 2, 1, 4, 6, 1, 6, 3, -1, -1, -1, -1},
+    {1, 5, 7, 1, 7, 2, 1, 2, 8, 1, 8, 6, 1, 6, 3, -1},
+    {1, 11, 5, 2, 9, 7, 3, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 1, 11, 5, 2, 9, 7, 3, 10, 6, -1, -1, -1, -1},
+    {0, 1, 11, 0, 11, 7, 0, 7, 2, 3, 10, 6, -1, -1, -1, -1},
+    {1, 11, 7, 1, 7, 2, 1, 2, 8, 1, 8, 4, 3, 10, 6, -1},
+    {2, 9, 7, 3, 11, 5, 3, 5, 4, 3, 4, 6, -1, -1, -1, -1},
+    {0, 8, 6, 0, 6, 3, 0, 3, 11, 0, 11, 5, 2, 9, 7, -1},
+    {0, 4, 6, 0, 6, 3, 0, 3, 11, 0, 11, 7, 0, 7, 2, -1},
+    {8, 6, 3, 8, 3, 11, 8, 11, 7, 8, 7, 2, -1, -1, -1, -1},
+    {3, 10, 8, 3, 8, 9, 3, 9, 7, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 7, 0, 7, 3, 0, 3, 10, 0, 10, 4, -1, -1, -1, -1},
+    {0, 5, 7, 0, 7, 3, 0, 3, 10, 0, 10, 8, -1, -1, -1, -1},
+    {3, 10, 4, 3, 4, 5, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 8, 1, 8, 9, 1, 9, 7, 1, 7, 3, -1, -1, -1, -1},
+    {0, 9, 7, 0, 7, 3, 0, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+    {7, 3, 1, 7, 1, 4, 7, 4, 8, 7, 8, 0, 7, 0, 5, -1},
+    {1, 5, 7, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 11, 5, 3, 10, 8, 3, 8, 9, 3, 9, 7, -1, -1, -1, -1},
+    {0, 9, 7, 0, 7, 3, 0, 3, 10, 0, 10, 4, 1, 11, 5, -1},
+    {0, 1, 11, 0, 11, 7, 0, 7, 3, 0, 3, 10, 0, 10, 8, -1},
+    {7, 3, 10, 7, 10, 4, 7, 4, 1, 7, 1, 11, -1, -1, -1, -1},
+    {3, 11, 5, 3, 5, 4, 3, 4, 8, 3, 8, 9, 3, 9, 7, -1},
+    {0, 9, 7, 0, 7, 3, 0, 3, 11, 0, 11, 5, -1, -1, -1, -1},
+    {0, 4, 8, 3, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 7, 11, 4, 5, 9, 4, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 10, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 10, 0, 10, 1, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 1, 4, 10, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1},
+    {1, 5, 9, 1, 9, 8, 1, 8, 10, 3, 7, 11, -1, -1, -1, -1},
+    {1, 3, 7, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 1, 3, 7, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, 3, 0, 3, 7, 0, 7, 9, -1, -1, -1, -1, -1, -1, -1},
+    {1, 3, 7, 1, 7, 9, 1, 9, 8, 1, 8, 4, -1, -1, -1, -1},
+    {3, 7, 5, 3, 5, 4, 3, 4, 10, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 10, 0, 10, 3, 0, 3, 7, 0, 7, 5, -1, -1, -1, -1},
+    {0, 4, 10, 0, 10, 3, 0, 3, 7, 0, 7, 9, -1, -1, -1, -1},
+    {3, 7, 9, 3, 9, 8, 3, 8, 10, -1, -1, -1, -1, -1, -1, -1},
+    {2, 6, 8, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 6, 0, 6, 4, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 2, 6, 8, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1},
+    {2, 6, 4, 2, 4, 5, 2, 5, 9, 3, 7, 11, -1, -1, -1, -1},
+    {1, 4, 10, 2, 6, 8, 3, 7, 11, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 6, 0, 6, 10, 0, 10, 1, 3, 7, 11, -1, -1, -1, -1},
+    {0, 5, 9, 1, 4, 10, 2, 6, 8, 3, 7, 11, -1, -1, -1, -1},
+    {1, 5, 9, 1, 9, 2, 1, 2, 6, 1, 6, 10, 3, 7, 11, -1},
+    {1, 3, 7, 1, 7, 5, 2, 6, 8, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 6, 0, 6, 4, 1, 3, 7, 1, 7, 5, -1, -1, -1, -1},
+    {0, 1, 3, 0, 3, 7, 0, 7, 9, 2, 6, 8, -1, -1, -1, -1},
+    {1, 3, 7, 1, 7, 9, 1, 9, 2, 1, 2, 6, 1, 6, 4, -1},
+    {2, 6, 8, 3, 7, 5, 3, 5, 4, 3, 4, 10, -1, -1, -1, -1},
+    {0, 2, 6, 0, 6, 10, 0, 10, 3, 0, 3, 7, 0, 7, 5, -1},
+    {0, 4, 10, 0, 10, 3, 0, 3, 7, 0, 7, 9, 2, 6, 8, -1},
+    {10, 3, 7, 10, 7, 9, 10, 9, 2, 10, 2, 6, -1, -1, -1, -1},
+    {2, 9, 11, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 2, 9, 11, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 11, 0, 11, 3, 0, 3, 2, -1, -1, -1, -1, -1, -1, -1},
+    {2, 8, 4, 2, 4, 5, 2, 5, 11, 2, 11, 3, -1, -1, -1, -1},
+    {1, 4, 10, 2, 9, 11, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 10, 0, 10, 1, 2, 9, 11, 2, 11, 3, -1, -1, -1, -1},
+    {0, 5, 11, 0, 11, 3, 0, 3, 2, 1, 4, 10, -1, -1, -1, -1},
+    {5, 11, 3, 5, 3, 2, 5, 2, 8, 5, 8, 10, 5, 10, 1, -1},
+    {1, 3, 2, 1, 2, 9, 1, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 1, 3, 2, 1, 2, 9, 1, 9, 5, -1, -1, -1, -1},
+    {0, 1, 3, 0, 3, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 3, 2, 1, 2, 8, 1, 8, 4, -1, -1, -1, -1, -1, -1, -1},
+    {2, 9, 5, 2, 5, 4, 2, 4, 10, 2, 10, 3, -1, -1, -1, -1},
+    {10, 3, 2, 10, 2, 9, 10, 9, 5, 10, 5, 0, 10, 0, 8, -1},
+    {0, 4, 10, 0, 10, 3, 0, 3, 2, -1, -1, -1, -1, -1, -1, -1},
+    {2, 8, 10, 2, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 6, 8, 3, 8, 9, 3, 9, 11, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 11, 0, 11, 3, 0, 3, 6, 0, 6, 4, -1, -1, -1, -1},
+    {0, 5, 11, 0, 11, 3, 0, 3, 6, 0, 6, 8, -1, -1, -1, -1},
+    {3, 6, 4, 3, 4, 5, 3, 5, 11, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 10, 3, 6, 8, 3, 8, 9, 3, 9, 11, -1, -1, -1, -1},
+    {0, 9, 11, 0, 11, 3, 0, 3, 6, 0, 6, 10, 0, 10, 1, -1},
+    {0, 5, 11, 0, 11, 3, 0, 3, 6, 0, 6, 8, 1, 4, 10, -1},
+    {5, 11, 3, 5, 3, 6, 5, 6, 10, 5, 10, 1, -1, -1, -1, -1},
+    {1, 3, 6, 1, 6, 8, 1, 8, 9, 1, 9, 5, -1, -1, -1, -1},
+    {9, 5, 1, 9, 1, 3, 9, 3, 6, 9, 6, 4, 9, 4, 0, -1},
+    {0, 1, 3, 0, 3, 6, 0, 6, 8, -1, -1, -1, -1, -1, -1, -1},
+    {1, 3, 6, 1, 6, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {3, 6, 8, 3, 8, 9, 3, 9, 5, 3, 5, 4, 3, 4, 10, -1},
+    {0, 9, 5, 3, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 4, 10, 0, 10, 3, 0, 3, 6, 0, 6, 8, -1, -1, -1, -1},
+    {3, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {6, 7, 11, 6, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 6, 7, 11, 6, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 6, 7, 11, 6, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+    {4, 5, 9, 4, 9, 8, 6, 7, 11, 6, 11, 10, -1, -1, -1, -1},
+    {1, 4, 6, 1, 6, 7, 1, 7, 11, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 6, 0, 6, 7, 0, 7, 11, 0, 11, 1, -1, -1, -1, -1},
+    {0, 5, 9, 1, 4, 6, 1, 6, 7, 1, 7, 11, -1, -1, -1, -1},
+    {1, 5, 9, 1, 9, 8, 1, 8, 6, 1, 6, 7, 1, 7, 11, -1},
+    {1, 10, 6, 1, 6, 7, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 1, 10, 6, 1, 6, 7, 1, 7, 5, -1, -1, -1, -1},
+    {0, 1, 10, 0, 10, 6, 0, 6, 7, 0, 7, 9, -1, -1, -1, -1},
+    {1, 10, 6, 1, 6, 7, 1, 7, 9, 1, 9, 8, 1, 8, 4, -1},
+    {4, 6, 7, 4, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 6, 0, 6, 7, 0, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+    {0, 4, 6, 0, 6, 7, 0, 7, 9, -1, -1, -1, -1, -1, -1, -1},
+    {6, 7, 9, 6, 9, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 7, 11, 2, 11, 10, 2, 10, 8, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 7, 0, 7, 11, 0, 11, 10, 0, 10, 4, -1, -1, -1, -1},
+    {0, 5, 9, 2, 7, 11, 2, 11, 10, 2, 10, 8, -1, -1, -1, -1},
+    {2, 7, 11, 2, 11, 10, 2, 10, 4, 2, 4, 5, 2, 5, 9, -1},
+    {1, 4, 8, 1, 8, 2, 1, 2, 7, 1, 7, 11, -1, -1, -1, -1},
+    {0, 2, 7, 0, 7, 11, 0, 11, 1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 9, 1, 4, 8, 1, 8, 2, 1, 2, 7, 1, 7, 11, -1},
+    {1, 5, 9, 1, 9, 2, 1, 2, 7, 1, 7, 11, -1, -1, -1, -1},
+    {1, 10, 8, 1, 8, 2, 1, 2, 7, 1, 7, 5, -1, -1, -1, -1},
+    {2, 7, 5, 2, 5, 1, 2, 1, 10, 2, 10, 4, 2, 4, 0, -1},
+    {1, 10, 8, 1, 8, 2, 1, 2, 7, 1, 7, 9, 1, 9, 0, -1},
+    {1, 10, 4, 2, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 7, 5, 2, 5, 4, 2, 4, 8, -1, -1, -1, -1, -1, -1, -1},
+    {0, 2, 7, 0, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 8, 2, 4, 2, 7, 4, 7, 9, 4, 9, 0, -1, -1, -1, -1},
+    {2, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 9, 11, 2, 11, 10, 2, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+    {0, 8, 4, 2, 9, 11, 2, 11, 10, 2, 10, 6, -1, -1, -1, -1},
+    {0, 5, 11, 0, 11, 10, 0, 10, 6, 0, 6, 2, -1, -1, -1, -1},
+    {2, 8, 4, 2, 4, 5, 2, 5, 11, 2, 11, 10, 2, 10, 6, -1},
+    {1, 4, 6, 1, 6, 2, 1, 2, 9, 1, 9, 11, -1, -1, -1, -1},
+    {6, 2, 9, 6, 9, 11, 6, 11, 1, 6, 1, 0, 6, 0, 8, -1},
+    {11, 1, 4, 11, 4, 6, 11, 6, 2, 11, 2, 0, 11, 0, 5, -1},
+    {1, 5, 11, 2, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 10, 6, 1, 6, 2, 1, 2, 9, 1, 9, 5, -1, -1, -1, -1},
+    {0, 8, 4, 1, 10, 6, 1, 6, 2, 1, 2, 9, 1, 9, 5, -1},
+    {0, 1, 10, 0, 10, 6, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+    {1, 10, 6, 1, 6, 2, 1, 2, 8, 1, 8, 4, -1, -1, -1, -1},
+    {2, 9, 5, 2, 5, 4, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+    {6, 2, 9, 6, 9, 5, 6, 5, 0, 6, 0, 8, -1, -1, -1, -1},
+    {0, 4, 6, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {8, 9, 11, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 11, 0, 11, 10, 0, 10, 4, -1, -1, -1, -1, -1, -1, -1},
+    {0, 5, 11, 0, 11, 10, 0, 10, 8, -1, -1, -1, -1, -1, -1, -1},
+    {4, 5, 11, 4, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 8, 1, 8, 9, 1, 9, 11, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 11, 0, 11, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {11, 1, 4, 11, 4, 8, 11, 8, 0, 11, 0, 5, -1, -1, -1, -1},
+    {1, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 10, 8, 1, 8, 9, 1, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+    {9, 5, 1, 9, 1, 10, 9, 10, 4, 9, 4, 0, -1, -1, -1, -1},
+    {0, 1, 10, 0, 10, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {4, 8, 9, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 9, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 4, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+};
+
+/* Where the vertex on each cube edge is numbered: the edge cache of the
+ * bottom x, bottom y, top x, top y or z edges, and the offset of its edge
+ * there from the cell origin.
+ */
+enum { CACHE_BOTTOM_X, CACHE_BOTTOM_Y, CACHE_TOP_X, CACHE_TOP_Y, CACHE_Z, CACHE_COUNT };
+
+static const unsigned char sEdgeCache[12][3] = {
+    {CACHE_BOTTOM_X, 0, 0}, {CACHE_BOTTOM_X, 0, 1}, {CACHE_TOP_X, 0, 0}, {CACHE_TOP_X, 0, 1},
+    {CACHE_BOTTOM_Y, 0, 0}, {CACHE_BOTTOM_Y, 1, 0}, {CACHE_TOP_Y, 0, 0}, {CACHE_TOP_Y, 1, 0},
+    {CACHE_Z, 0, 0}, {CACHE_Z, 1, 0}, {CACHE_Z, 0, 1}, {CACHE_Z, 1, 1}
+};
+
+
+/* Counts and placement of layer z: the cells between planes z and z + 1,
+ * the vertices on the x and y edges of plane z and those on the z edges up
+ * to plane z + 1. The last layer has only its plane. Vertex positions are
+ * into the vertex arrays of the whole surface.
+ */
+struct Layer {
+    long planeVertices;
+    long edgeVertices;
+    long triangles;
+    long firstVertex;
+    // Where this layer finds the vertices of plane z + 1: the next layer,
+    // or the copy at the end of the chunk when the chunk is cut there.
+    long nextPlane;
+    long chunkBase;
+    long firstIndex;
+    int chunk;
+};
+
+// Edge caches and vertex staging of one thread.
+struct Scratch {
+    int *ids;
+    float *positions;
+    float *normals;
+};
+
+struct SurfaceJob {
+    const SCALARFIELD *field;
+    const ISOSURFACEPARAMS *params;
+    Layer *layers;
+    Scratch *scratch;
+    GLVERTEXFORMAT format;
+    long vertexSize;
+    long normalSize;
+    unsigned char *vertexArray;
+    unsigned char *normalArray;
+    GLubyte *colorArray;
+    GLushort *indexArray;
+};
+
+
+static size_t alignSize(size_t size) {
+    return (size + ISOSURFACE_ARRAY_ALIGNMENT - 1) &
+           ~(size_t) (ISOSURFACE_ARRAY_ALIGNMENT - 1);
+}
+
+static int triangleCount(int cube) {
+    int n = 0;
+    while (n < 5 && sTriangleTable[cube][3 * n] >= 0)
+        n++;
+    return n;
+}
+
+static int caseIndex(const SCALARFIELD *field, long sample, float isovalue) {
+    long dy = field->nx, dz = (long) field->nx * field->ny;
+    const float *v = field->values + sample;
+    return (v[0] < isovalue) | (v[1] < isovalue) << 1 |
+           (v[dy] < isovalue) << 2 | (v[dy + 1] < isovalue) << 3 |
+           (v[dz] < isovalue) << 4 | (v[dz + 1] < isovalue) << 5 |
+           (v[dz + dy] < isovalue) << 6 | (v[dz + dy + 1] < isovalue) << 7;
+}
+
+// Central difference gradient at sample (i, j, k), one sided at the borders.
+static void gradient(const SCALARFIELD *field, int i, int j, int k, float g[3]) {
+    const int index[3] = {i, j, k}, size[3] = {field->nx, field->ny, field->nz};
+    const long stride[3] = {1, field->nx, (long) field->nx * field->ny};
+    const float *v = field->values + FIELD_INDEX(field, i, j, k);
+    int a;
+    for (a = 0; a < 3; a++) {
+        int low = index[a] > 0 ? -1 : 0, high = index[a] < size[a] - 1 ? 1 : 0;
+        g[a] = high > low ? (v[high * stride[a]] - v[low * stride[a]]) /
+                            ((high - low) * field->spacing[a]) : 0;
+    }
+}
+
+/* Puts the vertex of the edge from sample (i, j, k) one step along axis,
+ * which the surface crosses.
+ */
+static void edgeVertex(const SCALARFIELD *field, float isovalue, int i, int j, int k, int axis,
+                       float *position, float *normal) {
+    const int next[3] = {i + (axis == 0), j + (axis == 1), k + (axis == 2)};
+    float a = field->values[FIELD_INDEX(field, i, j, k)];
+    float b = field->values[FIELD_INDEX(field, next[0], next[1], next[2])];
+    float t = (isovalue - a) / (b - a), ga[3], gb[3], length = 0;
+    int c;
+
+    gradient(field, i, j, k, ga);
+    gradient(field, next[0], next[1], next[2], gb);
+    for (c = 0; c < 3; c++) {
+        position[c] = field->origin[c] + ((c == 0 ? i : c == 1 ? j : k) +
+                                          (c == axis ? t : 0)) * field->spacing[c];
+        normal[c] = -(ga[c] + t * (gb[c] - ga[c]));
+        length += normal[c] * normal[c];
+    }
+    if (length > 0) {
+        length = 1 / sqrtf(length);
+        for (c = 0; c < 3; c++)
+            normal[c] *= length;
+    }
+    else {
+        // Flat across the edge: face the lower end.
+        for (c = 0; c < 3; c++)
+            normal[c] = c == axis ? (b < a ? 1.0f : -1.0f) : 0;
+    }
+}
+
+/* Numbers the vertices on the x and y edges of plane z in scan order,
+ * storing them to idX and idY at the sample index within the plane; edges
+ * without a vertex are left alone. Puts the vertices to positions and
+ * normals unless they are NULL. Returns the count.
+ */
+static long scanPlane(const SCALARFIELD *field, float isovalue, int z, int *idX, int *idY,
+                      float *positions, float *normals) {
+    const int nx = field->nx, ny = field->ny;
+    const float *plane = field->values + FIELD_INDEX(field, 0, 0, z);
+    long count = 0;
+    int i, j;
+
+    for (j = 0; j < ny; j++) {
+        for (i = 0; i < nx; i++) {
+            int n = j * nx + i, below = plane[n] < isovalue;
+            if (i < nx - 1 && below != (plane[n + 1] < isovalue)) {
+                if (positions != NULL)
+                    edgeVertex(field, isovalue, i, j, z, 0, positions + 3 * count,
+                               normals + 3 * count);
+                idX[n] = (int) count++;
+            }
+            if (j < ny - 1 && below != (plane[n + nx] < isovalue)) {
+                if (positions != NULL)
+                    edgeVertex(field, isovalue, i, j, z, 1, positions + 3 * count,
+                               normals + 3 * count);
+                idY[n] = (int) count++;
+            }
+        }
+    }
+    return count;
+}
+
+// First pass: counts the vertices and triangles of layers first to last - 1.
+static void countTask(long first, long last, int worker, void *userData) {
+    SurfaceJob *job = (SurfaceJob *) userData;
+    const SCALARFIELD *field = job->field;
+    const float isovalue = job->params->isovalue;
+    const long planeSize = (long) field->nx * field->ny;
+    int *ids = job->scratch[worker].ids;
+    long z, n;
+    int i, j;
+
+    for (z = first; z < last; z++) {
+        Layer *layer = &job->layers[z];
+        const float *plane = field->values + z * planeSize;
+        layer->planeVertices = scanPlane(field, isovalue, (int) z, ids, ids, NULL, NULL);
+        layer->edgeVertices = 0;
+        layer->triangles = 0;
+        if (z == field->nz - 1)
+            continue;
+        for (n = 0; n < planeSize; n++)
+            layer->edgeVertices += (plane[n] < isovalue) != (plane[n + planeSize] < isovalue);
+        for (j = 0; j < field->ny - 1; j++)
+            for (i = 0; i < field->nx - 1; i++)
+                layer->triangles += triangleCount(
+                        caseIndex(field, FIELD_INDEX(field, i, j, z), isovalue));
+    }
+}
+
+// Converts count staged vertices to the arrays at vertex position first.
+static void storeVertices(const SurfaceJob *job, const Scratch *scratch, long count,
+                          long first) {
+    GLubyte *color = job->colorArray + first * 4;
+    long v;
+    convertGLVertices(&job->format, scratch->positions, count,
+                      job->vertexArray + first * job->vertexSize);
+    convertGLNormals(&job->format, scratch->normals, count,
+                     job->normalArray + first * job->normalSize);
+    for (v = 0; v < count; v++)
+        memcpy(color + v * 4, job->params->color, 4);
+}
+
+// Second pass: puts the vertices and triangles of layers first to last - 1.
+static void meshTask(long first, long last, int worker, void *userData) {
+    SurfaceJob *job = (SurfaceJob *) userData;
+    const SCALARFIELD *field = job->field;
+    const float isovalue = job->params->isovalue;
+    const int nx = field->nx, ny = field->ny;
+    const long planeSize = (long) nx * ny;
+    Scratch *scratch = &job->scratch[worker];
+    int *cache[CACHE_COUNT];
+    long z, base[CACHE_COUNT], count;
+    int i, j, c;
+
+    for (c = 0; c < CACHE_COUNT; c++)
+        cache[c] = scratch->ids + c * planeSize;
+    for (z = first; z < last; z++) {
+        const Layer *layer = &job->layers[z];
+        GLushort *index = job->indexArray + layer->firstIndex;
+
+        count = scanPlane(field, isovalue, (int) z, cache[CACHE_BOTTOM_X],
+                          cache[CACHE_BOTTOM_Y], scratch->positions, scratch->normals);
+        if (z < field->nz - 1) {
+            const float *plane = field->values + z * planeSize;
+            long n;
+            scanPlane(field, isovalue, (int) z + 1, cache[CACHE_TOP_X], cache[CACHE_TOP_Y],
+                      NULL, NULL);
+            for (n = 0; n < planeSize; n++) {
+                if ((plane[n] < isovalue) == (plane[n + planeSize] < isovalue))
+                    continue;
+                edgeVertex(field, isovalue, (int) (n % nx), (int) (n / nx), (int) z, 2,
+                           scratch->positions + 3 * count, scratch->normals + 3 * count);
+                cache[CACHE_Z][n] = (int) count++;
+            }
+
+            // Chunk relative numbers of the first vertex of each cache.
+            base[CACHE_BOTTOM_X] = base[CACHE_BOTTOM_Y] = base[CACHE_Z] =
+                    layer->firstVertex - layer->chunkBase;
+            base[CACHE_TOP_X] = base[CACHE_TOP_Y] = layer->nextPlane - layer->chunkBase;
+            for (j = 0; j < ny - 1; j++) {
+                for (i = 0; i < nx - 1; i++) {
+                    const signed char *edges =
+                            sTriangleTable[caseIndex(field, FIELD_INDEX(field, i, j, z),
+                                                     isovalue)];
+                    for (; *edges >= 0; edges++) {
+                        const unsigned char *edge = sEdgeCache[(int) *edges];
+                        *index++ = (GLushort) (base[edge[0]] +
+                                               cache[edge[0]][(j + edge[2]) * nx + i +
+                                                              edge[1]]);
+                    }
+                }
+            }
+        }
+
+        storeVertices(job, scratch, count, layer->firstVertex);
+        // The first layer of a chunk also ends the chunk before it.
+        if (z > 0 && job->layers[z - 1].chunk != layer->chunk)
+            storeVertices(job, scratch, layer->planeVertices, job->layers[z - 1].nextPlane);
+    }
+}
+
+/* Cuts the layers into chunks and places their vertices and indices.
+ * Returns the chunk count, or 0 when a layer does not fit in a chunk.
+ */
+static int placeLayers(Layer *layers, int layerCount, long *vertices, long *indices) {
+    long chunkBase = 0, used = 0, index = 0;
+    int chunks = 1, z;
+
+    for (z = 0; z < layerCount; z++) {
+        Layer *layer = &layers[z];
+        long size = layer->planeVertices + layer->edgeVertices;
+        long next = z + 1 < layerCount ? layers[z + 1].planeVertices : 0;
+        if (used + size + next > GLOBJECT_MAX_VERTICES && used > 0) {
+            // Copy the plane of this layer to the end of the chunk.
+            layers[z - 1].nextPlane = chunkBase + used;
+            chunkBase += used + layer->planeVertices;
+            used = 0;
+            chunks++;
+        }
+        if (size + next > GLOBJECT_MAX_VERTICES)
+            return 0;
+        layer->chunk = chunks - 1;
+        layer->chunkBase = chunkBase;
+        layer->firstVertex = chunkBase + used;
+        layer->nextPlane = layer->firstVertex + size;
+        layer->firstIndex = index;
+        used += size;
+        index += 3 * layer->triangles;
+    }
+    *vertices = chunkBase + used;
+    *indices = index;
+    return chunks;
+}
+
+
+void isosurfaceParamsDefault(ISOSURFACEPARAMS *params, const SCALARFIELD *field) {
+    float minimum, maximum;
+    scalarFieldRange(field, &minimum, &maximum);
+    memset(params, 0, sizeof(ISOSURFACEPARAMS));
+    params->isovalue = (minimum + maximum) / 2;
+    params->vertexType = GL_SHORT;
+    params->normalType = GL_BYTE;
+    params->color[0] = 230;
+    params->color[1] = 190;
+    params->color[2] = 60;
+    params->color[3] = 255;
+}
+
+
+/* Places the counted layers in one allocation, fills it and sets up the
+ * chunks.
+ */
+static int extractSurface(ISOSURFACE *surface, SurfaceJob *job, int workers,
+                          THREADPOOL *pool, ARENA *arena) {
+    const SCALARFIELD *field = job->field;
+    long vertices, indices, maxLayer = 0;
+    size_t chunkBytes, vertexBytes, normalBytes, indexBytes, colorBytes, size;
+    unsigned char *storage;
+    int chunkCount, z, w;
+
+    threadPoolRun(pool, field->nz, 0, countTask, job);
+    chunkCount = placeLayers(job->layers, field->nz, &vertices, &indices);
+    if (chunkCount == 0) {
+        LOGE(MESH, "isosurface layer too large for %d vertices", GLOBJECT_MAX_VERTICES);
+        return 0;
+    }
+    if (indices == 0)
+        return 1;
+    for (z = 0; z < field->nz; z++) {
+        long layerSize = job->layers[z].planeVertices + job->layers[z].edgeVertices;
+        if (layerSize > maxLayer)
+            maxLayer = layerSize;
+    }
+    for (w = 0; w < workers; w++) {
+        job->scratch[w].positions = (float *) malloc(maxLayer * 3 * sizeof(float));
+        job->scratch[w].normals = (float *) malloc(maxLayer * 3 * sizeof(float));
+        if (job->scratch[w].positions == NULL || job->scratch[w].normals == NULL)
+            return 0;
+    }
+
+    chunkBytes = alignSize(chunkCount * sizeof(GLOBJECT));
+    vertexBytes = alignSize(vertices * job->vertexSize);
+    normalBytes = alignSize(vertices * job->normalSize);
+    indexBytes = alignSize(indices * sizeof(GLushort));
+    colorBytes = alignSize(vertices * 4 * sizeof(GLubyte));
+    size = chunkBytes + vertexBytes + normalBytes + indexBytes + colorBytes;
+    if (arena != NULL)
+        storage = (unsigned char *) arenaAlloc(arena, size);
+    else
+        storage = (unsigned char *) Eigen::internal::aligned_malloc(size);
+    if (storage == NULL)
+        return 0;
+    surface->storage = arena != NULL ? NULL : storage;
+    surface->chunks = (GLOBJECT *) storage;
+    job->vertexArray = storage + chunkBytes;
+    job->normalArray = job->vertexArray + vertexBytes;
+    job->indexArray = (GLushort *) (job->normalArray + normalBytes);
+    job->colorArray = (GLubyte *) job->indexArray + indexBytes;
+
+    threadPoolRun(pool, field->nz, 0, meshTask, job);
+
+    memset(surface->chunks, 0, chunkCount * sizeof(GLOBJECT));
+    for (z = 0; z < field->nz; z++) {
+        const Layer *layer = &job->layers[z];
+        GLOBJECT *chunk = &surface->chunks[layer->chunk];
+        long next = z + 1 < field->nz ? job->layers[z + 1].planeVertices : 0;
+        if (z == 0 || job->layers[z - 1].chunk != layer->chunk) {
+            chunk->vertexArray = job->vertexArray + layer->chunkBase * job->vertexSize;
+            chunk->normalArray = job->normalArray + layer->chunkBase * job->normalSize;
+            chunk->colorArray = job->colorArray + layer->chunkBase * 4;
+            chunk->indexArray = job->indexArray + layer->firstIndex;
+            chunk->format = job->format;
+            chunk->vertexComponents = 3;
+        }
+        // Up to the plane after the layer, which is the copy after a cut.
+        chunk->count = (GLsizei) (layer->nextPlane + next - layer->chunkBase);
+        chunk->indexCount += (GLsizei) (3 * layer->triangles);
+    }
+    surface->chunkCount = chunkCount;
+    surface->vertexCount = vertices;
+    surface->triangleCount = indices / 3;
+    LOGD(MESH, "isosurface %g: %ld vertices, %ld triangles in %d chunks",
+         job->params->isovalue, surface->vertexCount, surface->triangleCount,
+         surface->chunkCount);
+    return 1;
+}
+
+
+int isosurfaceBuild(ISOSURFACE *surface, const SCALARFIELD *field,
+                    const ISOSURFACEPARAMS *params, THREADPOOL *pool, ARENA *arena) {
+    int workers = threadPoolSize(pool), result = 0, ready, a, w;
+    float boundsMin[3], boundsMax[3];
+    SurfaceJob job;
+    ProfileScope profile(PROFILE_STAGE_MESH_BUILD);
+
+    Eigen::internal::aligned_free(surface->storage);
+    memset(surface, 0, sizeof(ISOSURFACE));
+    if (field->nx < 2 || field->ny < 2 || field->nz < 2)
+        return 0;
+    for (a = 0; a < 3; a++) {
+        int count = a == 0 ? field->nx : a == 1 ? field->ny : field->nz;
+        boundsMin[a] = field->origin[a];
+        boundsMax[a] = field->origin[a] + (count - 1) * field->spacing[a];
+    }
+    memset(&job, 0, sizeof(SurfaceJob));
+    if (!fitGLVertexFormat(&job.format, params->vertexType, params->normalType,
+                           boundsMin, boundsMax))
+        return 0;
+    job.field = field;
+    job.params = params;
+    job.vertexSize = 3 * sizeOfGLType(job.format.vertexType);
+    job.normalSize = 3 * sizeOfGLType(job.format.normalType);
+    job.layers = (Layer *) malloc(field->nz * sizeof(Layer));
+    job.scratch = (Scratch *) calloc(workers, sizeof(Scratch));
+
+    ready = job.layers != NULL && job.scratch != NULL;
+    for (w = 0; ready && w < workers; w++) {
+        job.scratch[w].ids = (int *) malloc(CACHE_COUNT * field->nx * field->ny * sizeof(int));
+        ready = job.scratch[w].ids != NULL;
+    }
+    if (ready)
+        result = extractSurface(surface, &job, workers, pool, arena);
+
+    for (w = 0; job.scratch != NULL && w < workers; w++) {
+        free(job.scratch[w].ids);
+        free(job.scratch[w].positions);
+        free(job.scratch[w].normals);
+    }
+    free(job.scratch);
+    free(job.layers);
+    return result;
+}
+
+
+void isosurfaceDeinit(ISOSURFACE *surface) {
+    isosurfaceDeleteBuffers(surface);
+    Eigen::internal::aligned_free(surface->storage);
+    memset(surface, 0, sizeof(ISOSURFACE));
+}
+
+
+void isosurfaceCreateBuffers(ISOSURFACE *surface) {
+    int c;
+    for (c = 0; c < surface->chunkCount; c++)
+        createGLObjectBuffers(&surface->chunks[c]);
+}
+
+
+void isosurfaceDeleteBuffers(ISOSURFACE *surface) {
+    int c;
+    for (c = 0; c < surface->chunkCount; c++)
+        deleteGLObjectBuffers(&surface->chunks[c]);
+}
+
+
+void drawIsosurface(ISOSURFACE *surface) {
+    int c;
+    if (surface->chunkCount == 0)
+        return;
+    glShadeModel(GL_SMOOTH);
+    for (c = 0; c < surface->chunkCount; c++)
+        drawGLObject(&surface->chunks[c]);
+    glShadeModel(GL_FLAT);
+}
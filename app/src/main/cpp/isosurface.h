@@ -0,0 +1,114 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef ISOSURFACE_H_INCLUDED
+#define ISOSURFACE_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "globject.h"
+#include "field.h"
+#include "threadpool.h"
+#include "arena.h"
+
+
+/* Which surface to extract and how to store it.
+ */
+typedef struct {
+    float isovalue;
+    // Storage of the vertices and normals, see GLVERTEXFORMAT. Quantized
+    // vertices are fitted to the bounds of the field.
+    GLenum vertexType;
+    GLenum normalType;
+    GLubyte color[4];
+} ISOSURFACEPARAMS;
+
+/* Triangles of the surface where a scalar field takes the isovalue, by
+ * marching cubes. Each lattice edge the surface crosses has one vertex,
+ * shared by the cells around it, with the normal along the interpolated
+ * gradient toward lower values.
+ *
+ * The z layers of cells are meshed in parallel slabs. The vertices of a
+ * layer are numbered in a fixed scan order of its bottom plane and then of
+ * its z edges, so a layer finds the numbers of the vertices on its top
+ * plane by scanning that plane again, without a shared hash of the edges.
+ * A prefix sum over the layer counts places every layer in one allocation.
+ * The indices are 16 bit, so the mesh is cut between layers into chunks of
+ * at most GLOBJECT_MAX_VERTICES vertices, each an indexed GL object; the
+ * vertices of the plane at a cut are stored in both chunks.
+ */
+typedef struct {
+    GLOBJECT *chunks;
+    int chunkCount;
+    long vertexCount;
+    long triangleCount;
+    // The single heap block holding the chunks and all of their arrays,
+    // NULL when they were allocated from an arena.
+    void *storage;
+} ISOSURFACE;
+
+
+/* Fills in parameters for the surface halfway through the value range of
+ * field.
+ */
+extern void isosurfaceParamsDefault(ISOSURFACEPARAMS *params, const SCALARFIELD *field);
+
+/* Extracts the surface of field at params isovalue, splitting the layers
+ * between the threads of pool, which may be NULL. The chunks and their
+ * arrays come from arena, or from the heap when arena is NULL. Replaces
+ * the triangles of surface, which must be zero filled or hold an earlier
+ * surface whose buffer objects were deleted. Makes no GL calls. Returns
+ * non-zero on success and 0 on failure, also when a single layer has too
+ * many vertices for one chunk.
+ */
+extern int isosurfaceBuild(ISOSURFACE *surface, const SCALARFIELD *field,
+                           const ISOSURFACEPARAMS *params, THREADPOOL *pool, ARENA *arena);
+
+/* Deletes the buffer objects and frees the triangles unless they are in
+ * an arena.
+ */
+extern void isosurfaceDeinit(ISOSURFACE *surface);
+
+/* Moves the triangles into GL buffer objects. Needs a current GL context.
+ */
+extern void isosurfaceCreateBuffers(ISOSURFACE *surface);
+
+/* Deletes the buffer objects, after which the triangles are drawn from
+ * client memory and isosurfaceDeinit makes no GL calls. Needs a current
+ * GL context.
+ */
+extern void isosurfaceDeleteBuffers(ISOSURFACE *surface);
+
+/* Draws the chunks with glDrawElements, smooth shaded, and returns to flat
+ * shading afterwards.
+ */
+extern void drawIsosurface(ISOSURFACE *surface);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !ISOSURFACE_H_INCLUDED
@@ -0,0 +1,536 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+#include "lic.h"
+#include "log.h"
+#include "profile.h"
+
+
+// Alignment of the arrays inside the LICSLICE storage block.
+#define LIC_ARRAY_ALIGNMENT     64
+
+// In-plane directions shorter than this, in texels, count as no flow.
+#define LIC_MIN_FLOW            1e-6f
+
+
+/* Per-thread state of the convolution. sum and hits accumulate the tile
+ * being worked on, values and targets describe the streamline through the
+ * current seed: the noise under each point and its texel in the tile, or
+ * -1 outside it.
+ */
+typedef struct {
+    float *sum;
+    int *hits;
+    unsigned char *values;
+    int *targets;
+    float maxMagnitude;
+} Scratch;
+
+typedef struct {
+    LICSLICE *slice;
+    const FIELD *field;
+    const LICPLANE *plane;
+    const LICPARAMS *params;
+    Scratch *scratch;
+    // Maps a field vector to plane coordinates, see planeInverse.
+    float inverse[2][3];
+    int tilesX;
+    int kernelSteps;
+    int reuseSteps;
+    int maxSteps;
+    float gain;
+    float maxMagnitude;
+} LicJob;
+
+
+static size_t alignSize(size_t size) {
+    return (size + LIC_ARRAY_ALIGNMENT - 1) & ~(size_t) (LIC_ARRAY_ALIGNMENT - 1);
+}
+
+static float dot(const float *a, const float *b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+
+/* Sets the rows of inverse so that dotting them with a vector v gives the
+ * a, b minimizing |a * axisU + b * axisV - v|, which handles planes whose
+ * axes are not perpendicular. Returns 0 for degenerate axes.
+ */
+static int planeInverse(const LICPLANE *plane, float inverse[2][3]) {
+    float uu = dot(plane->axisU, plane->axisU), vv = dot(plane->axisV, plane->axisV);
+    float uv = dot(plane->axisU, plane->axisV), det = uu * vv - uv * uv;
+    int a;
+    if (det <= 1e-12f * uu * vv)
+        return 0;
+    for (a = 0; a < 3; a++) {
+        inverse[0][a] = (vv * plane->axisU[a] - uv * plane->axisV[a]) / det;
+        inverse[1][a] = (uu * plane->axisV[a] - uv * plane->axisU[a]) / det;
+    }
+    return 1;
+}
+
+// Samples the field at the texel centers of rows [first, last).
+static void projectTask(long first, long last, int worker, void *userData) {
+    LicJob *job = (LicJob *) userData;
+    LICSLICE *slice = job->slice;
+    const LICPLANE *plane = job->plane;
+    float maxMagnitude = job->scratch[worker].maxMagnitude;
+    long j;
+    int i, a;
+
+    for (j = first; j < last; j++) {
+        float t = (j + 0.5f) / slice->height;
+        for (i = 0; i < slice->width; i++) {
+            long n = j * slice->width + i;
+            float s = (i + 0.5f) / slice->width, position[3], vector[3], planar[3];
+            float u, v, length, magnitude;
+            for (a = 0; a < 3; a++)
+                position[a] = plane->origin[a] + s * plane->axisU[a] + t * plane->axisV[a];
+            slice->flow[2 * n] = slice->flow[2 * n + 1] = 0;
+            slice->magnitude[n] = 0;
+            if (!fieldInterpolate(job->field, position, vector))
+                continue;
+            u = dot(job->inverse[0], vector);
+            v = dot(job->inverse[1], vector);
+            for (a = 0; a < 3; a++)
+                planar[a] = u * plane->axisU[a] + v * plane->axisV[a];
+            magnitude = sqrtf(dot(planar, planar));
+            u *= slice->width;
+            v *= slice->height;
+            length = sqrtf(u * u + v * v);
+            if (length < LIC_MIN_FLOW)
+                continue;
+            slice->flow[2 * n] = u / length;
+            slice->flow[2 * n + 1] = v / length;
+            slice->magnitude[n] = magnitude;
+            if (magnitude > maxMagnitude)
+                maxMagnitude = magnitude;
+        }
+    }
+    job->scratch[worker].maxMagnitude = maxMagnitude;
+}
+
+
+/* Bilinearly interpolates the flow at a point in texels, where texel (i, j)
+ * covers [i, i + 1) x [j, j + 1), and returns its squared length, at most
+ * 1 since the samples are unit vectors. The point is clamped just inside
+ * the last texel centers so that the four texels always exist, which needs
+ * an image of at least 2 x 2 texels.
+ */
+static inline float sampleFlow(const LICSLICE *slice, float x, float y, float *flow) {
+    float fx = fminf(fmaxf(x - 0.5f, 0), slice->width - 1.001f);
+    float fy = fminf(fmaxf(y - 0.5f, 0), slice->height - 1.001f);
+    int i = (int) fx, j = (int) fy;
+    float wx = fx - i, wy = fy - j;
+    const float *f0 = slice->flow + 2 * (j * slice->width + i);
+    const float *f1 = f0 + 2 * slice->width;
+    flow[0] = (1 - wy) * ((1 - wx) * f0[0] + wx * f0[2]) + wy * ((1 - wx) * f1[0] + wx * f1[2]);
+    flow[1] = (1 - wy) * ((1 - wx) * f0[1] + wx * f0[3]) + wy * ((1 - wx) * f1[1] + wx * f1[3]);
+    return flow[0] * flow[0] + flow[1] * flow[1];
+}
+
+// A streamline being traced from a seed in one direction.
+typedef struct {
+    float x;
+    float y;
+    // Negative to go against the flow.
+    float step;
+    int count;
+    // Points in a row outside the tile.
+    int outside;
+    unsigned char *values;
+    int *targets;
+} Tracer;
+
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} Tile;
+
+/* Takes one midpoint step along the flow, storing the noise under the new
+ * point and its texel in the tile, or -1 outside it. Returns 0, storing
+ * nothing, at the image border and where the flow vanishes. Only the
+ * second sample is normalized; leaving the first one shortens the half
+ * step slightly where the directions diverge, and keeps a square root and
+ * a division off the dependency chain the streamline is made of.
+ */
+static inline int advanceTracer(const LICSLICE *slice, const Tile *tile, Tracer *tracer) {
+    float k1[2], k2[2], length2, scale, x, y;
+    int i, j;
+    if (sampleFlow(slice, tracer->x, tracer->y, k1) < LIC_MIN_FLOW * LIC_MIN_FLOW)
+        return 0;
+    length2 = sampleFlow(slice, tracer->x + 0.5f * tracer->step * k1[0],
+                         tracer->y + 0.5f * tracer->step * k1[1], k2);
+    if (length2 < LIC_MIN_FLOW * LIC_MIN_FLOW)
+        return 0;
+    scale = tracer->step / sqrtf(length2);
+    x = tracer->x + scale * k2[0];
+    y = tracer->y + scale * k2[1];
+    if (x < 0 || y < 0 || x >= slice->width || y >= slice->height)
+        return 0;
+    tracer->x = x;
+    tracer->y = y;
+    i = (int) x;
+    j = (int) y;
+    tracer->values[tracer->count] = slice->noise[j * slice->width + i];
+    i -= tile->x;
+    j -= tile->y;
+    if (i >= 0 && j >= 0 && i < tile->width && j < tile->height) {
+        tracer->targets[tracer->count] = j * tile->width + i;
+        tracer->outside = 0;
+    }
+    else {
+        tracer->targets[tracer->count] = -1;
+        tracer->outside++;
+    }
+    tracer->count++;
+    return 1;
+}
+
+/* Traces both halves of the streamline through a seed for at most maxSteps
+ * each. A half stops once it has been outside the tile for more than
+ * kernel points, which covers the kernels of all the points it deposits.
+ * The steps of a streamline depend on each other, so the two halves are
+ * interleaved to give the processor independent work.
+ */
+static void traceLine(const LICSLICE *slice, const Tile *tile, int maxSteps, int kernel,
+                      Tracer *forward, Tracer *backward) {
+    int forwardAlive = maxSteps > 0, backwardAlive = maxSteps > 0;
+    while (forwardAlive || backwardAlive) {
+        if (forwardAlive)
+            forwardAlive = advanceTracer(slice, tile, forward) &&
+                           forward->count < maxSteps && forward->outside <= kernel;
+        if (backwardAlive)
+            backwardAlive = advanceTracer(slice, tile, backward) &&
+                            backward->count < maxSteps && backward->outside <= kernel;
+    }
+}
+
+static void writeTexel(const LicJob *job, long n, float intensity) {
+    const LICSLICE *slice = job->slice;
+    GLubyte *texel = slice->texels + 4 * n;
+    float color[3] = {1, 1, 1}, value;
+    int c;
+    value = 0.5f + (intensity / 255 - 0.5f) * job->gain;
+    value = value < 0 ? 0 : value > 1 ? 1 : value;
+    if (job->params->colorByMagnitude) {
+        unsigned char ramp[4];
+        fieldMagnitudeColor(job->maxMagnitude > 0 ? slice->magnitude[n] / job->maxMagnitude : 0,
+                            ramp);
+        for (c = 0; c < 3; c++)
+            color[c] = ramp[c] / 255.0f;
+    }
+    for (c = 0; c < 3; c++)
+        texel[c] = (GLubyte) (color[c] * value * 255 + 0.5f);
+    texel[3] = 255;
+}
+
+/* Convolves the tiles [first, last). A streamline is traced through each
+ * texel of the tile that has fewer than minHits deposits, and the box sum
+ * slides along it so that every point within reuseSteps of the seed costs
+ * one add and one subtract. Only deposits into the tile are kept, so a
+ * streamline leaving the tile is traced again from the neighbouring one.
+ * Centers within the kernel of where tracing ended get a shorter kernel,
+ * which only happens outside the tile unless the streamline ended at the
+ * border or at a critical point.
+ */
+static void convolveTask(long first, long last, int worker, void *userData) {
+    LicJob *job = (LicJob *) userData;
+    LICSLICE *slice = job->slice;
+    const LICPARAMS *params = job->params;
+    Scratch *scratch = &job->scratch[worker];
+    int kernel = job->kernelSteps, reuse = job->reuseSteps, maxSteps = job->maxSteps;
+    // The seed sits at maxSteps, the backward points before it.
+    unsigned char *values = scratch->values;
+    int *targets = scratch->targets;
+    long n;
+
+    for (n = first; n < last; n++) {
+        Tile tile;
+        int i, j, k;
+        tile.x = (int) (n % job->tilesX) * params->tileSize;
+        tile.y = (int) (n / job->tilesX) * params->tileSize;
+        tile.width = slice->width - tile.x < params->tileSize ?
+                     slice->width - tile.x : params->tileSize;
+        tile.height = slice->height - tile.y < params->tileSize ?
+                      slice->height - tile.y : params->tileSize;
+
+        memset(scratch->sum, 0, tile.width * tile.height * sizeof(float));
+        memset(scratch->hits, 0, tile.width * tile.height * sizeof(int));
+        for (j = 0; j < tile.height; j++) {
+            for (i = 0; i < tile.width; i++) {
+                Tracer forward, backward;
+                float sum = 0;
+                int lo, hi, c0, c1, count = 0;
+                if (scratch->hits[j * tile.width + i] >= params->minHits)
+                    continue;
+                values[maxSteps] = slice->noise[(tile.y + j) * slice->width + tile.x + i];
+                targets[maxSteps] = j * tile.width + i;
+                forward.x = backward.x = tile.x + i + 0.5f;
+                forward.y = backward.y = tile.y + j + 0.5f;
+                forward.step = params->stepSize;
+                backward.step = -params->stepSize;
+                forward.count = backward.count = 0;
+                forward.outside = backward.outside = 0;
+                forward.values = values + maxSteps + 1;
+                forward.targets = targets + maxSteps + 1;
+                backward.values = values + 2 * maxSteps + 1;
+                backward.targets = targets + 2 * maxSteps + 1;
+                traceLine(slice, &tile, maxSteps, kernel, &forward, &backward);
+                for (k = 0; k < backward.count; k++) {
+                    values[maxSteps - 1 - k] = backward.values[k];
+                    targets[maxSteps - 1 - k] = backward.targets[k];
+                }
+                lo = maxSteps - backward.count;
+                hi = maxSteps + forward.count + 1;
+                c0 = maxSteps - reuse > lo ? maxSteps - reuse : lo;
+                c1 = maxSteps + reuse < hi - 1 ? maxSteps + reuse : hi - 1;
+                for (k = c0 - kernel > lo ? c0 - kernel : lo;
+                     k <= c0 + kernel && k < hi; k++) {
+                    sum += values[k];
+                    count++;
+                }
+                for (k = c0; k <= c1; k++) {
+                    int target = targets[k];
+                    if (target >= 0) {
+                        scratch->sum[target] += sum / count;
+                        scratch->hits[target]++;
+                    }
+                    if (k + kernel + 1 < hi) {
+                        sum += values[k + kernel + 1];
+                        count++;
+                    }
+                    if (k - kernel >= lo) {
+                        sum -= values[k - kernel];
+                        count--;
+                    }
+                }
+            }
+        }
+        for (j = 0; j < tile.height; j++)
+            for (i = 0; i < tile.width; i++)
+                writeTexel(job, (long) (tile.y + j) * slice->width + tile.x + i,
+                           scratch->sum[j * tile.width + i] / scratch->hits[j * tile.width + i]);
+    }
+}
+
+
+void licParamsDefault(LICPARAMS *params) {
+    memset(params, 0, sizeof(LICPARAMS));
+    params->kernelLength = 10;
+    params->stepSize = 1;
+    params->reuseLength = 80;
+    params->minHits = 1;
+    params->tileSize = 64;
+    params->colorByMagnitude = 1;
+}
+
+
+void licPlaneAxis(LICPLANE *plane, const FIELD *field, int axis, float position) {
+    int counts[3] = {field->nx, field->ny, field->nz};
+    int u = (axis + 1) % 3, v = (axis + 2) % 3;
+    memset(plane, 0, sizeof(LICPLANE));
+    memcpy(plane->origin, field->origin, sizeof(plane->origin));
+    plane->origin[axis] = position;
+    plane->axisU[u] = (counts[u] - 1) * field->spacing[u];
+    plane->axisV[v] = (counts[v] - 1) * field->spacing[v];
+}
+
+
+int licSliceInit(LICSLICE *slice, int width, int height, unsigned int seed) {
+    size_t texels = (size_t) width * height, noiseBytes, flowBytes, magnitudeBytes;
+    unsigned char *storage;
+    size_t n;
+
+    memset(slice, 0, sizeof(LICSLICE));
+    if (width <= 0 || height <= 0)
+        return 0;
+    noiseBytes = alignSize(texels);
+    flowBytes = alignSize(2 * texels * sizeof(float));
+    magnitudeBytes = alignSize(texels * sizeof(float));
+    storage = (unsigned char *) Eigen::internal::aligned_malloc(
+            noiseBytes + flowBytes + magnitudeBytes + 4 * texels);
+    if (storage == NULL) {
+        LOGE(MESH, "out of memory for a %dx%d LIC slice", width, height);
+        return 0;
+    }
+    slice->storage = storage;
+    slice->noise = storage;
+    slice->flow = (float *) (storage + noiseBytes);
+    slice->magnitude = (float *) (storage + noiseBytes + flowBytes);
+    slice->texels = storage + noiseBytes + flowBytes + magnitudeBytes;
+    slice->width = width;
+    slice->height = height;
+
+    // xorshift32, which must not start from 0.
+    if (seed == 0)
+        seed = 0x9e3779b9u;
+    for (n = 0; n < texels; n++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        slice->noise[n] = (unsigned char) (seed >> 24);
+    }
+    memset(slice->texels, 0, 4 * texels);
+    return 1;
+}
+
+
+void licSliceDeinit(LICSLICE *slice) {
+    licSliceDeleteTexture(slice);
+    Eigen::internal::aligned_free(slice->storage);
+    memset(slice, 0, sizeof(LICSLICE));
+}
+
+
+int licSliceCompute(LICSLICE *slice, const FIELD *field, const LICPLANE *plane,
+                    const LICPARAMS *params, THREADPOOL *pool) {
+    int workers = threadPoolSize(pool), tiles, lineLength, w;
+    size_t tileTexels, scratchSize;
+    unsigned char *scratchStorage;
+    LicJob job;
+    ProfileScope profile(PROFILE_STAGE_MESH_BUILD);
+
+    if (slice->storage == NULL || slice->width < 2 || slice->height < 2 ||
+        params->stepSize <= 0 || params->tileSize <= 0 ||
+        params->kernelLength < 0 || params->reuseLength < 0)
+        return 0;
+    memset(&job, 0, sizeof(LicJob));
+    if (!planeInverse(plane, job.inverse)) {
+        LOGE(MESH, "degenerate LIC slice plane");
+        return 0;
+    }
+    job.slice = slice;
+    job.field = field;
+    job.plane = plane;
+    job.params = params;
+    job.kernelSteps = (int) (params->kernelLength / params->stepSize + 0.5f);
+    job.reuseSteps = (int) (params->reuseLength / params->stepSize + 0.5f);
+    job.maxSteps = job.kernelSteps + job.reuseSteps;
+    /* Averaging n independent uniform samples shrinks their deviation by
+     * sqrt(n). The points are about a texel apart, so stretch the contrast
+     * back by the square root of the texels under the kernel.
+     */
+    job.gain = sqrtf(2 * params->kernelLength + 1) * 0.7f;
+    job.tilesX = (slice->width + params->tileSize - 1) / params->tileSize;
+    tiles = job.tilesX * ((slice->height + params->tileSize - 1) / params->tileSize);
+
+    // The backward trace goes after the assembled line before being moved.
+    lineLength = 3 * job.maxSteps + 1;
+    tileTexels = (size_t) params->tileSize * params->tileSize;
+    scratchSize = alignSize(tileTexels * sizeof(float)) + alignSize(tileTexels * sizeof(int)) +
+                  alignSize(lineLength) + alignSize(lineLength * sizeof(int));
+    job.scratch = (Scratch *) calloc(workers, sizeof(Scratch));
+    scratchStorage = (unsigned char *) malloc(workers * scratchSize);
+    if (job.scratch == NULL || scratchStorage == NULL) {
+        free(scratchStorage);
+        free(job.scratch);
+        return 0;
+    }
+    for (w = 0; w < workers; w++) {
+        unsigned char *block = scratchStorage + w * scratchSize;
+        job.scratch[w].sum = (float *) block;
+        block += alignSize(tileTexels * sizeof(float));
+        job.scratch[w].hits = (int *) block;
+        block += alignSize(tileTexels * sizeof(int));
+        job.scratch[w].values = block;
+        block += alignSize(lineLength);
+        job.scratch[w].targets = (int *) block;
+    }
+
+    slice->plane = *plane;
+    threadPoolRun(pool, slice->height, 0, projectTask, &job);
+    for (w = 0; w < workers; w++)
+        if (job.scratch[w].maxMagnitude > job.maxMagnitude)
+            job.maxMagnitude = job.scratch[w].maxMagnitude;
+    threadPoolRun(pool, tiles, 1, convolveTask, &job);
+
+    free(scratchStorage);
+    free(job.scratch);
+    return 1;
+}
+
+
+int licSliceCreateTexture(LICSLICE *slice) {
+    if (slice->storage == NULL)
+        return 0;
+    if (slice->texture == 0)
+        glGenTextures(1, &slice->texture);
+    if (slice->texture == 0)
+        return 0;
+    glBindTexture(GL_TEXTURE_2D, slice->texture);
+    // Without mipmaps the default minification filter would leave the
+    // texture incomplete.
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, slice->width, slice->height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, slice->texels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return 1;
+}
+
+
+void licSliceDeleteTexture(LICSLICE *slice) {
+    if (slice->texture != 0)
+        glDeleteTextures(1, &slice->texture);
+    slice->texture = 0;
+}
+
+
+void drawLicSlice(LICSLICE *slice) {
+    static const GLfloat texCoords[8] = {0, 0, 1, 0, 1, 1, 0, 1};
+    const LICPLANE *plane = &slice->plane;
+    GLfloat corners[12];
+    int a;
+    if (slice->texture == 0)
+        return;
+    for (a = 0; a < 3; a++) {
+        corners[a] = plane->origin[a];
+        corners[3 + a] = plane->origin[a] + plane->axisU[a];
+        corners[6 + a] = plane->origin[a] + plane->axisU[a] + plane->axisV[a];
+        corners[9 + a] = plane->origin[a] + plane->axisV[a];
+    }
+
+    glDisable(GL_LIGHTING);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glColor4x(0x10000, 0x10000, 0x10000, 0x10000);
+    glEnable(GL_TEXTURE_2D);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glBindTexture(GL_TEXTURE_2D, slice->texture);
+    glVertexPointer(3, GL_FLOAT, 0, corners);
+    glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisable(GL_TEXTURE_2D);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glEnable(GL_LIGHTING);
+}
@@ -0,0 +1,134 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef LIC_H_INCLUDED
+#define LIC_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "importgl.h"
+#include "field.h"
+#include "threadpool.h"
+
+
+/* A parallelogram through the field, in field coordinates. Texture
+ * coordinates s, t in [0, 1] map to origin + s * axisU + t * axisV.
+ */
+typedef struct {
+    float origin[3];
+    float axisU[3];
+    float axisV[3];
+} LICPLANE;
+
+/* How the noise is convolved. Lengths are in texels along the streamline.
+ */
+typedef struct {
+    // The box kernel averages the noise over kernelLength on each side.
+    float kernelLength;
+    float stepSize;
+    /* Fast LIC: a streamline traced from one seed texel is convolved over
+     * reuseLength on each side of the seed, updating the box sum by the
+     * samples that enter and leave it, and deposits the result into
+     * every texel it passes. Seeds are only traced from texels that got
+     * fewer than minHits deposits so far.
+     */
+    float reuseLength;
+    int minHits;
+    // Texels along each side of the square tiles the threads take.
+    int tileSize;
+    // Non-zero to tint the image by the in-plane magnitude.
+    int colorByMagnitude;
+} LICPARAMS;
+
+/* Line integral convolution image of the field in a slice plane. noise
+ * holds one white noise byte per texel, flow the in-plane field direction
+ * as a unit vector in texels and magnitude the length of the in-plane
+ * field component, 0 outside the field. texels is the RGBA result, rows
+ * bottom first as GL expects. Dimensions should be powers of two for GLES
+ * 1.x.
+ */
+typedef struct {
+    int width;
+    int height;
+    unsigned char *noise;
+    float *flow;
+    float *magnitude;
+    GLubyte *texels;
+    LICPLANE plane;
+    // Texture object holding texels, 0 when not created.
+    GLuint texture;
+    // The single heap block holding all of the arrays.
+    void *storage;
+} LICSLICE;
+
+
+extern void licParamsDefault(LICPARAMS *params);
+
+/* Sets plane to the cross-section of the field bounds perpendicular to axis
+ * (0 for x, 1 for y, 2 for z) at the given coordinate along it. axisU and
+ * axisV follow the next two axes in cyclic order.
+ */
+extern void licPlaneAxis(LICPLANE *plane, const FIELD *field, int axis, float position);
+
+/* Allocates a width * height slice and fills its noise from seed. Returns
+ * non-zero on success and 0 on failure.
+ */
+extern int licSliceInit(LICSLICE *slice, int width, int height, unsigned int seed);
+
+/* Deletes the texture and frees the arrays.
+ */
+extern void licSliceDeinit(LICSLICE *slice);
+
+/* Projects the field onto plane and convolves the noise along the in-plane
+ * streamlines, splitting the image into tiles between the threads of pool,
+ * which may be NULL. A tile only writes its own texels, so the threads
+ * share no output. Makes no GL calls. Returns non-zero on success and 0 on
+ * failure.
+ */
+extern int licSliceCompute(LICSLICE *slice, const FIELD *field, const LICPLANE *plane,
+                           const LICPARAMS *params, THREADPOOL *pool);
+
+/* Uploads texels into a texture object, creating it on the first call.
+ * Needs a current GL context. Returns non-zero on success and 0 on
+ * failure.
+ */
+extern int licSliceCreateTexture(LICSLICE *slice);
+
+/* Deletes the texture object, after which licSliceDeinit makes no GL
+ * calls. Needs a current GL context.
+ */
+extern void licSliceDeleteTexture(LICSLICE *slice);
+
+/* Draws the slice as a textured quad on its plane, unlit. Does nothing
+ * without a texture.
+ */
+extern void drawLicSlice(LICSLICE *slice);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !LIC_H_INCLUDED
@@ -0,0 +1,79 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <string.h>
+#include <math.h>
+
+#include "lod.h"
+
+
+// Weight of the newest frame in the moving averages.
+#define LOD_SMOOTHING       0.1f
+// The interval may exceed the target this much before density drops,
+// and the work must stay this far under it before density rises.
+#define LOD_OVER_TARGET     1.1f
+#define LOD_UNDER_TARGET    0.8f
+// Largest density change per frame, down and up.
+#define LOD_MAX_DECREASE    0.9f
+#define LOD_MAX_INCREASE    1.03f
+
+
+static float smooth(float average, float value) {
+    return average == 0 ? value : average + LOD_SMOOTHING * (value - average);
+}
+
+static float clampFloat(float value, float low, float high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+
+void lodControllerInit(LODCONTROLLER *controller, float targetMs) {
+    memset(controller, 0, sizeof(LODCONTROLLER));
+    controller->targetMs = targetMs;
+    controller->density = 1;
+    controller->minDensity = 0.125f;
+    controller->maxDensity = 1;
+}
+
+void lodControllerRestart(LODCONTROLLER *controller) {
+    controller->intervalMs = 0;
+    controller->workMs = 0;
+}
+
+float lodControllerUpdate(LODCONTROLLER *controller, float intervalMs, float workMs) {
+    float target = controller->targetMs, adjust = 1;
+
+    if (target <= 0)
+        return controller->density;
+    if (intervalMs > 0)
+        controller->intervalMs = smooth(controller->intervalMs, intervalMs);
+    controller->workMs = smooth(controller->workMs, workMs);
+
+    if (controller->intervalMs > target * LOD_OVER_TARGET ||
+        controller->workMs > target * LOD_OVER_TARGET) {
+        float slowest = fmaxf(controller->intervalMs, controller->workMs);
+        adjust = clampFloat(sqrtf(target / slowest), LOD_MAX_DECREASE, 1);
+    }
+    else if (controller->workMs > 0 && controller->workMs < target * LOD_UNDER_TARGET)
+        adjust = clampFloat(sqrtf(target * LOD_UNDER_TARGET / controller->workMs),
+                            1, LOD_MAX_INCREASE);
+    controller->density = clampFloat(controller->density * adjust,
+                                     controller->minDensity, controller->maxDensity);
+    return controller->density;
+}
@@ -0,0 +1,81 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef LOD_H_INCLUDED
+#define LOD_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Frame time the controller holds by default: one 60 Hz display refresh.
+#define LOD_DEFAULT_TARGET_MS   16.6f
+
+
+/* Steers a global density scalar in [minDensity, maxDensity] so that
+ * frames take targetMs. The geometry drawn is assumed to grow with the
+ * square of the density, as glyphs spaced by a fixed number of pixels
+ * over density do, so each update moves the density by the square root
+ * of the time ratio, limited to a few percent per frame.
+ *
+ * Two measurements are fed in: the interval between frames, which is
+ * what the user sees but is held at the refresh period by vsync, and the
+ * time the frame itself took. Density goes down when the interval runs
+ * over the target and up only when the frame work leaves headroom under
+ * it, so a vsync locked display does not hide spare time.
+ */
+typedef struct {
+    float targetMs;
+    float density;
+    float minDensity;
+    float maxDensity;
+    // Exponential moving averages of the measurements, 0 before the first.
+    float intervalMs;
+    float workMs;
+} LODCONTROLLER;
+
+
+/* Starts at full density. A targetMs of 0 disables the control and keeps
+ * the density at 1.
+ */
+extern void lodControllerInit(LODCONTROLLER *controller, float targetMs);
+
+/* Feeds the measurements of one frame and returns the new density.
+ * intervalMs may be 0 when unknown. Callers whose geometry follows the
+ * density with a delay should only feed frames drawn at the current
+ * density, restarting the controller when such frames arrive, or it
+ * keeps correcting for a change already made.
+ */
+extern float lodControllerUpdate(LODCONTROLLER *controller, float intervalMs, float workMs);
+
+/* Forgets the averaged measurements, which no longer apply once the
+ * drawn geometry has changed.
+ */
+extern void lodControllerRestart(LODCONTROLLER *controller);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !LOD_H_INCLUDED
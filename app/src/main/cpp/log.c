@@ -0,0 +1,205 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef ANDROID_NDK
+#include <android/log.h>
+#endif
+
+#include "log.h"
+
+
+// Number of messages the ring holds, must be a power of two.
+#define LOG_RING_SIZE       256
+#define LOG_MESSAGE_LENGTH  240
+
+/* One ring entry. The sequence number tells who owns the slot: it equals
+ * the enqueue position when the slot is free for that producer, and the
+ * position plus one when the message is complete and may be written out.
+ */
+typedef struct {
+    unsigned long sequence;
+    int level;
+    const char *tag;
+    char text[LOG_MESSAGE_LENGTH];
+} LOGSLOT;
+
+static LOGSLOT sRing[LOG_RING_SIZE];
+static unsigned long sEnqueuePos = 0;
+static unsigned long sDequeuePos = 0;
+static unsigned long sDropped = 0;
+static int sAsyncRunning = 0;
+// logPrint calls between their check of sAsyncRunning and the end of
+// their enqueue, which logStopAsync waits out.
+static int sProducers = 0;
+static int sStopRequested = 0;
+static pthread_t sLogThread;
+/* The log thread sets sSleeping and waits on sWake while the ring is
+ * empty. Only producers that see sSleeping set take sWakeLock to signal
+ * it, so logging into a busy sink never touches the mutex. Both sides
+ * go through sSleeping with a read-modify-write after their own update,
+ * so the later one sees the earlier: either the log thread finds the
+ * published message or the producer finds it asleep and signals.
+ */
+static int sSleeping = 0;
+static pthread_mutex_t sWakeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sWake = PTHREAD_COND_INITIALIZER;
+
+
+static void writeMessage(int level, const char *tag, const char *text) {
+#ifdef ANDROID_NDK
+    __android_log_write(level, tag, text);
+#else
+    static const char levelChars[] = "??VDIWEFS";
+    fprintf(stderr, "%c/%s: %s\n", levelChars[level & 7], tag, text);
+#endif
+}
+
+static int enqueueMessage(int level, const char *tag, const char *format, va_list args) {
+    unsigned long pos = __atomic_load_n(&sEnqueuePos, __ATOMIC_RELAXED);
+    LOGSLOT *slot;
+
+    for (;;) {
+        long diff;
+        slot = &sRing[pos & (LOG_RING_SIZE - 1)];
+        diff = (long) (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&sEnqueuePos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+            return 0;   // Ring is full.
+        else
+            pos = __atomic_load_n(&sEnqueuePos, __ATOMIC_RELAXED);
+    }
+
+    slot->level = level;
+    slot->tag = tag;
+    vsnprintf(slot->text, LOG_MESSAGE_LENGTH, format, args);
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void wakeLogThread() {
+    if (!__atomic_fetch_or(&sSleeping, 0, __ATOMIC_ACQ_REL))
+        return;
+    pthread_mutex_lock(&sWakeLock);
+    pthread_cond_signal(&sWake);
+    pthread_mutex_unlock(&sWakeLock);
+}
+
+static int messageReady() {
+    LOGSLOT *slot = &sRing[sDequeuePos & (LOG_RING_SIZE - 1)];
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == sDequeuePos + 1;
+}
+
+/* Only called from the log thread, or after it has been joined, so the
+ * dequeue side needs no CAS.
+ */
+static int dequeueMessage() {
+    LOGSLOT *slot = &sRing[sDequeuePos & (LOG_RING_SIZE - 1)];
+    if (!messageReady())
+        return 0;
+    writeMessage(slot->level, slot->tag, slot->text);
+    __atomic_store_n(&slot->sequence, sDequeuePos + LOG_RING_SIZE, __ATOMIC_RELEASE);
+    sDequeuePos++;
+    return 1;
+}
+
+static void *logThread(void *arg) {
+    (void) arg;
+    while (!__atomic_load_n(&sStopRequested, __ATOMIC_ACQUIRE)) {
+        if (dequeueMessage())
+            continue;
+        __atomic_exchange_n(&sSleeping, 1, __ATOMIC_ACQ_REL);
+        pthread_mutex_lock(&sWakeLock);
+        while (!__atomic_load_n(&sStopRequested, __ATOMIC_ACQUIRE) && !messageReady())
+            pthread_cond_wait(&sWake, &sWakeLock);
+        pthread_mutex_unlock(&sWakeLock);
+        __atomic_store_n(&sSleeping, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+
+void logPrint(int level, const char *tag, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    __atomic_fetch_add(&sProducers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sAsyncRunning, __ATOMIC_SEQ_CST)) {
+        if (enqueueMessage(level, tag, format, args))
+            wakeLogThread();
+        else
+            __atomic_fetch_add(&sDropped, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&sProducers, 1, __ATOMIC_RELEASE);
+    }
+    else {
+        __atomic_fetch_sub(&sProducers, 1, __ATOMIC_RELAXED);
+        char text[LOG_MESSAGE_LENGTH];
+        vsnprintf(text, sizeof(text), format, args);
+        writeMessage(level, tag, text);
+    }
+    va_end(args);
+}
+
+
+int logStartAsync() {
+    unsigned long i;
+    if (sAsyncRunning)
+        return 1;
+    for (i = 0; i < LOG_RING_SIZE; i++)
+        sRing[i].sequence = i;
+    sEnqueuePos = 0;
+    sDequeuePos = 0;
+    sStopRequested = 0;
+    if (pthread_create(&sLogThread, NULL, logThread, NULL) != 0)
+        return 0;
+    __atomic_store_n(&sAsyncRunning, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+void logStopAsync() {
+    if (!sAsyncRunning)
+        return;
+    // Producers that saw the sink running finish their enqueue; later ones
+    // write synchronously.
+    __atomic_store_n(&sAsyncRunning, 0, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&sProducers, __ATOMIC_SEQ_CST) != 0)
+        sched_yield();
+    __atomic_store_n(&sStopRequested, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&sWakeLock);
+    pthread_cond_signal(&sWake);
+    pthread_mutex_unlock(&sWakeLock);
+    pthread_join(sLogThread, NULL);
+    // Every reserved slot is published by now; write out what the log
+    // thread left.
+    while (sDequeuePos != __atomic_load_n(&sEnqueuePos, __ATOMIC_ACQUIRE))
+        dequeueMessage();
+}
+
+
+unsigned long logDroppedCount() {
+    return __atomic_load_n(&sDropped, __ATOMIC_RELAXED);
+}
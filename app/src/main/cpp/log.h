@@ -0,0 +1,125 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef LOG_H_INCLUDED
+#define LOG_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Log levels. The values match the Android log priorities so that they
+ * can be passed to the system logger unchanged.
+ */
+#define LOG_LEVEL_VERBOSE   2
+#define LOG_LEVEL_DEBUG     3
+#define LOG_LEVEL_INFO      4
+#define LOG_LEVEL_WARN      5
+#define LOG_LEVEL_ERROR     6
+#define LOG_LEVEL_SILENT    8
+
+/* Lowest level compiled in for tags that do not override it. Release
+ * builds (NDEBUG) keep info and above, other builds also keep debug.
+ * Verbose messages are compiled in only on request.
+ */
+#ifndef LOG_DEFAULT_LEVEL
+#ifdef NDEBUG
+#define LOG_DEFAULT_LEVEL   LOG_LEVEL_INFO
+#else
+#define LOG_DEFAULT_LEVEL   LOG_LEVEL_DEBUG
+#endif
+#endif
+
+/* Known tags. Each has a logcat tag string and a minimum level which can
+ * be overridden from the compiler command line, for example
+ * -DLOG_MIN_LEVEL_MESH=LOG_LEVEL_VERBOSE to trace the mesh builders.
+ */
+#define LOG_TAG_APP         "vf"
+#define LOG_TAG_FIELD       "vf.field"
+#define LOG_TAG_MESH        "vf.mesh"
+#define LOG_TAG_RENDER      "vf.render"
+
+#ifndef LOG_MIN_LEVEL_APP
+#define LOG_MIN_LEVEL_APP       LOG_DEFAULT_LEVEL
+#endif
+#ifndef LOG_MIN_LEVEL_FIELD
+#define LOG_MIN_LEVEL_FIELD     LOG_DEFAULT_LEVEL
+#endif
+#ifndef LOG_MIN_LEVEL_MESH
+#define LOG_MIN_LEVEL_MESH      LOG_DEFAULT_LEVEL
+#endif
+#ifndef LOG_MIN_LEVEL_RENDER
+#define LOG_MIN_LEVEL_RENDER    LOG_DEFAULT_LEVEL
+#endif
+
+/* Non-zero when messages of the given level are compiled in for the tag.
+ * This is a constant expression, so a disabled LOG call is dead code:
+ * its arguments are still type checked but never evaluated, and the
+ * optimizer removes the call entirely.
+ */
+#define LOG_ENABLED(tag, level) ((level) >= LOG_MIN_LEVEL_##tag)
+
+#define LOG_PRINT(tag, level, ...) do { \
+        if (LOG_ENABLED(tag, level)) \
+            logPrint(level, LOG_TAG_##tag, __VA_ARGS__); } while (0)
+
+#define LOGV(tag, ...)  LOG_PRINT(tag, LOG_LEVEL_VERBOSE, __VA_ARGS__)
+#define LOGD(tag, ...)  LOG_PRINT(tag, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOGI(tag, ...)  LOG_PRINT(tag, LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOGW(tag, ...)  LOG_PRINT(tag, LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOGE(tag, ...)  LOG_PRINT(tag, LOG_LEVEL_ERROR, __VA_ARGS__)
+
+
+/* Formats and emits one message. With the asynchronous sink running the
+ * message is copied to a ring buffer and written out by the log thread,
+ * otherwise it is written synchronously. Use the LOG macros instead of
+ * calling this directly.
+ */
+extern void logPrint(int level, const char *tag, const char *format, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 3, 4)))
+#endif
+        ;
+
+/* Starts the asynchronous sink. Callers never block on it: when the ring
+ * is full new messages are dropped and counted, and only a message that
+ * finds the log thread asleep briefly takes a lock to wake it. Calling
+ * this while the sink is already running does nothing. Returns non-zero
+ * on success.
+ */
+extern int logStartAsync();
+
+/* Writes out the pending messages and stops the asynchronous sink.
+ */
+extern void logStopAsync();
+
+/* Returns the number of messages dropped because the ring was full.
+ */
+extern unsigned long logDroppedCount();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !LOG_H_INCLUDED
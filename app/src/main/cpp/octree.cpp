@@ -0,0 +1,560 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <Eigen/Core>
+
+#include "octree.h"
+#include "log.h"
+
+
+using Eigen::internal::aligned_free;
+using Eigen::internal::aligned_malloc;
+using Eigen::internal::aligned_realloc;
+
+// Cells per brick along each axis.
+#define BRICK_CELLS     (OCTREE_BRICK_SIZE - 1)
+// Floats per brick, all three components.
+#define BRICK_FLOATS    (3 * OCTREE_BRICK_SAMPLES)
+// Queries sorted at a time by octreeFieldInterpolateBatch.
+#define BATCH_SIZE      256
+
+
+/* Stores the samples of the brick at brick position (bx, by, bz) to brick
+ * as three component arrays, i fastest. Samples beyond the lattice may be
+ * left undefined; the builder replaces them.
+ */
+typedef void (*BrickFill)(const OCTREEFIELD *tree, int bx, int by, int bz, float *brick,
+                          void *userData);
+
+// Component ranges of the samples under a node, empty outside the lattice.
+struct Range {
+    float lo[3];
+    float hi[3];
+};
+
+struct Builder {
+    OCTREEFIELD *tree;
+    BrickFill fill;
+    void *userData;
+    float tolerance;
+    // Range of each tree node, for merging constant siblings.
+    Range *ranges;
+    int rangeCapacity;
+    // Samples of the brick being built.
+    float *brick;
+    float minSquared;
+    float maxSquared;
+    bool failed;
+};
+
+struct Cell {
+    // Morton code of the brick position holding the cell.
+    unsigned int code;
+    // Index of the first corner of the cell in the brick.
+    int sample;
+    // Position inside the cell.
+    float u, v, w;
+};
+
+
+/* Morton codes */
+
+// Moves the low 10 bits of v to every third bit.
+static unsigned int spreadBits(unsigned int v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Inverse of spreadBits.
+static unsigned int compactBits(unsigned int v) {
+    v &= 0x09249249;
+    v = (v | (v >> 2)) & 0x030c30c3;
+    v = (v | (v >> 4)) & 0x0300f00f;
+    v = (v | (v >> 8)) & 0x030000ff;
+    v = (v | (v >> 16)) & 0x000003ff;
+    return v;
+}
+
+static unsigned int mortonCode(int x, int y, int z) {
+    return spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+}
+
+// Brick positions covered by a node of level.
+static unsigned int levelSpan(int level) {
+    return 1u << 3 * level;
+}
+
+
+/* Building */
+
+static void setRangeEmpty(Range *range) {
+    int c;
+    for (c = 0; c < 3; c++) {
+        range->lo[c] = HUGE_VALF;
+        range->hi[c] = -HUGE_VALF;
+    }
+}
+
+static bool rangeWithin(const Range &range, float tolerance) {
+    int c;
+    for (c = 0; c < 3; c++)
+        if (range.hi[c] - range.lo[c] > 2 * tolerance)
+            return false;
+    return true;
+}
+
+// Appends a node with its sample range, growing both arrays as needed.
+static OCTREENODE *appendNode(Builder *builder, unsigned int code, int level,
+                              const Range &range) {
+    OCTREEFIELD *tree = builder->tree;
+    OCTREENODE *node;
+    if (tree->nodeCount == tree->nodeCapacity) {
+        int capacity = tree->nodeCapacity > 0 ? 2 * tree->nodeCapacity : 64;
+        OCTREENODE *nodes = (OCTREENODE *) realloc(tree->nodes, capacity * sizeof(OCTREENODE));
+        if (nodes == NULL) {
+            builder->failed = true;
+            return NULL;
+        }
+        tree->nodes = nodes;
+        tree->nodeCapacity = capacity;
+    }
+    if (tree->nodeCount == builder->rangeCapacity) {
+        int capacity = tree->nodeCapacity;
+        Range *ranges = (Range *) realloc(builder->ranges, capacity * sizeof(Range));
+        if (ranges == NULL) {
+            builder->failed = true;
+            return NULL;
+        }
+        builder->ranges = ranges;
+        builder->rangeCapacity = capacity;
+    }
+    builder->ranges[tree->nodeCount] = range;
+    node = &tree->nodes[tree->nodeCount++];
+    node->code = code;
+    node->level = level;
+    node->brick = OCTREE_CONSTANT;
+    return node;
+}
+
+// Appends a constant node at the middle of range, zero when it is empty.
+static void appendConstant(Builder *builder, unsigned int code, int level, const Range &range) {
+    OCTREENODE *node = appendNode(builder, code, level, range);
+    int c;
+    if (node == NULL)
+        return;
+    for (c = 0; c < 3; c++)
+        node->value[c] = range.hi[c] >= range.lo[c] ? 0.5f * (range.lo[c] + range.hi[c]) : 0;
+}
+
+/* Makes the samples of the brick at (bx, by, bz) that lie beyond the
+ * lattice repeat its last sample plane, so that they never keep a brick
+ * from being constant.
+ */
+static void clampBrick(const OCTREEFIELD *tree, int bx, int by, int bz, float *brick) {
+    const int size = OCTREE_BRICK_SIZE;
+    int valid[3] = {tree->nx - bx * BRICK_CELLS, tree->ny - by * BRICK_CELLS,
+                    tree->nz - bz * BRICK_CELLS};
+    int a, c, i, j, k;
+    for (a = 0; a < 3; a++)
+        if (valid[a] > size)
+            valid[a] = size;
+    for (c = 0; c < 3; c++) {
+        float *samples = brick + c * OCTREE_BRICK_SAMPLES;
+        for (k = 0; k < size; k++) {
+            float *plane = samples + k * size * size;
+            if (k >= valid[2]) {
+                memcpy(plane, samples + (valid[2] - 1) * size * size,
+                       size * size * sizeof(float));
+                continue;
+            }
+            for (j = 0; j < size; j++) {
+                float *row = plane + j * size;
+                if (j >= valid[1]) {
+                    memcpy(row, plane + (valid[1] - 1) * size, size * sizeof(float));
+                    continue;
+                }
+                for (i = valid[0]; i < size; i++)
+                    row[i] = row[valid[0] - 1];
+            }
+        }
+    }
+}
+
+static void buildBrick(Builder *builder, unsigned int code, int bx, int by, int bz) {
+    OCTREEFIELD *tree = builder->tree;
+    const float *brick = builder->brick;
+    Range range;
+    OCTREENODE *node;
+    int c, s;
+
+    builder->fill(tree, bx, by, bz, builder->brick, builder->userData);
+    clampBrick(tree, bx, by, bz, builder->brick);
+    for (c = 0; c < 3; c++) {
+        const float *samples = brick + c * OCTREE_BRICK_SAMPLES;
+        float lo = samples[0], hi = samples[0];
+        for (s = 1; s < OCTREE_BRICK_SAMPLES; s++) {
+            lo = std::min(lo, samples[s]);
+            hi = std::max(hi, samples[s]);
+        }
+        range.lo[c] = lo;
+        range.hi[c] = hi;
+    }
+    for (s = 0; s < OCTREE_BRICK_SAMPLES; s++) {
+        float x = brick[s], y = brick[OCTREE_BRICK_SAMPLES + s];
+        float z = brick[2 * OCTREE_BRICK_SAMPLES + s];
+        float squared = x * x + y * y + z * z;
+        builder->minSquared = std::min(builder->minSquared, squared);
+        builder->maxSquared = std::max(builder->maxSquared, squared);
+    }
+    if (rangeWithin(range, builder->tolerance)) {
+        appendConstant(builder, code, 0, range);
+        return;
+    }
+
+    if (tree->brickCount == tree->brickCapacity) {
+        int capacity = tree->brickCapacity > 0 ? 2 * tree->brickCapacity : 16;
+        float *data = (float *) aligned_realloc(tree->brickData,
+                                                (size_t) capacity * BRICK_FLOATS * sizeof(float),
+                                                (size_t) tree->brickCapacity * BRICK_FLOATS *
+                                                sizeof(float));
+        if (data == NULL) {
+            builder->failed = true;
+            return;
+        }
+        tree->brickData = data;
+        tree->brickCapacity = capacity;
+    }
+    node = appendNode(builder, code, 0, range);
+    if (node == NULL)
+        return;
+    node->brick = tree->brickCount++;
+    memcpy(tree->brickData + (long) node->brick * BRICK_FLOATS, brick,
+           BRICK_FLOATS * sizeof(float));
+}
+
+/* Appends the leaves of the node of level at code in Morton order. Its
+ * children are built first; when all eight turn out constant and close
+ * enough together, they are replaced by one constant node.
+ */
+static void buildNode(Builder *builder, unsigned int code, int level) {
+    OCTREEFIELD *tree = builder->tree;
+    int x = compactBits(code), y = compactBits(code >> 1), z = compactBits(code >> 2);
+    int first = tree->nodeCount, child;
+    Range merged;
+
+    if (builder->failed)
+        return;
+    if (x >= tree->bricks[0] || y >= tree->bricks[1] || z >= tree->bricks[2]) {
+        setRangeEmpty(&merged);
+        appendConstant(builder, code, level, merged);
+        return;
+    }
+    if (level == 0) {
+        buildBrick(builder, code, x, y, z);
+        return;
+    }
+
+    for (child = 0; child < 8; child++)
+        buildNode(builder, code + child * levelSpan(level - 1), level - 1);
+    if (builder->failed || tree->nodeCount - first != 8)
+        return;
+    setRangeEmpty(&merged);
+    for (child = first; child < first + 8; child++) {
+        const Range &range = builder->ranges[child];
+        int c;
+        if (tree->nodes[child].brick != OCTREE_CONSTANT)
+            return;
+        for (c = 0; c < 3; c++) {
+            merged.lo[c] = std::min(merged.lo[c], range.lo[c]);
+            merged.hi[c] = std::max(merged.hi[c], range.hi[c]);
+        }
+    }
+    if (!rangeWithin(merged, builder->tolerance))
+        return;
+    tree->nodeCount = first;
+    appendConstant(builder, code, level, merged);
+}
+
+static int buildTree(OCTREEFIELD *tree, BrickFill fill, void *userData, float tolerance) {
+    Builder builder;
+
+    tree->nodeCount = 0;
+    tree->brickCount = 0;
+    tree->minMagnitude = tree->maxMagnitude = 0;
+    if (tree->depth < 0)
+        return 0;
+    builder.tree = tree;
+    builder.fill = fill;
+    builder.userData = userData;
+    builder.tolerance = tolerance > 0 ? tolerance : 0;
+    builder.ranges = NULL;
+    builder.rangeCapacity = 0;
+    builder.brick = (float *) aligned_malloc(BRICK_FLOATS * sizeof(float));
+    builder.minSquared = HUGE_VALF;
+    builder.maxSquared = 0;
+    builder.failed = builder.brick == NULL;
+
+    buildNode(&builder, 0, tree->depth);
+    free(builder.ranges);
+    aligned_free(builder.brick);
+    if (builder.failed) {
+        LOGE(FIELD, "cannot build the octree: out of memory");
+        tree->nodeCount = 0;
+        tree->brickCount = 0;
+        return 0;
+    }
+    tree->minMagnitude = sqrtf(builder.minSquared);
+    tree->maxMagnitude = sqrtf(builder.maxSquared);
+    LOGD(FIELD, "octree: %d nodes, %d of %d bricks stored, %ld KB for %ld KB dense",
+         tree->nodeCount, tree->brickCount, tree->bricks[0] * tree->bricks[1] * tree->bricks[2],
+         octreeFieldSize(tree) / 1024, (long) tree->nx * tree->ny * tree->nz * 12 / 1024);
+    return 1;
+}
+
+
+int octreeFieldInit(OCTREEFIELD *tree, int nx, int ny, int nz,
+                    const float origin[3], const float spacing[3]) {
+    int samples[3] = {nx, ny, nz}, a;
+    memset(tree, 0, sizeof(OCTREEFIELD));
+    tree->depth = -1;
+    if (nx <= 0 || ny <= 0 || nz <= 0)
+        return 0;
+    tree->nx = nx;
+    tree->ny = ny;
+    tree->nz = nz;
+    tree->depth = 0;
+    for (a = 0; a < 3; a++) {
+        tree->origin[a] = origin[a];
+        tree->spacing[a] = spacing[a];
+        tree->bricks[a] = samples[a] > 1 ? (samples[a] - 1 + BRICK_CELLS - 1) / BRICK_CELLS : 1;
+        while (tree->depth <= OCTREE_MAX_DEPTH && (1 << tree->depth) < tree->bricks[a])
+            tree->depth++;
+    }
+    if (tree->depth > OCTREE_MAX_DEPTH) {
+        LOGW(FIELD, "octree lattice %dx%dx%d is too large", nx, ny, nz);
+        tree->depth = -1;
+        return 0;
+    }
+    return 1;
+}
+
+void octreeFieldDeinit(OCTREEFIELD *tree) {
+    free(tree->nodes);
+    aligned_free(tree->brickData);
+    memset(tree, 0, sizeof(OCTREEFIELD));
+}
+
+
+static void fillFromField(const OCTREEFIELD *tree, int bx, int by, int bz, float *brick,
+                          void *userData) {
+    const FIELD *field = (const FIELD *) userData;
+    const int size = OCTREE_BRICK_SIZE;
+    int i, j, k;
+    for (k = 0; k < size && bz * BRICK_CELLS + k < tree->nz; k++) {
+        for (j = 0; j < size && by * BRICK_CELLS + j < tree->ny; j++) {
+            int count = std::min(size, tree->nx - bx * BRICK_CELLS);
+            long n = FIELD_INDEX(field, bx * BRICK_CELLS, by * BRICK_CELLS + j,
+                                 bz * BRICK_CELLS + k);
+            int s = (k * size + j) * size;
+            for (i = 0; i < count; i++) {
+                brick[s + i] = field->x[n + i];
+                brick[OCTREE_BRICK_SAMPLES + s + i] = field->y[n + i];
+                brick[2 * OCTREE_BRICK_SAMPLES + s + i] = field->z[n + i];
+            }
+        }
+    }
+}
+
+int octreeFieldFromField(OCTREEFIELD *tree, const FIELD *field, float tolerance) {
+    if (field->nx != tree->nx || field->ny != tree->ny || field->nz != tree->nz)
+        return 0;
+    return buildTree(tree, fillFromField, (void *) field, tolerance);
+}
+
+
+struct ExpressionFill {
+    // One brick of samples, evaluated in place.
+    FIELD part;
+    const FIELDEXPR *expression;
+    float t;
+};
+
+static void fillFromExpression(const OCTREEFIELD *tree, int bx, int by, int bz, float *brick,
+                               void *userData) {
+    ExpressionFill *fill = (ExpressionFill *) userData;
+    FIELD *part = &fill->part;
+    int position[3] = {bx, by, bz}, a;
+    for (a = 0; a < 3; a++)
+        part->origin[a] = tree->origin[a] + position[a] * BRICK_CELLS * tree->spacing[a];
+    fieldEvaluateExpression(part, fill->expression, fill->t);
+    memcpy(brick, part->x, OCTREE_BRICK_SAMPLES * sizeof(float));
+    memcpy(brick + OCTREE_BRICK_SAMPLES, part->y, OCTREE_BRICK_SAMPLES * sizeof(float));
+    memcpy(brick + 2 * OCTREE_BRICK_SAMPLES, part->z, OCTREE_BRICK_SAMPLES * sizeof(float));
+}
+
+int octreeFieldEvaluateExpression(OCTREEFIELD *tree, const FIELDEXPR *expression,
+                                  float t, float tolerance) {
+    ExpressionFill fill;
+    int result;
+
+    if (!fieldInit(&fill.part, OCTREE_BRICK_SIZE, OCTREE_BRICK_SIZE, OCTREE_BRICK_SIZE,
+                   tree->origin, tree->spacing)) {
+        LOGE(FIELD, "octreeFieldEvaluateExpression: out of memory");
+        return 0;
+    }
+    fill.expression = expression;
+    fill.t = t;
+    result = buildTree(tree, fillFromExpression, &fill, tolerance);
+    fieldDeinit(&fill.part);
+    return result;
+}
+
+
+/* Queries */
+
+// Finds the cell holding position p. Returns false outside the lattice.
+static bool locateCell(const OCTREEFIELD *tree, const float *p, Cell *cell) {
+    float u = (p[0] - tree->origin[0]) / tree->spacing[0];
+    float v = (p[1] - tree->origin[1]) / tree->spacing[1];
+    float w = (p[2] - tree->origin[2]) / tree->spacing[2];
+    int i, j, k, bx, by, bz;
+
+    // Also rejects NaN.
+    if (!(u >= 0 && u <= tree->nx - 1 && v >= 0 && v <= tree->ny - 1 &&
+          w >= 0 && w <= tree->nz - 1))
+        return false;
+    // The last sample plane belongs to the cell below it.
+    i = std::max(std::min((int) u, tree->nx - 2), 0);
+    j = std::max(std::min((int) v, tree->ny - 2), 0);
+    k = std::max(std::min((int) w, tree->nz - 2), 0);
+    bx = i / BRICK_CELLS;
+    by = j / BRICK_CELLS;
+    bz = k / BRICK_CELLS;
+    cell->code = mortonCode(bx, by, bz);
+    cell->sample = ((k - bz * BRICK_CELLS) * OCTREE_BRICK_SIZE + j - by * BRICK_CELLS) *
+                   OCTREE_BRICK_SIZE + i - bx * BRICK_CELLS;
+    cell->u = u - i;
+    cell->v = v - j;
+    cell->w = w - k;
+    return true;
+}
+
+// Last node starting at or before code, the one covering it.
+static const OCTREENODE *findNode(const OCTREEFIELD *tree, unsigned int code) {
+    int low = 0, high = tree->nodeCount - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (tree->nodes[middle].code <= code)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return &tree->nodes[low];
+}
+
+static void interpolateCell(const OCTREEFIELD *tree, const OCTREENODE *node, const Cell &cell,
+                            float *vector) {
+    const int dx = 1, dy = OCTREE_BRICK_SIZE, dz = OCTREE_BRICK_SIZE * OCTREE_BRICK_SIZE;
+    const float u = cell.u, v = cell.v, w = cell.w;
+    const float *x, *y, *z;
+
+    if (node->brick == OCTREE_CONSTANT) {
+        vector[0] = node->value[0];
+        vector[1] = node->value[1];
+        vector[2] = node->value[2];
+        return;
+    }
+    x = tree->brickData + (long) node->brick * BRICK_FLOATS + cell.sample;
+    y = x + OCTREE_BRICK_SAMPLES;
+    z = y + OCTREE_BRICK_SAMPLES;
+
+#define LERP(a, b, t) ((a) + ((b) - (a)) * (t))
+#define TRILINEAR(c) \
+        LERP(LERP(LERP(c[0], c[dx], u), LERP(c[dy], c[dy + dx], u), v), \
+             LERP(LERP(c[dz], c[dz + dx], u), LERP(c[dz + dy], c[dz + dy + dx], u), v), w)
+    vector[0] = TRILINEAR(x);
+    vector[1] = TRILINEAR(y);
+    vector[2] = TRILINEAR(z);
+#undef TRILINEAR
+#undef LERP
+}
+
+int octreeFieldInterpolate(const OCTREEFIELD *tree, const float position[3],
+                           float vector[3]) {
+    Cell cell;
+    if (tree->nodeCount == 0 || !locateCell(tree, position, &cell))
+        return 0;
+    interpolateCell(tree, findNode(tree, cell.code), cell, vector);
+    return 1;
+}
+
+int octreeFieldInterpolateBatch(const OCTREEFIELD *tree, const float *positions,
+                                int count, float *vectors, unsigned char *inside) {
+    Cell cells[BATCH_SIZE];
+    // Morton code above, query index within the batch below.
+    unsigned long long keys[BATCH_SIZE];
+    int start, total = 0;
+
+    for (start = 0; start < count; start += BATCH_SIZE) {
+        int batch = std::min(count - start, BATCH_SIZE), keyCount = 0, q;
+        const OCTREENODE *node = NULL;
+        unsigned int end = 0;
+
+        for (q = 0; q < batch; q++) {
+            int n = start + q;
+            bool found = tree->nodeCount > 0 && locateCell(tree, positions + 3 * n, &cells[q]);
+            if (inside != NULL)
+                inside[n] = found;
+            if (found)
+                keys[keyCount++] = (unsigned long long) cells[q].code << 8 | q;
+            else
+                vectors[3 * n] = vectors[3 * n + 1] = vectors[3 * n + 2] = 0;
+        }
+        std::sort(keys, keys + keyCount);
+
+        // Codes ascend, so a new node is looked up only past the end of
+        // the current one.
+        for (q = 0; q < keyCount; q++) {
+            unsigned int code = (unsigned int) (keys[q] >> 8);
+            int index = (int) (keys[q] & 0xff);
+            if (node == NULL || code >= end) {
+                node = findNode(tree, code);
+                end = node->code + levelSpan(node->level);
+            }
+            interpolateCell(tree, node, cells[index], vectors + 3 * (start + index));
+        }
+        total += keyCount;
+    }
+    return total;
+}
+
+
+long octreeFieldSize(const OCTREEFIELD *tree) {
+    return (long) tree->nodeCount * sizeof(OCTREENODE) +
+           (long) tree->brickCount * BRICK_FLOATS * sizeof(float);
+}
@@ -0,0 +1,145 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef OCTREE_H_INCLUDED
+#define OCTREE_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "field.h"
+
+
+/* Samples per axis in a brick. Neighbouring bricks share their boundary
+ * samples, so a brick spans OCTREE_BRICK_SIZE - 1 cells per axis and
+ * every cell of the lattice lies in exactly one brick.
+ */
+#define OCTREE_BRICK_SIZE       8
+#define OCTREE_BRICK_SAMPLES    (OCTREE_BRICK_SIZE * OCTREE_BRICK_SIZE * OCTREE_BRICK_SIZE)
+
+// Deepest tree: 2^10 bricks per axis, 30 bit Morton codes.
+#define OCTREE_MAX_DEPTH        10
+
+// OCTREENODE brick of a node holding a constant vector.
+#define OCTREE_CONSTANT         -1
+
+
+/* Leaf of the octree, covering 2^level by 2^level by 2^level brick
+ * positions starting at the one with Morton code code. Either a stored
+ * brick or a constant vector that every sample it covers is within the
+ * build tolerance of.
+ */
+typedef struct {
+    unsigned int code;
+    int level;
+    int brick;
+    float value[3];
+} OCTREENODE;
+
+/* A vector field on the same kind of lattice as FIELD, sample (i, j, k)
+ * at origin + (i, j, k) * spacing, stored sparsely. The lattice is split
+ * into bricks of OCTREE_BRICK_SIZE^3 samples; runs of bricks where the
+ * field is nearly constant, such as the background around a vortex,
+ * collapse into single constant nodes.
+ *
+ * The tree is stored linearly: only its leaves, sorted by Morton code,
+ * with no child pointers. A point is found by binary search on the code
+ * of the brick position holding it. Brick components are stored as
+ * structure of arrays, x[512], y[512] and z[512] per brick, i fastest.
+ */
+typedef struct {
+    int nx;
+    int ny;
+    int nz;
+    float origin[3];
+    float spacing[3];
+    // Brick positions per axis inside the lattice.
+    int bricks[3];
+    // The root covers 2^depth brick positions per axis.
+    int depth;
+    OCTREENODE *nodes;
+    int nodeCount;
+    int nodeCapacity;
+    float *brickData;
+    int brickCount;
+    int brickCapacity;
+    // Smallest and largest vector length of the samples of the last build.
+    float minMagnitude;
+    float maxMagnitude;
+} OCTREEFIELD;
+
+
+/* Sets up an empty tree for an nx * ny * nz lattice. Returns non-zero on
+ * success and 0 when the lattice is empty or needs more than
+ * OCTREE_MAX_DEPTH levels.
+ */
+extern int octreeFieldInit(OCTREEFIELD *tree, int nx, int ny, int nz,
+                           const float origin[3], const float spacing[3]);
+
+/* Frees the nodes and bricks.
+ */
+extern void octreeFieldDeinit(OCTREEFIELD *tree);
+
+/* Rebuilds the tree from a dense field with the same lattice. Bricks and
+ * subtrees whose samples stay within tolerance of one vector, per
+ * component, become constant nodes; 0 keeps only exactly constant ones.
+ * Storage of earlier builds is reused. Returns non-zero on success and 0
+ * on failure.
+ */
+extern int octreeFieldFromField(OCTREEFIELD *tree, const FIELD *field, float tolerance);
+
+/* Rebuilds the tree by sampling the expression at time t brick by brick,
+ * so no dense copy of the lattice is ever made. Otherwise the same as
+ * octreeFieldFromField.
+ */
+extern int octreeFieldEvaluateExpression(OCTREEFIELD *tree, const FIELDEXPR *expression,
+                                         float t, float tolerance);
+
+/* Trilinearly interpolates the tree at a position in field coordinates.
+ * Returns 0, leaving vector unchanged, when the position is outside the
+ * lattice, otherwise non-zero.
+ */
+extern int octreeFieldInterpolate(const OCTREEFIELD *tree, const float position[3],
+                                  float vector[3]);
+
+/* Interpolates count positions given as x, y, z triples, storing x, y, z
+ * triples to vectors. Queries are answered in Morton order of their
+ * bricks, so each node is looked up once per run of queries inside it
+ * and brick data is visited in memory order. Positions outside the
+ * lattice get zero vectors and a 0 in inside, which may be NULL. Returns
+ * the number of positions inside.
+ */
+extern int octreeFieldInterpolateBatch(const OCTREEFIELD *tree, const float *positions,
+                                       int count, float *vectors, unsigned char *inside);
+
+/* Bytes held by the nodes and bricks of the last build.
+ */
+extern long octreeFieldSize(const OCTREEFIELD *tree);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !OCTREE_H_INCLUDED
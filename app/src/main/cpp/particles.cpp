@@ -0,0 +1,328 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+#include "particles.h"
+#include "globject.h"
+#include "log.h"
+#include "profile.h"
+
+
+using namespace Eigen::internal;
+
+/* Native float packet: Packet4f with SSE or NEON, a plain float when
+ * Eigen is built without vectorization.
+ */
+typedef packet_traits<float>::type Packet;
+enum { PACKET_SIZE = packet_traits<float>::size };
+
+// Alignment of the arrays inside the PARTICLESYSTEM storage block.
+#define PARTICLE_ARRAY_ALIGNMENT    64
+
+
+// Grid constants of the packet lookups.
+typedef struct {
+    const FIELD *field;
+    Packet origin[3];
+    Packet inverseSpacing[3];
+} Sampler;
+
+
+static size_t alignSize(size_t size) {
+    return (size + PARTICLE_ARRAY_ALIGNMENT - 1) & ~(size_t) (PARTICLE_ARRAY_ALIGNMENT - 1);
+}
+
+// xorshift32, mapped to [-1, 1).
+static float randomSigned(unsigned int *state) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x >> 8) * (2.0f / (1 << 24)) - 1;
+}
+
+
+/* Trilinearly interpolates the field at PACKET_SIZE positions. The grid
+ * coordinates are computed on packets; the cells differ per lane, so
+ * their corners are gathered lane by lane and blended on packets again.
+ * inside gets 1 in the lanes inside the grid and 0 in the others, which
+ * are clamped to the nearest grid point.
+ */
+static void samplePacket(const Sampler &sampler, const Packet position[3], Packet vector[3],
+                         Packet &inside) {
+    const FIELD *field = sampler.field;
+    const int counts[3] = {field->nx, field->ny, field->nz};
+    const long strides[3] = {1, field->nx, (long) field->nx * field->ny};
+    EIGEN_ALIGN16 float grid[3][PACKET_SIZE], fraction[3][PACKET_SIZE];
+    EIGEN_ALIGN16 float corners[3][8][PACKET_SIZE], insideLanes[PACKET_SIZE];
+    Packet t[3];
+    int a, c, l, m;
+
+    for (a = 0; a < 3; a++)
+        pstore(grid[a], pmul(psub(position[a], sampler.origin[a]), sampler.inverseSpacing[a]));
+    for (l = 0; l < PACKET_SIZE; l++) {
+        long n = 0, offsets[3];
+        float in = 1;
+        for (a = 0; a < 3; a++) {
+            // fmaxf also maps NaN to 0.
+            float u = fminf(fmaxf(grid[a][l], 0), (float) (counts[a] - 1));
+            int i = (int) u;
+            in *= u == grid[a][l];
+            // The last sample plane belongs to the cell below it.
+            offsets[a] = i < counts[a] - 1 ? strides[a] : 0;
+            fraction[a][l] = u - i;
+            n += i * strides[a];
+        }
+        insideLanes[l] = in;
+        for (c = 0; c < 3; c++) {
+            const float *component = (c == 0 ? field->x : c == 1 ? field->y : field->z) + n;
+            for (m = 0; m < 8; m++)
+                corners[c][m][l] = component[(m & 1 ? offsets[0] : 0) +
+                                             (m & 2 ? offsets[1] : 0) +
+                                             (m & 4 ? offsets[2] : 0)];
+        }
+    }
+
+#define LERP(a, b, t) pmadd(psub(b, a), t, a)
+    for (a = 0; a < 3; a++)
+        t[a] = pload<Packet>(fraction[a]);
+    for (c = 0; c < 3; c++) {
+        Packet p[8];
+        for (m = 0; m < 8; m++)
+            p[m] = pload<Packet>(corners[c][m]);
+        vector[c] = LERP(LERP(LERP(p[0], p[1], t[0]), LERP(p[2], p[3], t[0]), t[1]),
+                         LERP(LERP(p[4], p[5], t[0]), LERP(p[6], p[7], t[0]), t[1]), t[2]);
+    }
+#undef LERP
+    inside = pload<Packet>(insideLanes);
+}
+
+// Writes slot of the trail of particle n.
+static void writeTrail(PARTICLESYSTEM *system, int n, int slot) {
+    long v = (long) n * system->params.trailLength + slot;
+    float t = system->params.maxMagnitude > 0 ?
+              system->speed[n] / system->params.maxMagnitude : 0;
+    system->vertexArray[3 * v] = system->x[n];
+    system->vertexArray[3 * v + 1] = system->y[n];
+    system->vertexArray[3 * v + 2] = system->z[n];
+    fieldMagnitudeColor(t < 1 ? t : 1, system->colorArray + 4 * v);
+}
+
+// Releases particle n at the next seed, with its whole trail there.
+static void releaseParticle(PARTICLESYSTEM *system, int n) {
+    const float *seed = system->seeds + 3 * system->nextSeed;
+    float radius = system->params.seedRadius;
+    int s;
+    system->x[n] = seed[0] + radius * randomSigned(&system->random);
+    system->y[n] = seed[1] + radius * randomSigned(&system->random);
+    system->z[n] = seed[2] + radius * randomSigned(&system->random);
+    system->age[n] = 0;
+    system->speed[n] = 0;
+    system->seed[n] = system->nextSeed;
+    system->nextSeed = (system->nextSeed + 1) % system->seedCount;
+    for (s = 0; s < system->params.trailLength; s++)
+        writeTrail(system, n, s);
+}
+
+/* Sets the GL_LINES of every trail from slot head back to the slot after
+ * it, the oldest.
+ */
+static void buildTrailIndices(PARTICLESYSTEM *system) {
+    int trail = system->params.trailLength, segments = trail - 1, n, k;
+    GLushort *index = system->indexArray;
+    for (n = 0; n < system->count; n++) {
+        GLushort first = (GLushort) (n * trail);
+        for (k = 0; k < segments; k++) {
+            *index++ = (GLushort) (first + (system->head - k + trail) % trail);
+            *index++ = (GLushort) (first + (system->head - k - 1 + trail) % trail);
+        }
+    }
+}
+
+
+void particleParamsDefault(PARTICLEPARAMS *params, const FIELD *field) {
+    float minimum, maximum, spacing = field->spacing[0], radius = field->spacing[0];
+    int a;
+    fieldMagnitudeRange(field, &minimum, &maximum);
+    for (a = 1; a < 3; a++) {
+        spacing = fminf(spacing, field->spacing[a]);
+        radius = fmaxf(radius, field->spacing[a]);
+    }
+    memset(params, 0, sizeof(PARTICLEPARAMS));
+    params->timeStep = maximum > 0 ? 0.5f * spacing / maximum : 0.5f * spacing;
+    params->lifetime = 120;
+    params->seedRadius = radius;
+    params->trailLength = 8;
+    params->maxMagnitude = maximum;
+    params->randomSeed = 1;
+}
+
+
+int particleSystemInit(PARTICLESYSTEM *system, int capacity, const float *seeds,
+                       int seedCount, const PARTICLEPARAMS *params) {
+    size_t particleBytes, seedBytes, vertexBytes, colorBytes, indexBytes;
+    long vertices;
+    unsigned char *storage;
+    int n;
+
+    memset(system, 0, sizeof(PARTICLESYSTEM));
+    capacity = (capacity + PACKET_SIZE - 1) / PACKET_SIZE * PACKET_SIZE;
+    vertices = (long) capacity * params->trailLength;
+    if (capacity <= 0 || seedCount <= 0 || params->trailLength < 1 || params->lifetime < 1)
+        return 0;
+    if (vertices > GLOBJECT_MAX_VERTICES) {
+        LOGE(MESH, "%d particles with trails of %d exceed %d vertices", capacity,
+             params->trailLength, GLOBJECT_MAX_VERTICES);
+        return 0;
+    }
+    particleBytes = alignSize(capacity * sizeof(float));
+    seedBytes = alignSize(seedCount * 3 * sizeof(float));
+    vertexBytes = alignSize(vertices * 3 * sizeof(GLfloat));
+    colorBytes = alignSize(vertices * 4 * sizeof(GLubyte));
+    indexBytes = (size_t) capacity * (params->trailLength - 1) * 2 * sizeof(GLushort);
+    // x, y, z, age, speed and seed.
+    storage = (unsigned char *) aligned_malloc(6 * particleBytes + seedBytes + vertexBytes +
+                                               colorBytes + indexBytes);
+    if (storage == NULL)
+        return 0;
+    system->storage = storage;
+    system->x = (float *) storage;
+    system->y = (float *) (storage + particleBytes);
+    system->z = (float *) (storage + 2 * particleBytes);
+    system->age = (float *) (storage + 3 * particleBytes);
+    system->speed = (float *) (storage + 4 * particleBytes);
+    system->seed = (int *) (storage + 5 * particleBytes);
+    storage += 6 * particleBytes;
+    system->seeds = (float *) storage;
+    system->vertexArray = (GLfloat *) (storage + seedBytes);
+    system->colorArray = (GLubyte *) (storage + seedBytes + vertexBytes);
+    system->indexArray = (GLushort *) (storage + seedBytes + vertexBytes + colorBytes);
+    memcpy(system->seeds, seeds, seedCount * 3 * sizeof(float));
+    system->seedCount = seedCount;
+    system->capacity = capacity;
+    system->params = *params;
+    system->random = params->randomSeed != 0 ? params->randomSeed : 1;
+
+    for (n = 0; n < capacity; n++) {
+        releaseParticle(system, n);
+        system->age[n] = (float) (int) ((randomSigned(&system->random) + 1) * 0.5f *
+                                        params->lifetime);
+    }
+    system->count = capacity;
+    if (params->trailLength > 1)
+        buildTrailIndices(system);
+    return 1;
+}
+
+
+void particleSystemDeinit(PARTICLESYSTEM *system) {
+    aligned_free(system->storage);
+    memset(system, 0, sizeof(PARTICLESYSTEM));
+}
+
+
+void particleSystemStep(PARTICLESYSTEM *system, const FIELD *field) {
+    const PARTICLEPARAMS *params = &system->params;
+    const Packet one = pset1<Packet>(1.0f), lifetime = pset1<Packet>((float) params->lifetime);
+    const Packet step = pset1<Packet>(params->timeStep);
+    const Packet halfStep = pset1<Packet>(0.5f * params->timeStep);
+    int trail = params->trailLength, live = 0, n, a;
+    Sampler sampler;
+    ProfileScope profile(PROFILE_STAGE_PARTICLES);
+
+    if (system->storage == NULL)
+        return;
+    sampler.field = field;
+    for (a = 0; a < 3; a++) {
+        sampler.origin[a] = pset1<Packet>(field->origin[a]);
+        sampler.inverseSpacing[a] = pset1<Packet>(1 / field->spacing[a]);
+    }
+    for (n = 0; n < system->count; n += PACKET_SIZE) {
+        Packet p[3], middle[3], k1[3], k2[3], inside1, inside2;
+        p[0] = pload<Packet>(system->x + n);
+        p[1] = pload<Packet>(system->y + n);
+        p[2] = pload<Packet>(system->z + n);
+        samplePacket(sampler, p, k1, inside1);
+        for (a = 0; a < 3; a++)
+            middle[a] = pmadd(k1[a], halfStep, p[a]);
+        samplePacket(sampler, middle, k2, inside2);
+        pstore(system->x + n, pmadd(k2[0], step, p[0]));
+        pstore(system->y + n, pmadd(k2[1], step, p[1]));
+        pstore(system->z + n, pmadd(k2[2], step, p[2]));
+        // Squared here; NEON has no packet square root.
+        pstore(system->speed + n, pmadd(k2[0], k2[0], pmadd(k2[1], k2[1], pmul(k2[2], k2[2]))));
+        // A step leaving the grid ages the particle past its lifetime.
+        pstore(system->age + n,
+               padd(pload<Packet>(system->age + n),
+                    padd(one, pmul(psub(one, pmul(inside1, inside2)), lifetime))));
+    }
+
+    /* Stream compaction: every particle is copied down to the first free
+     * slot, which only moves on past the ones that live.
+     */
+    for (n = 0; n < system->count; n++) {
+        int keep = system->age[n] < params->lifetime;
+        system->x[live] = system->x[n];
+        system->y[live] = system->y[n];
+        system->z[live] = system->z[n];
+        system->age[live] = system->age[n];
+        system->speed[live] = sqrtf(system->speed[n]);
+        system->seed[live] = system->seed[n];
+        if (keep && live != n && trail > 1) {
+            memcpy(system->vertexArray + (long) live * trail * 3,
+                   system->vertexArray + (long) n * trail * 3, trail * 3 * sizeof(GLfloat));
+            memcpy(system->colorArray + (long) live * trail * 4,
+                   system->colorArray + (long) n * trail * 4, trail * 4 * sizeof(GLubyte));
+        }
+        live += keep;
+    }
+
+    system->head = (system->head + 1) % trail;
+    for (n = 0; n < live; n++)
+        writeTrail(system, n, system->head);
+    for (n = live; n < system->capacity; n++)
+        releaseParticle(system, n);
+    system->count = system->capacity;
+    if (trail > 1)
+        buildTrailIndices(system);
+}
+
+
+void drawParticleSystem(const PARTICLESYSTEM *system) {
+    int trail = system->params.trailLength;
+    if (system->count == 0)
+        return;
+    glDisable(GL_LIGHTING);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, system->vertexArray);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, system->colorArray);
+    if (trail == 1)
+        glDrawArrays(GL_POINTS, 0, system->count);
+    else
+        glDrawElements(GL_LINES, system->count * (trail - 1) * 2, GL_UNSIGNED_SHORT,
+                       system->indexArray);
+    glEnable(GL_LIGHTING);
+}
@@ -0,0 +1,125 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef PARTICLES_H_INCLUDED
+#define PARTICLES_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "importgl.h"
+#include "field.h"
+
+
+/* How particles move and how long they live. Times are in field time
+ * units, lengths in field coordinates.
+ */
+typedef struct {
+    // Time a particle is advected by per step, with the midpoint rule.
+    float timeStep;
+    // Steps a particle lives before it is released again.
+    int lifetime;
+    // Particles are released up to this far from their seed along each
+    // axis.
+    float seedRadius;
+    /* Positions kept per particle. 1 draws the particles as GL_POINTS,
+     * more draws a trail of lines through the last trailLength positions.
+     */
+    int trailLength;
+    // Magnitude at the top of the color ramp.
+    float maxMagnitude;
+    // Seed of the release jitter.
+    unsigned int randomSeed;
+} PARTICLEPARAMS;
+
+/* A fixed pool of particles stored as structure of arrays, the live ones
+ * at the front. Particles are released around a set of seeds, taken in
+ * turn, and released again when they leave the grid or grow old.
+ *
+ * The GL arrays hold trailLength vertices per particle, particle after
+ * particle, slot head of every trail being the newest position. indexArray
+ * holds the GL_LINES of the trails from the newest position back. The
+ * arrays are drawn in place; stepping allocates nothing.
+ */
+typedef struct {
+    int capacity;
+    int count;
+    float *x;
+    float *y;
+    float *z;
+    // Steps since release.
+    float *age;
+    // Magnitude at the particle in the last step.
+    float *speed;
+    // Seed the particle was released from.
+    int *seed;
+    GLfloat *vertexArray;
+    GLubyte *colorArray;
+    GLushort *indexArray;
+    int head;
+    float *seeds;
+    int seedCount;
+    // Seed the next released particle is taken from.
+    int nextSeed;
+    unsigned int random;
+    PARTICLEPARAMS params;
+    // The single heap block holding all of the arrays.
+    void *storage;
+} PARTICLESYSTEM;
+
+
+/* Sets the defaults for particles in field: a step moving the fastest
+ * particle half a grid spacing, 120 steps of life, release within one
+ * grid spacing and trails of 8 positions.
+ */
+extern void particleParamsDefault(PARTICLEPARAMS *params, const FIELD *field);
+
+/* Allocates a pool of capacity particles, rounded up to a whole number of
+ * SIMD packets, copies the seedCount seeds, 3 floats each, and releases
+ * every particle with a random age so that they do not all expire
+ * together. capacity * trailLength must fit 16-bit indices. Returns
+ * non-zero on success and 0 on failure.
+ */
+extern int particleSystemInit(PARTICLESYSTEM *system, int capacity, const float *seeds,
+                              int seedCount, const PARTICLEPARAMS *params);
+
+extern void particleSystemDeinit(PARTICLESYSTEM *system);
+
+/* Advects every particle one step through field, four at a time with SIMD
+ * packets, then moves the live particles to the front of the pool and
+ * releases new ones behind them, and appends the new positions to the
+ * trails. Makes no GL calls.
+ */
+extern void particleSystemStep(PARTICLESYSTEM *system, const FIELD *field);
+
+/* Draws the particles as unlit points or trails from the client arrays.
+ */
+extern void drawParticleSystem(const PARTICLESYSTEM *system);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !PARTICLES_H_INCLUDED
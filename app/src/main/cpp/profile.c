@@ -0,0 +1,268 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "profile.h"
+
+
+/* Histograms of one recording thread. Only the owning thread writes them,
+ * so updates are plain relaxed loads and stores rather than atomic
+ * read-modify-writes; the atomics only keep the snapshot reader from
+ * seeing torn values.
+ *
+ * A slot is released when its thread exits and taken over by the next
+ * thread that needs one, keeping the histograms: the worker threads that
+ * every appInit starts reuse the slots of those appDeinit joined, and
+ * their times still add up in the snapshots.
+ */
+typedef struct {
+    PROFILESTAGE stages[PROFILE_STAGE_COUNT];
+    // Non-zero while a live thread owns the slot.
+    int used;
+} PROFILESLOT;
+
+static PROFILESLOT sSlots[PROFILE_MAX_THREADS];
+static unsigned long long sDropped = 0;
+// Slot index plus one of the calling thread, 0 before its first record
+// and -1 when no slot was left.
+static __thread int sThreadSlot = 0;
+// Releases the slot of an exiting thread; its value is the slot index
+// plus one.
+static pthread_key_t sSlotKey;
+static pthread_once_t sSlotKeyOnce = PTHREAD_ONCE_INIT;
+
+static const char *sStageNames[PROFILE_STAGE_COUNT] = {
+    "frame",
+    "frameInterval",
+    "prepareFrame",
+    "lighting",
+    "fieldUpdate",
+    "meshBuild",
+    "draw",
+    "particles"
+};
+
+
+static int bucketIndex(unsigned long long nanoseconds) {
+    int exponent, bucket;
+    if (nanoseconds < PROFILE_SUBBUCKETS)
+        return (int) nanoseconds;
+    exponent = 63 - __builtin_clzll(nanoseconds);
+    bucket = (exponent - 1) * PROFILE_SUBBUCKETS +
+             (int) ((nanoseconds >> (exponent - 2)) & (PROFILE_SUBBUCKETS - 1));
+    return bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1;
+}
+
+// Smallest time that falls in the bucket.
+static unsigned long long bucketStart(int bucket) {
+    int exponent = bucket / PROFILE_SUBBUCKETS + 1;
+    unsigned long long mantissa = PROFILE_SUBBUCKETS + bucket % PROFILE_SUBBUCKETS;
+    if (bucket < PROFILE_SUBBUCKETS)
+        return (unsigned long long) bucket;
+    return mantissa << (exponent - 2);
+}
+
+// Largest time that falls in the bucket.
+static unsigned long long bucketLimit(int bucket) {
+    return bucket + 1 < PROFILE_BUCKETS ? bucketStart(bucket + 1) - 1 : ~0ULL;
+}
+
+static void add(unsigned long long *value, unsigned long long amount) {
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount,
+                     __ATOMIC_RELAXED);
+}
+
+static unsigned long long load(const unsigned long long *value) {
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+
+static void releaseSlot(void *value) {
+    int slot = (int) (intptr_t) value - 1;
+    // Publishes the last records to the next owner.
+    __atomic_store_n(&sSlots[slot].used, 0, __ATOMIC_RELEASE);
+}
+
+static void createSlotKey() {
+    pthread_key_create(&sSlotKey, releaseSlot);
+}
+
+// Takes a free slot for the calling thread. Returns its index plus one, or
+// -1 when all are in use.
+static int claimSlot() {
+    int slot;
+    pthread_once(&sSlotKeyOnce, createSlotKey);
+    for (slot = 0; slot < PROFILE_MAX_THREADS; slot++) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&sSlots[slot].used, &unused, 1, 0, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            pthread_setspecific(sSlotKey, (void *) (intptr_t) (slot + 1));
+            return slot + 1;
+        }
+    }
+    return -1;
+}
+
+
+long long profileNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+void profileRecord(int stage, long long nanoseconds) {
+    PROFILESTAGE *entry;
+    unsigned long long time = nanoseconds > 0 ? (unsigned long long) nanoseconds : 0;
+
+    if (stage < 0 || stage >= PROFILE_STAGE_COUNT)
+        return;
+    if (sThreadSlot == 0)
+        sThreadSlot = claimSlot();
+    if (sThreadSlot < 0) {
+        __atomic_fetch_add(&sDropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    entry = &sSlots[sThreadSlot - 1].stages[stage];
+    if (load(&entry->count) == 0 || time < load(&entry->minimum))
+        __atomic_store_n(&entry->minimum, time, __ATOMIC_RELAXED);
+    if (time > load(&entry->maximum))
+        __atomic_store_n(&entry->maximum, time, __ATOMIC_RELAXED);
+    add(&entry->total, time);
+    add(&entry->histogram[bucketIndex(time)], 1);
+    add(&entry->count, 1);
+}
+
+
+void profileRecordSince(int stage, long long start) {
+    profileRecord(stage, profileNow() - start);
+}
+
+
+void profileSnapshot(PROFILESNAPSHOT *snapshot) {
+    int slot, stage, b;
+
+    memset(snapshot, 0, sizeof(PROFILESNAPSHOT));
+    // Free slots keep the times of the threads that had them.
+    for (slot = 0; slot < PROFILE_MAX_THREADS; slot++) {
+        for (stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+            const PROFILESTAGE *in = &sSlots[slot].stages[stage];
+            PROFILESTAGE *out = &snapshot->stages[stage];
+            unsigned long long count = load(&in->count), minimum, maximum;
+            if (count == 0)
+                continue;
+            minimum = load(&in->minimum);
+            maximum = load(&in->maximum);
+            if (out->count == 0 || minimum < out->minimum)
+                out->minimum = minimum;
+            if (maximum > out->maximum)
+                out->maximum = maximum;
+            out->count += count;
+            out->total += load(&in->total);
+            for (b = 0; b < PROFILE_BUCKETS; b++)
+                out->histogram[b] += load(&in->histogram[b]);
+        }
+    }
+    snapshot->dropped = load(&sDropped);
+}
+
+
+void profileReset() {
+    int slot, stage, b;
+    for (slot = 0; slot < PROFILE_MAX_THREADS; slot++) {
+        for (stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+            PROFILESTAGE *entry = &sSlots[slot].stages[stage];
+            __atomic_store_n(&entry->count, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&entry->total, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&entry->minimum, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&entry->maximum, 0, __ATOMIC_RELAXED);
+            for (b = 0; b < PROFILE_BUCKETS; b++)
+                __atomic_store_n(&entry->histogram[b], 0, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&sDropped, 0, __ATOMIC_RELAXED);
+}
+
+
+const char *profileStageName(int stage) {
+    if (stage < 0 || stage >= PROFILE_STAGE_COUNT)
+        return "unknown";
+    return sStageNames[stage];
+}
+
+
+unsigned long long profilePercentile(const PROFILESTAGE *stage, double percent) {
+    unsigned long long rank, seen = 0;
+    int b;
+    if (stage->count == 0)
+        return 0;
+    // Nearest rank, counting from 1.
+    rank = (unsigned long long) (percent / 100 * stage->count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    for (b = 0; b < PROFILE_BUCKETS; b++) {
+        unsigned long long in = stage->histogram[b], low, high;
+        if (seen + in < rank) {
+            seen += in;
+            continue;
+        }
+        // Assume the times are spread evenly over the bucket, which is
+        // also clipped to the range actually seen.
+        low = bucketStart(b) > stage->minimum ? bucketStart(b) : stage->minimum;
+        high = bucketLimit(b) < stage->maximum ? bucketLimit(b) : stage->maximum;
+        if (high <= low)
+            return low;
+        return low + (unsigned long long) ((double) (high - low) * (rank - seen) / in);
+    }
+    return stage->maximum;
+}
+
+
+int profileWriteJSON(const PROFILESNAPSHOT *snapshot, FILE *file) {
+    int stage, b;
+
+    fprintf(file, "{\n  \"clock\": \"monotonic\",\n  \"unit\": \"ns\",\n");
+    fprintf(file, "  \"dropped\": %llu,\n  \"stages\": {\n", snapshot->dropped);
+    for (stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+        const PROFILESTAGE *s = &snapshot->stages[stage];
+        int first = 1;
+        fprintf(file, "    \"%s\": {\"count\": %llu, \"total\": %llu, "
+                "\"min\": %llu, \"max\": %llu, \"mean\": %llu, "
+                "\"p50\": %llu, \"p95\": %llu, \"p99\": %llu,\n"
+                "      \"histogram\": [",
+                profileStageName(stage), s->count, s->total, s->minimum, s->maximum,
+                s->count > 0 ? s->total / s->count : 0,
+                profilePercentile(s, 50), profilePercentile(s, 95), profilePercentile(s, 99));
+        // Buckets as [upper bound, count] pairs.
+        for (b = 0; b < PROFILE_BUCKETS; b++) {
+            if (s->histogram[b] == 0)
+                continue;
+            fprintf(file, "%s[%llu, %llu]", first ? "" : ", ", bucketLimit(b), s->histogram[b]);
+            first = 0;
+        }
+        fprintf(file, "]}%s\n", stage + 1 < PROFILE_STAGE_COUNT ? "," : "");
+    }
+    fprintf(file, "  }\n}\n");
+    return !ferror(file);
+}
@@ -0,0 +1,131 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdio.h>
+
+
+/* Timed stages of the render loop. Stage times are kept in histograms per
+ * recording thread, so the render thread and workers never contend.
+ */
+#define PROFILE_STAGE_FRAME             0   // All of appRender.
+#define PROFILE_STAGE_FRAME_INTERVAL    1   // Start of one appRender to the next.
+#define PROFILE_STAGE_PREPARE_FRAME     2
+#define PROFILE_STAGE_LIGHTING          3
+#define PROFILE_STAGE_FIELD_UPDATE      4   // One frame of the field worker.
+#define PROFILE_STAGE_MESH_BUILD        5
+#define PROFILE_STAGE_DRAW              6
+#define PROFILE_STAGE_PARTICLES         7   // One particle step.
+
+#define PROFILE_STAGE_COUNT             8
+
+/* Histogram buckets are log-linear: PROFILE_SUBBUCKETS buckets per power
+ * of two nanoseconds, so a bucket is at most 25% wide, up to 2^40 ns.
+ */
+#define PROFILE_SUBBUCKETS      4
+#define PROFILE_BUCKETS         (41 * PROFILE_SUBBUCKETS)
+
+// Threads that can record at the same time. A thread holds its slot
+// until it exits; records of further threads are counted as dropped.
+#define PROFILE_MAX_THREADS     16
+
+
+// Times of one stage, in nanoseconds.
+typedef struct {
+    unsigned long long count;
+    unsigned long long total;
+    unsigned long long minimum;
+    unsigned long long maximum;
+    unsigned long long histogram[PROFILE_BUCKETS];
+} PROFILESTAGE;
+
+typedef struct {
+    PROFILESTAGE stages[PROFILE_STAGE_COUNT];
+    // Records lost because more than PROFILE_MAX_THREADS live threads
+    // recorded.
+    unsigned long long dropped;
+} PROFILESNAPSHOT;
+
+
+/* Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+extern long long profileNow(void);
+
+/* Adds a time to the histogram of stage for the calling thread. Lock
+ * free; the first call from a thread claims one of the thread slots.
+ */
+extern void profileRecord(int stage, long long nanoseconds);
+
+/* Records the time from start, a profileNow() value, to now.
+ */
+extern void profileRecordSince(int stage, long long start);
+
+/* Sums the histograms of all threads. A snapshot taken while threads are
+ * recording may miss their latest records but is otherwise consistent.
+ */
+extern void profileSnapshot(PROFILESNAPSHOT *snapshot);
+
+/* Clears all histograms. Records made concurrently may survive.
+ */
+extern void profileReset(void);
+
+extern const char *profileStageName(int stage);
+
+/* Time below which the given percentage of the records of a stage fall,
+ * interpolated within the histogram bucket holding it.
+ */
+extern unsigned long long profilePercentile(const PROFILESTAGE *stage, double percent);
+
+/* Writes a snapshot as a JSON object with the summary and the non-empty
+ * histogram buckets of each stage. Returns non-zero on success.
+ */
+extern int profileWriteJSON(const PROFILESNAPSHOT *snapshot, FILE *file);
+
+
+#ifdef __cplusplus
+}
+
+
+/* Records the time from construction to the end of the enclosing scope.
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(int stage) : mStage(stage), mStart(profileNow()) {}
+    ~ProfileScope() { profileRecordSince(mStage, mStart); }
+
+private:
+    ProfileScope(const ProfileScope &);
+    ProfileScope &operator=(const ProfileScope &);
+
+    int mStage;
+    long long mStart;
+};
+#endif
+
+
+#endif // !PROFILE_H_INCLUDED
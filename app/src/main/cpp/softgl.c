@@ -0,0 +1,1838 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <GLES/gl.h>
+#ifndef ANDROID_NDK
+#include <GLES/egl.h>
+#endif /* !ANDROID_NDK */
+
+#include "softgl.h"
+
+
+#define SOFTGL_MAX_LIGHTS           8
+#define SOFTGL_MODELVIEW_DEPTH      32
+#define SOFTGL_PROJECTION_DEPTH     4
+
+#define FIXED_TO_FLOAT(value)       ((float) (value) * (1.0f / 65536))
+
+
+// One client vertex array as set with gl*Pointer.
+typedef struct {
+    GLint size;
+    GLenum type;
+    GLsizei stride;
+    const GLvoid *pointer;
+    // Buffer object bound when the pointer was set, 0 for client memory.
+    GLuint buffer;
+    int enabled;
+} SGLARRAY;
+
+typedef struct {
+    unsigned char *data;
+    long size;
+    int allocated;
+} SGLBUFFER;
+
+// A 2D texture, stored as RGBA8 rows, bottom row first.
+typedef struct {
+    unsigned char *texels;
+    int width;
+    int height;
+    GLenum magFilter;
+    GLenum wrapS;
+    GLenum wrapT;
+    int allocated;
+} SGLTEXTURE;
+
+typedef struct {
+    int enabled;
+    // Position in eye coordinates, transformed when it is set.
+    float position[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+} SGLLIGHT;
+
+// A transformed and lit vertex.
+typedef struct {
+    float clip[4];
+    float color[4];
+    float texCoord[2];
+} SGLVERTEX;
+
+/* A vertex in window coordinates, ready for rasterization. The texture
+ * coordinates are divided by w, for perspective correct interpolation.
+ */
+typedef struct {
+    float x, y, z;
+    float color[4];
+    float texCoord[2];
+    float invW;
+} SGLWINDOWVERTEX;
+
+typedef struct {
+    int initialized;
+
+    int width;
+    int height;
+    unsigned char *colorBuffer;
+    float *depthBuffer;
+
+    GLint viewport[4];
+    float clearColor[4];
+    float currentColor[4];
+
+    float modelview[SOFTGL_MODELVIEW_DEPTH][16];
+    float projection[SOFTGL_PROJECTION_DEPTH][16];
+    int modelviewTop;
+    int projectionTop;
+    GLenum matrixMode;
+
+    int depthTest;
+    int blend;
+    int cullFace;
+    int lighting;
+    int colorMaterial;
+    int normalize;
+    int texture2D;
+    GLenum shadeModel;
+    GLenum blendSrc;
+    GLenum blendDst;
+
+    SGLLIGHT lights[SOFTGL_MAX_LIGHTS];
+    float lightModelAmbient[4];
+    float materialAmbient[4];
+    float materialDiffuse[4];
+    float materialSpecular[4];
+    float materialEmission[4];
+    float materialShininess;
+
+    SGLARRAY vertexArray;
+    SGLARRAY colorArray;
+    SGLARRAY normalArray;
+    SGLARRAY texCoordArray;
+
+    GLuint arrayBuffer;
+    GLuint elementBuffer;
+    SGLBUFFER *buffers;
+    GLuint bufferCount;
+
+    GLuint boundTexture;
+    SGLTEXTURE *textures;
+    GLuint textureCount;
+
+    GLenum error;
+
+    // Scratch space for the vertices of the current draw call.
+    SGLVERTEX *vertices;
+    long vertexCapacity;
+
+    SOFTGLSTATS stats;
+} SGLCONTEXT;
+
+static SGLCONTEXT sContext;
+
+
+static void setVector(float *dest, float x, float y, float z, float w) {
+    dest[0] = x;
+    dest[1] = y;
+    dest[2] = z;
+    dest[3] = w;
+}
+
+static void setError(GLenum error) {
+    if (sContext.error == GL_NO_ERROR)
+        sContext.error = error;
+}
+
+static void loadIdentity(float *m) {
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = m[5] = m[10] = m[15] = 1;
+}
+
+// Column-major product: dest = a * b. Dest may alias a or b.
+static void multiplyMatrix(float *dest, const float *a, const float *b) {
+    float result[16];
+    int row, col, k;
+    for (col = 0; col < 4; col++) {
+        for (row = 0; row < 4; row++) {
+            float sum = 0;
+            for (k = 0; k < 4; k++)
+                sum += a[k * 4 + row] * b[col * 4 + k];
+            result[col * 4 + row] = sum;
+        }
+    }
+    memcpy(dest, result, sizeof(result));
+}
+
+static void transformVector(float *dest, const float *m, const float *v) {
+    int row;
+    float result[4];
+    for (row = 0; row < 4; row++)
+        result[row] = m[row] * v[0] + m[4 + row] * v[1] + m[8 + row] * v[2] + m[12 + row] * v[3];
+    memcpy(dest, result, sizeof(result));
+}
+
+static float *currentMatrix() {
+    if (sContext.matrixMode == GL_PROJECTION)
+        return sContext.projection[sContext.projectionTop];
+    return sContext.modelview[sContext.modelviewTop];
+}
+
+static void multiplyCurrent(const float *m) {
+    float *current = currentMatrix();
+    multiplyMatrix(current, current, m);
+}
+
+static void normalize3(float *v) {
+    float mag = (float) sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (mag > 0) {
+        v[0] /= mag;
+        v[1] /= mag;
+        v[2] /= mag;
+    }
+}
+
+static float clamp01(float value) {
+    return value < 0 ? 0 : (value > 1 ? 1 : value);
+}
+
+
+static void initState() {
+    int i;
+    SGLCONTEXT *c = &sContext;
+
+    c->initialized = 1;
+    c->viewport[0] = c->viewport[1] = 0;
+    c->viewport[2] = c->width;
+    c->viewport[3] = c->height;
+    setVector(c->clearColor, 0, 0, 0, 0);
+    setVector(c->currentColor, 1, 1, 1, 1);
+    loadIdentity(c->modelview[0]);
+    loadIdentity(c->projection[0]);
+    c->modelviewTop = c->projectionTop = 0;
+    c->matrixMode = GL_MODELVIEW;
+
+    c->depthTest = c->blend = c->cullFace = 0;
+    c->lighting = c->colorMaterial = c->normalize = 0;
+    c->texture2D = 0;
+    c->shadeModel = GL_SMOOTH;
+    c->blendSrc = GL_ONE;
+    c->blendDst = GL_ZERO;
+
+    for (i = 0; i < SOFTGL_MAX_LIGHTS; i++) {
+        SGLLIGHT *light = &c->lights[i];
+        light->enabled = 0;
+        setVector(light->position, 0, 0, 1, 0);
+        setVector(light->ambient, 0, 0, 0, 1);
+        if (i == 0) {
+            setVector(light->diffuse, 1, 1, 1, 1);
+            setVector(light->specular, 1, 1, 1, 1);
+        }
+        else {
+            setVector(light->diffuse, 0, 0, 0, 1);
+            setVector(light->specular, 0, 0, 0, 1);
+        }
+    }
+    setVector(c->lightModelAmbient, 0.2f, 0.2f, 0.2f, 1);
+    setVector(c->materialAmbient, 0.2f, 0.2f, 0.2f, 1);
+    setVector(c->materialDiffuse, 0.8f, 0.8f, 0.8f, 1);
+    setVector(c->materialSpecular, 0, 0, 0, 1);
+    setVector(c->materialEmission, 0, 0, 0, 1);
+    c->materialShininess = 0;
+
+    memset(&c->vertexArray, 0, sizeof(SGLARRAY));
+    memset(&c->colorArray, 0, sizeof(SGLARRAY));
+    memset(&c->normalArray, 0, sizeof(SGLARRAY));
+    memset(&c->texCoordArray, 0, sizeof(SGLARRAY));
+    c->arrayBuffer = c->elementBuffer = 0;
+    c->boundTexture = 0;
+    c->error = GL_NO_ERROR;
+}
+
+
+/* Buffer objects */
+
+static SGLBUFFER *getBuffer(GLuint name) {
+    if (name == 0 || name >= sContext.bufferCount || !sContext.buffers[name].allocated)
+        return NULL;
+    return &sContext.buffers[name];
+}
+
+static SGLBUFFER *allocateBuffer(GLuint name) {
+    SGLCONTEXT *c = &sContext;
+    if (name >= c->bufferCount) {
+        GLuint count = c->bufferCount ? c->bufferCount : 16;
+        SGLBUFFER *buffers;
+        while (count <= name)
+            count *= 2;
+        buffers = (SGLBUFFER *) realloc(c->buffers, count * sizeof(SGLBUFFER));
+        if (buffers == NULL)
+            return NULL;
+        memset(&buffers[c->bufferCount], 0, (count - c->bufferCount) * sizeof(SGLBUFFER));
+        c->buffers = buffers;
+        c->bufferCount = count;
+    }
+    c->buffers[name].allocated = 1;
+    return &c->buffers[name];
+}
+
+static GLuint *boundBuffer(GLenum target) {
+    if (target == GL_ARRAY_BUFFER)
+        return &sContext.arrayBuffer;
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+        return &sContext.elementBuffer;
+    return NULL;
+}
+
+static void softGenBuffers(GLsizei n, GLuint *buffers) {
+    GLuint name = 1;
+    GLsizei i;
+    for (i = 0; i < n; i++) {
+        while (getBuffer(name) != NULL)
+            name++;
+        if (allocateBuffer(name) == NULL) {
+            setError(GL_OUT_OF_MEMORY);
+            buffers[i] = 0;
+            continue;
+        }
+        buffers[i] = name;
+    }
+}
+
+static void softDeleteBuffers(GLsizei n, const GLuint *buffers) {
+    GLsizei i;
+    for (i = 0; i < n; i++) {
+        SGLBUFFER *buffer = getBuffer(buffers[i]);
+        if (buffer == NULL)
+            continue;
+        free(buffer->data);
+        memset(buffer, 0, sizeof(SGLBUFFER));
+        if (sContext.arrayBuffer == buffers[i])
+            sContext.arrayBuffer = 0;
+        if (sContext.elementBuffer == buffers[i])
+            sContext.elementBuffer = 0;
+    }
+}
+
+static void softBindBuffer(GLenum target, GLuint buffer) {
+    GLuint *binding = boundBuffer(target);
+    if (binding == NULL) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    if (buffer != 0 && getBuffer(buffer) == NULL && allocateBuffer(buffer) == NULL) {
+        setError(GL_OUT_OF_MEMORY);
+        return;
+    }
+    *binding = buffer;
+}
+
+static void softBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) {
+    GLuint *binding = boundBuffer(target);
+    SGLBUFFER *buffer;
+    unsigned char *storage;
+    (void) usage;
+    if (binding == NULL) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    buffer = getBuffer(*binding);
+    if (buffer == NULL || size < 0) {
+        setError(GL_INVALID_OPERATION);
+        return;
+    }
+    storage = (unsigned char *) realloc(buffer->data, size > 0 ? size : 1);
+    if (storage == NULL) {
+        setError(GL_OUT_OF_MEMORY);
+        return;
+    }
+    if (data)
+        memcpy(storage, data, size);
+    else
+        memset(storage, 0, size);
+    buffer->data = storage;
+    buffer->size = size;
+}
+
+static void softBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
+                              const GLvoid *data) {
+    GLuint *binding = boundBuffer(target);
+    SGLBUFFER *buffer;
+    if (binding == NULL) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    buffer = getBuffer(*binding);
+    if (buffer == NULL) {
+        setError(GL_INVALID_OPERATION);
+        return;
+    }
+    if (offset < 0 || size < 0 || offset + size > buffer->size) {
+        setError(GL_INVALID_VALUE);
+        return;
+    }
+    memcpy(buffer->data + offset, data, size);
+}
+
+
+/* Textures */
+
+static SGLTEXTURE *getTexture(GLuint name) {
+    if (name == 0 || name >= sContext.textureCount || !sContext.textures[name].allocated)
+        return NULL;
+    return &sContext.textures[name];
+}
+
+static SGLTEXTURE *allocateTexture(GLuint name) {
+    SGLCONTEXT *c = &sContext;
+    SGLTEXTURE *texture;
+    if (name >= c->textureCount) {
+        GLuint count = c->textureCount ? c->textureCount : 16;
+        SGLTEXTURE *textures;
+        while (count <= name)
+            count *= 2;
+        textures = (SGLTEXTURE *) realloc(c->textures, count * sizeof(SGLTEXTURE));
+        if (textures == NULL)
+            return NULL;
+        memset(&textures[c->textureCount], 0, (count - c->textureCount) * sizeof(SGLTEXTURE));
+        c->textures = textures;
+        c->textureCount = count;
+    }
+    texture = &c->textures[name];
+    texture->allocated = 1;
+    texture->magFilter = GL_LINEAR;
+    texture->wrapS = texture->wrapT = GL_REPEAT;
+    return texture;
+}
+
+// The texture that draws sample from, or NULL when texturing is off.
+static const SGLTEXTURE *activeTexture() {
+    const SGLTEXTURE *texture;
+    if (!sContext.texture2D || !sContext.texCoordArray.enabled)
+        return NULL;
+    texture = getTexture(sContext.boundTexture);
+    return texture != NULL && texture->texels != NULL ? texture : NULL;
+}
+
+static int wrapCoordinate(int i, int size, GLenum wrap) {
+    if (wrap == GL_REPEAT) {
+        i %= size;
+        return i < 0 ? i + size : i;
+    }
+    return i < 0 ? 0 : i >= size ? size - 1 : i;
+}
+
+/* Samples the texture at s, t into color as floats. Minification uses the
+ * same filter as magnification, as there are no mipmaps.
+ */
+static void sampleTexture(const SGLTEXTURE *texture, float s, float t, float *color) {
+    float x = s * texture->width - 0.5f, y = t * texture->height - 0.5f;
+    int i;
+    if (texture->magFilter == GL_NEAREST) {
+        int tx = wrapCoordinate((int) floorf(x + 0.5f), texture->width, texture->wrapS);
+        int ty = wrapCoordinate((int) floorf(y + 0.5f), texture->height, texture->wrapT);
+        const unsigned char *texel = texture->texels + ((long) ty * texture->width + tx) * 4;
+        for (i = 0; i < 4; i++)
+            color[i] = texel[i] / 255.0f;
+    }
+    else {
+        int x0 = (int) floorf(x), y0 = (int) floorf(y);
+        float fx = x - x0, fy = y - y0;
+        int xs[2], ys[2];
+        const unsigned char *t00, *t10, *t01, *t11;
+        xs[0] = wrapCoordinate(x0, texture->width, texture->wrapS);
+        xs[1] = wrapCoordinate(x0 + 1, texture->width, texture->wrapS);
+        ys[0] = wrapCoordinate(y0, texture->height, texture->wrapT);
+        ys[1] = wrapCoordinate(y0 + 1, texture->height, texture->wrapT);
+        t00 = texture->texels + ((long) ys[0] * texture->width + xs[0]) * 4;
+        t10 = texture->texels + ((long) ys[0] * texture->width + xs[1]) * 4;
+        t01 = texture->texels + ((long) ys[1] * texture->width + xs[0]) * 4;
+        t11 = texture->texels + ((long) ys[1] * texture->width + xs[1]) * 4;
+        for (i = 0; i < 4; i++) {
+            float bottom = t00[i] + (t10[i] - t00[i]) * fx;
+            float top = t01[i] + (t11[i] - t01[i]) * fx;
+            color[i] = (bottom + (top - bottom) * fy) / 255.0f;
+        }
+    }
+}
+
+
+/* Vertex arrays */
+
+static int typeSize(GLenum type) {
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+static void setArray(SGLARRAY *array, GLint size, GLenum type, GLsizei stride,
+                     const GLvoid *pointer) {
+    array->size = size;
+    array->type = type;
+    array->stride = stride;
+    array->pointer = pointer;
+    array->buffer = sContext.arrayBuffer;
+}
+
+static const unsigned char *arrayBase(const SGLARRAY *array) {
+    if (array->buffer != 0) {
+        SGLBUFFER *buffer = getBuffer(array->buffer);
+        if (buffer == NULL || buffer->data == NULL)
+            return NULL;
+        return buffer->data + (size_t) array->pointer;
+    }
+    return (const unsigned char *) array->pointer;
+}
+
+/* Reads element index of the array as floats. Normal arrays map signed
+ * integer types to [-1, 1] and color arrays map unsigned bytes to [0, 1],
+ * as the GLES 1.x specification requires; vertex values are taken as is.
+ */
+static void fetchArray(const unsigned char *base, const SGLARRAY *array, long index,
+                       int isNormal, float *out) {
+    int stride = array->stride ? array->stride : array->size * typeSize(array->type);
+    const unsigned char *element = base + index * stride;
+    int i;
+    for (i = 0; i < array->size; i++) {
+        switch (array->type) {
+            case GL_BYTE: {
+                float value = ((const GLbyte *) element)[i];
+                out[i] = isNormal ? (2 * value + 1) / 255 : value;
+                break;
+            }
+            case GL_UNSIGNED_BYTE:
+                out[i] = ((const GLubyte *) element)[i] / 255.0f;
+                break;
+            case GL_SHORT: {
+                float value = ((const GLshort *) element)[i];
+                out[i] = isNormal ? (2 * value + 1) / 65535 : value;
+                break;
+            }
+            case GL_FIXED:
+                out[i] = FIXED_TO_FLOAT(((const GLfixed *) element)[i]);
+                break;
+            default:
+                out[i] = ((const GLfloat *) element)[i];
+                break;
+        }
+    }
+}
+
+
+/* Vertex processing */
+
+static void lightVertex(const float *eye, const float *normal, const float *color,
+                        float *out) {
+    SGLCONTEXT *c = &sContext;
+    const float *ambient = c->colorMaterial ? color : c->materialAmbient;
+    const float *diffuse = c->colorMaterial ? color : c->materialDiffuse;
+    int i, l;
+
+    for (i = 0; i < 3; i++)
+        out[i] = c->materialEmission[i] + ambient[i] * c->lightModelAmbient[i];
+
+    for (l = 0; l < SOFTGL_MAX_LIGHTS; l++) {
+        const SGLLIGHT *light = &c->lights[l];
+        float direction[3], nDotL;
+        if (!light->enabled)
+            continue;
+        if (light->position[3] == 0) {
+            direction[0] = light->position[0];
+            direction[1] = light->position[1];
+            direction[2] = light->position[2];
+        }
+        else {
+            direction[0] = light->position[0] / light->position[3] - eye[0];
+            direction[1] = light->position[1] / light->position[3] - eye[1];
+            direction[2] = light->position[2] / light->position[3] - eye[2];
+        }
+        normalize3(direction);
+        nDotL = normal[0] * direction[0] + normal[1] * direction[1] + normal[2] * direction[2];
+        if (nDotL < 0)
+            nDotL = 0;
+        for (i = 0; i < 3; i++)
+            out[i] += light->ambient[i] * ambient[i] + nDotL * light->diffuse[i] * diffuse[i];
+        if (nDotL > 0 && c->materialShininess >= 0) {
+            // Local viewer is off, so the eye direction is +z.
+            float half[3] = {direction[0], direction[1], direction[2] + 1};
+            float nDotH, specular;
+            normalize3(half);
+            nDotH = normal[0] * half[0] + normal[1] * half[1] + normal[2] * half[2];
+            if (nDotH > 0) {
+                specular = (float) pow(nDotH, c->materialShininess);
+                for (i = 0; i < 3; i++)
+                    out[i] += specular * light->specular[i] * c->materialSpecular[i];
+            }
+        }
+    }
+    for (i = 0; i < 3; i++)
+        out[i] = clamp01(out[i]);
+    out[3] = clamp01(diffuse[3]);
+}
+
+/* Computes the inverse transpose of the upper 3x3 of the modelview matrix,
+ * which transforms normals to eye coordinates.
+ */
+static void normalMatrix(float *n) {
+    const float *m = sContext.modelview[sContext.modelviewTop];
+    float a = m[0], b = m[4], cc = m[8];
+    float d = m[1], e = m[5], f = m[9];
+    float g = m[2], h = m[6], k = m[10];
+    float det = a * (e * k - f * h) - b * (d * k - f * g) + cc * (d * h - e * g);
+    float inv = det != 0 ? 1 / det : 0;
+    // Row-major 3x3 of the cofactor matrix divided by the determinant.
+    n[0] = (e * k - f * h) * inv;
+    n[1] = -(d * k - f * g) * inv;
+    n[2] = (d * h - e * g) * inv;
+    n[3] = -(b * k - cc * h) * inv;
+    n[4] = (a * k - cc * g) * inv;
+    n[5] = -(a * h - b * g) * inv;
+    n[6] = (b * f - cc * e) * inv;
+    n[7] = -(a * f - cc * d) * inv;
+    n[8] = (a * e - b * d) * inv;
+}
+
+// Transforms and lights the vertices first..last-1 into the scratch array.
+static int processVertices(long first, long last) {
+    SGLCONTEXT *c = &sContext;
+    const float *modelview = c->modelview[c->modelviewTop];
+    const unsigned char *vertexBase, *colorBase = NULL, *normalBase = NULL;
+    const unsigned char *texCoordBase = NULL;
+    float mvp[16], normalM[9];
+    long count = last - first, v;
+
+    if (!c->vertexArray.enabled)
+        return 0;
+    vertexBase = arrayBase(&c->vertexArray);
+    if (vertexBase == NULL)
+        return 0;
+    if (c->colorArray.enabled)
+        colorBase = arrayBase(&c->colorArray);
+    if (c->lighting && c->normalArray.enabled)
+        normalBase = arrayBase(&c->normalArray);
+    if (activeTexture() != NULL)
+        texCoordBase = arrayBase(&c->texCoordArray);
+
+    if (count > c->vertexCapacity) {
+        SGLVERTEX *vertices = (SGLVERTEX *) realloc(c->vertices, count * sizeof(SGLVERTEX));
+        if (vertices == NULL) {
+            setError(GL_OUT_OF_MEMORY);
+            return 0;
+        }
+        c->vertices = vertices;
+        c->vertexCapacity = count;
+    }
+
+    multiplyMatrix(mvp, c->projection[c->projectionTop], modelview);
+    normalMatrix(normalM);
+
+    for (v = 0; v < count; v++) {
+        SGLVERTEX *out = &c->vertices[v];
+        float position[4] = {0, 0, 0, 1};
+        float color[4];
+
+        fetchArray(vertexBase, &c->vertexArray, first + v, 0, position);
+        transformVector(out->clip, mvp, position);
+        if (texCoordBase) {
+            float texCoord[4] = {0, 0, 0, 1};
+            fetchArray(texCoordBase, &c->texCoordArray, first + v, 0, texCoord);
+            out->texCoord[0] = texCoord[0];
+            out->texCoord[1] = texCoord[1];
+        }
+
+        if (colorBase)
+            fetchArray(colorBase, &c->colorArray, first + v, 0, color);
+        else
+            memcpy(color, c->currentColor, sizeof(color));
+
+        if (c->lighting) {
+            float eye[4], normal[3] = {0, 0, 1}, eyeNormal[3];
+            transformVector(eye, modelview, position);
+            if (normalBase)
+                fetchArray(normalBase, &c->normalArray, first + v, 1, normal);
+            eyeNormal[0] = normalM[0] * normal[0] + normalM[1] * normal[1] + normalM[2] * normal[2];
+            eyeNormal[1] = normalM[3] * normal[0] + normalM[4] * normal[1] + normalM[5] * normal[2];
+            eyeNormal[2] = normalM[6] * normal[0] + normalM[7] * normal[1] + normalM[8] * normal[2];
+            if (c->normalize)
+                normalize3(eyeNormal);
+            lightVertex(eye, eyeNormal, color, out->color);
+        }
+        else {
+            int i;
+            for (i = 0; i < 4; i++)
+                out->color[i] = clamp01(color[i]);
+        }
+    }
+    c->stats.vertices += count;
+    return 1;
+}
+
+
+/* Rasterization */
+
+static float blendFactor(GLenum factor, int channel, const float *src, const float *dst) {
+    switch (factor) {
+        case GL_ZERO:
+            return 0;
+        case GL_ONE:
+            return 1;
+        case GL_SRC_COLOR:
+            return src[channel];
+        case GL_ONE_MINUS_SRC_COLOR:
+            return 1 - src[channel];
+        case GL_SRC_ALPHA:
+            return src[3];
+        case GL_ONE_MINUS_SRC_ALPHA:
+            return 1 - src[3];
+        case GL_DST_COLOR:
+            return dst[channel];
+        case GL_ONE_MINUS_DST_COLOR:
+            return 1 - dst[channel];
+        case GL_DST_ALPHA:
+            return dst[3];
+        case GL_ONE_MINUS_DST_ALPHA:
+            return 1 - dst[3];
+        default:
+            return 1;
+    }
+}
+
+static void writeFragment(int x, int y, float z, const float *color) {
+    SGLCONTEXT *c = &sContext;
+    long index = (long) y * c->width + x;
+    unsigned char *pixel = &c->colorBuffer[index * 4];
+    int i;
+
+    if (c->depthTest) {
+        if (!(z < c->depthBuffer[index]))
+            return;
+        c->depthBuffer[index] = z;
+    }
+
+    if (c->blend) {
+        float dst[4], result;
+        for (i = 0; i < 4; i++)
+            dst[i] = pixel[i] / 255.0f;
+        for (i = 0; i < 4; i++) {
+            result = color[i] * blendFactor(c->blendSrc, i, color, dst) +
+                     dst[i] * blendFactor(c->blendDst, i, color, dst);
+            pixel[i] = (unsigned char) (clamp01(result) * 255 + 0.5f);
+        }
+    }
+    else {
+        for (i = 0; i < 4; i++)
+            pixel[i] = (unsigned char) (color[i] * 255 + 0.5f);
+    }
+    c->stats.fragments++;
+}
+
+static void toWindow(const SGLVERTEX *in, SGLWINDOWVERTEX *out) {
+    const GLint *viewport = sContext.viewport;
+    float invW = 1 / in->clip[3];
+    out->x = (in->clip[0] * invW + 1) * 0.5f * viewport[2] + viewport[0];
+    out->y = (in->clip[1] * invW + 1) * 0.5f * viewport[3] + viewport[1];
+    out->z = (in->clip[2] * invW + 1) * 0.5f;
+    memcpy(out->color, in->color, sizeof(out->color));
+    out->texCoord[0] = in->texCoord[0] * invW;
+    out->texCoord[1] = in->texCoord[1] * invW;
+    out->invW = invW;
+}
+
+// Pixel bounds where fragments may be written.
+static void drawBounds(int *x0, int *y0, int *x1, int *y1) {
+    SGLCONTEXT *c = &sContext;
+    *x0 = c->viewport[0] > 0 ? c->viewport[0] : 0;
+    *y0 = c->viewport[1] > 0 ? c->viewport[1] : 0;
+    *x1 = c->viewport[0] + c->viewport[2];
+    *y1 = c->viewport[1] + c->viewport[3];
+    if (*x1 > c->width)
+        *x1 = c->width;
+    if (*y1 > c->height)
+        *y1 = c->height;
+}
+
+static float edgeFunction(const SGLWINDOWVERTEX *a, const SGLWINDOWVERTEX *b, float x, float y) {
+    return (b->x - a->x) * (y - a->y) - (b->y - a->y) * (x - a->x);
+}
+
+// Top-left fill rule for counter-clockwise triangles with y pointing up.
+static int isTopLeft(const SGLWINDOWVERTEX *a, const SGLWINDOWVERTEX *b) {
+    float dx = b->x - a->x, dy = b->y - a->y;
+    return dy < 0 || (dy == 0 && dx < 0);
+}
+
+static void rasterizeTriangle(const SGLVERTEX *v0, const SGLVERTEX *v1, const SGLVERTEX *v2,
+                              const float *flatColor) {
+    const SGLTEXTURE *texture = activeTexture();
+    SGLWINDOWVERTEX a, b, c;
+    float area, invArea;
+    int minX, minY, maxX, maxY, boundX0, boundY0, boundX1, boundY1, x, y, i;
+    int topLeft0, topLeft1, topLeft2;
+
+    toWindow(v0, &a);
+    toWindow(v1, &b);
+    toWindow(v2, &c);
+    area = edgeFunction(&a, &b, c.x, c.y);
+    if (area == 0)
+        return;
+    if (area < 0) {
+        SGLWINDOWVERTEX swap;
+        if (sContext.cullFace) {
+            sContext.stats.trianglesCulled++;
+            return;
+        }
+        swap = b;
+        b = c;
+        c = swap;
+        area = -area;
+    }
+    invArea = 1 / area;
+
+    drawBounds(&boundX0, &boundY0, &boundX1, &boundY1);
+    minX = (int) floor(fminf(a.x, fminf(b.x, c.x)));
+    maxX = (int) ceil(fmaxf(a.x, fmaxf(b.x, c.x)));
+    minY = (int) floor(fminf(a.y, fminf(b.y, c.y)));
+    maxY = (int) ceil(fmaxf(a.y, fmaxf(b.y, c.y)));
+    if (minX < boundX0)
+        minX = boundX0;
+    if (minY < boundY0)
+        minY = boundY0;
+    if (maxX > boundX1)
+        maxX = boundX1;
+    if (maxY > boundY1)
+        maxY = boundY1;
+
+    topLeft0 = isTopLeft(&b, &c);
+    topLeft1 = isTopLeft(&c, &a);
+    topLeft2 = isTopLeft(&a, &b);
+
+    for (y = minY; y < maxY; y++) {
+        float py = y + 0.5f;
+        for (x = minX; x < maxX; x++) {
+            float px = x + 0.5f;
+            float w0 = edgeFunction(&b, &c, px, py);
+            float w1 = edgeFunction(&c, &a, px, py);
+            float w2 = edgeFunction(&a, &b, px, py);
+            float color[4], z;
+
+            if (w0 < 0 || w1 < 0 || w2 < 0)
+                continue;
+            if ((w0 == 0 && !topLeft0) || (w1 == 0 && !topLeft1) || (w2 == 0 && !topLeft2))
+                continue;
+            w0 *= invArea;
+            w1 *= invArea;
+            w2 *= invArea;
+            z = w0 * a.z + w1 * b.z + w2 * c.z;
+            if (flatColor)
+                memcpy(color, flatColor, sizeof(color));
+            else {
+                for (i = 0; i < 4; i++)
+                    color[i] = w0 * a.color[i] + w1 * b.color[i] + w2 * c.color[i];
+            }
+            if (texture) {
+                // GL_MODULATE, the default texture environment.
+                float w = 1 / (w0 * a.invW + w1 * b.invW + w2 * c.invW), texel[4];
+                sampleTexture(texture,
+                              (w0 * a.texCoord[0] + w1 * b.texCoord[0] + w2 * c.texCoord[0]) * w,
+                              (w0 * a.texCoord[1] + w1 * b.texCoord[1] + w2 * c.texCoord[1]) * w,
+                              texel);
+                for (i = 0; i < 4; i++)
+                    color[i] *= texel[i];
+            }
+            writeFragment(x, y, z, color);
+        }
+    }
+    sContext.stats.triangles++;
+}
+
+static void lerpVertex(SGLVERTEX *out, const SGLVERTEX *a, const SGLVERTEX *b, float t) {
+    int i;
+    for (i = 0; i < 4; i++) {
+        out->clip[i] = a->clip[i] + (b->clip[i] - a->clip[i]) * t;
+        out->color[i] = a->color[i] + (b->color[i] - a->color[i]) * t;
+    }
+    for (i = 0; i < 2; i++)
+        out->texCoord[i] = a->texCoord[i] + (b->texCoord[i] - a->texCoord[i]) * t;
+}
+
+// Signed distance to the near plane, z = -w in clip coordinates.
+static float nearDistance(const SGLVERTEX *v) {
+    return v->clip[2] + v->clip[3];
+}
+
+// Non-zero when all vertices are outside one of the six clip planes.
+static int outsideFrustum(const SGLVERTEX **v, int count) {
+    int plane, i;
+    for (plane = 0; plane < 6; plane++) {
+        int axis = plane >> 1;
+        float sign = (plane & 1) ? -1.0f : 1.0f;
+        for (i = 0; i < count; i++) {
+            if (sign * v[i]->clip[axis] <= v[i]->clip[3])
+                break;
+        }
+        if (i == count)
+            return 1;
+    }
+    return 0;
+}
+
+static void drawTriangle(const SGLVERTEX *v0, const SGLVERTEX *v1, const SGLVERTEX *v2,
+                         const float *flatColor) {
+    const SGLVERTEX *in[3];
+    SGLVERTEX clipped[4];
+    int count = 0, i;
+
+    in[0] = v0;
+    in[1] = v1;
+    in[2] = v2;
+    if (outsideFrustum(in, 3))
+        return;
+
+    if (nearDistance(v0) > 0 && nearDistance(v1) > 0 && nearDistance(v2) > 0) {
+        rasterizeTriangle(v0, v1, v2, flatColor);
+        return;
+    }
+
+    // Clip against the near plane; the other planes are handled by the
+    // viewport bounds of the rasterizer.
+    for (i = 0; i < 3; i++) {
+        const SGLVERTEX *a = in[i], *b = in[(i + 1) % 3];
+        float da = nearDistance(a), db = nearDistance(b);
+        if (da > 0)
+            clipped[count++] = *a;
+        if ((da > 0) != (db > 0))
+            lerpVertex(&clipped[count++], a, b, da / (da - db));
+    }
+    for (i = 2; i < count; i++)
+        rasterizeTriangle(&clipped[0], &clipped[i - 1], &clipped[i], flatColor);
+}
+
+static void drawLine(const SGLVERTEX *v0, const SGLVERTEX *v1, const float *flatColor) {
+    const SGLVERTEX *in[2];
+    SGLVERTEX a = *v0, b = *v1;
+    SGLWINDOWVERTEX wa, wb;
+    float da, db, dx, dy, steps, t;
+    int boundX0, boundY0, boundX1, boundY1, i, s;
+
+    in[0] = v0;
+    in[1] = v1;
+    if (outsideFrustum(in, 2))
+        return;
+    da = nearDistance(v0);
+    db = nearDistance(v1);
+    if (da <= 0 && db <= 0)
+        return;
+    if (da <= 0)
+        lerpVertex(&a, v0, v1, da / (da - db));
+    else if (db <= 0)
+        lerpVertex(&b, v0, v1, da / (da - db));
+
+    toWindow(&a, &wa);
+    toWindow(&b, &wb);
+    drawBounds(&boundX0, &boundY0, &boundX1, &boundY1);
+    dx = wb.x - wa.x;
+    dy = wb.y - wa.y;
+    steps = fmaxf(fabsf(dx), fabsf(dy));
+    if (steps < 1)
+        steps = 1;
+    for (s = 0; s <= (int) steps; s++) {
+        float color[4];
+        int x, y;
+        t = s / steps;
+        x = (int) floor(wa.x + dx * t);
+        y = (int) floor(wa.y + dy * t);
+        if (x < boundX0 || y < boundY0 || x >= boundX1 || y >= boundY1)
+            continue;
+        if (flatColor)
+            memcpy(color, flatColor, sizeof(color));
+        else {
+            for (i = 0; i < 4; i++)
+                color[i] = wa.color[i] + (wb.color[i] - wa.color[i]) * t;
+        }
+        writeFragment(x, y, wa.z + (wb.z - wa.z) * t, color);
+    }
+}
+
+static void drawPoint(const SGLVERTEX *v) {
+    SGLWINDOWVERTEX w;
+    int boundX0, boundY0, boundX1, boundY1, x, y;
+    const SGLVERTEX *in[1];
+    in[0] = v;
+    if (outsideFrustum(in, 1) || nearDistance(v) <= 0)
+        return;
+    toWindow(v, &w);
+    drawBounds(&boundX0, &boundY0, &boundX1, &boundY1);
+    x = (int) floor(w.x);
+    y = (int) floor(w.y);
+    if (x >= boundX0 && y >= boundY0 && x < boundX1 && y < boundY1)
+        writeFragment(x, y, w.z, w.color);
+}
+
+// Returns the i:th vertex index of a draw call relative to base.
+static long vertexIndex(const void *indices, GLenum type, GLint first, long i, long base) {
+    if (indices == NULL)
+        return first + i - base;
+    if (type == GL_UNSIGNED_BYTE)
+        return ((const GLubyte *) indices)[i] - base;
+    return ((const GLushort *) indices)[i] - base;
+}
+
+static void drawPrimitives(GLenum mode, GLint first, GLsizei count,
+                           GLenum type, const void *indices) {
+    SGLCONTEXT *c = &sContext;
+    long minIndex = first, maxIndex = first + count - 1, i;
+    int flat = c->shadeModel == GL_FLAT;
+    const SGLVERTEX *v = NULL;
+
+    if (count <= 0 || c->colorBuffer == NULL)
+        return;
+    if (indices) {
+        minIndex = 0xffff;
+        maxIndex = 0;
+        for (i = 0; i < count; i++) {
+            long index = vertexIndex(indices, type, 0, i, 0);
+            if (index < minIndex)
+                minIndex = index;
+            if (index > maxIndex)
+                maxIndex = index;
+        }
+    }
+    if (!processVertices(minIndex, maxIndex + 1))
+        return;
+    v = c->vertices;
+    c->stats.drawCalls++;
+
+#define VERTEX(n) (&v[vertexIndex(indices, type, first, (n), minIndex)])
+    switch (mode) {
+        case GL_TRIANGLES:
+            for (i = 0; i + 2 < count; i += 3)
+                drawTriangle(VERTEX(i), VERTEX(i + 1), VERTEX(i + 2),
+                             flat ? VERTEX(i + 2)->color : NULL);
+            break;
+        case GL_TRIANGLE_STRIP:
+            for (i = 0; i + 2 < count; i++) {
+                if (i & 1)
+                    drawTriangle(VERTEX(i + 1), VERTEX(i), VERTEX(i + 2),
+                                 flat ? VERTEX(i + 2)->color : NULL);
+                else
+                    drawTriangle(VERTEX(i), VERTEX(i + 1), VERTEX(i + 2),
+                                 flat ? VERTEX(i + 2)->color : NULL);
+            }
+            break;
+        case GL_TRIANGLE_FAN:
+            for (i = 1; i + 1 < count; i++)
+                drawTriangle(VERTEX(0), VERTEX(i), VERTEX(i + 1),
+                             flat ? VERTEX(i + 1)->color : NULL);
+            break;
+        case GL_LINES:
+            for (i = 0; i + 1 < count; i += 2)
+                drawLine(VERTEX(i), VERTEX(i + 1), flat ? VERTEX(i + 1)->color : NULL);
+            break;
+        case GL_LINE_STRIP:
+        case GL_LINE_LOOP:
+            for (i = 0; i + 1 < count; i++)
+                drawLine(VERTEX(i), VERTEX(i + 1), flat ? VERTEX(i + 1)->color : NULL);
+            if (mode == GL_LINE_LOOP && count > 2)
+                drawLine(VERTEX(count - 1), VERTEX(0), flat ? VERTEX(0)->color : NULL);
+            break;
+        case GL_POINTS:
+            for (i = 0; i < count; i++)
+                drawPoint(VERTEX(i));
+            break;
+        default:
+            setError(GL_INVALID_ENUM);
+            break;
+    }
+#undef VERTEX
+}
+
+
+/* GL entry points */
+
+static void softBlendFunc(GLenum sfactor, GLenum dfactor) {
+    sContext.blendSrc = sfactor;
+    sContext.blendDst = dfactor;
+}
+
+static void softClear(GLbitfield mask) {
+    SGLCONTEXT *c = &sContext;
+    long pixels = (long) c->width * c->height, i;
+    if (c->colorBuffer == NULL)
+        return;
+    if (mask & GL_COLOR_BUFFER_BIT) {
+        unsigned char clear[4];
+        for (i = 0; i < 4; i++)
+            clear[i] = (unsigned char) (clamp01(c->clearColor[i]) * 255 + 0.5f);
+        for (i = 0; i < pixels; i++)
+            memcpy(&c->colorBuffer[i * 4], clear, 4);
+    }
+    if (mask & GL_DEPTH_BUFFER_BIT) {
+        for (i = 0; i < pixels; i++)
+            c->depthBuffer[i] = 1;
+    }
+}
+
+static void softClearColorx(GLclampx red, GLclampx green, GLclampx blue, GLclampx alpha) {
+    setVector(sContext.clearColor, FIXED_TO_FLOAT(red), FIXED_TO_FLOAT(green),
+              FIXED_TO_FLOAT(blue), FIXED_TO_FLOAT(alpha));
+}
+
+static void softColor4x(GLfixed red, GLfixed green, GLfixed blue, GLfixed alpha) {
+    setVector(sContext.currentColor, FIXED_TO_FLOAT(red), FIXED_TO_FLOAT(green),
+              FIXED_TO_FLOAT(blue), FIXED_TO_FLOAT(alpha));
+}
+
+static void softColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {
+    setArray(&sContext.colorArray, size, type, stride, pointer);
+}
+
+static void setCapability(GLenum cap, int enabled) {
+    SGLCONTEXT *c = &sContext;
+    if (cap >= GL_LIGHT0 && cap < GL_LIGHT0 + SOFTGL_MAX_LIGHTS) {
+        c->lights[cap - GL_LIGHT0].enabled = enabled;
+        return;
+    }
+    switch (cap) {
+        case GL_DEPTH_TEST:
+            c->depthTest = enabled;
+            break;
+        case GL_BLEND:
+            c->blend = enabled;
+            break;
+        case GL_CULL_FACE:
+            c->cullFace = enabled;
+            break;
+        case GL_LIGHTING:
+            c->lighting = enabled;
+            break;
+        case GL_COLOR_MATERIAL:
+            c->colorMaterial = enabled;
+            break;
+        case GL_NORMALIZE:
+        case GL_RESCALE_NORMAL:
+            c->normalize = enabled;
+            break;
+        case GL_TEXTURE_2D:
+            c->texture2D = enabled;
+            break;
+        default:
+            // Other capabilities do not affect this rasterizer.
+            break;
+    }
+}
+
+static void softEnable(GLenum cap) {
+    setCapability(cap, 1);
+}
+
+static void softDisable(GLenum cap) {
+    setCapability(cap, 0);
+}
+
+static SGLARRAY *clientArray(GLenum array) {
+    switch (array) {
+        case GL_VERTEX_ARRAY:
+            return &sContext.vertexArray;
+        case GL_COLOR_ARRAY:
+            return &sContext.colorArray;
+        case GL_NORMAL_ARRAY:
+            return &sContext.normalArray;
+        case GL_TEXTURE_COORD_ARRAY:
+            return &sContext.texCoordArray;
+        default:
+            return NULL;
+    }
+}
+
+static void softEnableClientState(GLenum array) {
+    SGLARRAY *clientArrayState = clientArray(array);
+    if (clientArrayState)
+        clientArrayState->enabled = 1;
+}
+
+static void softDisableClientState(GLenum array) {
+    SGLARRAY *clientArrayState = clientArray(array);
+    if (clientArrayState)
+        clientArrayState->enabled = 0;
+}
+
+static void softDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    drawPrimitives(mode, first, count, GL_UNSIGNED_SHORT, NULL);
+}
+
+static void softDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {
+    if (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    if (sContext.elementBuffer != 0) {
+        SGLBUFFER *buffer = getBuffer(sContext.elementBuffer);
+        if (buffer == NULL || buffer->data == NULL) {
+            setError(GL_INVALID_OPERATION);
+            return;
+        }
+        indices = buffer->data + (size_t) indices;
+    }
+    if (indices == NULL)
+        return;
+    drawPrimitives(mode, 0, count, type, indices);
+}
+
+static void softFlush(void) {
+}
+
+static void softFrustumx(GLfixed left, GLfixed right, GLfixed bottom, GLfixed top,
+                         GLfixed zNear, GLfixed zFar) {
+    float l = FIXED_TO_FLOAT(left), r = FIXED_TO_FLOAT(right);
+    float b = FIXED_TO_FLOAT(bottom), t = FIXED_TO_FLOAT(top);
+    float n = FIXED_TO_FLOAT(zNear), f = FIXED_TO_FLOAT(zFar);
+    float m[16];
+    if (n <= 0 || f <= 0 || l == r || b == t || n == f) {
+        setError(GL_INVALID_VALUE);
+        return;
+    }
+    memset(m, 0, sizeof(m));
+    m[0] = 2 * n / (r - l);
+    m[5] = 2 * n / (t - b);
+    m[8] = (r + l) / (r - l);
+    m[9] = (t + b) / (t - b);
+    m[10] = -(f + n) / (f - n);
+    m[11] = -1;
+    m[14] = -2 * f * n / (f - n);
+    multiplyCurrent(m);
+}
+
+static GLenum softGetError(void) {
+    GLenum error = sContext.error;
+    sContext.error = GL_NO_ERROR;
+    return error;
+}
+
+static void softLightxv(GLenum lightName, GLenum pname, const GLfixed *params) {
+    SGLLIGHT *light;
+    float value[4];
+    int i;
+    if (lightName < GL_LIGHT0 || lightName >= GL_LIGHT0 + SOFTGL_MAX_LIGHTS) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    light = &sContext.lights[lightName - GL_LIGHT0];
+    for (i = 0; i < 4; i++)
+        value[i] = FIXED_TO_FLOAT(params[i]);
+    switch (pname) {
+        case GL_POSITION:
+            transformVector(light->position, sContext.modelview[sContext.modelviewTop], value);
+            break;
+        case GL_AMBIENT:
+            memcpy(light->ambient, value, sizeof(value));
+            break;
+        case GL_DIFFUSE:
+            memcpy(light->diffuse, value, sizeof(value));
+            break;
+        case GL_SPECULAR:
+            memcpy(light->specular, value, sizeof(value));
+            break;
+        default:
+            // Spot lights and attenuation are not supported.
+            break;
+    }
+}
+
+static void softLoadIdentity(void) {
+    loadIdentity(currentMatrix());
+}
+
+static void softMaterialxv(GLenum face, GLenum pname, const GLfixed *params) {
+    SGLCONTEXT *c = &sContext;
+    float value[4];
+    int i;
+    (void) face;
+    if (pname == GL_SHININESS) {
+        c->materialShininess = FIXED_TO_FLOAT(params[0]);
+        return;
+    }
+    for (i = 0; i < 4; i++)
+        value[i] = FIXED_TO_FLOAT(params[i]);
+    switch (pname) {
+        case GL_AMBIENT:
+            memcpy(c->materialAmbient, value, sizeof(value));
+            break;
+        case GL_DIFFUSE:
+            memcpy(c->materialDiffuse, value, sizeof(value));
+            break;
+        case GL_AMBIENT_AND_DIFFUSE:
+            memcpy(c->materialAmbient, value, sizeof(value));
+            memcpy(c->materialDiffuse, value, sizeof(value));
+            break;
+        case GL_SPECULAR:
+            memcpy(c->materialSpecular, value, sizeof(value));
+            break;
+        case GL_EMISSION:
+            memcpy(c->materialEmission, value, sizeof(value));
+            break;
+        default:
+            setError(GL_INVALID_ENUM);
+            break;
+    }
+}
+
+static void softMaterialx(GLenum face, GLenum pname, GLfixed param) {
+    if (pname != GL_SHININESS) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    softMaterialxv(face, pname, &param);
+}
+
+static void softMatrixMode(GLenum mode) {
+    sContext.matrixMode = mode;
+}
+
+static void softMultMatrixx(const GLfixed *m) {
+    float matrix[16];
+    int i;
+    for (i = 0; i < 16; i++)
+        matrix[i] = FIXED_TO_FLOAT(m[i]);
+    multiplyCurrent(matrix);
+}
+
+static void softNormalPointer(GLenum type, GLsizei stride, const GLvoid *pointer) {
+    setArray(&sContext.normalArray, 3, type, stride, pointer);
+}
+
+static void softPopMatrix(void) {
+    int *top = sContext.matrixMode == GL_PROJECTION ?
+               &sContext.projectionTop : &sContext.modelviewTop;
+    if (*top == 0) {
+        setError(GL_STACK_UNDERFLOW);
+        return;
+    }
+    (*top)--;
+}
+
+static void softPushMatrix(void) {
+    SGLCONTEXT *c = &sContext;
+    if (c->matrixMode == GL_PROJECTION) {
+        if (c->projectionTop + 1 >= SOFTGL_PROJECTION_DEPTH) {
+            setError(GL_STACK_OVERFLOW);
+            return;
+        }
+        memcpy(c->projection[c->projectionTop + 1], c->projection[c->projectionTop],
+               16 * sizeof(float));
+        c->projectionTop++;
+    }
+    else {
+        if (c->modelviewTop + 1 >= SOFTGL_MODELVIEW_DEPTH) {
+            setError(GL_STACK_OVERFLOW);
+            return;
+        }
+        memcpy(c->modelview[c->modelviewTop + 1], c->modelview[c->modelviewTop],
+               16 * sizeof(float));
+        c->modelviewTop++;
+    }
+}
+
+static void softRotatex(GLfixed angle, GLfixed x, GLfixed y, GLfixed z) {
+    float axis[3] = {FIXED_TO_FLOAT(x), FIXED_TO_FLOAT(y), FIXED_TO_FLOAT(z)};
+    float radians = FIXED_TO_FLOAT(angle) * 3.1415926535897932f / 180;
+    float s = (float) sin(radians), c = (float) cos(radians), t = 1 - c;
+    float m[16];
+    normalize3(axis);
+    loadIdentity(m);
+    m[0] = t * axis[0] * axis[0] + c;
+    m[1] = t * axis[0] * axis[1] + s * axis[2];
+    m[2] = t * axis[0] * axis[2] - s * axis[1];
+    m[4] = t * axis[0] * axis[1] - s * axis[2];
+    m[5] = t * axis[1] * axis[1] + c;
+    m[6] = t * axis[1] * axis[2] + s * axis[0];
+    m[8] = t * axis[0] * axis[2] + s * axis[1];
+    m[9] = t * axis[1] * axis[2] - s * axis[0];
+    m[10] = t * axis[2] * axis[2] + c;
+    multiplyCurrent(m);
+}
+
+static void softScalex(GLfixed x, GLfixed y, GLfixed z) {
+    float m[16];
+    loadIdentity(m);
+    m[0] = FIXED_TO_FLOAT(x);
+    m[5] = FIXED_TO_FLOAT(y);
+    m[10] = FIXED_TO_FLOAT(z);
+    multiplyCurrent(m);
+}
+
+static void softShadeModel(GLenum mode) {
+    sContext.shadeModel = mode;
+}
+
+static void softGenTextures(GLsizei n, GLuint *textures) {
+    GLuint name = 1;
+    GLsizei i;
+    for (i = 0; i < n; i++) {
+        while (getTexture(name) != NULL)
+            name++;
+        if (allocateTexture(name) == NULL) {
+            setError(GL_OUT_OF_MEMORY);
+            textures[i] = 0;
+            continue;
+        }
+        textures[i] = name;
+    }
+}
+
+static void softDeleteTextures(GLsizei n, const GLuint *textures) {
+    GLsizei i;
+    for (i = 0; i < n; i++) {
+        SGLTEXTURE *texture = getTexture(textures[i]);
+        if (texture == NULL)
+            continue;
+        free(texture->texels);
+        memset(texture, 0, sizeof(SGLTEXTURE));
+        if (sContext.boundTexture == textures[i])
+            sContext.boundTexture = 0;
+    }
+}
+
+static void softBindTexture(GLenum target, GLuint texture) {
+    if (target != GL_TEXTURE_2D) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    if (texture != 0 && getTexture(texture) == NULL && allocateTexture(texture) == NULL) {
+        setError(GL_OUT_OF_MEMORY);
+        return;
+    }
+    sContext.boundTexture = texture;
+}
+
+// Copies width * height pixels of format into RGBA8 texels.
+static void convertTexels(GLenum format, const GLubyte *pixels, long count,
+                          unsigned char *texels) {
+    long i;
+    for (i = 0; i < count; i++) {
+        switch (format) {
+            case GL_RGBA:
+                memcpy(texels + i * 4, pixels + i * 4, 4);
+                break;
+            case GL_RGB:
+                memcpy(texels + i * 4, pixels + i * 3, 3);
+                texels[i * 4 + 3] = 255;
+                break;
+            default:
+                // GL_LUMINANCE
+                memset(texels + i * 4, pixels[i], 3);
+                texels[i * 4 + 3] = 255;
+                break;
+        }
+    }
+}
+
+/* Only level 0 of GL_RGBA, GL_RGB and GL_LUMINANCE unsigned byte images,
+ * with rows packed as by the default GL_UNPACK_ALIGNMENT for these sizes.
+ */
+static void softTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width,
+                           GLsizei height, GLint border, GLenum format, GLenum type,
+                           const GLvoid *pixels) {
+    SGLTEXTURE *texture = getTexture(sContext.boundTexture);
+    unsigned char *texels;
+    (void) internalformat;
+    if (target != GL_TEXTURE_2D || type != GL_UNSIGNED_BYTE ||
+        (format != GL_RGBA && format != GL_RGB && format != GL_LUMINANCE)) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    if (level != 0 || border != 0 || width <= 0 || height <= 0) {
+        setError(GL_INVALID_VALUE);
+        return;
+    }
+    if (texture == NULL) {
+        setError(GL_INVALID_OPERATION);
+        return;
+    }
+    texels = (unsigned char *) realloc(texture->texels, (size_t) width * height * 4);
+    if (texels == NULL) {
+        setError(GL_OUT_OF_MEMORY);
+        return;
+    }
+    if (pixels)
+        convertTexels(format, (const GLubyte *) pixels, (long) width * height, texels);
+    else
+        memset(texels, 0, (size_t) width * height * 4);
+    texture->texels = texels;
+    texture->width = width;
+    texture->height = height;
+}
+
+static void softTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset,
+                              GLsizei width, GLsizei height, GLenum format, GLenum type,
+                              const GLvoid *pixels) {
+    SGLTEXTURE *texture = getTexture(sContext.boundTexture);
+    int bytes = format == GL_RGBA ? 4 : format == GL_RGB ? 3 : 1, y;
+    if (target != GL_TEXTURE_2D || type != GL_UNSIGNED_BYTE ||
+        (format != GL_RGBA && format != GL_RGB && format != GL_LUMINANCE)) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    if (texture == NULL || texture->texels == NULL) {
+        setError(GL_INVALID_OPERATION);
+        return;
+    }
+    if (level != 0 || xoffset < 0 || yoffset < 0 || width < 0 || height < 0 ||
+        xoffset + width > texture->width || yoffset + height > texture->height) {
+        setError(GL_INVALID_VALUE);
+        return;
+    }
+    for (y = 0; y < height; y++)
+        convertTexels(format, (const GLubyte *) pixels + (long) y * width * bytes, width,
+                      texture->texels +
+                      ((long) (yoffset + y) * texture->width + xoffset) * 4);
+}
+
+static void softTexParameterx(GLenum target, GLenum pname, GLfixed param) {
+    SGLTEXTURE *texture = getTexture(sContext.boundTexture);
+    if (target != GL_TEXTURE_2D) {
+        setError(GL_INVALID_ENUM);
+        return;
+    }
+    if (texture == NULL)
+        return;
+    switch (pname) {
+        case GL_TEXTURE_MIN_FILTER:
+            // Minification uses the magnification filter.
+            break;
+        case GL_TEXTURE_MAG_FILTER:
+            texture->magFilter = param == GL_NEAREST ? GL_NEAREST : GL_LINEAR;
+            break;
+        case GL_TEXTURE_WRAP_S:
+            texture->wrapS = param == GL_REPEAT ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+            break;
+        case GL_TEXTURE_WRAP_T:
+            texture->wrapT = param == GL_REPEAT ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+            break;
+        default:
+            setError(GL_INVALID_ENUM);
+            break;
+    }
+}
+
+static void softTexCoordPointer(GLint size, GLenum type, GLsizei stride,
+                                const GLvoid *pointer) {
+    setArray(&sContext.texCoordArray, size, type, stride, pointer);
+}
+
+static void softTranslatex(GLfixed x, GLfixed y, GLfixed z) {
+    float m[16];
+    loadIdentity(m);
+    m[12] = FIXED_TO_FLOAT(x);
+    m[13] = FIXED_TO_FLOAT(y);
+    m[14] = FIXED_TO_FLOAT(z);
+    multiplyCurrent(m);
+}
+
+static void softVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {
+    setArray(&sContext.vertexArray, size, type, stride, pointer);
+}
+
+static void softViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    sContext.viewport[0] = x;
+    sContext.viewport[1] = y;
+    sContext.viewport[2] = width;
+    sContext.viewport[3] = height;
+}
+
+
+/* EGL entry points. There is a single implicit display, config, context
+ * and surface; the surface is the framebuffer sized with softglResize.
+ */
+
+#ifndef ANDROID_NDK
+#define SOFTGL_HANDLE ((void *) 1)
+
+static EGLBoolean softEglChooseConfig(EGLDisplay dpy, const EGLint *attrib_list,
+                                      EGLConfig *configs, EGLint config_size,
+                                      EGLint *num_config) {
+    (void) dpy;
+    (void) attrib_list;
+    if (configs && config_size > 0)
+        configs[0] = (EGLConfig) SOFTGL_HANDLE;
+    if (num_config)
+        *num_config = 1;
+    return EGL_TRUE;
+}
+
+static EGLContext softEglCreateContext(EGLDisplay dpy, EGLConfig config,
+                                       EGLContext share_list, const EGLint *attrib_list) {
+    (void) dpy;
+    (void) config;
+    (void) share_list;
+    (void) attrib_list;
+    return (EGLContext) SOFTGL_HANDLE;
+}
+
+static EGLSurface softEglCreateWindowSurface(EGLDisplay dpy, EGLConfig config,
+                                             NativeWindowType window,
+                                             const EGLint *attrib_list) {
+    (void) dpy;
+    (void) config;
+    (void) window;
+    (void) attrib_list;
+    return (EGLSurface) SOFTGL_HANDLE;
+}
+
+static EGLBoolean softEglDestroyContext(EGLDisplay dpy, EGLContext ctx) {
+    (void) dpy;
+    (void) ctx;
+    return EGL_TRUE;
+}
+
+static EGLBoolean softEglDestroySurface(EGLDisplay dpy, EGLSurface surface) {
+    (void) dpy;
+    (void) surface;
+    return EGL_TRUE;
+}
+
+static EGLBoolean softEglGetConfigAttrib(EGLDisplay dpy, EGLConfig config,
+                                         EGLint attribute, EGLint *value) {
+    (void) dpy;
+    (void) config;
+    (void) attribute;
+    if (value)
+        *value = 0;
+    return EGL_TRUE;
+}
+
+static EGLBoolean softEglGetConfigs(EGLDisplay dpy, EGLConfig *configs, EGLint config_size,
+                                    EGLint *num_config) {
+    return softEglChooseConfig(dpy, NULL, configs, config_size, num_config);
+}
+
+static EGLDisplay softEglGetDisplay(NativeDisplayType display) {
+    (void) display;
+    return (EGLDisplay) SOFTGL_HANDLE;
+}
+
+static EGLint softEglGetError(void) {
+    return EGL_SUCCESS;
+}
+
+static EGLBoolean softEglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor) {
+    (void) dpy;
+    if (major)
+        *major = 1;
+    if (minor)
+        *minor = 0;
+    return EGL_TRUE;
+}
+
+static EGLBoolean softEglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read,
+                                     EGLContext ctx) {
+    (void) dpy;
+    (void) draw;
+    (void) read;
+    (void) ctx;
+    return EGL_TRUE;
+}
+
+static EGLBoolean softEglSwapBuffers(EGLDisplay dpy, EGLSurface draw) {
+    (void) dpy;
+    (void) draw;
+    return EGL_TRUE;
+}
+
+static EGLBoolean softEglTerminate(EGLDisplay dpy) {
+    (void) dpy;
+    return EGL_TRUE;
+}
+#endif /* !ANDROID_NDK */
+
+
+typedef struct {
+    const char *name;
+    void *address;
+} SGLPROC;
+
+#define SGL_PROC(funcName, impl) { #funcName, (void *) impl }
+
+static const SGLPROC sProcs[] = {
+#ifndef ANDROID_NDK
+    SGL_PROC(eglChooseConfig, softEglChooseConfig),
+    SGL_PROC(eglCreateContext, softEglCreateContext),
+    SGL_PROC(eglCreateWindowSurface, softEglCreateWindowSurface),
+    SGL_PROC(eglDestroyContext, softEglDestroyContext),
+    SGL_PROC(eglDestroySurface, softEglDestroySurface),
+    SGL_PROC(eglGetConfigAttrib, softEglGetConfigAttrib),
+    SGL_PROC(eglGetConfigs, softEglGetConfigs),
+    SGL_PROC(eglGetDisplay, softEglGetDisplay),
+    SGL_PROC(eglGetError, softEglGetError),
+    SGL_PROC(eglInitialize, softEglInitialize),
+    SGL_PROC(eglMakeCurrent, softEglMakeCurrent),
+    SGL_PROC(eglSwapBuffers, softEglSwapBuffers),
+    SGL_PROC(eglTerminate, softEglTerminate),
+#endif /* !ANDROID_NDK */
+    SGL_PROC(glBindBuffer, softBindBuffer),
+    SGL_PROC(glBindTexture, softBindTexture),
+    SGL_PROC(glBlendFunc, softBlendFunc),
+    SGL_PROC(glBufferData, softBufferData),
+    SGL_PROC(glBufferSubData, softBufferSubData),
+    SGL_PROC(glClear, softClear),
+    SGL_PROC(glClearColorx, softClearColorx),
+    SGL_PROC(glColor4x, softColor4x),
+    SGL_PROC(glColorPointer, softColorPointer),
+    SGL_PROC(glDeleteBuffers, softDeleteBuffers),
+    SGL_PROC(glDeleteTextures, softDeleteTextures),
+    SGL_PROC(glDisable, softDisable),
+    SGL_PROC(glDisableClientState, softDisableClientState),
+    SGL_PROC(glDrawArrays, softDrawArrays),
+    SGL_PROC(glDrawElements, softDrawElements),
+    SGL_PROC(glEnable, softEnable),
+    SGL_PROC(glEnableClientState, softEnableClientState),
+    SGL_PROC(glFlush, softFlush),
+    SGL_PROC(glFrustumx, softFrustumx),
+    SGL_PROC(glGenBuffers, softGenBuffers),
+    SGL_PROC(glGenTextures, softGenTextures),
+    SGL_PROC(glGetError, softGetError),
+    SGL_PROC(glLightxv, softLightxv),
+    SGL_PROC(glLoadIdentity, softLoadIdentity),
+    SGL_PROC(glMaterialx, softMaterialx),
+    SGL_PROC(glMaterialxv, softMaterialxv),
+    SGL_PROC(glMatrixMode, softMatrixMode),
+    SGL_PROC(glMultMatrixx, softMultMatrixx),
+    SGL_PROC(glNormalPointer, softNormalPointer),
+    SGL_PROC(glPopMatrix, softPopMatrix),
+    SGL_PROC(glPushMatrix, softPushMatrix),
+    SGL_PROC(glRotatex, softRotatex),
+    SGL_PROC(glScalex, softScalex),
+    SGL_PROC(glShadeModel, softShadeModel),
+    SGL_PROC(glTexCoordPointer, softTexCoordPointer),
+    SGL_PROC(glTexImage2D, softTexImage2D),
+    SGL_PROC(glTexParameterx, softTexParameterx),
+    SGL_PROC(glTexSubImage2D, softTexSubImage2D),
+    SGL_PROC(glTranslatex, softTranslatex),
+    SGL_PROC(glVertexPointer, softVertexPointer),
+    SGL_PROC(glViewport, softViewport),
+};
+#define SGL_PROC_COUNT (sizeof(sProcs) / sizeof(sProcs[0]))
+
+
+void *softglGetProcAddress(const char *name) {
+    unsigned int i;
+    if (!sContext.initialized)
+        initState();
+    for (i = 0; i < SGL_PROC_COUNT; i++) {
+        if (strcmp(sProcs[i].name, name) == 0)
+            return sProcs[i].address;
+    }
+    return NULL;
+}
+
+
+int softglResize(int width, int height) {
+    SGLCONTEXT *c = &sContext;
+    unsigned char *colorBuffer;
+    float *depthBuffer;
+    if (width <= 0 || height <= 0)
+        return 0;
+    colorBuffer = (unsigned char *) malloc((size_t) width * height * 4);
+    depthBuffer = (float *) malloc((size_t) width * height * sizeof(float));
+    if (colorBuffer == NULL || depthBuffer == NULL) {
+        free(colorBuffer);
+        free(depthBuffer);
+        return 0;
+    }
+    free(c->colorBuffer);
+    free(c->depthBuffer);
+    c->colorBuffer = colorBuffer;
+    c->depthBuffer = depthBuffer;
+    c->width = width;
+    c->height = height;
+    if (!c->initialized)
+        initState();
+    softClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    return 1;
+}
+
+
+void softglDeinit() {
+    SGLCONTEXT *c = &sContext;
+    GLuint i;
+    for (i = 0; i < c->bufferCount; i++)
+        free(c->buffers[i].data);
+    free(c->buffers);
+    for (i = 0; i < c->textureCount; i++)
+        free(c->textures[i].texels);
+    free(c->textures);
+    free(c->vertices);
+    free(c->colorBuffer);
+    free(c->depthBuffer);
+    memset(c, 0, sizeof(SGLCONTEXT));
+}
+
+
+const unsigned char *softglGetColorBuffer(int *width, int *height) {
+    *width = sContext.width;
+    *height = sContext.height;
+    return sContext.colorBuffer;
+}
+
+
+int softglWritePPM(const char *path) {
+    SGLCONTEXT *c = &sContext;
+    FILE *file;
+    int x, y, ok = 1;
+    if (c->colorBuffer == NULL)
+        return 0;
+    file = fopen(path, "wb");
+    if (file == NULL)
+        return 0;
+    fprintf(file, "P6\n%d %d\n255\n", c->width, c->height);
+    for (y = c->height - 1; y >= 0 && ok; y--) {
+        const unsigned char *row = &c->colorBuffer[(long) y * c->width * 4];
+        for (x = 0; x < c->width; x++) {
+            if (fwrite(&row[x * 4], 1, 3, file) != 3) {
+                ok = 0;
+                break;
+            }
+        }
+    }
+    if (fclose(file) != 0)
+        ok = 0;
+    return ok;
+}
+
+
+void softglGetStats(SOFTGLSTATS *stats) {
+    *stats = sContext.stats;
+}
+
+
+void softglResetStats() {
+    memset(&sContext.stats, 0, sizeof(SOFTGLSTATS));
+}
@@ -0,0 +1,88 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef SOFTGL_H_INCLUDED
+#define SOFTGL_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Software OpenGL ES 1.x Common backend.
+ *
+ * Implements the egl & gl calls listed in importgl.h on the CPU, drawing
+ * into an in-memory framebuffer with an RGBA8 color buffer and a float
+ * depth buffer. It covers what the demo uses: fixed and float vertex
+ * arrays, buffer objects, matrix stacks, up to 8 directional or positional
+ * lights with color material, flat and smooth shading, back face culling,
+ * depth test, blending and 2D textures in the modulate environment. EGL
+ * calls succeed without doing anything, the framebuffer size is set with
+ * softglResize.
+ *
+ * Select it with importGLInitBackend(IMPORTGL_BACKEND_SOFTWARE) or by
+ * setting IMPORTGL_BACKEND=software in the environment.
+ */
+
+
+// Counters since the last softglResetStats call.
+typedef struct {
+    unsigned long drawCalls;
+    unsigned long vertices;
+    unsigned long triangles;
+    unsigned long trianglesCulled;
+    unsigned long fragments;
+} SOFTGLSTATS;
+
+
+/* Returns the software implementation of the named egl or gl function,
+ * or NULL if it is not implemented.
+ */
+extern void *softglGetProcAddress(const char *name);
+
+/* (Re)allocates the framebuffer. Returns non-zero on success and 0 on
+ * failure.
+ */
+extern int softglResize(int width, int height);
+
+/* Frees the framebuffer and all buffer objects and resets the GL state.
+ */
+extern void softglDeinit();
+
+/* Returns the color buffer as RGBA8 rows, bottom row first as in GL.
+ */
+extern const unsigned char *softglGetColorBuffer(int *width, int *height);
+
+/* Writes the color buffer to a binary PPM file, top row first.
+ * Returns non-zero on success and 0 on failure.
+ */
+extern int softglWritePPM(const char *path);
+
+extern void softglGetStats(SOFTGLSTATS *stats);
+extern void softglResetStats();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !SOFTGL_H_INCLUDED
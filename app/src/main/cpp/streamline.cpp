@@ -0,0 +1,571 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+#include "streamline.h"
+#include "log.h"
+#include "profile.h"
+
+
+using Eigen::Matrix4Xf;
+using Eigen::Vector3f;
+
+// Alignment of the arrays inside the STREAMLINESET storage block.
+#define STREAMLINE_ARRAY_ALIGNMENT  64
+// Initial vertex capacity of a thread's trace buffer.
+#define STREAMLINE_INITIAL_CAPACITY 4096
+// Steps per culling segment.
+#define STREAMLINE_SEGMENT_STEPS    32
+
+
+/* Vertices traced by one thread, one column per vertex holding the
+ * position and the field magnitude there.
+ */
+struct TraceBuffer {
+    Matrix4Xf points;
+    long used;
+};
+
+/* Interpolates the field at a position, returning false outside it:
+ * fieldInterpolate or octreeFieldInterpolate.
+ */
+typedef bool (*Interpolate)(const void *field, const float *position, float *vector);
+
+struct Tracer {
+    Interpolate interpolate;
+    const void *field;
+    const STREAMLINEPARAMS *params;
+    float cutoff;
+};
+
+/* Where each seed's line ended up: count vertices from start in the trace
+ * buffer of thread worker.
+ */
+struct TracedLine {
+    long start;
+    int count;
+    int worker;
+};
+
+struct TraceJob {
+    Tracer tracer;
+    const float *seeds;
+    TraceBuffer *buffers;
+    TracedLine *lines;
+};
+
+struct CopyJob {
+    const TraceBuffer *buffers;
+    const TracedLine *lines;
+    // Index of the seed of each output line.
+    const int *seedOfLine;
+    STREAMLINESET *set;
+    float maxMagnitude;
+};
+
+
+/* Samples the field at p. On success stores the field direction times sign
+ * to direction, zero where the field vanishes, and the magnitude.
+ */
+static bool sampleDirection(const Tracer &tracer, const Vector3f &p, float sign,
+                            Vector3f *direction, float *magnitude) {
+    Vector3f v;
+    if (!tracer.interpolate(tracer.field, p.data(), v.data()))
+        return false;
+    *magnitude = v.norm();
+    if (*magnitude > 0)
+        *direction = v * (sign / *magnitude);
+    else
+        direction->setZero();
+    return true;
+}
+
+/* Classic fourth order Runge-Kutta step of length h from p, whose direction
+ * k1 is known. Stores the new position with its direction and magnitude.
+ */
+static bool stepRK4(const Tracer &tracer, float sign, const Vector3f &p, const Vector3f &k1,
+                    float h, Vector3f *next, Vector3f *nextDirection, float *nextMagnitude) {
+    Vector3f k2, k3, k4;
+    float magnitude;
+    if (!sampleDirection(tracer, p + 0.5f * h * k1, sign, &k2, &magnitude) ||
+        !sampleDirection(tracer, p + 0.5f * h * k2, sign, &k3, &magnitude) ||
+        !sampleDirection(tracer, p + h * k3, sign, &k4, &magnitude))
+        return false;
+    *next = p + (h / 6) * (k1 + 2 * k2 + 2 * k3 + k4);
+    return sampleDirection(tracer, *next, sign, nextDirection, nextMagnitude);
+}
+
+/* Adaptive Dormand-Prince 5(4) step from p, whose direction k1 is known.
+ * The step length h is shrunk until the difference of the fifth and fourth
+ * order solutions is within tolerance, or it reaches minStep, and is then
+ * updated to the length suggested for the next step. The last stage is
+ * taken at the new position, so it gives the next direction for free.
+ */
+static bool stepRK45(const Tracer &tracer, float sign, const Vector3f &p, const Vector3f &k1,
+                     float *h, Vector3f *next, Vector3f *nextDirection, float *nextMagnitude) {
+    const STREAMLINEPARAMS *params = tracer.params;
+    Vector3f k2, k3, k4, k5, k6, k7;
+    float magnitude;
+
+    for (;;) {
+        float step = *h, error, scale;
+        bool inside =
+            sampleDirection(tracer, p + step * (1.0f / 5) * k1, sign, &k2, &magnitude) &&
+            sampleDirection(tracer, p + step * ((3.0f / 40) * k1 + (9.0f / 40) * k2),
+                            sign, &k3, &magnitude) &&
+            sampleDirection(tracer, p + step * ((44.0f / 45) * k1 - (56.0f / 15) * k2 +
+                                                (32.0f / 9) * k3),
+                            sign, &k4, &magnitude) &&
+            sampleDirection(tracer, p + step * ((19372.0f / 6561) * k1 -
+                                                (25360.0f / 2187) * k2 +
+                                                (64448.0f / 6561) * k3 -
+                                                (212.0f / 729) * k4),
+                            sign, &k5, &magnitude) &&
+            sampleDirection(tracer, p + step * ((9017.0f / 3168) * k1 - (355.0f / 33) * k2 +
+                                                (46732.0f / 5247) * k3 + (49.0f / 176) * k4 -
+                                                (5103.0f / 18656) * k5),
+                            sign, &k6, &magnitude);
+        if (inside) {
+            *next = p + step * ((35.0f / 384) * k1 + (500.0f / 1113) * k3 +
+                                (125.0f / 192) * k4 - (2187.0f / 6784) * k5 +
+                                (11.0f / 84) * k6);
+            inside = sampleDirection(tracer, *next, sign, &k7, nextMagnitude);
+        }
+        if (!inside) {
+            // Some stage left the grid; approach the boundary with
+            // shorter steps.
+            if (step <= params->minStep)
+                return false;
+            *h = fmaxf(step * 0.5f, params->minStep);
+            continue;
+        }
+
+        error = step * ((71.0f / 57600) * k1 - (71.0f / 16695) * k3 + (71.0f / 1920) * k4 -
+                        (17253.0f / 339200) * k5 + (22.0f / 525) * k6 -
+                        (1.0f / 40) * k7).norm();
+        scale = error > 0 ? 0.9f * powf(params->tolerance / error, 0.2f) : 5;
+        if (error > params->tolerance && step > params->minStep) {
+            *h = fmaxf(step * fmaxf(scale, 0.2f), params->minStep);
+            continue;
+        }
+        *h = fminf(step * fminf(scale, 5.0f), params->maxStep);
+        *nextDirection = k7;
+        return true;
+    }
+}
+
+static void appendPoint(TraceBuffer *buffer, const Vector3f &p, float magnitude) {
+    if (buffer->used == buffer->points.cols()) {
+        long capacity = buffer->points.cols() * 2;
+        buffer->points.conservativeResize(Eigen::NoChange, capacity > STREAMLINE_INITIAL_CAPACITY ?
+                                                           capacity : STREAMLINE_INITIAL_CAPACITY);
+    }
+    buffer->points.col(buffer->used) << p, magnitude;
+    buffer->used++;
+}
+
+/* Traces from the seed in the direction given by sign and appends the
+ * vertices to buffer, leaving out the seed itself when skipSeed is set.
+ */
+static void traceDirection(const Tracer &tracer, const Vector3f &seed, float sign,
+                           bool skipSeed, TraceBuffer *buffer) {
+    const STREAMLINEPARAMS *params = tracer.params;
+    Vector3f p = seed, direction, nextP, nextDirection;
+    float magnitude, nextMagnitude, h = params->stepSize;
+    int step;
+
+    if (!sampleDirection(tracer, p, sign, &direction, &magnitude))
+        return;
+    for (step = 0;; step++) {
+        bool stepped;
+        if (step > 0 || !skipSeed)
+            appendPoint(buffer, p, magnitude);
+        if (magnitude <= 0 || magnitude < tracer.cutoff || step >= params->maxSteps)
+            break;
+        if (params->integrator == STREAMLINE_RK45)
+            stepped = stepRK45(tracer, sign, p, direction, &h,
+                               &nextP, &nextDirection, &nextMagnitude);
+        else
+            stepped = stepRK4(tracer, sign, p, direction, h,
+                              &nextP, &nextDirection, &nextMagnitude);
+        if (!stepped)
+            break;
+        p = nextP;
+        direction = nextDirection;
+        magnitude = nextMagnitude;
+    }
+}
+
+static void traceTask(long first, long last, int worker, void *userData) {
+    TraceJob *job = (TraceJob *) userData;
+    TraceBuffer *buffer = &job->buffers[worker];
+    long s;
+
+    for (s = first; s < last; s++) {
+        Vector3f seed(job->seeds[s * 3], job->seeds[s * 3 + 1], job->seeds[s * 3 + 2]);
+        TracedLine *line = &job->lines[s];
+        line->start = buffer->used;
+        line->worker = worker;
+        if (job->tracer.params->bothDirections) {
+            long a, b;
+            traceDirection(job->tracer, seed, -1, false, buffer);
+            // The backward part was traced away from the seed; turn it
+            // around so that the line runs along the field.
+            for (a = line->start, b = buffer->used - 1; a < b; a++, b--)
+                buffer->points.col(a).swap(buffer->points.col(b));
+            traceDirection(job->tracer, seed, 1, buffer->used > line->start, buffer);
+        }
+        else
+            traceDirection(job->tracer, seed, 1, false, buffer);
+        line->count = (int) (buffer->used - line->start);
+    }
+}
+
+static void copyTask(long first, long last, int worker, void *userData) {
+    CopyJob *job = (CopyJob *) userData;
+    STREAMLINESET *set = job->set;
+    long n, v;
+    (void) worker;
+
+    for (n = first; n < last; n++) {
+        const TracedLine *line = &job->lines[job->seedOfLine[n]];
+        const Matrix4Xf &points = job->buffers[line->worker].points;
+        GLfloat *vertex = set->vertexArray + (long) set->first[n] * 3;
+        GLubyte *color = set->colorArray + (long) set->first[n] * 4;
+        for (v = 0; v < line->count; v++, vertex += 3, color += 4) {
+            const float *point = points.col(line->start + v).data();
+            vertex[0] = point[0];
+            vertex[1] = point[1];
+            vertex[2] = point[2];
+            fieldMagnitudeColor(fminf(point[3] / job->maxMagnitude, 1), color);
+        }
+    }
+}
+
+static size_t alignSize(size_t size) {
+    return (size + STREAMLINE_ARRAY_ALIGNMENT - 1) &
+           ~(size_t) (STREAMLINE_ARRAY_ALIGNMENT - 1);
+}
+
+
+void streamlineParamsDefault(STREAMLINEPARAMS *params, const FIELD *field) {
+    float spacing = field->spacing[0];
+    if (field->spacing[1] < spacing)
+        spacing = field->spacing[1];
+    if (field->spacing[2] < spacing)
+        spacing = field->spacing[2];
+
+    memset(params, 0, sizeof(STREAMLINEPARAMS));
+    params->integrator = STREAMLINE_RK45;
+    params->stepSize = 0.5f * spacing;
+    params->minStep = 0.05f * spacing;
+    params->maxStep = 2 * spacing;
+    params->tolerance = 1e-3f * spacing;
+    params->minMagnitude = 0.01f;
+    params->maxSteps = 200;
+    params->bothDirections = 1;
+}
+
+
+// Number of culling segments of a line of count vertices.
+static int segmentsOfLine(long count) {
+    return (int) ((count - 2) / STREAMLINE_SEGMENT_STEPS + 1);
+}
+
+/* Cuts the gathered lines into segments and bounds them. Neighbouring
+ * segments overlap by one vertex so that they join up when drawn apart.
+ */
+static void buildSegments(STREAMLINESET *set) {
+    int line, segment = 0, s;
+    for (line = 0; line < set->lineCount; line++) {
+        int segments = segmentsOfLine(set->counts[line]);
+        for (s = 0; s < segments; s++, segment++) {
+            long first = set->first[line] + (long) s * STREAMLINE_SEGMENT_STEPS;
+            long last = first + STREAMLINE_SEGMENT_STEPS + 1;
+            if (last > set->first[line] + set->counts[line])
+                last = set->first[line] + set->counts[line];
+            set->segmentFirst[segment] = (GLint) first;
+            set->segmentCounts[segment] = (GLsizei) (last - first);
+            bvhBoxSetEmpty(&set->segmentBoxes[segment]);
+            bvhBoxExtend(&set->segmentBoxes[segment], set->vertexArray + first * 3,
+                         last - first);
+        }
+    }
+}
+
+/* Collects the lines of at least two vertices from the trace buffers into
+ * one allocation in set.
+ */
+static int gatherLines(STREAMLINESET *set, const TraceBuffer *buffers, const TracedLine *lines,
+                       int *seedOfLine, int seedCount, float maxMagnitude, THREADPOOL *pool,
+                       ARENA *arena) {
+    size_t vertexBytes, colorBytes, firstBytes, boxBytes, segmentBytes, size;
+    unsigned char *storage;
+    long vertices = 0;
+    int lineCount = 0, segmentCount = 0, s;
+    CopyJob job;
+
+    for (s = 0; s < seedCount; s++) {
+        if (lines[s].count >= 2) {
+            seedOfLine[lineCount++] = s;
+            vertices += lines[s].count;
+            segmentCount += segmentsOfLine(lines[s].count);
+        }
+    }
+
+    vertexBytes = alignSize(vertices * 3 * sizeof(GLfloat));
+    colorBytes = alignSize(vertices * 4 * sizeof(GLubyte));
+    firstBytes = alignSize(lineCount * sizeof(GLint));
+    boxBytes = alignSize(segmentCount * sizeof(BVHBOX));
+    segmentBytes = alignSize(segmentCount * sizeof(GLint));
+    size = vertexBytes + colorBytes + boxBytes + 2 * segmentBytes + 2 * firstBytes;
+    if (arena != NULL)
+        storage = (unsigned char *) arenaAlloc(arena, size);
+    else
+        storage = (unsigned char *) Eigen::internal::aligned_malloc(size);
+    if (storage == NULL)
+        return 0;
+    set->storage = arena != NULL ? NULL : storage;
+    set->vertexArray = (GLfloat *) storage;
+    set->colorArray = (GLubyte *) (storage + vertexBytes);
+    set->segmentBoxes = (BVHBOX *) (storage + vertexBytes + colorBytes);
+    storage += vertexBytes + colorBytes + boxBytes;
+    set->segmentFirst = (GLint *) storage;
+    set->segmentCounts = (GLsizei *) (storage + segmentBytes);
+    set->first = (GLint *) (storage + 2 * segmentBytes);
+    set->counts = (GLsizei *) (storage + 2 * segmentBytes + firstBytes);
+    set->lineCount = lineCount;
+    set->segmentCount = segmentCount;
+    set->vertexCount = vertices;
+
+    vertices = 0;
+    for (s = 0; s < lineCount; s++) {
+        set->first[s] = (GLint) vertices;
+        set->counts[s] = lines[seedOfLine[s]].count;
+        vertices += set->counts[s];
+    }
+
+    job.buffers = buffers;
+    job.lines = lines;
+    job.seedOfLine = seedOfLine;
+    job.set = set;
+    job.maxMagnitude = maxMagnitude;
+    threadPoolRun(pool, lineCount, 0, copyTask, &job);
+    buildSegments(set);
+    return bvhUpdate(&set->bvh, set->segmentBoxes, segmentCount);
+}
+
+
+static bool interpolateField(const void *field, const float *position, float *vector) {
+    return fieldInterpolate((const FIELD *) field, position, vector) != 0;
+}
+
+static bool interpolateOctree(const void *tree, const float *position, float *vector) {
+    return octreeFieldInterpolate((const OCTREEFIELD *) tree, position, vector) != 0;
+}
+
+/* Traces the lines through a field whose magnitude range is known, read
+ * through interpolate.
+ */
+static int traceLines(STREAMLINESET *set, Interpolate interpolate, const void *field,
+                      float maxMagnitude, const float *seeds, int seedCount,
+                      const STREAMLINEPARAMS *params, THREADPOOL *pool, ARENA *arena) {
+    int workers = threadPoolSize(pool), result = 0, w;
+    TraceBuffer *buffers;
+    int *seedOfLine;
+    TraceJob job;
+    ProfileScope profile(PROFILE_STAGE_MESH_BUILD);
+
+    Eigen::internal::aligned_free(set->storage);
+    set->storage = NULL;
+    set->vertexArray = NULL;
+    set->colorArray = NULL;
+    set->first = NULL;
+    set->counts = NULL;
+    set->lineCount = 0;
+    set->vertexCount = 0;
+    set->segmentBoxes = NULL;
+    set->segmentFirst = NULL;
+    set->segmentCounts = NULL;
+    set->segmentCount = 0;
+    set->buffered = 0;
+    if (params->stepSize <= 0 || params->maxSteps < 1 ||
+        (params->integrator == STREAMLINE_RK45 &&
+         (params->minStep <= 0 || params->maxStep < params->minStep ||
+          params->tolerance <= 0)))
+        return 0;
+
+    if (seedCount <= 0 || maxMagnitude <= 0)
+        return bvhUpdate(&set->bvh, NULL, 0);
+
+    job.tracer.interpolate = interpolate;
+    job.tracer.field = field;
+    job.tracer.params = params;
+    job.tracer.cutoff = params->minMagnitude * maxMagnitude;
+    job.seeds = seeds;
+    job.buffers = buffers = new TraceBuffer[workers];
+    job.lines = (TracedLine *) malloc(seedCount * sizeof(TracedLine));
+    seedOfLine = (int *) malloc(seedCount * sizeof(int));
+
+    if (job.lines != NULL && seedOfLine != NULL) {
+        for (w = 0; w < workers; w++)
+            buffers[w].used = 0;
+        threadPoolRun(pool, seedCount, 0, traceTask, &job);
+        result = gatherLines(set, buffers, job.lines, seedOfLine, seedCount,
+                             maxMagnitude, pool, arena);
+        LOGD(FIELD, "traced %d streamlines of %ld vertices in %d segments from %d seeds",
+             set->lineCount, set->vertexCount, set->segmentCount, seedCount);
+    }
+
+    delete[] buffers;
+    free(job.lines);
+    free(seedOfLine);
+    return result;
+}
+
+
+int streamlineSetTrace(STREAMLINESET *set, const FIELD *field,
+                       const float *seeds, int seedCount,
+                       const STREAMLINEPARAMS *params, THREADPOOL *pool,
+                       ARENA *arena) {
+    float minMagnitude, maxMagnitude;
+    fieldMagnitudeRange(field, &minMagnitude, &maxMagnitude);
+    return traceLines(set, interpolateField, field, maxMagnitude, seeds, seedCount,
+                      params, pool, arena);
+}
+
+
+int streamlineSetTraceOctree(STREAMLINESET *set, const OCTREEFIELD *tree,
+                             const float *seeds, int seedCount,
+                             const STREAMLINEPARAMS *params, THREADPOOL *pool,
+                             ARENA *arena) {
+    return traceLines(set, interpolateOctree, tree, tree->maxMagnitude, seeds, seedCount,
+                      params, pool, arena);
+}
+
+
+void streamlineSetDeinit(STREAMLINESET *set) {
+    streamlineSetDeleteBuffers(set);
+    bvhDeinit(&set->bvh);
+    Eigen::internal::aligned_free(set->storage);
+    memset(set, 0, sizeof(STREAMLINESET));
+}
+
+
+int streamlineSetCreateBuffers(STREAMLINESET *set) {
+    if (set->vertexCount == 0)
+        return 1;
+    if (set->buffers[0] == 0) {
+        glGenBuffers(2, set->buffers);
+        if (set->buffers[0] == 0 || set->buffers[1] == 0) {
+            LOGW(RENDER, "cannot create streamline buffers");
+            glDeleteBuffers(2, set->buffers);
+            set->buffers[0] = set->buffers[1] = 0;
+            return 0;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, set->buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, set->vertexCount * 3 * sizeof(GLfloat),
+                 set->vertexArray, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, set->buffers[1]);
+    glBufferData(GL_ARRAY_BUFFER, set->vertexCount * 4 * sizeof(GLubyte),
+                 set->colorArray, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    set->buffered = 1;
+    return 1;
+}
+
+
+void streamlineSetDeleteBuffers(STREAMLINESET *set) {
+    if (set->buffers[0] != 0)
+        glDeleteBuffers(2, set->buffers);
+    set->buffers[0] = set->buffers[1] = 0;
+    set->buffered = 0;
+}
+
+
+void drawStreamlineSet(STREAMLINESET *set, const FRUSTUM *frustum, ARENA *scratch,
+                       CULLSTATS *stats) {
+    unsigned char *visible = NULL;
+    int n;
+    if (set->lineCount == 0)
+        return;
+    if (frustum != NULL)
+        visible = (unsigned char *) arenaAlloc(scratch, set->segmentCount);
+    if (visible != NULL)
+        bvhCull(&set->bvh, frustum, visible, stats);
+
+    glDisable(GL_LIGHTING);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    if (set->buffered) {
+        glBindBuffer(GL_ARRAY_BUFFER, set->buffers[0]);
+        glVertexPointer(3, GL_FLOAT, 0, (const GLvoid *) 0);
+        glBindBuffer(GL_ARRAY_BUFFER, set->buffers[1]);
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid *) 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    else {
+        glVertexPointer(3, GL_FLOAT, 0, set->vertexArray);
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, set->colorArray);
+    }
+
+    // GLES 1.x has no multi-draw, so the batch is one draw per line from
+    // the arrays bound once above.
+    if (visible == NULL) {
+        for (n = 0; n < set->lineCount; n++)
+            glDrawArrays(GL_LINE_STRIP, set->first[n], set->counts[n]);
+        if (stats != NULL)
+            stats->drawCalls += set->lineCount;
+    }
+    else {
+        // One draw per run of visible segments, which share end vertices.
+        GLint first = 0, last = -1;
+        for (n = 0; n <= set->segmentCount; n++) {
+            if (n < set->segmentCount && !visible[n]) {
+                if (stats != NULL)
+                    stats->clustersCulled++;
+                continue;
+            }
+            if (n < set->segmentCount && set->segmentFirst[n] == last - 1) {
+                last = set->segmentFirst[n] + set->segmentCounts[n];
+                if (stats != NULL)
+                    stats->clustersDrawn++;
+                continue;
+            }
+            if (last > first) {
+                glDrawArrays(GL_LINE_STRIP, first, last - first);
+                if (stats != NULL)
+                    stats->drawCalls++;
+            }
+            if (n < set->segmentCount) {
+                first = set->segmentFirst[n];
+                last = first + set->segmentCounts[n];
+                if (stats != NULL)
+                    stats->clustersDrawn++;
+            }
+        }
+    }
+
+    glEnable(GL_LIGHTING);
+}
@@ -0,0 +1,154 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef STREAMLINE_H_INCLUDED
+#define STREAMLINE_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "importgl.h"
+#include "field.h"
+#include "octree.h"
+#include "threadpool.h"
+#include "arena.h"
+#include "bvh.h"
+
+
+// Integrators for STREAMLINEPARAMS integrator.
+#define STREAMLINE_RK4      0
+#define STREAMLINE_RK45     1
+
+
+/* How streamlines are integrated and when they end. Lengths are in field
+ * coordinates. Lines follow the field direction at unit speed, so a step
+ * advances the line by about the step length whatever the magnitude.
+ */
+typedef struct {
+    int integrator;
+    // Step length, the initial one for STREAMLINE_RK45.
+    float stepSize;
+    // Step length bounds and the position error allowed per step for the
+    // adaptive STREAMLINE_RK45.
+    float minStep;
+    float maxStep;
+    float tolerance;
+    // Lines end where the magnitude falls below this fraction of the
+    // largest vector, and where they leave the grid.
+    float minMagnitude;
+    // Most steps taken in each direction from the seed.
+    int maxSteps;
+    // Non-zero to trace backward from the seed as well as forward.
+    int bothDirections;
+} STREAMLINEPARAMS;
+
+/* Traced lines as one array of vertices, line after line, colored by
+ * magnitude. Line n is the line strip of counts[n] vertices starting at
+ * vertex first[n]. Seeds whose line has fewer than two vertices get no
+ * line.
+ *
+ * For culling the lines are cut into segments of a few steps, segment n
+ * being the strip of segmentCounts[n] vertices from segmentFirst[n].
+ * Consecutive segments of a line share their end vertex. The bounding
+ * hierarchy over the segment boxes is kept across traces and refit when
+ * the number of segments stays the same.
+ */
+typedef struct {
+    GLfloat *vertexArray;
+    GLubyte *colorArray;
+    GLint *first;
+    GLsizei *counts;
+    int lineCount;
+    long vertexCount;
+    BVHBOX *segmentBoxes;
+    GLint *segmentFirst;
+    GLsizei *segmentCounts;
+    int segmentCount;
+    BVH bvh;
+    // Vertex and color buffer objects, 0 when not created.
+    GLuint buffers[2];
+    // Non-zero when the buffer objects hold the current lines.
+    int buffered;
+    // The single heap block holding all of the arrays, NULL when they
+    // were allocated from an arena.
+    void *storage;
+} STREAMLINESET;
+
+
+/* Fills in parameters that fit the grid spacing of the field.
+ */
+extern void streamlineParamsDefault(STREAMLINEPARAMS *params, const FIELD *field);
+
+/* Traces a line through each of seedCount seed positions, given as x, y, z
+ * triples, splitting the seeds between the threads of pool, which may be
+ * NULL. The arrays come from arena, or from the heap when arena is NULL.
+ * Replaces the lines of set, which must be zero filled or hold earlier
+ * lines. Makes no GL calls; lines traced again are drawn from
+ * client memory until streamlineSetCreateBuffers is called. Returns
+ * non-zero on success and 0 on failure.
+ */
+extern int streamlineSetTrace(STREAMLINESET *set, const FIELD *field,
+                              const float *seeds, int seedCount,
+                              const STREAMLINEPARAMS *params, THREADPOOL *pool,
+                              ARENA *arena);
+
+/* streamlineSetTrace for a sparse field.
+ */
+extern int streamlineSetTraceOctree(STREAMLINESET *set, const OCTREEFIELD *tree,
+                                    const float *seeds, int seedCount,
+                                    const STREAMLINEPARAMS *params, THREADPOOL *pool,
+                                    ARENA *arena);
+
+/* Deletes the buffer objects and frees the lines unless they are in an
+ * arena, and frees the hierarchy.
+ */
+extern void streamlineSetDeinit(STREAMLINESET *set);
+
+/* Copies the lines into GL buffer objects, creating them on the first
+ * call. Needs a current GL context. Returns non-zero on success and 0 on
+ * failure, in which case the lines are drawn from client memory.
+ */
+extern int streamlineSetCreateBuffers(STREAMLINESET *set);
+
+/* Deletes the buffer objects, after which the lines are drawn from client
+ * memory and streamlineSetDeinit makes no GL calls. Needs a current GL
+ * context.
+ */
+extern void streamlineSetDeleteBuffers(STREAMLINESET *set);
+
+/* Draws the lines as line strips from the shared arrays, only the
+ * segments that may be inside frustum unless it is NULL. The per-frame
+ * scratch comes from scratch. Adds the counts of this draw to stats,
+ * which may be NULL. Lines have no normals, so lighting is turned off for
+ * them and on again afterwards.
+ */
+extern void drawStreamlineSet(STREAMLINESET *set, const FRUSTUM *frustum, ARENA *scratch,
+                              CULLSTATS *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !STREAMLINE_H_INCLUDED
@@ -0,0 +1,201 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "threadpool.h"
+#include "log.h"
+
+
+// Chunks per thread when the caller leaves the grain to the pool.
+#define THREADPOOL_CHUNKS_PER_THREAD    4
+
+
+struct THREADPOOL {
+    pthread_t *threads;
+    // Worker threads, not counting the thread that runs a job.
+    int threadCount;
+    // Held for the whole of a job so that jobs do not overlap.
+    pthread_mutex_t runMutex;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    // Incremented for every job; workers wake up when it changes.
+    unsigned long generation;
+    // Worker threads that have not finished the current job.
+    int busy;
+    int stop;
+    THREADPOOLTASK task;
+    void *userData;
+    long count;
+    long grain;
+    // First item of the next chunk to hand out.
+    long next;
+};
+
+
+static void runChunks(THREADPOOL *pool, int worker) {
+    for (;;) {
+        long first = __atomic_fetch_add(&pool->next, pool->grain, __ATOMIC_RELAXED);
+        long last = first + pool->grain;
+        if (first >= pool->count)
+            break;
+        if (last > pool->count)
+            last = pool->count;
+        pool->task(first, last, worker, pool->userData);
+    }
+}
+
+typedef struct {
+    THREADPOOL *pool;
+    int worker;
+} WORKERSTART;
+
+static void *workerThread(void *arg) {
+    WORKERSTART *start = (WORKERSTART *) arg;
+    THREADPOOL *pool = start->pool;
+    int worker = start->worker;
+    unsigned long seen;
+
+    pthread_mutex_lock(&pool->mutex);
+    seen = pool->generation;
+    // The creator waits for this before reusing start.
+    pool->busy--;
+    pthread_cond_signal(&pool->done);
+    for (;;) {
+        while (pool->generation == seen && !pool->stop)
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        if (pool->stop)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        runChunks(pool, worker);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+
+THREADPOOL *threadPoolCreate(int threads) {
+    THREADPOOL *pool;
+    WORKERSTART start;
+    int i;
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int) cpus : 1;
+    }
+    pool = (THREADPOOL *) calloc(1, sizeof(THREADPOOL));
+    if (pool == NULL)
+        return NULL;
+    pool->threads = (pthread_t *) calloc(threads, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->runMutex, NULL);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    start.pool = pool;
+    for (i = 1; i < threads; i++) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->busy = 1;
+        start.worker = i;
+        if (pthread_create(&pool->threads[pool->threadCount], NULL, workerThread, &start) != 0) {
+            pthread_mutex_unlock(&pool->mutex);
+            LOGW(APP, "thread pool started only %d of %d threads", pool->threadCount + 1, threads);
+            break;
+        }
+        pool->threadCount++;
+        while (pool->busy)
+            pthread_cond_wait(&pool->done, &pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    pool->busy = 0;
+    return pool;
+}
+
+
+void threadPoolDestroy(THREADPOOL *pool) {
+    int i;
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    for (i = 0; i < pool->threadCount; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->runMutex);
+    free(pool->threads);
+    free(pool);
+}
+
+
+int threadPoolSize(const THREADPOOL *pool) {
+    return pool != NULL ? pool->threadCount + 1 : 1;
+}
+
+
+void threadPoolRun(THREADPOOL *pool, long count, long grain,
+                   THREADPOOLTASK task, void *userData) {
+    if (count <= 0)
+        return;
+    if (pool == NULL || pool->threadCount == 0 || count == 1) {
+        task(0, count, 0, userData);
+        return;
+    }
+    if (grain <= 0) {
+        grain = count / (threadPoolSize(pool) * THREADPOOL_CHUNKS_PER_THREAD);
+        if (grain < 1)
+            grain = 1;
+    }
+
+    pthread_mutex_lock(&pool->runMutex);
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->userData = userData;
+    pool->count = count;
+    pool->grain = grain;
+    pool->next = 0;
+    pool->busy = pool->threadCount;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    runChunks(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->busy)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+    pthread_mutex_unlock(&pool->runMutex);
+}
@@ -0,0 +1,72 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Processes the items first..last-1 of a parallel job. worker is the index
+ * of the calling thread within the pool, 0 to threadPoolSize() - 1, so it
+ * can select per-thread scratch memory.
+ */
+typedef void (*THREADPOOLTASK)(long first, long last, int worker, void *userData);
+
+/* Fixed set of worker threads that split index ranges between them. The
+ * thread that runs a job takes part in it as worker 0.
+ */
+typedef struct THREADPOOL THREADPOOL;
+
+
+/* Starts threads - 1 worker threads, or one per online CPU less one when
+ * threads is 0 or less. Returns NULL on failure.
+ */
+extern THREADPOOL *threadPoolCreate(int threads);
+
+/* Stops and joins the worker threads. NULL is accepted.
+ */
+extern void threadPoolDestroy(THREADPOOL *pool);
+
+/* Number of threads taking part in a job, including the caller. 1 for a
+ * NULL pool.
+ */
+extern int threadPoolSize(const THREADPOOL *pool);
+
+/* Calls task for chunks of at most grain items until all count items are
+ * done, and returns when every chunk has finished. Chunks are handed out
+ * dynamically, so uneven items balance out. A grain of 0 picks one that
+ * gives each thread a few chunks. With a NULL pool the task runs once on
+ * the caller for the whole range. Jobs from different threads are run one
+ * after the other; a task must not run a job on the same pool.
+ */
+extern void threadPoolRun(THREADPOOL *pool, long count, long grain,
+                          THREADPOOLTASK task, void *userData);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !THREADPOOL_H_INCLUDED
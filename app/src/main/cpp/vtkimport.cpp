@@ -0,0 +1,997 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vtkimport.h"
+#include "log.h"
+
+
+// Bytes of ASCII data each parsing task takes at a time.
+#define TEXT_CHUNK_SIZE     (256 * 1024)
+// Tuples each binary conversion task takes at a time.
+#define BINARY_GRAIN        65536
+
+#define VTK_MAX_LINE        256
+#define VTK_MAX_NAME        128
+
+
+// True for the separators between ASCII numbers.
+static inline bool isSpace(char c) {
+    return (unsigned char) c <= ' ';
+}
+
+static const char *skipSpace(const char *p, const char *end) {
+    while (p < end && isSpace(*p))
+        p++;
+    return p;
+}
+
+
+/* Where the tuples of one array go: the samples of grid points
+ * extent[0]..extent[1], extent[2]..extent[3] and extent[4]..extent[5] of
+ * field, x fastest. Only arrays of 3 components are read.
+ */
+typedef struct {
+    FIELD *field;
+    int extent[6];
+} Target;
+
+// Position of the next value of an array within its target.
+typedef struct {
+    float *components[3];
+    int component;
+    int i;
+    int j;
+    int k;
+    long index;
+} Cursor;
+
+static void cursorStart(Cursor *cursor, const Target *target, long value) {
+    const int *e = target->extent;
+    long tuple = value / 3, rowLength = e[1] - e[0] + 1, rows = e[3] - e[2] + 1;
+
+    cursor->components[0] = target->field->x;
+    cursor->components[1] = target->field->y;
+    cursor->components[2] = target->field->z;
+    cursor->component = (int) (value % 3);
+    cursor->i = e[0] + (int) (tuple % rowLength);
+    cursor->j = e[2] + (int) (tuple / rowLength % rows);
+    cursor->k = e[4] + (int) (tuple / rowLength / rows);
+    cursor->index = FIELD_INDEX(target->field, cursor->i, cursor->j, cursor->k);
+}
+
+static inline void cursorStore(Cursor *cursor, const Target *target, float value) {
+    cursor->components[cursor->component][cursor->index] = value;
+    if (++cursor->component < 3)
+        return;
+    cursor->component = 0;
+    if (++cursor->i <= target->extent[1]) {
+        cursor->index++;
+        return;
+    }
+    cursor->i = target->extent[0];
+    if (++cursor->j > target->extent[3]) {
+        cursor->j = target->extent[2];
+        cursor->k++;
+    }
+    cursor->index = FIELD_INDEX(target->field, cursor->i, cursor->j, cursor->k);
+}
+
+
+static const double sPowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Parses the number token at p, which ends at end or at a separator, and
+ * returns the end of the token, or NULL when it is not a number. Decimal
+ * numbers are read as an integer of up to 19 digits scaled by an exact
+ * power of ten, which is within an ulp of strtof. Anything else, such as
+ * nan and inf, goes through strtof.
+ */
+static const char *parseNumber(const char *p, const char *end, float *value) {
+    const char *start = p;
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    bool negative = false;
+    double scaled;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    for (; p < end && (unsigned) (*p - '0') < 10; p++, digits++) {
+        if (mantissa < 1000000000000000000ull)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            exponent++;
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && (unsigned) (*p - '0') < 10; p++, digits++) {
+            if (mantissa < 1000000000000000000ull) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+        bool negativeExponent = false;
+        int power = 0;
+        p++;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+        if (p == end || (unsigned) (*p - '0') >= 10)
+            return NULL;
+        for (; p < end && (unsigned) (*p - '0') < 10; p++) {
+            if (power < 10000)
+                power = power * 10 + (*p - '0');
+        }
+        exponent += negativeExponent ? -power : power;
+    }
+
+    if (digits == 0 || (p < end && !isSpace(*p))) {
+        char token[64], *tokenEnd;
+        const char *q = start;
+        int length = 0;
+        while (q < end && !isSpace(*q) && length < (int) sizeof(token) - 1)
+            token[length++] = *q++;
+        token[length] = '\0';
+        *value = strtof(token, &tokenEnd);
+        return length > 0 && tokenEnd == token + length ? q : NULL;
+    }
+
+    scaled = (double) mantissa;
+    if (mantissa != 0) {
+        for (; exponent > 22; exponent -= 22)
+            scaled *= 1e22;
+        for (; exponent < -22; exponent += 22)
+            scaled /= 1e22;
+        scaled = exponent < 0 ? scaled / sPowersOf10[-exponent] :
+                 scaled * sPowersOf10[exponent];
+    }
+    *value = (float) (negative ? -scaled : scaled);
+    return p;
+}
+
+
+// A piece of ASCII data, starting and ending between numbers.
+typedef struct {
+    const char *begin;
+    const char *end;
+    // Index of the first number in the array, and numbers in the piece.
+    long first;
+    long count;
+    // Just past the last number used.
+    const char *stop;
+} TextChunk;
+
+typedef struct {
+    TextChunk *chunks;
+    // NULL to skip the numbers.
+    const Target *target;
+    long total;
+    int failed;
+} TextJob;
+
+static void countTask(long first, long last, int worker, void *userData) {
+    TextJob *job = (TextJob *) userData;
+    long c;
+    (void) worker;
+
+    for (c = first; c < last; c++) {
+        TextChunk *chunk = &job->chunks[c];
+        const char *p;
+        long count = 0;
+        bool space = true;
+        for (p = chunk->begin; p < chunk->end; p++) {
+            bool nextSpace = isSpace(*p);
+            count += space && !nextSpace;
+            space = nextSpace;
+        }
+        chunk->count = count;
+    }
+}
+
+static void parseTask(long first, long last, int worker, void *userData) {
+    TextJob *job = (TextJob *) userData;
+    long c, n;
+    (void) worker;
+
+    for (c = first; c < last; c++) {
+        TextChunk *chunk = &job->chunks[c];
+        long count = chunk->count < job->total - chunk->first ?
+                     chunk->count : job->total - chunk->first;
+        const char *p = chunk->begin;
+        Cursor cursor;
+
+        if (job->target == NULL) {
+            for (n = 0; n < count; n++) {
+                p = skipSpace(p, chunk->end);
+                while (p < chunk->end && !isSpace(*p))
+                    p++;
+            }
+            chunk->stop = p;
+            continue;
+        }
+        cursorStart(&cursor, job->target, chunk->first);
+        for (n = 0; n < count; n++) {
+            float value;
+            p = skipSpace(p, chunk->end);
+            p = parseNumber(p, chunk->end, &value);
+            if (p == NULL) {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            cursorStore(&cursor, job->target, value);
+        }
+        chunk->stop = p;
+    }
+}
+
+/* Reads total ASCII numbers from begin, storing them in target or, when
+ * it is NULL, skipping them. The text is cut into chunks at separators;
+ * a batch of chunks is counted in parallel, which gives the index of the
+ * first number of each, and then parsed in parallel. Batches go on until
+ * total numbers are found, so text after them is hardly looked at.
+ * Returns the end of the last number, or NULL when there are too few or
+ * one is not a number.
+ */
+static const char *readText(const char *begin, const char *end, long total,
+                            const Target *target, THREADPOOL *pool) {
+    int batchSize = 4 * threadPoolSize(pool);
+    const char *p = begin, *next = NULL;
+    long done = 0;
+    TextJob job;
+
+    job.chunks = (TextChunk *) malloc(batchSize * sizeof(TextChunk));
+    job.target = target;
+    job.total = total;
+    job.failed = 0;
+    if (job.chunks == NULL)
+        return NULL;
+    while (done < total) {
+        int count = 0, used = 0, c;
+        p = skipSpace(p, end);
+        if (p == end)
+            break;
+        while (count < batchSize && p < end) {
+            const char *chunkEnd = end - p > TEXT_CHUNK_SIZE ? p + TEXT_CHUNK_SIZE : end;
+            while (chunkEnd < end && !isSpace(*chunkEnd))
+                chunkEnd++;
+            job.chunks[count].begin = p;
+            job.chunks[count].end = chunkEnd;
+            job.chunks[count].stop = p;
+            count++;
+            p = chunkEnd;
+        }
+        threadPoolRun(pool, count, 1, countTask, &job);
+        for (c = 0; c < count && done < total; c++) {
+            job.chunks[c].first = done;
+            done += job.chunks[c].count;
+            used++;
+        }
+        threadPoolRun(pool, used, 1, parseTask, &job);
+        if (job.failed)
+            break;
+        next = job.chunks[used - 1].stop;
+    }
+    free(job.chunks);
+    return done >= total && !job.failed ? next : NULL;
+}
+
+
+// Element types of binary arrays that can be read.
+enum {
+    TYPE_FLOAT32,
+    TYPE_FLOAT64
+};
+
+typedef struct {
+    const unsigned char *bytes;
+    const Target *target;
+    int type;
+    bool swap;
+} BinaryJob;
+
+static void binaryTask(long first, long last, int worker, void *userData) {
+    BinaryJob *job = (BinaryJob *) userData;
+    long n, values = (last - first) * 3;
+    Cursor cursor;
+    (void) worker;
+
+    cursorStart(&cursor, job->target, first * 3);
+    if (job->type == TYPE_FLOAT32) {
+        const unsigned char *bytes = job->bytes + first * 3 * sizeof(float);
+        for (n = 0; n < values; n++) {
+            uint32_t bits;
+            float value;
+            memcpy(&bits, bytes + n * sizeof(bits), sizeof(bits));
+            if (job->swap)
+                bits = __builtin_bswap32(bits);
+            memcpy(&value, &bits, sizeof(value));
+            cursorStore(&cursor, job->target, value);
+        }
+    }
+    else {
+        const unsigned char *bytes = job->bytes + first * 3 * sizeof(double);
+        for (n = 0; n < values; n++) {
+            uint64_t bits;
+            double value;
+            memcpy(&bits, bytes + n * sizeof(bits), sizeof(bits));
+            if (job->swap)
+                bits = __builtin_bswap64(bits);
+            memcpy(&value, &bits, sizeof(value));
+            cursorStore(&cursor, job->target, (float) value);
+        }
+    }
+}
+
+static long targetTuples(const Target *target) {
+    const int *e = target->extent;
+    return (long) (e[1] - e[0] + 1) * (e[3] - e[2] + 1) * (e[5] - e[4] + 1);
+}
+
+// Converts the tuples of target from bytes, in the order of the host or
+// swapped.
+static void readBinary(const unsigned char *bytes, int type, bool swap,
+                       const Target *target, THREADPOOL *pool) {
+    BinaryJob job = {bytes, target, type, swap};
+    threadPoolRun(pool, targetTuples(target), BINARY_GRAIN, binaryTask, &job);
+}
+
+static bool bigEndianHost() {
+    const uint32_t one = 1;
+    return *(const unsigned char *) &one == 0;
+}
+
+
+/* Decodes base64 text from p until size bytes are out or the text ends
+ * at end or at a '<'. Padding may end any quantum, since VTK encodes the
+ * header of a block apart from its data in some files. out needs room for
+ * size + 2 bytes. Returns the bytes decoded.
+ */
+static long decodeBase64(const char *p, const char *end, unsigned char *out, long size) {
+    long decoded = 0;
+    uint32_t bits = 0;
+    int count = 0, padding = 0;
+
+    for (; p < end && *p != '<' && decoded < size; p++) {
+        char c = *p;
+        int digit;
+        if (c >= 'A' && c <= 'Z')
+            digit = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            digit = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            digit = c - '0' + 52;
+        else if (c == '+' || c == '/')
+            digit = c == '+' ? 62 : 63;
+        else if (c == '=') {
+            digit = 0;
+            padding++;
+        }
+        else
+            continue;
+        bits = bits << 6 | digit;
+        if (++count < 4)
+            continue;
+        out[decoded] = (unsigned char) (bits >> 16);
+        out[decoded + 1] = (unsigned char) (bits >> 8);
+        out[decoded + 2] = (unsigned char) bits;
+        decoded += 3 - padding;
+        bits = 0;
+        count = 0;
+        padding = 0;
+    }
+    return decoded;
+}
+
+
+static bool parseType(const char *name, int *type, int *size) {
+    if (strcmp(name, "float") == 0 || strcmp(name, "Float32") == 0) {
+        *type = TYPE_FLOAT32;
+        *size = 4;
+        return true;
+    }
+    if (strcmp(name, "double") == 0 || strcmp(name, "Float64") == 0) {
+        *type = TYPE_FLOAT64;
+        *size = 8;
+        return true;
+    }
+    return false;
+}
+
+// Bytes per value of the other types of legacy files, 0 if unknown.
+static int legacyTypeSize(const char *name) {
+    static const struct {
+        const char *name;
+        int size;
+    } types[] = {
+        {"unsigned_char", 1}, {"char", 1}, {"unsigned_short", 2}, {"short", 2},
+        {"unsigned_int", 4}, {"int", 4}, {"vtkIdType", 4}, {"unsigned_long", 8},
+        {"long", 8}, {"float", 4}, {"double", 8}
+    };
+    size_t t;
+    for (t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        if (strcmp(name, types[t].name) == 0)
+            return types[t].size;
+    }
+    return 0;
+}
+
+
+/* Copies the line at p, without its line break and cut to size - 1
+ * characters, and returns the start of the next line.
+ */
+static const char *readLine(const char *p, const char *end, char *line, int size) {
+    int length = 0;
+    for (; p < end && *p != '\n'; p++) {
+        if (length < size - 1 && *p != '\r')
+            line[length++] = *p;
+    }
+    line[length] = '\0';
+    return p < end ? p + 1 : p;
+}
+
+// An array of a legacy file: its values are at p.
+typedef struct {
+    char name[VTK_MAX_NAME];
+    char type[32];
+    long tuples;
+    int components;
+    bool pointData;
+} LegacyArray;
+
+/* Reads or skips the values of array, and returns the position after
+ * them, or NULL on failure. Binary values are big-endian.
+ */
+static const char *legacyArray(const LegacyArray *array, const char *p, const char *end,
+                               bool binary, const Target *target, THREADPOOL *pool) {
+    long values = array->tuples * array->components;
+    int type, size = legacyTypeSize(array->type);
+
+    if (!binary)
+        return readText(p, end, values, target, pool);
+    if (size == 0 || (long) (end - p) / size < values) {
+        LOGE(FIELD, "array %s of type %s is truncated or unsupported", array->name,
+             array->type);
+        return NULL;
+    }
+    if (target != NULL) {
+        if (!parseType(array->type, &type, &size))
+            return NULL;
+        readBinary((const unsigned char *) p, type, !bigEndianHost(), target, pool);
+    }
+    return p + values * size;
+}
+
+static int importLegacy(FIELD *field, const char *p, const char *end, const char *arrayName,
+                        THREADPOOL *pool) {
+    char line[VTK_MAX_LINE], keyword[64], format[16];
+    int dims[3] = {0, 0, 0}, a;
+    float origin[3] = {0, 0, 0}, spacing[3] = {1, 1, 1};
+    LegacyArray array;
+    bool binary;
+
+    memset(&array, 0, sizeof(array));
+    p = readLine(p, end, line, sizeof(line));
+    p = readLine(p, end, line, sizeof(line));
+    p = readLine(p, end, line, sizeof(line));
+    if (sscanf(line, "%15s", format) != 1 ||
+        (strcmp(format, "ASCII") != 0 && strcmp(format, "BINARY") != 0)) {
+        LOGE(FIELD, "not a legacy VTK file");
+        return 0;
+    }
+    binary = strcmp(format, "BINARY") == 0;
+
+    while (p < end) {
+        int type, size, count, n;
+        bool candidate = false;
+
+        p = readLine(p, end, line, sizeof(line));
+        if (sscanf(line, "%63s", keyword) != 1)
+            continue;
+        if (strcmp(keyword, "DATASET") == 0) {
+            if (strstr(line, "STRUCTURED_POINTS") == NULL) {
+                LOGE(FIELD, "only STRUCTURED_POINTS datasets can be read: %s", line);
+                return 0;
+            }
+            continue;
+        }
+        if (strcmp(keyword, "DIMENSIONS") == 0) {
+            sscanf(line, "%*s %d %d %d", &dims[0], &dims[1], &dims[2]);
+            continue;
+        }
+        if (strcmp(keyword, "ORIGIN") == 0) {
+            sscanf(line, "%*s %f %f %f", &origin[0], &origin[1], &origin[2]);
+            continue;
+        }
+        if (strcmp(keyword, "SPACING") == 0 || strcmp(keyword, "ASPECT_RATIO") == 0) {
+            sscanf(line, "%*s %f %f %f", &spacing[0], &spacing[1], &spacing[2]);
+            if (!fieldSpacingValid(spacing)) {
+                LOGE(FIELD, "bad spacing %g %g %g", spacing[0], spacing[1], spacing[2]);
+                return 0;
+            }
+            continue;
+        }
+        if (strcmp(keyword, "METADATA") == 0) {
+            // Information entries, ended by an empty line.
+            do {
+                p = readLine(p, end, line, sizeof(line));
+            } while (p < end && sscanf(line, "%63s", keyword) == 1);
+            continue;
+        }
+        if (strcmp(keyword, "POINT_DATA") == 0 || strcmp(keyword, "CELL_DATA") == 0) {
+            array.pointData = strcmp(keyword, "POINT_DATA") == 0;
+            array.tuples = 0;
+            sscanf(line, "%*s %ld", &array.tuples);
+            if (array.pointData && array.tuples != (long) dims[0] * dims[1] * dims[2]) {
+                LOGE(FIELD, "%ld points on a %d x %d x %d grid", array.tuples, dims[0],
+                     dims[1], dims[2]);
+                return 0;
+            }
+            continue;
+        }
+        if (array.tuples == 0) {
+            LOGE(FIELD, "unexpected %s", keyword);
+            return 0;
+        }
+
+        if (strcmp(keyword, "FIELD") == 0) {
+            // Arrays of any size, each introduced by a line of its own.
+            if (sscanf(line, "%*s %*s %d", &count) != 1)
+                return 0;
+            for (n = 0; n < count; n++) {
+                LegacyArray fieldArray = array;
+                const Target *target = NULL;
+                Target fieldTarget;
+                do
+                    p = readLine(p, end, line, sizeof(line));
+                while (p < end && sscanf(line, "%63s", keyword) != 1);
+                if (strcmp(keyword, "NULL_ARRAY") == 0)
+                    continue;
+                if (sscanf(line, "%127s %d %ld %31s", fieldArray.name, &fieldArray.components,
+                           &fieldArray.tuples, fieldArray.type) != 4)
+                    return 0;
+                if (field->x == NULL && fieldArray.pointData && fieldArray.components == 3 &&
+                    (arrayName == NULL || strcmp(fieldArray.name, arrayName) == 0)) {
+                    if (!parseType(fieldArray.type, &type, &size)) {
+                        LOGE(FIELD, "array %s has unsupported type %s", fieldArray.name,
+                             fieldArray.type);
+                        return 0;
+                    }
+                    if (!fieldInit(field, dims[0], dims[1], dims[2], origin, spacing))
+                        return 0;
+                    fieldTarget.field = field;
+                    for (a = 0; a < 3; a++) {
+                        fieldTarget.extent[a * 2] = 0;
+                        fieldTarget.extent[a * 2 + 1] = dims[a] - 1;
+                    }
+                    target = &fieldTarget;
+                }
+                p = legacyArray(&fieldArray, p, end, binary, target, pool);
+                if (p == NULL)
+                    return 0;
+                if (target != NULL)
+                    return 1;
+            }
+            continue;
+        }
+
+        array.name[0] = '\0';
+        array.type[0] = '\0';
+        if (strcmp(keyword, "SCALARS") == 0) {
+            array.components = 1;
+            sscanf(line, "%*s %127s %31s %d", array.name, array.type, &array.components);
+            // Followed by the name of its lookup table.
+            const char *next = readLine(p, end, line, sizeof(line));
+            if (sscanf(line, "%63s", keyword) == 1 && strcmp(keyword, "LOOKUP_TABLE") == 0)
+                p = next;
+        }
+        else if (strcmp(keyword, "VECTORS") == 0 || strcmp(keyword, "NORMALS") == 0) {
+            array.components = 3;
+            sscanf(line, "%*s %127s %31s", array.name, array.type);
+            candidate = strcmp(keyword, "VECTORS") == 0 || arrayName != NULL;
+        }
+        else if (strcmp(keyword, "TENSORS") == 0 || strcmp(keyword, "TENSORS6") == 0) {
+            array.components = strcmp(keyword, "TENSORS") == 0 ? 9 : 6;
+            sscanf(line, "%*s %127s %31s", array.name, array.type);
+        }
+        else if (strcmp(keyword, "TEXTURE_COORDINATES") == 0) {
+            sscanf(line, "%*s %127s %d %31s", array.name, &array.components, array.type);
+        }
+        else if (strcmp(keyword, "COLOR_SCALARS") == 0) {
+            sscanf(line, "%*s %127s %d", array.name, &array.components);
+            strcpy(array.type, "unsigned_char");
+        }
+        else if (strcmp(keyword, "LOOKUP_TABLE") == 0) {
+            // A table of RGBA entries rather than one value per tuple.
+            LegacyArray table = array;
+            if (sscanf(line, "%*s %127s %ld", table.name, &table.tuples) != 2)
+                return 0;
+            table.components = 4;
+            strcpy(table.type, "unsigned_char");
+            p = legacyArray(&table, p, end, binary, NULL, pool);
+            if (p == NULL)
+                return 0;
+            continue;
+        }
+        else {
+            LOGE(FIELD, "unknown legacy VTK keyword %s", keyword);
+            return 0;
+        }
+
+        if (candidate && array.pointData &&
+            (arrayName == NULL || strcmp(array.name, arrayName) == 0)) {
+            Target target;
+            if (!parseType(array.type, &type, &size)) {
+                LOGE(FIELD, "array %s has unsupported type %s", array.name, array.type);
+                return 0;
+            }
+            if (!fieldInit(field, dims[0], dims[1], dims[2], origin, spacing))
+                return 0;
+            target.field = field;
+            for (a = 0; a < 3; a++) {
+                target.extent[a * 2] = 0;
+                target.extent[a * 2 + 1] = dims[a] - 1;
+            }
+            return legacyArray(&array, p, end, binary, &target, pool) != NULL;
+        }
+        p = legacyArray(&array, p, end, binary, NULL, pool);
+        if (p == NULL)
+            return 0;
+    }
+    LOGE(FIELD, "no point vector array %s", arrayName != NULL ? arrayName : "");
+    return 0;
+}
+
+
+static const char *findText(const char *p, const char *end, const char *text) {
+    return (const char *) memmem(p, end - p, text, strlen(text));
+}
+
+// An XML element tag from its '<' to its '>'.
+typedef struct {
+    const char *begin;
+    const char *end;
+} Tag;
+
+/* Finds the next start tag called name, returning 0 if there is none
+ * before end.
+ */
+static bool findTag(const char *p, const char *end, const char *name, Tag *tag) {
+    size_t length = strlen(name);
+    while ((p = findText(p, end, "<")) != NULL) {
+        if ((size_t) (end - p) > length + 1 && memcmp(p + 1, name, length) == 0 &&
+            (isSpace(p[length + 1]) || p[length + 1] == '>' || p[length + 1] == '/')) {
+            tag->begin = p;
+            tag->end = (const char *) memchr(p, '>', end - p);
+            return tag->end != NULL;
+        }
+        p++;
+    }
+    return false;
+}
+
+static bool selfClosing(const Tag *tag) {
+    return tag->end[-1] == '/';
+}
+
+/* Copies the value of the attribute called name into value, cut to size
+ * - 1 characters. Returns false, leaving value empty, when the tag has no
+ * such attribute.
+ */
+static bool attribute(const Tag *tag, const char *name, char *value, int size) {
+    size_t length = strlen(name);
+    const char *p = tag->begin;
+    value[0] = '\0';
+    while ((p = findText(p + 1, tag->end, name)) != NULL) {
+        const char *q = p + length;
+        if (!isSpace(p[-1]) || q + 1 >= tag->end || q[0] != '=' ||
+            (q[1] != '"' && q[1] != '\''))
+            continue;
+        char quote = q[1];
+        int n = 0;
+        for (q += 2; q < tag->end && *q != quote; q++) {
+            if (n < size - 1)
+                value[n++] = *q;
+        }
+        value[n] = '\0';
+        return true;
+    }
+    return false;
+}
+
+// Layout of the binary blocks of an XML file.
+typedef struct {
+    bool swap;
+    int headerSize;
+    bool compressed;
+    // Just past the '_' that starts the appended data, or NULL.
+    const char *appended;
+    bool appendedBase64;
+    const char *end;
+} XmlFile;
+
+static uint64_t blockSize(const XmlFile *xml, const unsigned char *header) {
+    if (xml->headerSize == 8) {
+        uint64_t size;
+        memcpy(&size, header, 8);
+        return xml->swap ? __builtin_bswap64(size) : size;
+    }
+    uint32_t size;
+    memcpy(&size, header, 4);
+    return xml->swap ? __builtin_bswap32(size) : size;
+}
+
+/* Start of the appended block of the DataArray tag, or NULL when the
+ * file has no appended data or the offset is outside it.
+ */
+static const char *appendedBlock(const XmlFile *xml, const Tag *tag) {
+    char offsetText[32];
+    long offset;
+    if (xml->appended == NULL || !attribute(tag, "offset", offsetText, sizeof(offsetText)))
+        return NULL;
+    offset = atol(offsetText);
+    return offset >= 0 && offset < xml->end - xml->appended ? xml->appended + offset : NULL;
+}
+
+/* Reads one piece of a DataArray, whose tag is given, into target.
+ */
+static int readDataArray(const XmlFile *xml, const Tag *tag, const char *name,
+                         const Target *target, THREADPOOL *pool) {
+    char format[16], typeName[16];
+    long tuples = targetTuples(target), bytes;
+    int type, size;
+    const char *content = tag->end + 1;
+    const unsigned char *block;
+    unsigned char *decoded = NULL;
+
+    attribute(tag, "format", format, sizeof(format));
+    attribute(tag, "type", typeName, sizeof(typeName));
+    if (strcmp(format, "ascii") == 0) {
+        const char *contentEnd = findText(content, xml->end, "</DataArray");
+        if (contentEnd == NULL || readText(content, contentEnd, tuples * 3, target, pool) == NULL) {
+            LOGE(FIELD, "array %s has too few or bad numbers", name);
+            return 0;
+        }
+        return 1;
+    }
+    if (!parseType(typeName, &type, &size)) {
+        LOGE(FIELD, "array %s has unsupported type %s", name, typeName);
+        return 0;
+    }
+    if (xml->compressed) {
+        LOGE(FIELD, "compressed arrays are not supported");
+        return 0;
+    }
+    bytes = tuples * 3 * size;
+    if (strcmp(format, "binary") == 0 ||
+        (strcmp(format, "appended") == 0 && xml->appendedBase64)) {
+        const char *text = content;
+        if (strcmp(format, "appended") == 0) {
+            text = appendedBlock(xml, tag);
+            if (text == NULL)
+                return 0;
+        }
+        decoded = (unsigned char *) malloc(xml->headerSize + bytes + 2);
+        if (decoded == NULL)
+            return 0;
+        if (decodeBase64(text, xml->end, decoded, xml->headerSize + bytes) <
+            xml->headerSize + bytes) {
+            LOGE(FIELD, "array %s is truncated", name);
+            free(decoded);
+            return 0;
+        }
+        block = decoded;
+    }
+    else if (strcmp(format, "appended") == 0) {
+        block = (const unsigned char *) appendedBlock(xml, tag);
+        if (block == NULL || xml->end - (const char *) block < xml->headerSize + bytes) {
+            LOGE(FIELD, "array %s is truncated", name);
+            return 0;
+        }
+    }
+    else {
+        LOGE(FIELD, "array %s has unknown format %s", name, format);
+        return 0;
+    }
+    if (blockSize(xml, block) != (uint64_t) bytes) {
+        LOGE(FIELD, "array %s holds %llu bytes instead of %ld", name,
+             (unsigned long long) blockSize(xml, block), bytes);
+        free(decoded);
+        return 0;
+    }
+    readBinary(block + xml->headerSize, type, xml->swap, target, pool);
+    free(decoded);
+    return 1;
+}
+
+static int importXml(FIELD *field, const char *p, const char *end, const char *arrayName,
+                     THREADPOOL *pool) {
+    char value[VTK_MAX_LINE], chosen[VTK_MAX_NAME] = "";
+    int whole[6], pieces = 0, a;
+    float origin[3] = {0, 0, 0}, spacing[3] = {1, 1, 1};
+    const char *xmlEnd = end;
+    Tag tag;
+    XmlFile xml;
+
+    memset(&xml, 0, sizeof(xml));
+    xml.end = end;
+    if (!findTag(p, end, "VTKFile", &tag) || !attribute(&tag, "type", value, sizeof(value)) ||
+        strcmp(value, "ImageData") != 0) {
+        LOGE(FIELD, "not a VTK ImageData file");
+        return 0;
+    }
+    attribute(&tag, "byte_order", value, sizeof(value));
+    xml.swap = (strcmp(value, "BigEndian") == 0) != bigEndianHost();
+    attribute(&tag, "header_type", value, sizeof(value));
+    xml.headerSize = strcmp(value, "UInt64") == 0 ? 8 : 4;
+    xml.compressed = attribute(&tag, "compressor", value, sizeof(value)) && value[0] != '\0';
+
+    // The XML stops where appended data, which may hold any byte, starts.
+    if (findTag(p, end, "AppendedData", &tag)) {
+        xmlEnd = tag.begin;
+        attribute(&tag, "encoding", value, sizeof(value));
+        xml.appendedBase64 = strcmp(value, "base64") == 0;
+        xml.appended = (const char *) memchr(tag.end, '_', end - tag.end);
+        if (xml.appended != NULL)
+            xml.appended++;
+    }
+
+    if (!findTag(p, xmlEnd, "ImageData", &tag) ||
+        !attribute(&tag, "WholeExtent", value, sizeof(value)) ||
+        sscanf(value, "%d %d %d %d %d %d", &whole[0], &whole[1], &whole[2], &whole[3],
+               &whole[4], &whole[5]) != 6) {
+        LOGE(FIELD, "no ImageData extent");
+        return 0;
+    }
+    if (attribute(&tag, "Origin", value, sizeof(value)))
+        sscanf(value, "%f %f %f", &origin[0], &origin[1], &origin[2]);
+    if (attribute(&tag, "Spacing", value, sizeof(value)))
+        sscanf(value, "%f %f %f", &spacing[0], &spacing[1], &spacing[2]);
+    if (!fieldSpacingValid(spacing)) {
+        LOGE(FIELD, "bad spacing %g %g %g", spacing[0], spacing[1], spacing[2]);
+        return 0;
+    }
+    // Grid point (0, 0, 0) of the field is the first of the whole extent.
+    for (a = 0; a < 3; a++)
+        origin[a] += whole[a * 2] * spacing[a];
+    if (!fieldInit(field, whole[1] - whole[0] + 1, whole[3] - whole[2] + 1,
+                   whole[5] - whole[4] + 1, origin, spacing)) {
+        LOGE(FIELD, "bad extent %d %d %d %d %d %d", whole[0], whole[1], whole[2], whole[3],
+             whole[4], whole[5]);
+        return 0;
+    }
+
+    p = tag.end;
+    while (findTag(p, xmlEnd, "Piece", &tag)) {
+        const char *pieceEnd = findText(tag.end, xmlEnd, "</Piece");
+        char vectors[VTK_MAX_NAME];
+        const char *arrays, *arraysEnd;
+        Target target;
+        Tag pointData, array;
+        bool found = false;
+
+        if (pieceEnd == NULL)
+            pieceEnd = xmlEnd;
+        target.field = field;
+        if (!attribute(&tag, "Extent", value, sizeof(value)) ||
+            sscanf(value, "%d %d %d %d %d %d", &target.extent[0], &target.extent[1],
+                   &target.extent[2], &target.extent[3], &target.extent[4],
+                   &target.extent[5]) != 6) {
+            LOGE(FIELD, "piece without an extent");
+            return 0;
+        }
+        for (a = 0; a < 6; a++) {
+            target.extent[a] -= whole[a & ~1];
+            if (target.extent[a] < 0 || target.extent[a] > whole[a | 1] - whole[a & ~1] ||
+                ((a & 1) && target.extent[a] < target.extent[a - 1])) {
+                LOGE(FIELD, "piece extent %s outside the whole extent", value);
+                return 0;
+            }
+        }
+        p = pieceEnd;
+        if (!findTag(tag.end, pieceEnd, "PointData", &pointData) || selfClosing(&pointData)) {
+            LOGE(FIELD, "piece %d has no point data", pieces);
+            return 0;
+        }
+        attribute(&pointData, "Vectors", vectors, sizeof(vectors));
+        arrays = pointData.end;
+        arraysEnd = findText(arrays, pieceEnd, "</PointData");
+        if (arraysEnd == NULL)
+            arraysEnd = pieceEnd;
+        while (findTag(arrays, arraysEnd, "DataArray", &array)) {
+            char name[VTK_MAX_NAME], components[16];
+            arrays = array.end;
+            attribute(&array, "Name", name, sizeof(name));
+            attribute(&array, "NumberOfComponents", components, sizeof(components));
+            if (atoi(components) != 3)
+                continue;
+            // Every piece has the same arrays.
+            if (chosen[0] != '\0' ? strcmp(name, chosen) != 0 :
+                arrayName != NULL ? strcmp(name, arrayName) != 0 :
+                vectors[0] != '\0' && strcmp(name, vectors) != 0)
+                continue;
+            strcpy(chosen, name);
+            if (!readDataArray(&xml, &array, name, &target, pool))
+                return 0;
+            found = true;
+            break;
+        }
+        if (!found) {
+            LOGE(FIELD, "no point vector array %s in piece %d",
+                 arrayName != NULL ? arrayName : "", pieces);
+            return 0;
+        }
+        pieces++;
+    }
+    if (pieces == 0) {
+        LOGE(FIELD, "no pieces");
+        return 0;
+    }
+    return 1;
+}
+
+
+int vtkImportField(FIELD *field, const char *path, const char *arrayName, THREADPOOL *pool) {
+    struct stat status;
+    const char *data, *start;
+    void *mapping;
+    int fd, ok;
+
+    memset(field, 0, sizeof(FIELD));
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOGE(FIELD, "cannot open %s: %s", path, strerror(errno));
+        return 0;
+    }
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        LOGE(FIELD, "%s is empty", path);
+        close(fd);
+        return 0;
+    }
+    mapping = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGE(FIELD, "cannot map %s: %s", path, strerror(errno));
+        return 0;
+    }
+    data = (const char *) mapping;
+    start = skipSpace(data, data + status.st_size);
+    if (data + status.st_size - start > 5 && memcmp(start, "# vtk", 5) == 0)
+        ok = importLegacy(field, start, data + status.st_size, arrayName, pool);
+    else
+        ok = importXml(field, start, data + status.st_size, arrayName, pool);
+    munmap(mapping, (size_t) status.st_size);
+    if (!ok) {
+        LOGE(FIELD, "cannot import %s", path);
+        fieldDeinit(field);
+        return 0;
+    }
+    LOGI(FIELD, "imported %s, %d x %d x %d", path, field->nx, field->ny, field->nz);
+    return 1;
+}
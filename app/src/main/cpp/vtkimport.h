@@ -0,0 +1,60 @@
+/* Vector Fields 3 Open Source
+ * Copyright 2016 Todd B Smith Enterprises LLC
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#ifndef VTKIMPORT_H_INCLUDED
+#define VTKIMPORT_H_INCLUDED
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "field.h"
+#include "threadpool.h"
+
+
+/* Reads a point vector array of a VTK image file into field, which is
+ * allocated on the file grid and released with fieldDeinit. The array is
+ * the one called arrayName or, when that is NULL, the active vectors of
+ * the file or else its first array of 3 components. Float and double
+ * arrays are read; doubles are rounded to float.
+ *
+ * Two formats are understood:
+ * - legacy .vtk files with a STRUCTURED_POINTS dataset, ASCII or binary;
+ * - XML .vti ImageData files, with the array inline as ASCII or base64,
+ *   or appended, raw or base64, split into any number of pieces.
+ *   Compressed XML arrays are not supported. Orientations other than the
+ *   identity Direction are ignored.
+ *
+ * ASCII numbers are split into chunks parsed in parallel on pool, which
+ * may be NULL, and binary arrays are converted in parallel. Returns
+ * non-zero on success and 0, with the reason logged, on failure.
+ */
+extern int vtkImportField(FIELD *field, const char *path, const char *arrayName,
+                          THREADPOOL *pool);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !VTKIMPORT_H_INCLUDED
@@ -19,9 +19,11 @@ public class DemoGLSurfaceView extends GLSurfaceView {
     }
 
     public boolean onTouchEvent(final MotionEvent event) {
-        if (event.getAction() == MotionEvent.ACTION_DOWN
-                || event.getAction() == MotionEvent.ACTION_MOVE) {
-            nativeTouchEvent(event.getX(), event.getY());
+        int action = event.getActionMasked();
+        if (action == MotionEvent.ACTION_DOWN
+                || action == MotionEvent.ACTION_MOVE
+                || action == MotionEvent.ACTION_UP) {
+            nativeTouchEvent(action, event.getX(), event.getY());
         }
         return true;
     }
@@ -47,5 +49,5 @@ public class DemoGLSurfaceView extends GLSurfaceView {
 
     private static native void nativeTogglePauseResume();
 
-    private static native void nativeTouchEvent(float x, float y);
+    private static native void nativeTouchEvent(int action, float x, float y);
 }
@@ -6,6 +6,14 @@ import javax.microedition.khronos.egl.EGLConfig;
 import javax.microedition.khronos.opengles.GL10;
 
 class DemoRenderer implements GLSurfaceView.Renderer {
+    // Stages of nativeGetProfile, in the order they are returned.
+    static final String[] PROFILE_STAGES = {
+            "frame", "frameInterval", "prepareFrame", "lighting",
+            "fieldUpdate", "meshBuild", "draw", "particles"
+    };
+    // Values per stage: count, total, min, max, p50, p95, p99; times in ns.
+    static final int PROFILE_FIELDS = 7;
+
     public void onSurfaceCreated(GL10 gl, EGLConfig config) {
         nativeInit();
     }
@@ -26,4 +34,7 @@ class DemoRenderer implements GLSurfaceView.Renderer {
     private static native void nativeRender();
 
     private static native void nativeDone();
+
+    // Safe to call from any thread.
+    static native long[] nativeGetProfile(boolean reset);
 }